@@ -25,6 +25,7 @@
 #include <Common/PointerIntPair.hpp>
 #include <Common/Poly.hpp>
 #include <Common/Result.hpp>
+#include <Common/ScopeExit.hpp>
 #include <Common/SmallStr.hpp>
 #include <Common/StringSwitch.hpp>
 #include <Common/Twine.hpp>
@@ -33,6 +34,7 @@
 #include <Support/Logging.hpp>
 #include <Support/MemoryBuffer.hpp>
 #include <Support/MemoryBufferRef.hpp>
+#include <Support/Path.hpp>
 #include <Support/Process.hpp>
 #include <Support/ScopedSave.hpp>
 #include <Support/Signals.hpp>
@@ -43,15 +45,30 @@
 #include <exi/Basic/StringTables.hpp>
 #include <exi/Basic/XMLManager.hpp>
 #include <exi/Basic/XMLContainer.hpp>
+#include <exi/Basic/XMLTokenizer.hpp>
 #include <exi/Decode/BodyDecoder.hpp>
+#include <exi/Decode/EventBuffer.hpp>
+#include <exi/Decode/EventCursor.hpp>
+#include <exi/Decode/SelfContained.hpp>
 #include <exi/Decode/XMLSerializer.hpp>
+#include <exi/Encode/BodyEncoder.hpp>
+#include <exi/Encode/StreamEncoder.hpp>
+#include <exi/Encode/Transcoder.hpp>
+#include <exi/Grammar/SchemaCache.hpp>
+#include <exi/Grammar/SchemaLoader.hpp>
+#include <exi/Stream/ChunkedInput.hpp>
 #include <exi/Stream/OrderedReader.hpp>
 
 #include <algorithm>
 #include <rapidxml.hpp>
 
+#if EXI_COMPILED_SCHEMAS
+# include "EmptyTypes.hpp"
+#endif
+
 #define DEBUG_TYPE "__DRIVER__"
 #define TEST_LARGE_EXAMPLES 0
+#define RUN_BENCHMARKS 0
 
 using namespace exi;
 
@@ -186,6 +203,129 @@ static int Decode(ExiDecoder& Decoder, MemoryBufferRef MB, Serializer* S) {
   return 0;
 }
 
+namespace {
+/// Reads a file in blocks as the decoder requests them, so only a block and
+/// the data for the current event are in memory at once.
+class FileInput final : public ChunkedInput {
+  sys::fs::file_t File;
+  SmallVec<char, 0> Block;
+
+public:
+  FileInput(sys::fs::file_t File, usize BlockSize = 64 * 1024) :
+   ChunkedInput(), File(File) {
+    Block.resize(BlockSize);
+  }
+  ~FileInput() { sys::fs::closeFile(File); }
+
+private:
+  void underflow() override {
+    auto BytesOrErr = sys::fs::readNativeFile(File, Block);
+    if (Error Err = BytesOrErr.takeError()) {
+      logAllUnhandledErrors(std::move(Err), errs());
+      return this->finish();
+    }
+    if (*BytesOrErr == 0)
+      return this->finish();
+    this->feed(StrRef(Block.data(), *BytesOrErr));
+  }
+};
+
+/// Records events as text, so decoded streams can be compared.
+class EventRecorder final : public Serializer {
+  SmallStr<256> Data;
+  raw_svector_ostream OS {Data};
+
+public:
+  StrRef str() const { return Data.str(); }
+
+  ExiError SD() override { return this->add("SD"); }
+  ExiError ED() override {
+    this->add("ED");
+    return ExiError::DONE;
+  }
+  ExiError SE(QName Name) override { return this->add("SE", Name.getName()); }
+  ExiError EE(QName) override { return this->add("EE"); }
+  ExiError SC() override { return this->add("SC"); }
+  ExiError AT(QName Name, StrRef Value) override {
+    OS << "AT " << Name.getName() << '=' << Value << '\n';
+    return ExiError::OK;
+  }
+  ExiError CH(StrRef Value) override { return this->add("CH", Value); }
+
+private:
+  ExiError add(StrRef Event, StrRef Value = "") {
+    OS << Event;
+    if (!Value.empty())
+      OS << ' ' << Value;
+    OS << '\n';
+    return ExiError::OK;
+  }
+};
+
+/// Forwards events, except for the contents and ends of elements at
+/// `SkipDepth`. This matches `ExiEventCursor::skipSubtree` being called after
+/// each of their SE events.
+class SubtreeSkipper final : public Serializer {
+  Serializer& S;
+  u32 SkipDepth;
+  u32 Depth = 0;
+
+public:
+  SubtreeSkipper(Serializer& S, u32 SkipDepth) :
+   S(S), SkipDepth(SkipDepth) {}
+
+  ExiError SD() override { return S.SD(); }
+  ExiError ED() override { return S.ED(); }
+  ExiError SE(QName Name) override {
+    if (++Depth > SkipDepth)
+      return ExiError::OK;
+    return S.SE(Name);
+  }
+  ExiError EE(QName Name) override {
+    if (Depth-- >= SkipDepth)
+      return ExiError::OK;
+    return S.EE(Name);
+  }
+  ExiError SC() override {
+    return skipped() ? ExiError::OK : S.SC();
+  }
+  ExiError AT(QName Name, StrRef Value) override {
+    return skipped() ? ExiError::OK : S.AT(Name, Value);
+  }
+  ExiError CH(StrRef Value) override {
+    return skipped() ? ExiError::OK : S.CH(Value);
+  }
+
+private:
+  bool skipped() const { return Depth >= SkipDepth; }
+};
+} // namespace `anonymous`
+
+static int DecodeStreaming(StrRef File, ExiOptions& Opts) {
+  auto FileOrErr = sys::fs::openNativeFileForRead(File);
+  if (Error Err = FileOrErr.takeError()) {
+    logAllUnhandledErrors(std::move(Err), errs());
+    return 1;
+  }
+
+  LOG_INFO("Streaming: \"{}\"", File);
+  FileInput In(*FileOrErr);
+  ExiDecoder Decoder(Opts, errs());
+  Serializer S {};
+  if (auto E = Decoder.setInput(In)) {
+    Decoder.diagnose(E);
+    return 1;
+  }
+
+  // The file is pulled as needed, so this will only stop once finished.
+  if (auto E = Decoder.decodeAvailable(&S)) {
+    Decoder.diagnose(E);
+    return 1;
+  }
+
+  return 0;
+}
+
 static int Decode(XMLManager* Mgr, StrRef File, ExiOptions& Opts) {
   XMLContainerRef Exi
     = Mgr->getOptXMLRef(File, errs())
@@ -197,18 +337,125 @@ static int Decode(XMLManager* Mgr, StrRef File, ExiOptions& Opts) {
   return Decode(Decoder, MB);
 }
 
+/// Decodes `MB` fed a few bytes at a time. With a tiny lookahead, most
+/// events run out of input and are replayed.
+static int DecodePushed(ExiDecoder& Decoder, MemoryBufferRef MB,
+                        Serializer* S) {
+  ChunkedInput In(/*Lookahead=*/1);
+  if (auto E = Decoder.setInput(In)) {
+    Decoder.diagnose(E);
+    return 1;
+  }
+
+  constexpr usize kChunkSize = 5;
+  ArrayRef<u8> Rest = arrayRefFromStringRef(MB.getBuffer());
+  while (true) {
+    const ExiError E = Decoder.decodeAvailable(S);
+    if (E == ExiError::OK)
+      return 0;
+    if (E != ExiError::FULL || In.finished()) {
+      Decoder.diagnose(E, /*Force=*/true);
+      return 1;
+    }
+    const usize Size = std::min(kChunkSize, Rest.size());
+    In.feed(Rest.take_front(Size));
+    Rest = Rest.drop_front(Size);
+    if (Rest.empty())
+      In.finish();
+  }
+}
+
+/// Decodes `File` in full and pushed, which must produce the same events.
+static int DecodePushed(XMLManager* Mgr, StrRef File, ExiOptions& Opts) {
+  XMLContainerRef Exi
+    = Mgr->getOptXMLRef(File, errs())
+      .expect("could not locate file!");
+  auto MB = Exi.getBufferRef();
+
+  EventRecorder Want;
+  {
+    ExiDecoder Decoder(Opts, errs());
+    if (int Ret = Decode(Decoder, MB, &Want))
+      return Ret;
+  }
+
+  LOG_INFO("Pushing: \"{}\"", File);
+  EventRecorder Got;
+  ExiDecoder Decoder(Opts, errs());
+  if (int Ret = DecodePushed(Decoder, MB, &Got))
+    return Ret;
+
+  if (Got.str() != Want.str()) {
+    WithColor(errs(), raw_ostream::BRIGHT_RED)
+      << "Pushed events mismatch: " << File << '\n';
+    return 1;
+  }
+  return 0;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Encoding
 
-static int Encode(XMLManager* Mgr, StrRef File, ExiHeader& Opts) {
+static int Encode(ExiEncoder& Encoder, const XMLDocument& Xml,
+                  bool HasCookie = false) {
+  LOG_INFO("Encoding header...");
+  if (auto E = Encoder.encodeHeader(HasCookie)) {
+    Encoder.diagnose(E);
+    return 1;
+  }
+
+  LOG_INFO("Encoding body...");
+  if (auto E = Encoder.encodeBody(Xml)) {
+    Encoder.diagnose(E);
+    return 1;
+  }
+
+  if (hasDbgLogLevel(INFO))
+    dbgs() << '\n';
+  return 0;
+}
+
+static int Encode(XMLManager* Mgr, StrRef File, ExiOptions& Opts,
+                  SmallVecImpl<char>& Out) {
   XMLDocument& Xml
     = Mgr->getOptXMLDocument(File, errs())
       .expect("could not locate file!");
-  
 
   LOG_INFO("Encoding: \"{}\"", File);
-  // ExiDecoder Decoder(Opts, errs());
-  // return Decode(Decoder, MB);
+  ExiEncoder Encoder(Opts, errs());
+  if (auto E = Encoder.setWriter(Out)) {
+    Encoder.diagnose(E);
+    return 1;
+  }
+  return Encode(Encoder, Xml);
+}
+
+/// Encodes `File` by tokenizing it directly, without building a document.
+/// The file is loaded separately, as the manager's buffers may already have
+/// been parsed in place.
+static int EncodeTokenized(StrRef File, ExiOptions& Opts,
+                           SmallVecImpl<char>& Out) {
+  auto Xml = MemoryBuffer::getFile(File);
+  if (!Xml) {
+    WithColor(errs(), raw_ostream::BRIGHT_RED)
+      << "Could not locate " << File << ": " << Xml.getError().message()
+      << '\n';
+    return 1;
+  }
+
+  LOG_INFO("Tokenizing: \"{}\"", File);
+  ExiEncoder Encoder(Opts, errs());
+  if (auto E = Encoder.setWriter(Out)) {
+    Encoder.diagnose(E);
+    return 1;
+  }
+
+  StreamEncoder S(Encoder);
+  XMLTokenizer Tokenizer((*Xml)->getMemBufferRef());
+  if (auto E = Tokenizer.tokenize(S)) {
+    Encoder.diagnose(E);
+    return 1;
+  }
   return 0;
 }
 
@@ -231,6 +478,14 @@ EXI_INLINE static constexpr bool CheckIters(int& NIters) {
 }
 
 static int TestSchemalessDecoding(XMLManagerRef SharedMgr);
+static int TestPushedDecoding(XMLManagerRef SharedMgr);
+static int TestSelfContained();
+static int TestCompression();
+static int TestSchemaDecoding(XMLManagerRef SharedMgr);
+static int TestEventCursor(XMLManagerRef SharedMgr);
+static int TestGrammarCache();
+static int TestMemoryBudget(XMLManagerRef SharedMgr);
+static int TestBoundedTables();
 
 int main(int Argc, char* Argv[]) {
   using enum raw_ostream::Colors;
@@ -243,6 +498,11 @@ int main(int Argc, char* Argv[]) {
 
   XMLManagerRef Mgr = make_refcounted<XMLManager>();
 
+#if RUN_BENCHMARKS
+  root::RunBenchmarks(*Mgr);
+  return 0;
+#endif
+
 #if 0
   if (int Ret = TestSchemalessDecoding(Mgr)) {
     WithColor OS(outs(), BRIGHT_RED);
@@ -251,8 +511,6 @@ int main(int Argc, char* Argv[]) {
   }
 #endif
 
-  // Add https://www.w3.org/TR/xmlschema-0/#ipo.xsd
-
   root::FullXMLDump(*Mgr, "examples/Namespace.xml");
   {
     using enum exi::PreserveKind;
@@ -281,8 +539,116 @@ int main(int Argc, char* Argv[]) {
     }
 
     root::FullXMLDump(S.document());
+
+    // Encoding the source should produce the same stream.
+    SmallVec<char, 0> Out;
+    if (int Ret = Encode(Mgr.get(), "examples/Namespace.xml", Opts, Out)) {
+      WithColor OS(outs(), BRIGHT_RED);
+      OS << "Encoding failed.\n";
+      return Ret;
+    }
+
+    if (StrRef(Out.data(), Out.size()) != MB.getBuffer()) {
+      WithColor OS(outs(), BRIGHT_RED);
+      OS << "Encoding mismatch.\n";
+      return 1;
+    }
+
+    // As should tokenizing it.
+    Out.clear();
+    if (int Ret = EncodeTokenized("examples/Namespace.xml", Opts, Out)) {
+      WithColor OS(outs(), BRIGHT_RED);
+      OS << "Tokenizing failed.\n";
+      return Ret;
+    }
+
+    if (StrRef(Out.data(), Out.size()) != MB.getBuffer()) {
+      WithColor OS(outs(), BRIGHT_RED);
+      OS << "Tokenized encoding mismatch.\n";
+      return 1;
+    }
   }
-  
+
+  {
+    // Transcoding a bit-packed stream should produce the byte-aligned one.
+    auto In = Mgr->getOptXMLRef("examples/BasicNoopt.exi", errs());
+    auto Expected = Mgr->getOptXMLRef("examples/BasicNooptB.exi", errs());
+    if (!In || !Expected) {
+      WithColor OS(outs(), BRIGHT_RED);
+      OS << "Could not locate transcoding examples.\n";
+      return 1;
+    }
+
+    ExiOptions InOpts {};
+    ExiOptions OutOpts { .Alignment = AlignKind::BytePacked };
+    InOpts.SchemaID.emplace(nullptr);
+    OutOpts.SchemaID.emplace(nullptr);
+
+    SmallVec<char, 0> Out;
+    ExiTranscoder Transcoder(InOpts, errs());
+    if (auto E = Transcoder.transcode(In->getBufferRef(), OutOpts, Out)) {
+      Transcoder.diagnose(E);
+      WithColor OS(outs(), BRIGHT_RED);
+      OS << "Transcoding failed.\n";
+      return 1;
+    }
+
+    const StrRef Want = Expected->getBufferRef().getBuffer();
+    if (StrRef(Out.data(), Out.size()) != Want) {
+      WithColor OS(outs(), BRIGHT_RED);
+      OS << "Transcoding mismatch.\n";
+      return 1;
+    }
+  }
+
+  if (int Ret = TestPushedDecoding(Mgr)) {
+    WithColor OS(outs(), BRIGHT_RED);
+    OS << "Pushed decoding failed.\n";
+    return Ret;
+  }
+
+  if (int Ret = TestSelfContained()) {
+    WithColor OS(outs(), BRIGHT_RED);
+    OS << "Self-contained decoding failed.\n";
+    return Ret;
+  }
+
+  if (int Ret = TestCompression()) {
+    WithColor OS(outs(), BRIGHT_RED);
+    OS << "Compression decoding failed.\n";
+    return Ret;
+  }
+
+  if (int Ret = TestSchemaDecoding(Mgr)) {
+    WithColor OS(outs(), BRIGHT_RED);
+    OS << "Schema decoding failed.\n";
+    return Ret;
+  }
+
+  if (int Ret = TestEventCursor(Mgr)) {
+    WithColor OS(outs(), BRIGHT_RED);
+    OS << "Cursor decoding failed.\n";
+    return Ret;
+  }
+
+  if (int Ret = TestGrammarCache()) {
+    WithColor OS(outs(), BRIGHT_RED);
+    OS << "Grammar cache failed.\n";
+    return Ret;
+  }
+
+  if (int Ret = TestMemoryBudget(Mgr)) {
+    WithColor OS(outs(), BRIGHT_RED);
+    OS << "Memory budget failed.\n";
+    return Ret;
+  }
+
+  if (int Ret = TestBoundedTables()) {
+    WithColor OS(outs(), BRIGHT_RED);
+    OS << "Bounded table decoding failed.\n";
+    return Ret;
+  }
+
   WithColor OS(outs(), BRIGHT_GREEN);
   OS << "Decoding successful!\n";
 }
@@ -299,6 +665,12 @@ int main(int Argc, char* Argv[]) {
   DECODE_GENERIC(DecodePreserveBits, FILE, __VA_ARGS__)
 #define DECODE_ORD_BYTES(FILE, ...)                                           \
   DECODE_GENERIC(DecodePreserveBytes, FILE, __VA_ARGS__)
+#define DECODE_STREAM_BITS(FILE, ...)                                         \
+  DECODE_GENERIC(DecodeStreamBits, FILE, __VA_ARGS__)
+#define DECODE_PUSH_BITS(FILE, ...)                                           \
+  DECODE_GENERIC(DecodePushedBits, FILE, __VA_ARGS__)
+#define DECODE_PUSH_BYTES(FILE, ...)                                          \
+  DECODE_GENERIC(DecodePushedBytes, FILE, __VA_ARGS__)
 
 static int TestSchemalessDecoding(XMLManagerRef SharedMgr) {
   ScopedSave FlagSave(exi::DebugFlag);
@@ -317,6 +689,16 @@ static int TestSchemalessDecoding(XMLManagerRef SharedMgr) {
     });
   };
 
+  auto DecodeStreamBits = []
+   (StrRef HiddenFile, ExiOptions::PreserveOpts Preserve = {}) {
+    ExiOptions Opts {
+      .Alignment = AlignKind::BitPacked,
+      .Preserve = Preserve
+    };
+    Opts.SchemaID.emplace(nullptr);
+    return DecodeStreaming(HiddenFile, Opts);
+  };
+
   auto DecodePreserveBytes = [&DecodeFile]
    (StrRef HiddenFile, ExiOptions::PreserveOpts Preserve = {}) {
     return DecodeFile(HiddenFile, {
@@ -374,16 +756,836 @@ static int TestSchemalessDecoding(XMLManagerRef SharedMgr) {
     // Orders.xml with Preserve.prefixes and no options.
     // Has a lot of data with minimal distinct keys.
     DECODE_ORD_BITS("Orders.exi", Prefixes);
+    DECODE_STREAM_BITS("Orders.exi", Prefixes);
 
     // LineItem.xml with Preserve.prefixes and no options.
     // Has a TON of data with minimal distinct keys.
     DECODE_ORD_BITS("LineItem.exi", Prefixes);
+    DECODE_STREAM_BITS("LineItem.exi", Prefixes);
 
     // treebank_e.xml with Preserve.prefixes and no options.
-    // Has 100mb of data in XML form, quite a large test.
+    // Has 100mb of data in XML form, quite a large test. The streamed
+    // versions are read from disk, rather than being loaded in full.
     DECODE_ORD_BITS("Treebank.exi", Prefixes);
+    DECODE_STREAM_BITS("Treebank.exi", Prefixes);
   }
 #endif // TEST_LARGE_EXAMPLES
 
   return 0;
 }
+
+/// Decodes the small examples fed a few bytes at a time, which replays most
+/// events as they run out of input.
+static int TestPushedDecoding(XMLManagerRef SharedMgr) {
+  auto PushFile = [Mgr = SharedMgr.get()]
+   (StrRef HiddenFile, ExiOptions Opts) {
+    Opts.SchemaID.emplace(nullptr);
+    return DecodePushed(Mgr, HiddenFile, Opts);
+  };
+
+  auto DecodePushedBits = [&PushFile]
+   (StrRef HiddenFile, ExiOptions::PreserveOpts Preserve = {}) {
+    return PushFile(HiddenFile, {
+      .Alignment = AlignKind::BitPacked,
+      .Preserve = Preserve
+    });
+  };
+
+  auto DecodePushedBytes = [&PushFile]
+   (StrRef HiddenFile, ExiOptions::PreserveOpts Preserve = {}) {
+    return PushFile(HiddenFile, {
+      .Alignment = AlignKind::BytePacked,
+      .Preserve = Preserve
+    });
+  };
+
+  DECODE_PUSH_BITS("SpecExample.exi");
+  DECODE_PUSH_BYTES("SpecExampleB.exi");
+  DECODE_PUSH_BITS("CustomersNoopt.exi",   Prefixes);
+  DECODE_PUSH_BYTES("CustomersNooptB.exi", Prefixes);
+  DECODE_PUSH_BITS("ThaiNoopt.exi");
+  DECODE_PUSH_BYTES("ThaiNooptB.exi");
+  DECODE_PUSH_BITS("NamespaceNoopt.exi",   All & ~LexicalValues);
+  DECODE_PUSH_BYTES("NamespaceNooptB.exi", All & ~LexicalValues);
+  return 0;
+}
+
+/// Encodes a small document with SC elements, and checks that it decodes the
+/// same as the document without them, both in place and as fragments.
+static int TestSelfContained() {
+  auto Fail = [] (StrRef Msg) {
+    WithColor OS(outs(), raw_ostream::BRIGHT_RED);
+    OS << Msg << '\n';
+    return 1;
+  };
+
+  auto EncodeDoc = [] (ExiOptions& Opts, SmallVecImpl<char>& Out) -> int {
+    ExiEncoder Encoder(Opts, errs());
+    const bool SC = Opts.SelfContained;
+    auto Item = [&] (StrRef Id, StrRef Name) -> ExiError {
+      const QName Q {.Name = "item"};
+      exi_try(Encoder.encodeSE(Q));
+      if (SC)
+        exi_try(Encoder.encodeSC(Q));
+      exi_try(Encoder.encodeAT(QName{.Name = "id"}, Id));
+      exi_try(Encoder.encodeSE(QName{.Name = "name"}));
+      exi_try(Encoder.encodeCH(Name));
+      return Encoder.encodeEE();
+    };
+    auto Body = [&] () -> ExiError {
+      exi_try(Encoder.setWriter(Out));
+      exi_try(Encoder.encodeHeader());
+      exi_try(Encoder.encodeSD());
+      exi_try(Encoder.encodeSE(QName{.Name = "root"}));
+      exi_try(Item("1", "first"));
+      exi_try(Encoder.encodeEE());
+      exi_try(Item("2", "second"));
+      const QName Note {.Name = "note"};
+      exi_try(Encoder.encodeSE(Note));
+      if (SC)
+        exi_try(Encoder.encodeSC(Note));
+      exi_try(Encoder.encodeCH("nested"));
+      exi_try(Encoder.encodeEE());
+      exi_try(Encoder.encodeEE());
+      exi_try(Encoder.encodeSE(QName{.Name = "other"}));
+      exi_try(Encoder.encodeCH("inline"));
+      exi_try(Encoder.encodeEE());
+      exi_try(Encoder.encodeEE());
+      return Encoder.encodeED();
+    };
+    if (auto E = Body()) {
+      Encoder.diagnose(E);
+      return 1;
+    }
+    return 0;
+  };
+
+  auto Check = [&] (AlignKind Align) -> int {
+    ExiOptions Opts { .Alignment = Align };
+    Opts.SchemaID.emplace(nullptr);
+    SmallVec<char, 0> Plain;
+    if (int Ret = EncodeDoc(Opts, Plain))
+      return Ret;
+
+    Opts.SelfContained = true;
+    SmallVec<char, 0> Out;
+    if (int Ret = EncodeDoc(Opts, Out))
+      return Ret;
+
+    EventRecorder Want;
+    {
+      ExiOptions PlainOpts { .Alignment = Align };
+      PlainOpts.SchemaID.emplace(nullptr);
+      ExiDecoder Decoder(PlainOpts, errs());
+      if (int Ret = Decode(Decoder, MemoryBufferRef(
+          StrRef(Plain.data(), Plain.size()), "Plain"), &Want))
+        return Ret;
+    }
+
+    SCIndex Index;
+    EventRecorder Got;
+    {
+      ExiDecoder Decoder(Opts, errs());
+      Decoder.setSCIndex(&Index);
+      if (int Ret = Decode(Decoder, MemoryBufferRef(
+          StrRef(Out.data(), Out.size()), "SelfContained"), &Got))
+        return Ret;
+    }
+
+    // SC events are the only difference when decoded in place.
+    SmallStr<256> Serial;
+    for (StrRef Rest = Got.str(); !Rest.empty();) {
+      auto [Line, Tail] = Rest.split('\n');
+      if (Line != "SC")
+        Serial.append({Line, "\n"});
+      Rest = Tail;
+    }
+    if (Serial.str() != Want.str())
+      return Fail("Self-contained events mismatch.");
+    if (Index.size() != 2)
+      return Fail("Self-contained index mismatch.");
+
+    EventRecorder Fragments[2];
+    if (decodeSCFragments(StrRef(Out.data(), Out.size()), Index, Opts,
+        [&Fragments] (usize Ix) -> Serializer* { return &Fragments[Ix]; }, 2))
+      return Fail("Self-contained fragment decoding failed.");
+
+    const StrRef WantFragments[2] {
+      "SD\nSE item\nAT id=1\nSE name\nCH first\nEE\nEE\nED\n",
+      "SD\nSE item\nAT id=2\nSE name\nCH second\nEE\n"
+        "SE note\nSC\nCH nested\nEE\nEE\nED\n"
+    };
+    for (int Ix = 0; Ix < 2; ++Ix) {
+      if (Fragments[Ix].str() != WantFragments[Ix])
+        return Fail("Self-contained fragment mismatch.");
+    }
+
+    return 0;
+  };
+
+  if (int Ret = Check(AlignKind::BitPacked))
+    return Ret;
+  return Check(AlignKind::BytePacked);
+}
+
+/// Encodes a generated document split into channels, and checks that it
+/// decodes to the events it was generated from. Blocks of at most 100 values
+/// are a single stream, larger ones split channels of more than 100 values
+/// into their own streams, so block sizes exercising both are used.
+static int TestCompression() {
+  auto Fail = [] (StrRef Msg) {
+    WithColor OS(outs(), raw_ostream::BRIGHT_RED);
+    OS << Msg << '\n';
+    return 1;
+  };
+
+  // Ids and names have a value per item, notes only for the first few.
+  constexpr int NItems = 150;
+  constexpr int NNotes = 40;
+  auto GetId = [] (int Ix) { return Twine(Ix).str(); };
+  auto GetName = [] (int Ix) { return ("name" + Twine(Ix % 7)).str(); };
+  auto GetNote = [] (int Ix) { return ("note" + Twine(Ix)).str(); };
+
+  SmallStr<0> Want;
+  {
+    raw_svector_ostream OS(Want);
+    OS << "SD\nSE root\n";
+    for (int Ix = 0; Ix < NItems; ++Ix) {
+      OS << "SE item\nAT id=" << GetId(Ix) << '\n'
+         << "SE name\nCH " << GetName(Ix) << "\nEE\n";
+      if (Ix < NNotes)
+        OS << "SE note\nCH " << GetNote(Ix) << "\nEE\n";
+      OS << "EE\n";
+    }
+    OS << "EE\nED\n";
+  }
+
+  auto EncodeDoc = [&] (ExiOptions& Opts, SmallVecImpl<char>& Out) -> int {
+    ExiEncoder Encoder(Opts, errs());
+    auto Body = [&] () -> ExiError {
+      exi_try(Encoder.setWriter(Out));
+      exi_try(Encoder.encodeHeader());
+      exi_try(Encoder.encodeSD());
+      exi_try(Encoder.encodeSE(QName{.Name = "root"}));
+      for (int Ix = 0; Ix < NItems; ++Ix) {
+        exi_try(Encoder.encodeSE(QName{.Name = "item"}));
+        exi_try(Encoder.encodeAT(QName{.Name = "id"}, GetId(Ix)));
+        exi_try(Encoder.encodeSE(QName{.Name = "name"}));
+        exi_try(Encoder.encodeCH(GetName(Ix)));
+        exi_try(Encoder.encodeEE());
+        if (Ix < NNotes) {
+          exi_try(Encoder.encodeSE(QName{.Name = "note"}));
+          exi_try(Encoder.encodeCH(GetNote(Ix)));
+          exi_try(Encoder.encodeEE());
+        }
+        exi_try(Encoder.encodeEE());
+      }
+      exi_try(Encoder.encodeEE());
+      return Encoder.encodeED();
+    };
+    if (auto E = Body()) {
+      Encoder.diagnose(E);
+      return 1;
+    }
+    return 0;
+  };
+
+  auto Check = [&] (bool Compression, u64 BlockSize) -> int {
+    ExiOptions Opts {
+      .Alignment = AlignKind::PreCompression,
+      .Compression = Compression,
+      .BlockSize = BlockSize
+    };
+    Opts.SchemaID.emplace(nullptr);
+
+    SmallVec<char, 0> Out;
+    if (int Ret = EncodeDoc(Opts, Out))
+      return Ret;
+
+    EventRecorder Got;
+    ExiDecoder Decoder(Opts, errs());
+    if (int Ret = Decode(Decoder, MemoryBufferRef(
+        StrRef(Out.data(), Out.size()), "Compression"), &Got))
+      return Ret;
+    if (Got.str() != Want.str())
+      return Fail(Compression ? "Compressed events mismatch."
+                              : "Pre-compressed events mismatch.");
+    return 0;
+  };
+
+  // 40 values per block, and the whole document as one block.
+  for (u64 BlockSize : {40, 1'000'000}) {
+    if (int Ret = Check(/*Compression=*/false, BlockSize))
+      return Ret;
+#if EXI_USE_ZLIB
+    if (int Ret = Check(/*Compression=*/true, BlockSize))
+      return Ret;
+#endif
+  }
+  return 0;
+}
+
+static int TestSchemaDecoding(XMLManagerRef SharedMgr) {
+  // https://www.w3.org/TR/xmlschema-0/#ipo.xsd
+  for (StrRef File : {"examples/IPO.xsd"_str, "examples/SpecExample.xsd"_str}) {
+    auto GrammarsOrErr = loadXSDGrammars(*SharedMgr, File);
+    if (Error Err = GrammarsOrErr.takeError()) {
+      logAllUnhandledErrors(std::move(Err), errs());
+      return 1;
+    }
+    LOG_INFO("Loaded \"{}\": {} bytes", File,
+      (*GrammarsOrErr)->getMemoryUsage());
+  }
+
+  // Values are typed, and the nillable element uses `xsi:nil`.
+  const StrRef Dir = "vendored/exip/tests/test-set/EmptyTypes";
+  XMLContainerRef Exi
+    = SharedMgr->getOptXMLRef(Dir + "/emptyTypeTest-def.exi", errs())
+      .expect("could not locate file!");
+
+  ExiOptions Opts {};
+  Opts.SchemaID.emplace(
+    std::make_unique<String>((Dir + "/emptyTypeSchema.xsd").str()));
+
+  auto CheckDecode = [&] (ExiDecoder& Decoder, bool Push = false) -> int {
+    XMLSerializer S;
+    const MemoryBufferRef MB = Exi.getBufferRef();
+    if (int Ret = Push ? DecodePushed(Decoder, MB, &S)
+                       : Decode(Decoder, MB, &S))
+      return Ret;
+
+    XMLNode* Root = S.document().first_node();
+    XMLNode* Nil = Root ? Root->first_node() : nullptr;
+    if (!Nil || !Nil->last_attribute()
+        || StrRef(Nil->last_attribute()->value()) != "11") {
+      WithColor(outs(), raw_ostream::BRIGHT_RED) << "Schema value mismatch.\n";
+      return 1;
+    }
+    return 0;
+  };
+
+  ExiDecoder Decoder(Opts, errs());
+  Decoder.setSchemaResolver(make_refcounted<XSDSchemaResolver>(SharedMgr));
+  if (int Ret = CheckDecode(Decoder))
+    return Ret;
+
+  ExiDecoder Pushed(Opts, errs());
+  Pushed.setSchemaResolver(make_refcounted<XSDSchemaResolver>(SharedMgr));
+  if (int Ret = CheckDecode(Pushed, /*Push=*/true))
+    return Ret;
+
+#if EXI_COMPILED_SCHEMAS
+  // The same schema, compiled by exi-schemac.
+  ExiDecoder Compiled(Opts, errs());
+  Compiled.addCompiledSchema(schemas::EmptyTypes);
+  if (int Ret = CheckDecode(Compiled))
+    return Ret;
+
+  ExiDecoder CompiledPushed(Opts, errs());
+  CompiledPushed.addCompiledSchema(schemas::EmptyTypes);
+  if (int Ret = CheckDecode(CompiledPushed, /*Push=*/true))
+    return Ret;
+#endif
+
+  return 0;
+}
+
+/// Replays a pulled event into `Rec`, so it can be compared with
+/// `decodeBody`. `Value` is only used for AT/CH.
+static void RecordEvent(const ExiEventCursor& Cursor, const ExiEvent& Event,
+                        StrRef Value, Serializer& Rec) {
+  if (Event.isSE())
+    Rec.SE(Cursor.getQName(Event));
+  else if (Event.isEE())
+    Rec.EE(QName{});
+  else if (Event.isAT())
+    Rec.AT(Cursor.getQName(Event), Value);
+  else if (Event.isCH())
+    Rec.CH(Value);
+  else if (Event.getTerm() == EventTerm::SD)
+    Rec.SD();
+  else if (Event.isED())
+    Rec.ED();
+}
+
+/// Replays a batch into `Rec`.
+static void RecordBatch(const ExiEventCursor& Cursor,
+                        const ExiEventBuffer& Buf, Serializer& Rec) {
+  for (usize Ix = 0, E = Buf.size(); Ix != E; ++Ix) {
+    const ExiEvent Event { .UID = Buf.getUID(Ix), .Depth = Buf.depths()[Ix] };
+    const bool HasValue = Event.isAT() || Event.isCH();
+    RecordEvent(Cursor, Event,
+      HasValue ? Cursor.getValue(Buf, Ix) : StrRef(), Rec);
+  }
+}
+
+/// Decodes a stream with `next`. If `SkipDepth` is set, `skipSubtree` is
+/// called after every SE at that depth.
+static int DecodeCursor(ExiDecoder& Decoder, MemoryBufferRef MB,
+                        Serializer& Rec, u32 SkipDepth = 0) {
+  if (auto E = Decoder.decodeHeader(MB)) {
+    Decoder.diagnose(E);
+    return 1;
+  }
+
+  ExiEventCursor Cursor(Decoder);
+  while (true) {
+    auto Event = Cursor.next();
+    if (Event.is_err()) {
+      if (Event.error() == ExiError::DONE)
+        return 0;
+      Decoder.diagnose(Event.error());
+      return 1;
+    }
+
+    const bool HasValue = Event->isAT() || Event->isCH();
+    RecordEvent(Cursor, *Event,
+      HasValue ? Cursor.getValue(*Event) : StrRef(), Rec);
+    if (!SkipDepth || !Event->isSE() || Event->Depth != SkipDepth)
+      continue;
+
+    if (auto E = Cursor.skipSubtree()) {
+      Decoder.diagnose(E);
+      return 1;
+    }
+    if (Cursor.depth() != SkipDepth - 1) {
+      WithColor(outs(), raw_ostream::BRIGHT_RED) << "Skipped to wrong depth.\n";
+      return 1;
+    }
+  }
+}
+
+/// Decodes a stream with `nextBatch`, in batches of at most `MaxEvents`.
+static int DecodeBatched(ExiDecoder& Decoder, MemoryBufferRef MB,
+                         usize MaxEvents, Serializer& Rec) {
+  if (auto E = Decoder.decodeHeader(MB)) {
+    Decoder.diagnose(E);
+    return 1;
+  }
+
+  ExiEventCursor Cursor(Decoder);
+  ExiEventBuffer Buf;
+  while (true) {
+    auto Count = Cursor.nextBatch(Buf, MaxEvents);
+    if (Count.is_err()) {
+      if (Count.error() == ExiError::DONE)
+        return 0;
+      Decoder.diagnose(Count.error());
+      return 1;
+    }
+    RecordBatch(Cursor, Buf, Rec);
+  }
+}
+
+/// Checks that events pulled through `ExiEventCursor` match the ones pushed
+/// by `decodeBody`.
+static int TestEventCursor(XMLManagerRef SharedMgr) {
+  auto Fail = [] (StrRef Msg) {
+    WithColor OS(outs(), raw_ostream::BRIGHT_RED);
+    OS << Msg << '\n';
+    return 1;
+  };
+
+  struct Example {
+    StrRef File;
+    AlignKind Alignment;
+    ExiOptions::PreserveOpts Preserve;
+  };
+
+  using enum exi::PreserveKind;
+  const Example Examples[] {
+    {"examples/SpecExample.exi",    AlignKind::BitPacked,  {}},
+    {"examples/SpecExampleB.exi",   AlignKind::BytePacked, {}},
+    {"examples/BasicNoopt.exi",     AlignKind::BitPacked,  {}},
+    {"examples/CustomersNoopt.exi", AlignKind::BitPacked,
+      make_preserve_opts(Prefixes)},
+    {"examples/ThaiNooptB.exi",     AlignKind::BytePacked, {}},
+    {"examples/NamespaceNoopt.exi", AlignKind::BitPacked,
+      make_preserve_opts(All & ~LexicalValues)},
+  };
+
+  for (const Example& Ex : Examples) {
+    XMLContainerRef Exi = SharedMgr->getOptXMLRef(Ex.File, errs())
+      .expect("could not locate file!");
+    const MemoryBufferRef MB = Exi.getBufferRef();
+    ExiOptions Opts {
+      .Alignment = Ex.Alignment,
+      .Preserve = Ex.Preserve
+    };
+    Opts.SchemaID.emplace(nullptr);
+
+    // Every event, then with the children of the root skipped.
+    for (u32 SkipDepth : {0, 2}) {
+      EventRecorder Want;
+      {
+        ExiDecoder Decoder(Opts, errs());
+        if (SkipDepth) {
+          SubtreeSkipper S(Want, SkipDepth);
+          if (int Ret = Decode(Decoder, MB, &S))
+            return Ret;
+        } else if (int Ret = Decode(Decoder, MB, &Want))
+          return Ret;
+      }
+
+      EventRecorder Got;
+      ExiDecoder Decoder(Opts, errs());
+      if (int Ret = DecodeCursor(Decoder, MB, Got, SkipDepth))
+        return Ret;
+      if (Got.str() != Want.str())
+        return Fail(SkipDepth ? "Skipped cursor events mismatch."
+                              : "Cursor events mismatch.");
+      if (SkipDepth)
+        continue;
+
+      // Batches which end mid-element, and one for the whole stream.
+      for (usize MaxEvents : {7, 4096}) {
+        EventRecorder Batched;
+        ExiDecoder BatchDecoder(Opts, errs());
+        if (int Ret = DecodeBatched(BatchDecoder, MB, MaxEvents, Batched))
+          return Ret;
+        if (Batched.str() != Want.str())
+          return Fail("Batched cursor events mismatch.");
+      }
+    }
+  }
+
+  // Channels and SC fragments are unsupported, and must be reported as such.
+  for (bool SC : {false, true}) {
+    ExiOptions Opts {
+      .Alignment = SC ? AlignKind::BitPacked : AlignKind::PreCompression,
+      .SelfContained = SC
+    };
+    Opts.SchemaID.emplace(nullptr);
+
+    SmallVec<char, 0> Out;
+    {
+      ExiEncoder Encoder(Opts, errs());
+      auto Body = [&] () -> ExiError {
+        const QName Root {.Name = "root"};
+        exi_try(Encoder.setWriter(Out));
+        exi_try(Encoder.encodeHeader());
+        exi_try(Encoder.encodeSD());
+        exi_try(Encoder.encodeSE(Root));
+        if (SC)
+          exi_try(Encoder.encodeSC(Root));
+        exi_try(Encoder.encodeCH("value"));
+        exi_try(Encoder.encodeEE());
+        return Encoder.encodeED();
+      };
+      if (auto E = Body()) {
+        Encoder.diagnose(E);
+        return 1;
+      }
+    }
+
+    ScopedSave FlagSave(exi::DebugFlag, LogLevel::NONE);
+    ExiDecoder Decoder(Opts, errs());
+    if (auto E = Decoder.decodeHeader(MemoryBufferRef(
+        StrRef(Out.data(), Out.size()), "Unsupported"))) {
+      Decoder.diagnose(E);
+      return 1;
+    }
+
+    ExiEventCursor Cursor(Decoder);
+    ExiError E = ExiError::OK;
+    while (!E) {
+      auto Event = Cursor.next();
+      E = Event.is_err() ? Event.error() : ExiError::OK;
+    }
+    if (E != ErrorCode::kUnimplemented)
+      return Fail("Unsupported cursor stream was decoded.");
+  }
+
+  // Typed values are transient, so every one in a batch must be copied.
+  {
+    const StrRef Dir = "vendored/exip/examples/simpleEncoding";
+    XMLContainerRef Exi
+      = SharedMgr->getOptXMLRef("examples/TypedValues.exi", errs())
+        .expect("could not locate file!");
+    const MemoryBufferRef MB = Exi.getBufferRef();
+
+    ExiOptions Opts { .Strict = true };
+    Opts.SchemaID.emplace(
+      std::make_unique<String>((Dir + "/exipe-test.xsd").str()));
+    auto Resolver = make_refcounted<XSDSchemaResolver>(SharedMgr);
+
+    EventRecorder Want;
+    {
+      ExiDecoder Decoder(Opts, errs());
+      Decoder.setSchemaResolver(Resolver);
+      if (int Ret = Decode(Decoder, MB, &Want))
+        return Ret;
+    }
+    if (!Want.str().contains("CH true\n")
+        || !Want.str().contains("CH 2012-07-31T13:33:55.000839\n"))
+      return Fail("Typed values mismatch.");
+
+    for (usize MaxEvents : {3, 1024}) {
+      EventRecorder Got;
+      ExiDecoder Decoder(Opts, errs());
+      Decoder.setSchemaResolver(Resolver);
+      if (int Ret = DecodeBatched(Decoder, MB, MaxEvents, Got))
+        return Ret;
+      if (Got.str() != Want.str())
+        return Fail("Batched typed values mismatch.");
+    }
+  }
+
+  return 0;
+}
+
+namespace {
+/// Resolves every schema to the same grammars.
+class FixedSchemaResolver final : public SchemaResolver {
+  SchemaGrammarsRef Grammars;
+
+public:
+  explicit FixedSchemaResolver(SchemaGrammarsRef Grammars) :
+   Grammars(std::move(Grammars)) {}
+
+  Expected<SchemaGrammarsRef> resolve(StrRef) override { return Grammars; }
+};
+} // namespace `anonymous`
+
+/// Caches the grammars of a copy of the EmptyTypes schema, and checks that
+/// the mapped grammars decode the same events. The cache must be rejected
+/// once its payload is damaged, and once its source changes.
+static int TestGrammarCache() {
+  auto Fail = [] (StrRef Msg) {
+    WithColor OS(outs(), raw_ostream::BRIGHT_RED);
+    OS << Msg << '\n';
+    return 1;
+  };
+
+  auto WriteFile = [] (StrRef Path, StrRef Data) -> int {
+    Error E = writeToOutput(Path, [Data] (raw_ostream& OS) {
+      OS << Data;
+      return Error::success();
+    });
+    if (E) {
+      logAllUnhandledErrors(std::move(E), errs());
+      return 1;
+    }
+    return 0;
+  };
+
+  const StrRef Dir = "vendored/exip/tests/test-set/EmptyTypes";
+  auto Source = MemoryBuffer::getFile(Dir + "/emptyTypeSchema.xsd");
+  auto Exi = MemoryBuffer::getFile(Dir + "/emptyTypeTest-def.exi");
+  if (!Source || !Exi)
+    return Fail("Could not locate the EmptyTypes schema.");
+
+  SmallStr<128> TmpDir;
+  if (sys::fs::createUniqueDirectory("exi-cache", TmpDir))
+    return Fail("Could not create a cache directory.");
+
+  SmallStr<128> Schema(TmpDir), CachePath(TmpDir), CorruptPath(TmpDir);
+  sys::path::append(Schema, "emptyTypeSchema.xsd");
+  sys::path::append(CachePath, "emptyTypeSchema.exig");
+  sys::path::append(CorruptPath, "corrupt.exig");
+  auto Cleanup = make_scope_exit([&] {
+    for (StrRef Path : {Schema.str(), CachePath.str(), CorruptPath.str(),
+                        TmpDir.str()})
+      sys::fs::remove(Path);
+  });
+
+  if (int Ret = WriteFile(Schema, (*Source)->getBuffer()))
+    return Ret;
+
+  // A new manager, so the copy is hashed as it is parsed.
+  XMLManagerRef Mgr = make_refcounted<XMLManager>();
+  XSDSources Sources;
+  auto GrammarsOrErr = loadXSDGrammars(*Mgr, Schema, &Sources);
+  if (Error Err = GrammarsOrErr.takeError()) {
+    logAllUnhandledErrors(std::move(Err), errs());
+    return 1;
+  }
+  if (!Sources.IsComplete)
+    return Fail("Schema sources were not hashed.");
+
+  SmallStr<0> Cache;
+  {
+    raw_svector_ostream OS(Cache);
+    writeSchemaCache(OS, (*GrammarsOrErr)->tables(),
+      Sources.Paths, Sources.Hash.final());
+  }
+  if (int Ret = WriteFile(CachePath, Cache.str()))
+    return Ret;
+
+  SchemaGrammarsRef Mapped = loadSchemaCache(CachePath);
+  if (!Mapped)
+    return Fail("Grammar cache was rejected.");
+
+  ExiOptions Opts {};
+  Opts.SchemaID.emplace(std::make_unique<String>(Schema.str().str()));
+  auto DecodeWith = [&] (SchemaGrammarsRef Grammars, EventRecorder& Rec) {
+    ExiDecoder Decoder(Opts, errs());
+    Decoder.setSchemaResolver(
+      make_refcounted<FixedSchemaResolver>(std::move(Grammars)));
+    return Decode(Decoder, (*Exi)->getMemBufferRef(), &Rec);
+  };
+
+  EventRecorder Want, Got;
+  if (int Ret = DecodeWith(*GrammarsOrErr, Want))
+    return Ret;
+  if (int Ret = DecodeWith(Mapped, Got))
+    return Ret;
+  if (!Want.str().contains("AT foo=11\n") || Got.str() != Want.str())
+    return Fail("Cached grammar events mismatch.");
+
+  ScopedSave FlagSave(exi::DebugFlag, LogLevel::NONE);
+
+  // Damage the payload, the header is still intact.
+  Cache.back() ^= 0x1;
+  if (int Ret = WriteFile(CorruptPath, Cache.str()))
+    return Ret;
+  if (loadSchemaCache(CorruptPath))
+    return Fail("Corrupt grammar cache was mapped.");
+
+  // Editing the source makes the original cache stale.
+  SmallStr<0> Edited((*Source)->getBuffer());
+  Edited.append("<!-- edited -->\n");
+  if (int Ret = WriteFile(Schema, Edited.str()))
+    return Ret;
+  if (loadSchemaCache(CachePath))
+    return Fail("Stale grammar cache was mapped.");
+
+  return 0;
+}
+
+/// Decodes Orders.exi under memory budgets relative to what it uses without
+/// one. The stream is long enough that usage is checked many times.
+static int TestMemoryBudget(XMLManagerRef SharedMgr) {
+  auto Fail = [] (StrRef Msg) {
+    WithColor OS(outs(), raw_ostream::BRIGHT_RED);
+    OS << Msg << '\n';
+    return 1;
+  };
+
+  XMLContainerRef Exi = SharedMgr->getOptXMLRef("examples/Orders.exi", errs())
+    .expect("could not locate file!");
+  const MemoryBufferRef MB = Exi.getBufferRef();
+
+  using enum exi::PreserveKind;
+  ExiOptions Opts { .Preserve = make_preserve_opts(Prefixes) };
+  Opts.SchemaID.emplace(nullptr);
+
+  u64 Used = 0;
+  {
+    ExiDecoder Decoder(Opts, errs());
+    if (int Ret = Decode(Decoder, MB))
+      return Ret;
+    Used = Decoder.getMemoryUsage().total();
+  }
+
+  {
+    ScopedSave FlagSave(exi::DebugFlag, LogLevel::NONE);
+    ExiDecoder Decoder(Opts, errs());
+    Decoder.setMemoryBudget(Used / 4);
+    ExiError E = Decoder.decodeHeader(MB);
+    if (!E)
+      E = Decoder.decodeBody();
+    if (E != ErrorCode::kInvalidMemoryAlloc)
+      return Fail("Decoding exceeded the memory budget.");
+  }
+
+  {
+    ExiDecoder Decoder(Opts, errs());
+    Decoder.setMemoryBudget(Used * 2);
+    if (int Ret = Decode(Decoder, MB))
+      return Ret;
+    if (Decoder.getMemoryUsage().total() > Used * 2)
+      return Fail("Memory usage exceeded the budget.");
+  }
+
+  return 0;
+}
+
+/// Encodes a generated document with bounded value tables, and checks that
+/// it decodes to the values it was generated from. Values repeat, so hits
+/// are encoded against partitions which have wrapped, and some names are
+/// longer than `ValueMaxLength`, so they are never added.
+static int TestBoundedTables() {
+  auto Fail = [] (StrRef Msg) {
+    WithColor OS(outs(), raw_ostream::BRIGHT_RED);
+    OS << Msg << '\n';
+    return 1;
+  };
+
+  constexpr int NItems = 200;
+  auto GetId = [] (int Ix) { return Twine(Ix % 37).str(); };
+  // "name0" through "name9" fit in 5 characters, the rest don't.
+  auto GetName = [] (int Ix) { return ("name" + Twine(Ix % 23)).str(); };
+
+  SmallStr<0> Want;
+  {
+    raw_svector_ostream OS(Want);
+    OS << "SD\nSE root\n";
+    for (int Ix = 0; Ix < NItems; ++Ix) {
+      OS << "SE item\nAT id=" << GetId(Ix) << '\n'
+         << "SE name\nCH " << GetName(Ix) << "\nEE\nEE\n";
+    }
+    OS << "EE\nED\n";
+  }
+
+  auto EncodeDoc = [&] (ExiOptions& Opts, SmallVecImpl<char>& Out) -> int {
+    ExiEncoder Encoder(Opts, errs());
+    auto Body = [&] () -> ExiError {
+      exi_try(Encoder.setWriter(Out));
+      exi_try(Encoder.encodeHeader());
+      exi_try(Encoder.encodeSD());
+      exi_try(Encoder.encodeSE(QName{.Name = "root"}));
+      for (int Ix = 0; Ix < NItems; ++Ix) {
+        exi_try(Encoder.encodeSE(QName{.Name = "item"}));
+        exi_try(Encoder.encodeAT(QName{.Name = "id"}, GetId(Ix)));
+        exi_try(Encoder.encodeSE(QName{.Name = "name"}));
+        exi_try(Encoder.encodeCH(GetName(Ix)));
+        exi_try(Encoder.encodeEE());
+        exi_try(Encoder.encodeEE());
+      }
+      exi_try(Encoder.encodeEE());
+      return Encoder.encodeED();
+    };
+    if (auto E = Body()) {
+      Encoder.diagnose(E);
+      return 1;
+    }
+    return 0;
+  };
+
+  auto Check = [&] (Bounded<u64> Capacity, Bounded<u64> MaxLength) -> int {
+    ExiOptions Opts {};
+    Opts.ValuePartitionCapacity = Capacity;
+    Opts.ValueMaxLength = MaxLength;
+    Opts.SchemaID.emplace(nullptr);
+
+    SmallVec<char, 0> Out;
+    if (int Ret = EncodeDoc(Opts, Out))
+      return Ret;
+    const MemoryBufferRef MB(StrRef(Out.data(), Out.size()), "Bounded");
+
+    EventRecorder Got;
+    {
+      ExiDecoder Decoder(Opts, errs());
+      if (int Ret = Decode(Decoder, MB, &Got))
+        return Ret;
+    }
+    if (Got.str() != Want.str())
+      return Fail("Bounded table events mismatch.");
+
+    // IDs may be reused within a batch, so values must be copied.
+    EventRecorder Batched;
+    ExiDecoder Decoder(Opts, errs());
+    if (int Ret = DecodeBatched(Decoder, MB, 64, Batched))
+      return Ret;
+    if (Batched.str() != Want.str())
+      return Fail("Batched bounded table events mismatch.");
+    return 0;
+  };
+
+  if (int Ret = Check(16, exi::unbounded))
+    return Ret;
+  if (int Ret = Check(exi::unbounded, 5))
+    return Ret;
+  return Check(16, 5);
+}
@@ -56,6 +56,15 @@ namespace root {
 
 void tests_main(int Argc, char* Argv[]);
 
+/// Runs decoding benchmarks on `examples/`.
+void RunBenchmarks(exi::XMLManager& Mgr);
+
+/// Compares parsing `Text` with rapidxml against the streaming tokenizer.
+void BenchXMLParse(exi::StrRef Name, exi::StrRef Text, int Iters);
+
+/// Compares parsing `Filepath` with rapidxml against the streaming tokenizer.
+void BenchXMLParse(const exi::Twine& Filepath, int Iters);
+
 void FullXMLDump(exi::XMLManager& Mgr,
                  const exi::Twine& Filepath,
                  exi::Option<exi::raw_ostream&> InOS = std::nullopt,
@@ -0,0 +1,1771 @@
+//===- DriverBench.cpp ----------------------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+
+#include "Driver.hpp"
+#include <Common/ScopeExit.hpp>
+#include <Common/SmallStr.hpp>
+#include <Support/Filesystem.hpp>
+#include <Support/Format.hpp>
+#include <Support/Logging.hpp>
+#include <Support/MemoryBuffer.hpp>
+#include <Support/MemoryBufferRef.hpp>
+#include <Support/Path.hpp>
+#include <Support/ScopedSave.hpp>
+#include <Support/raw_ostream.hpp>
+#include <exi/Basic/ExiOptions.hpp>
+#include <exi/Basic/XMLTokenizer.hpp>
+#include <exi/Basic/XMLManager.hpp>
+#include <exi/Basic/XMLContainer.hpp>
+#include <exi/Decode/BodyDecoder.hpp>
+#include <exi/Decode/BodyDecoderImpl.hpp>
+#include <exi/Decode/EventBuffer.hpp>
+#include <exi/Decode/EventCursor.hpp>
+#include <exi/Decode/SelfContained.hpp>
+#include <exi/Decode/XMLSerializer.hpp>
+#include <exi/Encode/BodyEncoder.hpp>
+#include <exi/Encode/StreamEncoder.hpp>
+#include <exi/Encode/Transcoder.hpp>
+#include <exi/Grammar/SchemaCache.hpp>
+#include <exi/Grammar/SchemaLoader.hpp>
+#include <exi/Stream/ChunkedInput.hpp>
+#include <exi/Stream/OrderedReader.hpp>
+#include <chrono>
+#include <thread>
+#include <rapidxml.hpp>
+
+#define DEBUG_TYPE "__BENCH__"
+
+using namespace exi;
+
+namespace {
+
+using BenchClock = std::chrono::steady_clock;
+using BenchTime = std::chrono::duration<double, std::milli>;
+
+/// Counts events and touches every string, so nothing is optimized out.
+class CountingSerializer : public Serializer {
+public:
+  u64 Events = 0;
+  u64 Bytes = 0;
+
+  ExiError SE(QName Name) override {
+    ++Events;
+    Bytes += Name.Name.size();
+    return ExiError::OK;
+  }
+  ExiError EE(QName Name) override {
+    ++Events;
+    return ExiError::OK;
+  }
+  ExiError AT(QName Name, StrRef Value) override {
+    ++Events;
+    Bytes += Name.Name.size() + Value.size();
+    return ExiError::OK;
+  }
+  ExiError CH(StrRef Value) override {
+    ++Events;
+    Bytes += Value.size();
+    return ExiError::OK;
+  }
+};
+
+struct BenchFile {
+  StrRef Name;
+  AlignKind Alignment;
+  ExiOptions::PreserveOpts Preserve;
+  int Iters;
+};
+
+struct BenchResult {
+  BenchTime Time {};
+  u64 Events = 0;
+  /// The size of values touched, where tracked.
+  u64 Bytes = 0;
+};
+
+/// A small deterministic generator, so runs are comparable.
+struct XorShift64 {
+  u64 State = 0x9E37'79B9'7F4A'7C15;
+  u64 operator()() {
+    State ^= State << 13;
+    State ^= State >> 7;
+    State ^= State << 17;
+    return State;
+  }
+};
+
+struct UIntDist {
+  StrRef Name;
+  u64(*Gen)(XorShift64& Rng);
+};
+
+} // namespace `anonymous`
+
+template <bool IsStatic>
+static Option<BenchResult> TimeDecode(MemoryBufferRef MB, ExiOptions& Opts,
+                                      int Iters, bool Borrow = false) {
+  BenchResult Out;
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    ExiDecoder Decoder(Opts, errs());
+    Decoder.setBorrowInput(Borrow);
+    CountingSerializer S;
+
+    const auto Start = BenchClock::now();
+    ExiError E = Decoder.decodeHeader(MB);
+    if (!E) {
+      if constexpr (IsStatic)
+        E = Decoder.decodeBody(S);
+      else
+        E = Decoder.decodeBody(&S);
+    }
+    Out.Time += BenchClock::now() - Start;
+
+    if (E) {
+      Decoder.diagnose(E, /*Force=*/true);
+      return std::nullopt;
+    }
+    Out.Events = S.Events;
+  }
+  return Out;
+}
+
+static Option<MemoryBufferRef> LoadBenchFile(XMLManager& Mgr, StrRef Name) {
+  SmallStr<64> Path("examples/");
+  Path.append(Name);
+
+  auto Exi = Mgr.getOptXMLRef(Path.str(), errs());
+  if (!Exi) {
+    WithColor(errs(), raw_ostream::BRIGHT_RED)
+      << "Could not locate " << Path << '\n';
+    return std::nullopt;
+  }
+  return Exi->getBufferRef();
+}
+
+static void BenchDispatch(StrRef Name, MemoryBufferRef MB, ExiOptions& Opts,
+                          int Iters) {
+  using enum raw_ostream::Colors;
+  auto Dyn = TimeDecode<false>(MB, Opts, Iters);
+  auto Static = TimeDecode<true>(MB, Opts, Iters);
+  if (!Dyn || !Static) {
+    WithColor(errs(), BRIGHT_RED) << "Decoding " << Name << " failed.\n";
+    return;
+  }
+
+  const double DynMs = Dyn->Time.count();
+  const double StaticMs = Static->Time.count();
+  // Millions of events per second on the static path.
+  const double MEvents = double(Static->Events * Iters) / 1000.0;
+  outs() << format("{: <24} {: >8} events x{: <6} "
+                   "virtual: {: >9.3f}ms  static: {: >9.3f}ms  ({:.2f}x)  "
+                   "{:.2f} Mev/s\n",
+    Name, Dyn->Events, Iters,
+    DynMs, StaticMs, DynMs / StaticMs, MEvents / StaticMs);
+}
+
+static void BenchSerializerDispatch(XMLManager& Mgr, const BenchFile& File) {
+  auto MB = LoadBenchFile(Mgr, File.Name);
+  if (!MB)
+    return;
+
+  ExiOptions Opts {
+    .Alignment = File.Alignment,
+    .Preserve = File.Preserve
+  };
+  Opts.SchemaID.emplace(nullptr);
+  BenchDispatch(File.Name, *MB, Opts, File.Iters);
+}
+
+static void BenchBorrowInput(XMLManager& Mgr, const BenchFile& File) {
+  using enum raw_ostream::Colors;
+  auto MB = LoadBenchFile(Mgr, File.Name);
+  if (!MB)
+    return;
+
+  ExiOptions Opts {
+    .Alignment = File.Alignment,
+    .Preserve = File.Preserve
+  };
+  Opts.SchemaID.emplace(nullptr);
+
+  auto Copied = TimeDecode<true>(*MB, Opts, File.Iters);
+  auto Borrowed = TimeDecode<true>(*MB, Opts, File.Iters, /*Borrow=*/true);
+  if (!Copied || !Borrowed) {
+    WithColor(errs(), BRIGHT_RED) << "Decoding " << File.Name << " failed.\n";
+    return;
+  }
+
+  const double CopiedMs = Copied->Time.count();
+  const double BorrowedMs = Borrowed->Time.count();
+  outs() << format("{: <24} copied: {: >9.3f}ms  borrowed: {: >9.3f}ms  "
+                   "({:.2f}x)\n",
+    File.Name, CopiedMs, BorrowedMs, CopiedMs / BorrowedMs);
+}
+
+/// Decodes `MB` by feeding it in chunks of `ChunkSize`, as it would arrive
+/// from a socket.
+static Option<BenchResult> TimeChunkedDecode(MemoryBufferRef MB,
+                                             ExiOptions& Opts, int Iters,
+                                             usize ChunkSize) {
+  const StrRef Data = MB.getBuffer();
+  BenchResult Out;
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    ChunkedInput In;
+    ExiDecoder Decoder(Opts, errs());
+    CountingSerializer S;
+
+    const auto Start = BenchClock::now();
+    ExiError E = Decoder.setInput(In);
+    bool Done = false;
+    for (usize Pos = 0; !E && !Done && Pos < Data.size(); Pos += ChunkSize) {
+      In.feed(Data.substr(Pos, ChunkSize));
+      E = Decoder.decodeAvailable(S);
+      if (E == ExiError::FULL)
+        E = ExiError::OK;
+      else
+        Done = !E;
+    }
+    if (!E && !Done) {
+      In.finish();
+      E = Decoder.decodeAvailable(S);
+    }
+    Out.Time += BenchClock::now() - Start;
+
+    if (E) {
+      Decoder.diagnose(E, /*Force=*/true);
+      return std::nullopt;
+    }
+    Out.Events = S.Events;
+  }
+  return Out;
+}
+
+static void BenchChunkedInput(XMLManager& Mgr, const BenchFile& File) {
+  using enum raw_ostream::Colors;
+  auto MB = LoadBenchFile(Mgr, File.Name);
+  if (!MB)
+    return;
+
+  ExiOptions Opts {
+    .Alignment = File.Alignment,
+    .Preserve = File.Preserve
+  };
+  Opts.SchemaID.emplace(nullptr);
+
+  auto Whole = TimeDecode<true>(*MB, Opts, File.Iters);
+  auto Small = TimeChunkedDecode(*MB, Opts, File.Iters, 512);
+  auto Large = TimeChunkedDecode(*MB, Opts, File.Iters, 64 * 1024);
+  if (!Whole || !Small || !Large
+      || Small->Events != Whole->Events
+      || Large->Events != Whole->Events) {
+    WithColor(errs(), BRIGHT_RED) << "Decoding " << File.Name << " failed.\n";
+    return;
+  }
+
+  const double WholeMs = Whole->Time.count();
+  const double SmallMs = Small->Time.count();
+  const double LargeMs = Large->Time.count();
+  outs() << format("{: <24} whole: {: >9.3f}ms  512b: {: >9.3f}ms ({:.2f}x)  "
+                   "64kb: {: >9.3f}ms ({:.2f}x)\n",
+    File.Name, WholeMs, SmallMs, WholeMs / SmallMs,
+    LargeMs, WholeMs / LargeMs);
+}
+
+/// Decodes `MB` repeatedly, including the cost of setting up the decoder.
+/// When `Reuse` is set, a single decoder is reset between streams.
+static Option<BenchResult> TimeRepeatedDecode(MemoryBufferRef MB,
+                                              ExiOptions& Opts, int Iters,
+                                              bool Reuse) {
+  BenchResult Out;
+  Option<ExiDecoder> Decoder;
+  const auto Start = BenchClock::now();
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    if (Reuse && Decoder)
+      Decoder->reset();
+    else
+      Decoder.emplace(Opts, errs());
+
+    CountingSerializer S;
+    ExiError E = Decoder->decodeHeader(MB);
+    if (!E)
+      E = Decoder->decodeBody(S);
+
+    if (E) {
+      Decoder->diagnose(E, /*Force=*/true);
+      return std::nullopt;
+    }
+    Out.Events = S.Events;
+  }
+  Out.Time = BenchClock::now() - Start;
+  return Out;
+}
+
+static void BenchDecoderReuse(XMLManager& Mgr, const BenchFile& File) {
+  using enum raw_ostream::Colors;
+  auto MB = LoadBenchFile(Mgr, File.Name);
+  if (!MB)
+    return;
+
+  ExiOptions Opts {
+    .Alignment = File.Alignment,
+    .Preserve = File.Preserve
+  };
+  Opts.SchemaID.emplace(nullptr);
+
+  auto Fresh = TimeRepeatedDecode(*MB, Opts, File.Iters, /*Reuse=*/false);
+  auto Reused = TimeRepeatedDecode(*MB, Opts, File.Iters, /*Reuse=*/true);
+  if (!Fresh || !Reused || Reused->Events != Fresh->Events) {
+    WithColor(errs(), BRIGHT_RED) << "Decoding " << File.Name << " failed.\n";
+    return;
+  }
+
+  const double FreshMs = Fresh->Time.count();
+  const double ReusedMs = Reused->Time.count();
+  // Microseconds per stream.
+  const double Scale = 1000.0 / File.Iters;
+  outs() << format("{: <24} fresh: {: >9.3f}us  reused: {: >9.3f}us  "
+                   "({:.2f}x)\n",
+    File.Name, FreshMs * Scale, ReusedMs * Scale, FreshMs / ReusedMs);
+}
+
+/// Pulls every event through `ExiEventCursor`, either one at a time or in
+/// batches. Values are resolved, so the work matches `CountingSerializer`.
+template <bool IsBatched>
+static Option<BenchResult> TimeCursor(MemoryBufferRef MB, ExiOptions& Opts,
+                                      int Iters) {
+  constexpr usize kBatchSize = 256;
+  BenchResult Out;
+  ExiEventBuffer Buf;
+  Buf.reserve(kBatchSize);
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    ExiDecoder Decoder(Opts, errs());
+    u64 Events = 0, Bytes = 0;
+
+    const auto Start = BenchClock::now();
+    ExiError E = Decoder.decodeHeader(MB);
+    ExiEventCursor Cursor(Decoder);
+    while (!E) {
+      if constexpr (IsBatched) {
+        auto Count = Cursor.nextBatch(Buf, kBatchSize);
+        if (Count.is_err()) {
+          E = Count.error();
+          break;
+        }
+        for (usize EventIx = 0; EventIx != *Count; ++EventIx) {
+          const ExiEvent Event { .UID = Buf.getUID(EventIx) };
+          if (Event.isAT() || Event.isCH())
+            Bytes += Cursor.getValue(Buf, EventIx).size();
+        }
+        Events += *Count;
+      } else {
+        auto Event = Cursor.next();
+        if (Event.is_err()) {
+          E = Event.error();
+          break;
+        }
+        if (Event->isAT() || Event->isCH())
+          Bytes += Cursor.getValue(*Event).size();
+        ++Events;
+      }
+    }
+    Out.Time += BenchClock::now() - Start;
+
+    if (E != ExiError::DONE) {
+      Decoder.diagnose(E, /*Force=*/true);
+      return std::nullopt;
+    }
+    Out.Events = Events;
+    Out.Bytes = Bytes;
+  }
+  return Out;
+}
+
+static void BenchCursor(XMLManager& Mgr, const BenchFile& File) {
+  using enum raw_ostream::Colors;
+  auto MB = LoadBenchFile(Mgr, File.Name);
+  if (!MB)
+    return;
+
+  ExiOptions Opts {
+    .Alignment = File.Alignment,
+    .Preserve = File.Preserve
+  };
+  Opts.SchemaID.emplace(nullptr);
+
+  auto Static = TimeDecode<true>(*MB, Opts, File.Iters);
+  auto Single = TimeCursor<false>(*MB, Opts, File.Iters);
+  auto Batched = TimeCursor<true>(*MB, Opts, File.Iters);
+  if (!Static || !Single || !Batched || Single->Bytes != Batched->Bytes) {
+    WithColor(errs(), BRIGHT_RED) << "Decoding " << File.Name << " failed.\n";
+    return;
+  }
+
+  const double StaticMs = Static->Time.count();
+  const double SingleMs = Single->Time.count();
+  const double BatchedMs = Batched->Time.count();
+  outs() << format("{: <24} static: {: >9.3f}ms  next: {: >9.3f}ms  "
+                   "batched: {: >9.3f}ms  ({:.2f}x)\n",
+    File.Name, StaticMs, SingleMs, BatchedMs, SingleMs / BatchedMs);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Encoding
+
+namespace {
+struct EncodeFile {
+  StrRef Name;
+  AlignKind Alignment;
+  ExiOptions::PreserveOpts Preserve;
+  int Iters;
+};
+} // namespace `anonymous`
+
+/// Encodes `Doc` into `Out`, including the cost of setting up the encoder.
+static Option<BenchTime> TimeEncode(const XMLDocument& Doc, ExiOptions& Opts,
+                                    int Iters, SmallVecImpl<char>& Out) {
+  BenchTime Time {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    Out.clear();
+    const auto Start = BenchClock::now();
+    ExiError E = ExiError::OK;
+    {
+      ExiEncoder Encoder(Opts, errs());
+      E = Encoder.setWriter(Out);
+      if (!E)
+        E = Encoder.encodeHeader();
+      if (!E)
+        E = Encoder.encodeBody(Doc);
+      if (E)
+        Encoder.diagnose(E);
+    }
+    Time += BenchClock::now() - Start;
+    if (E)
+      return std::nullopt;
+  }
+  return Time;
+}
+
+static void BenchEncodeDoc(StrRef Name, const XMLDocument& Doc, usize Size,
+                           ExiOptions Opts, int Iters) {
+  using enum raw_ostream::Colors;
+  Opts.SchemaID.emplace(nullptr);
+
+  SmallVec<char, 0> Out;
+  auto Enc = TimeEncode(Doc, Opts, Iters, Out);
+  if (!Enc) {
+    WithColor(errs(), BRIGHT_RED) << "Encoding " << Name << " failed.\n";
+    return;
+  }
+
+  MemoryBufferRef MB(StrRef(Out.data(), Out.size()), Name);
+  auto Dec = TimeDecode<true>(MB, Opts, Iters);
+  if (!Dec) {
+    WithColor(errs(), BRIGHT_RED) << "Decoding " << Name << " failed.\n";
+    return;
+  }
+
+  // Throughput is measured in terms of the source XML.
+  const double MBytes = double(Size * Iters) / (1024.0 * 1024.0);
+  const double EncMs = Enc->count();
+  const double DecMs = Dec->Time.count();
+  outs() << format("{: <24} {: >8} -> {: >7} bytes  "
+                   "encode: {: >7.1f}MB/s  decode: {: >7.1f}MB/s  "
+                   "({:.2f}x)\n",
+    Name, Size, Out.size(),
+    MBytes / (EncMs / 1000.0), MBytes / (DecMs / 1000.0), DecMs / EncMs);
+}
+
+static void BenchEncoding(XMLManager& Mgr, const EncodeFile& File) {
+  SmallStr<64> Path("examples/");
+  Path.append(File.Name);
+
+  auto Xml = Mgr.getOptXMLRef(Path.str(), errs());
+  auto Doc = Mgr.getOptXMLDocument(Path.str(), errs());
+  if (!Xml || !Doc)
+    return;
+
+  BenchEncodeDoc(File.Name, *Doc, Xml->getBufferRef().getBufferSize(),
+    {.Alignment = File.Alignment, .Preserve = File.Preserve}, File.Iters);
+}
+
+/// Generates a document shaped like a parsed treebank: deep nesting, a small
+/// set of short tags, and short words as data. Events are passed to `Emit`,
+/// which has `open(Tag)`, `text(Word)` and `close(Tag)`.
+template <class EmitterT>
+static void GenerateTreebank(EmitterT& Emit, usize Sentences) {
+  static constexpr StrRef Tags[] {
+    "S", "NP", "VP", "PP", "ADJP", "SBAR", "NN", "NNS", "VBD", "DT", "JJ", "IN"
+  };
+  static constexpr StrRef Words[] {
+    "the", "market", "fell", "in", "early", "trading", "shares",
+    "of", "company", "rose", "percent", "yesterday", "analysts", "said"
+  };
+
+  XorShift64 Rng;
+  Emit.open("FILE");
+  for (usize Ix = 0; Ix < Sentences; ++Ix) {
+    Emit.open("EMPTY");
+    Emit.open("S");
+    SmallVec<StrRef, 16> Open;
+    for (usize N = 0, E = 8 + Rng() % 24; N < E; ++N) {
+      if (Open.size() < 12 && Rng() % 3 != 0) {
+        const StrRef Tag = Tags[Rng() % std::size(Tags)];
+        Emit.open(Tag);
+        Open.push_back(Tag);
+      } else if (!Open.empty()) {
+        Emit.text(Words[Rng() % std::size(Words)]);
+        Emit.close(Open.pop_back_val());
+      }
+    }
+    while (!Open.empty())
+      Emit.close(Open.pop_back_val());
+    Emit.close("S");
+    Emit.close("EMPTY");
+  }
+  Emit.close("FILE");
+}
+
+namespace {
+/// Writes the treebank as XML text.
+struct TreebankText {
+  raw_svector_ostream OS;
+  TreebankText(SmallVecImpl<char>& Out) : OS(Out) {}
+  void open(StrRef Tag) { OS << '<' << Tag << '>'; }
+  void text(StrRef Word) { OS << Word; }
+  void close(StrRef Tag) { OS << "</" << Tag << '>'; }
+};
+
+/// Passes the treebank straight to an encoder, without any XML.
+struct TreebankEvents {
+  StreamEncoder& S;
+  ExiError Err = ExiError::OK;
+  void open(StrRef Tag) {
+    if (!Err)
+      Err = S.SE({.Name = Tag});
+  }
+  void text(StrRef Word) {
+    if (!Err)
+      Err = S.CH(Word);
+  }
+  void close(StrRef Tag) {
+    if (!Err)
+      Err = S.EE({.Name = Tag});
+  }
+};
+} // namespace `anonymous`
+
+/// Encodes the treebank as events are generated, writing to `OS`. If
+/// `FlushBuffers` is nonzero, data is written on a background thread.
+static Option<BenchTime> TimeStreamEncode(ExiOptions& Opts, usize Sentences,
+                                          raw_ostream& OS, int Iters,
+                                          u32 FlushBuffers = 0) {
+  BenchTime Time {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    const auto Start = BenchClock::now();
+    ExiEncoder Encoder(Opts, errs());
+    ExiError E = Encoder.setWriter(OS);
+    if (!E && FlushBuffers)
+      E = Encoder.setBackgroundFlush(FlushBuffers);
+    StreamEncoder S(Encoder);
+    if (!E)
+      E = S.SD();
+    if (!E) {
+      TreebankEvents Emit {S};
+      GenerateTreebank(Emit, Sentences);
+      E = Emit.Err;
+    }
+    if (!E)
+      E = S.ED();
+    OS.flush();
+    Time += BenchClock::now() - Start;
+
+    if (E != ExiError::DONE) {
+      Encoder.diagnose(E);
+      return std::nullopt;
+    }
+  }
+  return Time;
+}
+
+/// Compares generating XML, parsing it and encoding the document against
+/// tokenizing it straight into the encoder, and encoding events as they are
+/// generated.
+static void BenchStreamEncoding(usize Sentences, int Iters) {
+  using enum raw_ostream::Colors;
+  ExiOptions Opts {.Alignment = AlignKind::BitPacked};
+  Opts.SchemaID.emplace(nullptr);
+
+  usize Size = 0;
+  SmallVec<char, 0> Out;
+  BenchTime DomTime {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    const auto Start = BenchClock::now();
+    SmallVec<char, 0> Text;
+    {
+      TreebankText Emit(Text);
+      GenerateTreebank(Emit, Sentences);
+    }
+    Size = Text.size();
+    Text.push_back('\0');
+
+    XMLDocument Doc;
+    Doc.parse<xml::parse_no_entity_translation>(Text.data());
+    auto Enc = TimeEncode(Doc, Opts, 1, Out);
+    DomTime += BenchClock::now() - Start;
+    if (!Enc) {
+      WithColor(errs(), BRIGHT_RED) << "Encoding treebank failed.\n";
+      return;
+    }
+  }
+
+  raw_null_ostream Null;
+  BenchTime TokTime {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    const auto Start = BenchClock::now();
+    SmallVec<char, 0> Text;
+    {
+      TreebankText Emit(Text);
+      GenerateTreebank(Emit, Sentences);
+    }
+
+    ExiEncoder Encoder(Opts, errs());
+    ExiError E = Encoder.setWriter(Null);
+    if (!E) {
+      StreamEncoder S(Encoder);
+      XMLTokenizer Tokenizer(StrRef(Text.data(), Text.size()));
+      E = Tokenizer.tokenize(S);
+    }
+    Null.flush();
+    TokTime += BenchClock::now() - Start;
+    if (E) {
+      Encoder.diagnose(E);
+      WithColor(errs(), BRIGHT_RED) << "Tokenizing treebank failed.\n";
+      return;
+    }
+  }
+
+  auto Streamed = TimeStreamEncode(Opts, Sentences, Null, Iters);
+  if (!Streamed) {
+    WithColor(errs(), BRIGHT_RED) << "Streaming treebank failed.\n";
+    return;
+  }
+
+  // Throughput is measured in terms of the equivalent XML.
+  const double MBytes = double(Size * Iters) / (1024.0 * 1024.0);
+  const double DomMs = DomTime.count();
+  const double TokMs = TokTime.count();
+  const double StreamMs = Streamed->count();
+  outs() << format("{: <24} {: >8} bytes  "
+                   "document: {: >7.1f}MB/s  tokenized: {: >7.1f}MB/s  "
+                   "streamed: {: >7.1f}MB/s  ({:.2f}x)\n",
+    "treebank (generated)", Size,
+    MBytes / (DomMs / 1000.0), MBytes / (TokMs / 1000.0),
+    MBytes / (StreamMs / 1000.0), DomMs / StreamMs);
+}
+
+namespace {
+/// A stream which takes time proportional to the data written, like slow
+/// storage. Writes sleep rather than spin, so other threads can run.
+class SlowStream : public raw_ostream {
+  std::chrono::duration<double, std::nano> PerByte;
+  u64 Pos = 0;
+
+  void write_impl(const char* Ptr, usize Size) override {
+    Pos += Size;
+    std::this_thread::sleep_for(Size * PerByte);
+  }
+  u64 current_pos() const override { return Pos; }
+
+public:
+  explicit SlowStream(double MBPerSec) : raw_ostream(/*unbuffered=*/true),
+   PerByte(1e9 / (MBPerSec * 1024.0 * 1024.0)) {}
+};
+} // namespace `anonymous`
+
+/// Compares flushing to slow storage on the encoding thread against
+/// flushing on a background thread, with two and four buffers.
+static void BenchBackgroundFlush(usize Sentences, int Iters) {
+  using enum raw_ostream::Colors;
+  ExiOptions Opts {.Alignment = AlignKind::BitPacked};
+  Opts.SchemaID.emplace(nullptr);
+
+  for (double Rate : {10.0, 50.0}) {
+    SlowStream OS(Rate);
+    auto Sync = TimeStreamEncode(Opts, Sentences, OS, Iters);
+    auto Double = TimeStreamEncode(Opts, Sentences, OS, Iters, 2);
+    auto Ring = TimeStreamEncode(Opts, Sentences, OS, Iters, 4);
+    if (!Sync || !Double || !Ring) {
+      WithColor(errs(), BRIGHT_RED) << "Streaming treebank failed.\n";
+      return;
+    }
+
+    const double SyncMs = Sync->count() / Iters;
+    const double DoubleMs = Double->count() / Iters;
+    const double RingMs = Ring->count() / Iters;
+    outs() << format("storage at {: >4.0f}MB/s  "
+                     "sync: {: >9.3f}ms  2 buffers: {: >9.3f}ms ({:.2f}x)  "
+                     "4 buffers: {: >9.3f}ms ({:.2f}x)\n",
+      Rate, SyncMs, DoubleMs, SyncMs / DoubleMs, RingMs, SyncMs / RingMs);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Transcoding
+
+/// How a stream is re-encoded.
+enum class TranscodeKind {
+  /// Decoded into a document, which is then encoded.
+  Document,
+  /// Decoded straight into a `StreamEncoder`.
+  Events,
+  /// Decoded with an `ExiTranscoder`.
+  Transcoder,
+};
+
+static Option<BenchTime> TimeTranscode(TranscodeKind Kind, MemoryBufferRef MB,
+                                       ExiOptions& InOpts, ExiOptions& OutOpts,
+                                       int Iters, SmallVecImpl<char>& Out) {
+  BenchTime Time {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    Out.clear();
+    const auto Start = BenchClock::now();
+    ExiError E = ExiError::OK;
+    if (Kind == TranscodeKind::Transcoder) {
+      ExiTranscoder Transcoder(InOpts, errs());
+      E = Transcoder.transcode(MB, OutOpts, Out);
+    } else {
+      ExiDecoder Decoder(InOpts, errs());
+      ExiEncoder Encoder(OutOpts, errs());
+      E = Decoder.decodeHeader(MB);
+      if (!E)
+        E = Encoder.setWriter(Out);
+      if (!E && Kind == TranscodeKind::Document) {
+        XMLSerializer S;
+        E = Decoder.decodeBody(S);
+        if (!E)
+          E = Encoder.encodeHeader();
+        if (!E)
+          E = Encoder.encodeBody(S.document());
+      } else if (!E) {
+        StreamEncoder S(Encoder);
+        E = Decoder.decodeBody(S);
+      }
+    }
+    Time += BenchClock::now() - Start;
+    if (E)
+      return std::nullopt;
+  }
+  return Time;
+}
+
+/// Compares re-encoding `MB` with `OutOpts` through a document, through
+/// events, and with the transcoder.
+static void BenchTranscodeStream(StrRef Name, MemoryBufferRef MB,
+                                 ExiOptions InOpts, ExiOptions OutOpts,
+                                 int Iters) {
+  using enum raw_ostream::Colors;
+  InOpts.SchemaID.emplace(nullptr);
+  OutOpts.SchemaID.emplace(nullptr);
+
+  SmallVec<char, 0> Out;
+  BenchTime Times[3] {};
+  for (TranscodeKind Kind : {TranscodeKind::Document, TranscodeKind::Events,
+                             TranscodeKind::Transcoder}) {
+    auto T = TimeTranscode(Kind, MB, InOpts, OutOpts, Iters, Out);
+    if (!T) {
+      WithColor(errs(), BRIGHT_RED) << "Transcoding " << Name << " failed.\n";
+      return;
+    }
+    Times[usize(Kind)] = *T;
+  }
+
+  // Throughput is measured in terms of the input.
+  const double MBytes = double(MB.getBufferSize() * Iters)
+    / (1024.0 * 1024.0);
+  auto Rate = [MBytes] (BenchTime T) {
+    return MBytes / (T.count() / 1000.0);
+  };
+  outs() << format("{: <24} {: >8} -> {: >8} bytes  "
+                   "document: {: >7.1f}MB/s  events: {: >7.1f}MB/s  "
+                   "transcoder: {: >7.1f}MB/s  ({:.2f}x)\n",
+    Name, MB.getBufferSize(), Out.size(),
+    Rate(Times[0]), Rate(Times[1]), Rate(Times[2]),
+    Times[0].count() / Times[2].count());
+}
+
+static void BenchTranscoding(XMLManager& Mgr, usize Sentences, int Iters) {
+  using enum exi::PreserveKind;
+  const auto Preserve = make_preserve_opts(Prefixes);
+  if (auto MB = LoadBenchFile(Mgr, "Orders.exi")) {
+    BenchTranscodeStream("Orders.exi (bit -> byte)", *MB,
+      {.Preserve = Preserve},
+      {.Alignment = AlignKind::BytePacked, .Preserve = Preserve}, Iters);
+  }
+
+  ExiOptions Opts {.Alignment = AlignKind::BitPacked};
+  Opts.SchemaID.emplace(nullptr);
+  SmallVec<char, 0> Treebank;
+  {
+    ExiEncoder Encoder(Opts, errs());
+    StreamEncoder S(Encoder);
+    ExiError E = Encoder.setWriter(Treebank);
+    if (!E)
+      E = S.SD();
+    if (!E) {
+      TreebankEvents Emit {S};
+      GenerateTreebank(Emit, Sentences);
+      E = Emit.Err;
+    }
+    if (!E)
+      E = S.ED();
+    if (E != ExiError::DONE) {
+      Encoder.diagnose(E);
+      return;
+    }
+  }
+
+  MemoryBufferRef MB(StrRef(Treebank.data(), Treebank.size()), "treebank");
+  BenchTranscodeStream("treebank (bit -> byte)", MB,
+    {.Alignment = AlignKind::BitPacked},
+    {.Alignment = AlignKind::BytePacked}, Iters);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Compression
+
+/// Encodes `Doc` bit-packed, pre-compressed and compressed.
+static void BenchCompressionDoc(StrRef Name, const XMLDocument& Doc,
+                                usize Size, ExiOptions::PreserveOpts Preserve,
+                                int Iters) {
+  SmallStr<64> Label;
+  auto Bench = [&] (StrRef Kind, ExiOptions Opts) {
+    Label.assign(Name);
+    Label.append(Kind);
+    Opts.Preserve = Preserve;
+    BenchEncodeDoc(Label.str(), Doc, Size, std::move(Opts), Iters);
+  };
+
+  Bench(" (bit)", {.Alignment = AlignKind::BitPacked});
+  Bench(" (pre-comp)", {.Alignment = AlignKind::PreCompression});
+  Bench(" (deflate)",
+    {.Alignment = AlignKind::PreCompression, .Compression = true});
+}
+
+static void BenchCompression(XMLManager& Mgr, usize Sentences, int Iters) {
+  using enum exi::PreserveKind;
+  const auto Preserve = make_preserve_opts(Prefixes);
+  if (auto MB = LoadBenchFile(Mgr, "Orders.exi")) {
+    // Sizes are relative to the bit-packed input.
+    ExiOptions Opts {.Preserve = Preserve};
+    Opts.SchemaID.emplace(nullptr);
+    ExiDecoder Decoder(Opts, errs());
+    XMLSerializer S;
+    ExiError E = Decoder.decodeHeader(*MB);
+    if (!E)
+      E = Decoder.decodeBody(S);
+    if (!E)
+      BenchCompressionDoc("Orders.exi", S.document(),
+        MB->getBufferSize(), Preserve, Iters);
+    else
+      Decoder.diagnose(E, /*Force=*/true);
+  }
+
+  SmallVec<char, 0> Treebank;
+  {
+    TreebankText Emit(Treebank);
+    GenerateTreebank(Emit, Sentences);
+  }
+  const usize Size = Treebank.size();
+  Treebank.push_back('\0');
+
+  XMLDocument Doc;
+  Doc.parse<xml::parse_no_entity_translation>(Treebank.data());
+  BenchCompressionDoc("treebank", Doc, Size, {}, Iters);
+}
+
+static void BenchBoundedTables(usize Sentences, int Iters) {
+  SmallVec<char, 0> Treebank;
+  {
+    TreebankText Emit(Treebank);
+    GenerateTreebank(Emit, Sentences);
+  }
+  const usize Size = Treebank.size();
+  Treebank.push_back('\0');
+
+  XMLDocument Doc;
+  Doc.parse<xml::parse_no_entity_translation>(Treebank.data());
+
+  SmallStr<64> Label;
+  for (u64 Capacity : {u64(0), u64(256), u64(4096), max_v<u64>}) {
+    ExiOptions Opts {.Alignment = AlignKind::BitPacked};
+    Label.clear();
+    raw_svector_ostream OS(Label);
+    if (Capacity != max_v<u64>) {
+      Opts.ValuePartitionCapacity = Capacity;
+      OS << "treebank (" << Capacity << ')';
+    } else
+      OS << "treebank (unbounded)";
+    BenchEncodeDoc(Label.str(), Doc, Size, std::move(Opts), Iters);
+  }
+}
+
+/// Encodes `Doc` with compression, using `Threads` workers when nonzero.
+static Option<BenchTime> TimeDeflate(const XMLDocument& Doc, ExiOptions& Opts,
+                                     unsigned Threads, int Iters,
+                                     SmallVecImpl<char>& Out) {
+  BenchTime Time {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    Out.clear();
+    const auto Start = BenchClock::now();
+    ExiError E = ExiError::OK;
+    {
+      ExiEncoder Encoder(Opts, errs());
+      E = Encoder.setWriter(Out);
+      if (!E && Threads)
+        E = Encoder.setParallelCompression(Threads);
+      if (!E)
+        E = Encoder.encodeHeader();
+      if (!E)
+        E = Encoder.encodeBody(Doc);
+      if (E)
+        Encoder.diagnose(E);
+    }
+    Time += BenchClock::now() - Start;
+    if (E)
+      return std::nullopt;
+  }
+  return Time;
+}
+
+/// Decodes compressed `MB`, inflating ahead when `Ahead` is set.
+static Option<BenchResult> TimeInflate(MemoryBufferRef MB, ExiOptions& Opts,
+                                       bool Ahead, int Iters) {
+  BenchResult Out;
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    ExiDecoder Decoder(Opts, errs());
+    Decoder.setInflateAhead(Ahead);
+    CountingSerializer S;
+
+    const auto Start = BenchClock::now();
+    ExiError E = Decoder.decodeHeader(MB);
+    if (!E)
+      E = Decoder.decodeBody(S);
+    Out.Time += BenchClock::now() - Start;
+
+    if (E) {
+      Decoder.diagnose(E, /*Force=*/true);
+      return std::nullopt;
+    }
+    Out.Events = S.Events;
+  }
+  return Out;
+}
+
+#if EXI_USE_THREADS
+static void BenchParallelCompression(usize Sentences, u64 BlockSize,
+                                     int Iters) {
+  using enum raw_ostream::Colors;
+  SmallVec<char, 0> Treebank;
+  {
+    TreebankText Emit(Treebank);
+    GenerateTreebank(Emit, Sentences);
+  }
+  const usize Size = Treebank.size();
+  Treebank.push_back('\0');
+
+  XMLDocument Doc;
+  Doc.parse<xml::parse_no_entity_translation>(Treebank.data());
+
+  ExiOptions Opts {
+    .Alignment = AlignKind::PreCompression,
+    .Compression = true,
+    .BlockSize = BlockSize
+  };
+  Opts.SchemaID.emplace(nullptr);
+
+  const unsigned Threads = std::max(std::thread::hardware_concurrency(), 1u);
+  SmallVec<char, 0> Serial, Parallel;
+  auto SerialEnc = TimeDeflate(Doc, Opts, 0, Iters, Serial);
+  auto ParallelEnc = TimeDeflate(Doc, Opts, Threads, Iters, Parallel);
+  if (!SerialEnc || !ParallelEnc || Serial != Parallel) {
+    WithColor(errs(), BRIGHT_RED) << "Parallel compression failed.\n";
+    return;
+  }
+
+  MemoryBufferRef MB(StrRef(Serial.data(), Serial.size()), "treebank");
+  auto SerialDec = TimeInflate(MB, Opts, /*Ahead=*/false, Iters);
+  auto AheadDec = TimeInflate(MB, Opts, /*Ahead=*/true, Iters);
+  if (!SerialDec || !AheadDec || SerialDec->Events != AheadDec->Events) {
+    WithColor(errs(), BRIGHT_RED) << "Inflating ahead failed.\n";
+    return;
+  }
+
+  // Throughput is measured in terms of the source XML.
+  const double MBytes = double(Size * Iters) / (1024.0 * 1024.0);
+  auto Rate = [MBytes] (BenchTime Time) {
+    return MBytes / (Time.count() / 1000.0);
+  };
+  outs() << format("{: <24} encode: {: >7.1f}MB/s -> {: >7.1f}MB/s "
+                   "({} threads)\n",
+    "treebank (deflate)", Rate(*SerialEnc), Rate(*ParallelEnc), Threads);
+  outs() << format("{: <24} decode: {: >7.1f}MB/s -> {: >7.1f}MB/s "
+                   "(inflate ahead)\n",
+    "", Rate(SerialDec->Time), Rate(AheadDec->Time));
+}
+#endif // EXI_USE_THREADS
+
+/// Generates a document of records, each holding a run of fields. Field
+/// names are drawn from `NTags` distinct names, so most events are
+/// SE(qname) productions of learned grammars.
+static void GenerateRecords(SmallVecImpl<char>& Out, usize Records,
+                            usize NTags) {
+  static constexpr StrRef Words[] {
+    "red", "green", "blue", "north", "south", "open", "closed", "none"
+  };
+
+  TreebankText Emit(Out);
+  SmallStr<16> Tag;
+  XorShift64 Rng;
+  Emit.open("records");
+  for (usize Ix = 0; Ix < Records; ++Ix) {
+    Emit.open("record");
+    for (usize N = 0, E = 4 + Rng() % 12; N < E; ++N) {
+      Tag.clear();
+      raw_svector_ostream(Tag) << 'f' << (Rng() % NTags);
+      Emit.open(Tag);
+      Emit.text(Words[Rng() % std::size(Words)]);
+      Emit.close(Tag);
+    }
+    Emit.close("record");
+  }
+  Emit.close("records");
+}
+
+static void BenchGrammarLookup(StrRef Name, SmallVecImpl<char>& Xml,
+                               int Iters) {
+  using enum raw_ostream::Colors;
+  Xml.push_back('\0');
+  XMLDocument Doc;
+  Doc.parse<xml::parse_no_entity_translation>(Xml.data());
+
+  for (AlignKind Align : {AlignKind::BitPacked, AlignKind::BytePacked}) {
+    ExiOptions Opts {.Alignment = Align};
+    Opts.SchemaID.emplace(nullptr);
+
+    SmallVec<char, 0> Out;
+    if (!TimeEncode(Doc, Opts, 1, Out)) {
+      WithColor(errs(), BRIGHT_RED) << "Encoding " << Name << " failed.\n";
+      return;
+    }
+
+    MemoryBufferRef MB(StrRef(Out.data(), Out.size()), Name);
+    auto Dec = TimeDecode<true>(MB, Opts, Iters);
+    if (!Dec) {
+      WithColor(errs(), BRIGHT_RED) << "Decoding " << Name << " failed.\n";
+      return;
+    }
+
+    // Millions of events per second.
+    const double MEvents = double(Dec->Events * Iters) / 1000.0;
+    outs() << format("{: <24} {: >8} events x{: <3} {}  "
+                     "decode: {: >9.3f}ms  {:.2f} Mev/s\n",
+      Name, Dec->Events, Iters,
+      (Align == AlignKind::BitPacked) ? "bit " : "byte",
+      Dec->Time.count(), MEvents / Dec->Time.count());
+  }
+}
+
+static void BenchGrammarLookups(usize Sentences, int Iters) {
+  {
+    SmallVec<char, 0> Treebank;
+    TreebankText Emit(Treebank);
+    GenerateTreebank(Emit, Sentences);
+    BenchGrammarLookup("treebank (12 tags)", Treebank, Iters);
+  }
+  for (usize NTags : {64, 4096}) {
+    SmallVec<char, 0> Records;
+    GenerateRecords(Records, Sentences * 2, NTags);
+    SmallStr<32> Label;
+    raw_svector_ostream(Label) << "records (" << NTags << " tags)";
+    BenchGrammarLookup(Label.str(), Records, Iters);
+  }
+}
+
+/// Generates a flat document of `Items` siblings, each with a few
+/// attributes and a short value.
+static void GenerateWide(SmallVecImpl<char>& Out, usize Items) {
+  static constexpr StrRef Words[] {
+    "red", "green", "blue", "north", "south", "open", "closed", "none"
+  };
+
+  raw_svector_ostream OS(Out);
+  XorShift64 Rng;
+  OS << "<items>";
+  for (usize Ix = 0; Ix < Items; ++Ix) {
+    OS << "<item id=\"" << Ix << "\" kind=\""
+       << Words[Rng() % std::size(Words)] << "\" rank=\"" << (Rng() % 100)
+       << "\">" << Words[Rng() % std::size(Words)] << "</item>";
+  }
+  OS << "</items>";
+}
+
+/// Generates `Chains` runs of elements nested `Depth` deep, each ending in a
+/// short value.
+static void GenerateDeep(SmallVecImpl<char>& Out, usize Chains,
+                         usize Depth) {
+  static constexpr StrRef Words[] {
+    "red", "green", "blue", "north", "south", "open", "closed", "none"
+  };
+
+  raw_svector_ostream OS(Out);
+  XorShift64 Rng;
+  OS << "<deep>";
+  for (usize Ix = 0; Ix < Chains; ++Ix) {
+    for (usize D = 0; D < Depth; ++D)
+      OS << "<d" << D << '>';
+    OS << Words[Rng() % std::size(Words)];
+    for (usize D = Depth; D-- > 0;)
+      OS << "</d" << D << '>';
+  }
+  OS << "</deep>";
+}
+
+/// Encodes a generated document, then compares virtual and static dispatch
+/// when decoding it.
+static void BenchGeneratedDispatch(StrRef Name, SmallVecImpl<char>& Xml,
+                                   int Iters) {
+  using enum raw_ostream::Colors;
+  Xml.push_back('\0');
+  XMLDocument Doc;
+  Doc.parse<xml::parse_no_entity_translation>(Xml.data());
+
+  ExiOptions Opts {};
+  Opts.SchemaID.emplace(nullptr);
+  SmallVec<char, 0> Out;
+  if (!TimeEncode(Doc, Opts, 1, Out)) {
+    WithColor(errs(), BRIGHT_RED) << "Encoding " << Name << " failed.\n";
+    return;
+  }
+
+  MemoryBufferRef MB(StrRef(Out.data(), Out.size()), Name);
+  BenchDispatch(Name, MB, Opts, Iters);
+}
+
+/// Loads the grammars of `Schema` from its XSD, with a new manager each time
+/// so nothing is reused, and then from a grammar cache written once.
+static void BenchGrammarCache(StrRef Schema, int Iters) {
+  using enum raw_ostream::Colors;
+  const StrRef Name = sys::path::filename(Schema);
+  auto Failed = [Name] (StrRef What) {
+    WithColor(errs(), BRIGHT_RED) << What << ' ' << Name << " failed.\n";
+  };
+
+  // Sources are hashed as they would be when caching.
+  BenchTime Cold {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    XMLManagerRef Mgr = make_refcounted<XMLManager>();
+    XSDSources Sources;
+    const auto Start = BenchClock::now();
+    auto GrammarsOrErr = loadXSDGrammars(*Mgr, Schema, &Sources);
+    Cold += BenchClock::now() - Start;
+    if (!GrammarsOrErr) {
+      consumeError(GrammarsOrErr.takeError());
+      return Failed("Loading");
+    }
+  }
+
+  XMLManagerRef Mgr = make_refcounted<XMLManager>();
+  XSDSources Sources;
+  auto GrammarsOrErr = loadXSDGrammars(*Mgr, Schema, &Sources);
+  if (!GrammarsOrErr) {
+    consumeError(GrammarsOrErr.takeError());
+    return Failed("Loading");
+  }
+
+  SmallStr<128> CachePath;
+  if (sys::fs::createTemporaryFile("exi-bench", "exig", CachePath))
+    return Failed("Caching");
+  auto Cleanup = make_scope_exit([&CachePath] {
+    sys::fs::remove(CachePath);
+  });
+
+  const MD5::MD5Result Hash = Sources.Hash.final();
+  Error E = writeToOutput(CachePath, [&] (raw_ostream& OS) {
+    writeSchemaCache(OS, (*GrammarsOrErr)->tables(), Sources.Paths, Hash);
+    return Error::success();
+  });
+  if (E) {
+    consumeError(std::move(E));
+    return Failed("Caching");
+  }
+
+  BenchTime Cached {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    const auto Start = BenchClock::now();
+    SchemaGrammarsRef Mapped = loadSchemaCache(CachePath);
+    Cached += BenchClock::now() - Start;
+    if (!Mapped)
+      return Failed("Mapping");
+  }
+
+  // Microseconds per load.
+  const double Scale = 1000.0 / Iters;
+  outs() << format("{: <24} xsd: {: >9.3f}us  cached: {: >9.3f}us  "
+                   "({:.2f}x)\n",
+    Name, Cold.count() * Scale, Cached.count() * Scale,
+    Cold.count() / Cached.count());
+}
+
+/// Encodes `Records` records, each a self-contained element holding a run
+/// of fields.
+static ExiError EncodeSCRecords(ExiOptions& Opts, usize Records,
+                                SmallVecImpl<char>& Out) {
+  static constexpr StrRef Words[] {
+    "red", "green", "blue", "north", "south", "open", "closed", "none"
+  };
+
+  ExiEncoder Encoder(Opts, errs());
+  XorShift64 Rng;
+  SmallStr<16> Tag;
+  auto Body = [&] () -> ExiError {
+    exi_try(Encoder.setWriter(Out));
+    exi_try(Encoder.encodeHeader());
+    exi_try(Encoder.encodeSD());
+    exi_try(Encoder.encodeSE(QName{.Name = "records"}));
+    for (usize Ix = 0; Ix < Records; ++Ix) {
+      const QName Record {.Name = "record"};
+      exi_try(Encoder.encodeSE(Record));
+      exi_try(Encoder.encodeSC(Record));
+      exi_try(Encoder.encodeAT(QName{.Name = "id"}, Twine(Ix).str()));
+      for (usize N = 0; N < 16; ++N) {
+        Tag.clear();
+        raw_svector_ostream(Tag) << 'f' << (Rng() % 32);
+        exi_try(Encoder.encodeSE(QName{.Name = Tag.str()}));
+        exi_try(Encoder.encodeCH(Words[Rng() % std::size(Words)]));
+        exi_try(Encoder.encodeEE());
+      }
+      exi_try(Encoder.encodeEE());
+    }
+    exi_try(Encoder.encodeEE());
+    return Encoder.encodeED();
+  };
+
+  ExiError E = Body();
+  if (E)
+    Encoder.diagnose(E);
+  return E;
+}
+
+/// Compares decoding SC records in place with building an index of them,
+/// and then decoding the fragments from the index.
+static void BenchSCFragments(usize Records, int Iters) {
+  using enum raw_ostream::Colors;
+  ExiOptions Opts {.SelfContained = true};
+  Opts.SchemaID.emplace(nullptr);
+
+  SmallVec<char, 0> Out;
+  if (EncodeSCRecords(Opts, Records, Out))
+    return;
+  const StrRef Data(Out.data(), Out.size());
+  const MemoryBufferRef MB(Data, "SC records");
+
+  auto Serial = TimeDecode<true>(MB, Opts, Iters);
+  if (!Serial) {
+    WithColor(errs(), BRIGHT_RED) << "Decoding SC records failed.\n";
+    return;
+  }
+
+  // Built as cheaply as possible, without a serializer.
+  SCIndex Index;
+  BenchTime Indexing {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    Index.clear();
+    ExiDecoder Decoder(Opts, errs());
+    Decoder.setSCIndex(&Index);
+    const auto Start = BenchClock::now();
+    ExiError E = Decoder.decodeHeader(MB);
+    if (!E)
+      E = Decoder.decodeBody();
+    Indexing += BenchClock::now() - Start;
+    if (E) {
+      Decoder.diagnose(E, /*Force=*/true);
+      return;
+    }
+  }
+
+  BenchTime Fragments {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    SmallVec<CountingSerializer, 0> Counters(Index.size());
+    const auto Start = BenchClock::now();
+    ExiError E = decodeSCFragments(Data, Index, Opts,
+      [&Counters] (usize Ix) -> Serializer* { return &Counters[Ix]; });
+    Fragments += BenchClock::now() - Start;
+    if (E) {
+      WithColor(errs(), BRIGHT_RED) << "Decoding SC fragments failed.\n";
+      return;
+    }
+  }
+
+  const double SerialMs = Serial->Time.count();
+  const double IndexMs = Indexing.count();
+  const double FragmentsMs = Fragments.count();
+  outs() << format("{: >6} fragments x{: <3} serial: {: >9.3f}ms  "
+                   "index: {: >9.3f}ms  fragments: {: >9.3f}ms  "
+                   "(both {:.2f}x)\n",
+    Index.size(), Iters, SerialMs, IndexMs, FragmentsMs,
+    SerialMs / (IndexMs + FragmentsMs));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// XML Parsing
+
+/// Counts every node and attribute in `Doc`, touching their names.
+static u64 WalkDocument(const XMLDocument& Doc, u64& Bytes) {
+  u64 Nodes = 0;
+  const XMLNode* Node = Doc.first_node();
+  while (Node) {
+    ++Nodes;
+    Bytes += Node->name_size() + Node->value_size();
+    for (const XMLAttribute* Attr = Node->first_attribute();
+         Attr; Attr = Attr->next_attribute()) {
+      ++Nodes;
+      Bytes += Attr->name_size() + Attr->value_size();
+    }
+
+    if (const XMLNode* Child = Node->first_node()) {
+      Node = Child;
+      continue;
+    }
+    // Ascend until there is a sibling, stopping at the document.
+    while (!Node->next_sibling()) {
+      Node = Node->parent();
+      if (!Node || Node->type() == NodeKind::node_document)
+        return Nodes;
+    }
+    Node = Node->next_sibling();
+  }
+  return Nodes;
+}
+
+/// Parses `Text`, which must be null terminated, and walks the document.
+static BenchResult TimeRapidXML(StrRef Text, int Iters) {
+  constexpr int kFlags = xml::parse_no_entity_translation
+                       | xml::parse_non_destructive
+                       | xml::parse_all;
+  BenchResult Out;
+  u64 Bytes = 0;
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    const auto Start = BenchClock::now();
+    XMLDocument Doc;
+    Doc.parse<kFlags>(const_cast<char*>(Text.data()));
+    Out.Events = WalkDocument(Doc, Bytes);
+    Out.Time += BenchClock::now() - Start;
+  }
+  return Out;
+}
+
+static Option<BenchResult> TimeTokenizer(StrRef Text, int Iters) {
+  BenchResult Out;
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    CountingSerializer S;
+    const auto Start = BenchClock::now();
+    XMLTokenizer Tokenizer(Text);
+    const ExiError E = Tokenizer.tokenize(S);
+    Out.Time += BenchClock::now() - Start;
+    if (E)
+      return std::nullopt;
+    Out.Events = S.Events;
+  }
+  return Out;
+}
+
+void root::BenchXMLParse(StrRef Name, StrRef Text, int Iters) {
+  using enum raw_ostream::Colors;
+  // rapidxml needs a null terminated buffer.
+  SmallVec<char, 0> Buffer(Text.begin(), Text.end());
+  Buffer.push_back('\0');
+  const StrRef Terminated(Buffer.data(), Text.size());
+
+  const BenchResult Dom = TimeRapidXML(Terminated, Iters);
+  auto Tok = TimeTokenizer(Terminated, Iters);
+  if (!Tok) {
+    WithColor(errs(), BRIGHT_RED) << "Tokenizing " << Name << " failed.\n";
+    return;
+  }
+
+  const double MBytes = double(Text.size() * Iters) / (1024.0 * 1024.0);
+  const double DomMs = Dom.Time.count();
+  const double TokMs = Tok->Time.count();
+  outs() << format("{: <24} {: >8} bytes  "
+                   "rapidxml: {: >7.1f}MB/s  tokenizer: {: >7.1f}MB/s  "
+                   "({:.2f}x, {} nodes / {} events)\n",
+    Name, Text.size(),
+    MBytes / (DomMs / 1000.0), MBytes / (TokMs / 1000.0),
+    DomMs / TokMs, Dom.Events, Tok->Events);
+}
+
+void root::BenchXMLParse(const Twine& Filepath, int Iters) {
+  SmallStr<80> Storage;
+  const StrRef Name = Filepath.toStrRef(Storage);
+  // The manager's buffers may already have been parsed in place.
+  auto Xml = MemoryBuffer::getFile(Name);
+  if (!Xml) {
+    WithColor(errs(), raw_ostream::BRIGHT_RED)
+      << "Could not locate " << Name << '\n';
+    return;
+  }
+  root::BenchXMLParse(Name, (*Xml)->getBuffer(), Iters);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UInt Decoding
+
+static void EncodeUInt(SmallVecImpl<u8>& Out, u64 Value) {
+  while (Value >= 0x80) {
+    Out.push_back(u8(Value & 0x7F) | 0x80);
+    Value >>= 7;
+  }
+  Out.push_back(u8(Value));
+}
+
+/// Shifts the stream right by `Bits`, so no read is byte-aligned.
+static SmallVec<u8, 0> MisalignBytes(ArrayRef<u8> Bytes, unsigned Bits) {
+  SmallVec<u8, 0> Out;
+  Out.reserve(Bytes.size() + 1);
+  u8 Last = 0;
+  for (u8 Byte : Bytes) {
+    Out.push_back(u8(Last << (8 - Bits)) | u8(Byte >> Bits));
+    Last = Byte;
+  }
+  Out.push_back(u8(Last << (8 - Bits)));
+  return Out;
+}
+
+template <class ReaderT>
+static Option<BenchTime> TimeUInts(ArrayRef<u8> Data, unsigned SkipBits,
+                                   usize Count, u64 Expected, int Iters) {
+  BenchTime Time {};
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    ReaderT Reader(Data);
+    u64 Sum = 0;
+
+    const auto Start = BenchClock::now();
+    if (SkipBits && Reader.readBits64(SkipBits).is_err())
+      return std::nullopt;
+    for (usize N = 0; N < Count; ++N) {
+      auto R = Reader.readUInt();
+      if EXI_UNLIKELY(R.is_err())
+        return std::nullopt;
+      Sum += *R;
+    }
+    Time += BenchClock::now() - Start;
+
+    if (Sum != Expected)
+      return std::nullopt;
+  }
+  return Time;
+}
+
+static void BenchUIntDecoding(const UIntDist& Dist) {
+  using enum raw_ostream::Colors;
+  constexpr usize Count = 1 << 16;
+  constexpr int Iters = 200;
+
+  XorShift64 Rng;
+  SmallVec<u8, 0> Bytes;
+  u64 Expected = 0;
+  for (usize N = 0; N < Count; ++N) {
+    const u64 Value = Dist.Gen(Rng);
+    EncodeUInt(Bytes, Value);
+    Expected += Value;
+  }
+  const auto Bits = MisalignBytes(Bytes, 3);
+
+  auto Aligned   = TimeUInts<BitReader>(Bytes, 0, Count, Expected, Iters);
+  auto Unaligned = TimeUInts<BitReader>(Bits,  3, Count, Expected, Iters);
+  auto Byte      = TimeUInts<ByteReader>(Bytes, 0, Count, Expected, Iters);
+  if (!Aligned || !Unaligned || !Byte) {
+    WithColor(errs(), BRIGHT_RED) << "Decoding " << Dist.Name << " failed.\n";
+    return;
+  }
+
+  // Nanoseconds per UInt.
+  const double Scale = 1e6 / double(Count * Iters);
+  outs() << format("{: <20} {:.2f} octets/uint  "
+                   "bit: {: >6.2f}ns  bit+3: {: >6.2f}ns  byte: {: >6.2f}ns\n",
+    Dist.Name, double(Bytes.size()) / double(Count),
+    Aligned->count() * Scale, Unaligned->count() * Scale,
+    Byte->count() * Scale);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// String Decoding
+
+struct StringDist {
+  StrRef Name;
+  u64 MinLen, MaxLen;
+  /// Chance of a non-ASCII codepoint, out of 1000.
+  u64 NonASCII;
+};
+
+template <class ReaderT>
+static Option<BenchTime> TimeStrings(ArrayRef<u8> Data, unsigned SkipBits,
+                                     usize Count, u64 Expected, int Iters) {
+  BenchTime Time {};
+  SmallStr<256> Str;
+  for (int Ix = 0; Ix < Iters; ++Ix) {
+    ReaderT Reader(Data);
+    u64 Sum = 0;
+
+    const auto Start = BenchClock::now();
+    if (SkipBits && Reader.readBits64(SkipBits).is_err())
+      return std::nullopt;
+    for (usize N = 0; N < Count; ++N) {
+      auto R = Reader.decodeString(Str);
+      if EXI_UNLIKELY(R.is_err())
+        return std::nullopt;
+      for (char C : *R)
+        Sum += u8(C);
+    }
+    Time += BenchClock::now() - Start;
+
+    if (Sum != Expected)
+      return std::nullopt;
+  }
+  return Time;
+}
+
+static void BenchStringDecoding(const StringDist& Dist) {
+  using enum raw_ostream::Colors;
+  constexpr usize Count = 1 << 12;
+  constexpr int Iters = 50;
+
+  XorShift64 Rng;
+  SmallVec<u8, 0> Bytes;
+  u64 Expected = 0, Chars = 0;
+  for (usize N = 0; N < Count; ++N) {
+    const u64 Len = Dist.MinLen + Rng() % (Dist.MaxLen - Dist.MinLen + 1);
+    EncodeUInt(Bytes, Len);
+    for (u64 Ix = 0; Ix < Len; ++Ix) {
+      const bool IsASCII = (Rng() % 1000) >= Dist.NonASCII;
+      const Rune C = IsASCII ? Rune(' ' + Rng() % 95) : Rune(0xE01 + Rng() % 48);
+      EncodeUInt(Bytes, C);
+      const RuneBuf Buf = RuneEncoder::Encode(C);
+      for (char Octet : Buf.str())
+        Expected += u8(Octet);
+    }
+    Chars += Len;
+  }
+  const auto Bits = MisalignBytes(Bytes, 3);
+
+  auto Aligned   = TimeStrings<BitReader>(Bytes, 0, Count, Expected, Iters);
+  auto Unaligned = TimeStrings<BitReader>(Bits,  3, Count, Expected, Iters);
+  auto Byte      = TimeStrings<ByteReader>(Bytes, 0, Count, Expected, Iters);
+  if (!Aligned || !Unaligned || !Byte) {
+    WithColor(errs(), BRIGHT_RED) << "Decoding " << Dist.Name << " failed.\n";
+    return;
+  }
+
+  // Nanoseconds per codepoint.
+  const double Scale = 1e6 / double(Chars * Iters);
+  outs() << format("{: <20} bit: {: >6.2f}ns  bit+3: {: >6.2f}ns  "
+                   "byte: {: >6.2f}ns\n",
+    Dist.Name, Aligned->count() * Scale, Unaligned->count() * Scale,
+    Byte->count() * Scale);
+}
+
+void root::RunBenchmarks(XMLManager& Mgr) {
+  using enum exi::PreserveKind;
+  ScopedSave S(DebugFlag, LogLevel::ERROR);
+
+  const BenchFile Files[] {
+    {"SpecExample.exi",     AlignKind::BitPacked,  {}, 20'000},
+    {"SpecExampleB.exi",    AlignKind::BytePacked, {}, 20'000},
+    {"BasicNoopt.exi",      AlignKind::BitPacked,  {}, 20'000},
+    {"BasicNooptB.exi",     AlignKind::BytePacked, {}, 20'000},
+    {"CustomersNoopt.exi",  AlignKind::BitPacked,
+      make_preserve_opts(Prefixes), 20'000},
+    {"CustomersNooptB.exi", AlignKind::BytePacked,
+      make_preserve_opts(Prefixes), 20'000},
+    {"NamespaceNoopt.exi",  AlignKind::BitPacked,
+      make_preserve_opts(All & ~LexicalValues), 20'000},
+    // Has a lot of data with minimal distinct keys.
+    {"Orders.exi",          AlignKind::BitPacked,
+      make_preserve_opts(Prefixes), 20},
+  };
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "Serializer dispatch (virtual vs. static):\n";
+  for (const BenchFile& File : Files)
+    BenchSerializerDispatch(Mgr, File);
+  {
+    SmallVec<char, 0> Wide;
+    GenerateWide(Wide, 50'000);
+    BenchGeneratedDispatch("wide (generated)", Wide, 20);
+    SmallVec<char, 0> Deep;
+    GenerateDeep(Deep, 2'000, 48);
+    BenchGeneratedDispatch("deep (generated)", Deep, 20);
+  }
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nBorrowed input (byte-aligned only):\n";
+  for (const BenchFile& File : Files) {
+    if (File.Alignment == AlignKind::BytePacked)
+      BenchBorrowInput(Mgr, File);
+  }
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nChunked input (whole buffer vs. fed in chunks):\n";
+  for (const BenchFile& File : Files)
+    BenchChunkedInput(Mgr, File);
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nDecoder reuse (per stream, new decoder vs. reset):\n";
+  for (const BenchFile& File : Files)
+    BenchDecoderReuse(Mgr, File);
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nCursor decoding (serializer vs. per-event vs. batched):\n";
+  for (const BenchFile& File : Files)
+    BenchCursor(Mgr, File);
+
+  const EncodeFile EncodeFiles[] {
+    {"SpecExample.xml", AlignKind::BitPacked,  {}, 20'000},
+    {"SpecExample.xml", AlignKind::BytePacked, {}, 20'000},
+    {"Basic.xml",       AlignKind::BitPacked,  {}, 20'000},
+    {"Customers.xml",   AlignKind::BitPacked,
+      make_preserve_opts(Prefixes), 20'000},
+    {"Namespace.xml",   AlignKind::BitPacked,
+      make_preserve_opts(All & ~LexicalValues), 20'000},
+  };
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nEncoding (from a parsed document, throughput of the source):\n";
+  for (const EncodeFile& File : EncodeFiles)
+    BenchEncoding(Mgr, File);
+
+  {
+    SmallVec<char, 0> Treebank;
+    {
+      TreebankText Emit(Treebank);
+      GenerateTreebank(Emit, 50'000);
+    }
+    const usize Size = Treebank.size();
+    Treebank.push_back('\0');
+
+    XMLDocument Doc;
+    Doc.parse<xml::parse_no_entity_translation>(Treebank.data());
+    BenchEncodeDoc("treebank (generated)", Doc, Size,
+      {.Alignment = AlignKind::BitPacked}, 5);
+    BenchEncodeDoc("treebank (generated, B)", Doc, Size,
+      {.Alignment = AlignKind::BytePacked}, 5);
+  }
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nStreaming encoding (parsed document vs. tokenized vs. events):\n";
+  BenchStreamEncoding(50'000, 5);
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nBackground flushing (treebank, per stream):\n";
+  BenchBackgroundFlush(50'000, 5);
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nTranscoding (document vs. events vs. transcoder):\n";
+  BenchTranscoding(Mgr, 50'000, 5);
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nCompression (bit vs. pre-compression vs. DEFLATE):\n";
+  BenchCompression(Mgr, 50'000, 5);
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nBounded value tables (by ValuePartitionCapacity):\n";
+  BenchBoundedTables(50'000, 5);
+
+#if EXI_USE_THREADS
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nParallel compression (serial vs. worker pool, per stream):\n";
+  BenchParallelCompression(50'000, 10'000, 5);
+#endif
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nGrammar lookup (element-heavy schemaless decoding):\n";
+  BenchGrammarLookups(50'000, 5);
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nGrammar caches (per load, from the XSD vs. mapped):\n";
+  for (StrRef Schema : {"examples/IPO.xsd", "examples/SpecExample.xsd",
+                        "vendored/exip/examples/simpleEncoding/exipe-test.xsd"})
+    BenchGrammarCache(Schema, 200);
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nSelf-contained records (in place vs. indexed fragments):\n";
+  BenchSCFragments(20'000, 5);
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nXML parsing (rapidxml document vs. tokenizer events):\n";
+  for (StrRef Name : {"examples/SpecExample.xml", "examples/Basic.xml",
+                      "examples/Customers.xml", "examples/Namespace.xml",
+                      "examples/Thai.xml"})
+    root::BenchXMLParse(Name, 20'000);
+  {
+    SmallVec<char, 0> Treebank;
+    TreebankText Emit(Treebank);
+    GenerateTreebank(Emit, 50'000);
+    root::BenchXMLParse("treebank (generated)",
+      StrRef(Treebank.data(), Treebank.size()), 5);
+  }
+
+  // Lengths and IDs are mostly small, with a long tail.
+  const UIntDist Dists[] {
+    {"ids [0, 2^7)", [] (XorShift64& Rng) -> u64 {
+      return Rng() % 128;
+    }},
+    {"lengths", [] (XorShift64& Rng) -> u64 {
+      const u64 Kind = Rng() % 100;
+      if (Kind < 80)
+        return Rng() % 64;
+      return Rng() % (Kind < 97 ? 4096 : (1 << 20));
+    }},
+    {"mixed [1, 4] octets", [] (XorShift64& Rng) -> u64 {
+      const u64 Bits = 7 * (1 + Rng() % 4);
+      return Rng() & ((u64(1) << Bits) - 1);
+    }},
+    {"wide [5, 8] octets", [] (XorShift64& Rng) -> u64 {
+      const u64 Bits = 7 * (5 + Rng() % 4);
+      return Rng() & ((u64(1) << Bits) - 1);
+    }},
+  };
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nUInt decoding (per uint):\n";
+  for (const UIntDist& Dist : Dists)
+    BenchUIntDecoding(Dist);
+
+  const StringDist Strings[] {
+    {"short ascii",     1,    16,   0},
+    {"medium ascii",    16,   128,  0},
+    {"long ascii",      256,  2048, 0},
+    {"long 2% unicode", 256,  2048, 20},
+    {"medium unicode",  16,   128,  1000},
+  };
+
+  WithColor(outs(), raw_ostream::BRIGHT_WHITE)
+    << "\nString decoding (per codepoint):\n";
+  for (const StringDist& Dist : Strings)
+    BenchStringDecoding(Dist);
+}
@@ -88,19 +88,37 @@ include_items(EXICPP_SRC "lib/exi"
   Basic/XML.cpp
   Basic/XMLContainer.cpp
   Basic/XMLManager.cpp
+  Basic/XMLNames.cpp
+  Basic/XMLTokenizer.cpp
 
   Decode/BodyDecoder.cpp
+  Decode/EventCursor.cpp
   Decode/HeaderDecoder.cpp
+  Decode/SelfContained.cpp
   Decode/Serializer.cpp
   Decode/StringTables.cpp
+  Decode/TypedValues.cpp
 
+  Encode/BodyEncoder.cpp
   Encode/HeaderEncoder.cpp
+  Encode/StreamEncoder.cpp
   Encode/StringTables.cpp
+  Encode/Transcoder.cpp
 
   Grammar/Grammar.cpp
   #Grammar/Schema.cpp
+  Grammar/SchemaBuilder.cpp
+  Grammar/SchemaCache.cpp
+  Grammar/SchemaGrammars.cpp
+  Grammar/SchemaLoader.cpp
   Grammar/Decode/BuiltinSchema.cpp
+  Grammar/Decode/DynamicSchema.cpp
+  Grammar/Encode/BuiltinSchema.cpp
 
+  Stream/BackgroundFlusher.cpp
+  Stream/ChannelReader.cpp
+  Stream/ChannelWriter.cpp
+  Stream/ChunkedInput.cpp
   Stream/Stream.cpp
 )
 
@@ -109,11 +127,63 @@ add_library(exi::exicpp ALIAS exicpp)
 
 target_include_directories(exicpp PUBLIC include)
 target_link_libraries(exicpp PUBLIC exi::core rapidxml::rapidxml)
+if(EXI_USE_THREADS)
+  # Used for decoding self-contained fragments in parallel.
+  find_package(Threads REQUIRED)
+  target_link_libraries(exicpp PRIVATE Threads::Threads)
+endif()
+if(EXI_USE_ZLIB)
+  # Used for DEFLATE in compressed streams.
+  find_package(ZLIB REQUIRED)
+  target_link_libraries(exicpp PRIVATE ZLIB::ZLIB)
+endif()
 target_compile_options(exicpp PRIVATE ${EXI_WARNING_FLAGS})
 
+if(EXI_SCHEMAC)
+  add_executable(exi-schemac tools/SchemaCompiler.cpp)
+  target_link_libraries(exi-schemac exi::exicpp)
+  target_compile_options(exi-schemac PRIVATE ${EXI_WARNING_FLAGS})
+endif()
+
+# Compiles the XSD at SCHEMA to C++ with exi-schemac, and adds it to TARGET.
+# The schema is declared as `exi::schemas::NAME` in "NAME.hpp", for streams
+# with the schemaId ID (SCHEMA by default). Only SCHEMA itself is tracked,
+# changes to the schemas it includes don't trigger a rebuild.
+function(exi_add_schema TARGET NAME SCHEMA)
+  cmake_parse_arguments(ARG "" "ID" "" ${ARGN})
+  if(NOT TARGET exi-schemac)
+    message(FATAL_ERROR "exi_add_schema requires EXI_SCHEMAC.")
+  endif()
+  if(NOT ARG_ID)
+    set(ARG_ID ${SCHEMA})
+  endif()
+
+  get_filename_component(SCHEMA_PATH ${SCHEMA} ABSOLUTE)
+  set(OUT_DIR ${CMAKE_CURRENT_BINARY_DIR}/schemas)
+  add_custom_command(
+    OUTPUT ${OUT_DIR}/${NAME}.hpp ${OUT_DIR}/${NAME}.cpp
+    COMMAND ${CMAKE_COMMAND} -E make_directory ${OUT_DIR}
+    COMMAND exi-schemac ${SCHEMA_PATH} -name ${NAME} -id ${ARG_ID} -o ${OUT_DIR}
+    DEPENDS exi-schemac ${SCHEMA_PATH}
+    COMMENT "Compiling schema ${SCHEMA}"
+    VERBATIM
+  )
+
+  target_sources(${TARGET} PRIVATE ${OUT_DIR}/${NAME}.cpp)
+  # The generated schemas only reach the decoder internals through the
+  # support header in lib/exi/Grammar/Compiled.
+  target_include_directories(${TARGET} PRIVATE ${OUT_DIR}
+    ${EXI_BASE_FOLDER}/lib/exi/Grammar/Compiled)
+endfunction()
+
 if(PROJECT_IS_TOP_LEVEL OR EXICPP_DRIVER)
   add_executable(exi-driver Driver.cpp
-    DriverTests.cpp XMLDumper.cpp)
+    DriverBench.cpp DriverTests.cpp XMLDumper.cpp)
   target_link_libraries(exi-driver exi::exicpp)
   exi_minject(exi-driver CLASSIC BACKUP)
+  if(EXI_SCHEMAC)
+    exi_add_schema(exi-driver EmptyTypes
+      vendored/exip/tests/test-set/EmptyTypes/emptyTypeSchema.xsd)
+    target_compile_definitions(exi-driver PRIVATE EXI_COMPILED_SCHEMAS=1)
+  endif()
 endif()
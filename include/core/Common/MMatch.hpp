@@ -25,6 +25,7 @@
 #pragma once
 
 #include <Common/Features.hpp>
+#include <Common/Fundamental.hpp>
 #include <type_traits>
 
 namespace exi {
@@ -94,6 +94,9 @@ public:
     Elts[Size - 1] = GetNewElt(Key);
     return Elts[Size - 1].Value;
   }
+
+  /// Removes all entries from the cache.
+  void clear() { Size = 0; }
 };
 
 } // namespace exi
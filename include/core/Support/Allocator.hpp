@@ -461,6 +461,8 @@ public:
   Option<i64> identifyObject(const void *Ptr) const {
     return Allocator.identifyObject(Ptr);
   }
+
+  usize getTotalMemory() const { return Allocator.getTotalMemory(); }
 };
 
 } // namespace exi
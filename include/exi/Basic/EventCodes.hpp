@@ -85,6 +85,10 @@ enum : u64 {
   kInvalidTerm    = u64(EventTerm::Invalid),
   /// Invalid Value for `EventUID`.
   kInvalidVID     = 0xFFFFFFFFFFFF,
+  /// Empty Value for `EventUID`, these are never added to the tables.
+  kEmptyVID       = kInvalidVID - 1,
+  /// Value for `EventUID` which was not added to the bounded tables.
+  kTransientVID   = kInvalidVID - 2,
 };
 
 /// A compressed version of a QName, only represents IDs.
@@ -214,7 +218,18 @@ public:
     return {.ValueID = ID, .IsLocal = false};
   }
 
-  /// Creates a new unbound GlobalValue.
+  /// Creates a new empty value, which has no table entry.
+  static constexpr EventUID NewEmptyValue() {
+    return {.ValueID = kEmptyVID, .IsLocal = false};
+  }
+
+  /// Creates a new value which was not added to the tables, as they are
+  /// bounded. Only the most recent is kept.
+  static constexpr EventUID NewTransientValue() {
+    return {.ValueID = kTransientVID, .IsLocal = false};
+  }
+
+  /// Creates a new unbound LocalValue.
   static constexpr EventUID NewLocalValue(SmallQName Name, u64 ID) {
     return {.ValueID = ID, .IsLocal = true, .Name = Name};
   }
@@ -243,6 +258,14 @@ public:
   constexpr bool hasValue() const {
     return ValueID != kInvalidVID;
   }
+  /// Checks if the value is empty.
+  constexpr bool isEmptyValue() const {
+    return ValueID == kEmptyVID;
+  }
+  /// Checks if the value was not added to the tables.
+  constexpr bool isTransientValue() const {
+    return ValueID == kTransientVID;
+  }
 
   /// Checks if Prefix is active.
   constexpr bool isGlobal() const { return !IsLocal; }
@@ -385,4 +385,12 @@ bool encodeRunes(ArrayRef<Rune> Runes, SmallVecImpl<char>& Chars);
 /// Only use when you know the data is definitely valid.
 bool encodeRunesUnchecked(ArrayRef<Rune> Runes, SmallVecImpl<char>& Chars);
 
+/// Returns the length of the leading run of ASCII bytes in `Bytes`. In EXI
+/// strings, these are exactly the single octet codepoints.
+usize countASCIIPrefix(ArrayRef<u8> Bytes);
+
+/// Returns the number of codepoints in the UTF8 string `Str`. This is the
+/// length written before EXI strings. Assumes the input is valid.
+usize countRunes(StrRef Str);
+
 } // namespace exi
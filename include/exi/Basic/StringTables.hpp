@@ -48,6 +48,7 @@
 namespace exi {
 
 struct ExiOptions;
+struct SchemaTables;
 
 //===----------------------------------------------------------------===//
 // Decoding
@@ -77,22 +78,40 @@ struct URIInfo {
 
 /// The value stored for each entry in the LocalName map.
 struct LocalName {
-  using value_type = SmallVec<InlineStr*, 2>;
+  using value_type = SmallVec<StrRef, 2>;
   StrRef Name; /// namespace:[local-name]
   InlineStr* FullName = nullptr; /// [namespace:local-name]
   value_type LocalValues;
+  /// The ID of `LocalValues[0]`. Values removed from bounded tables leave
+  /// their IDs vacant, and leading vacant IDs are trimmed.
+  CompactID Offset = 0;
+  /// The number of vacant IDs at the front of `LocalValues`.
+  u32 NVacant = 0;
 public:
+  /// Returns the number of IDs assigned, including vacant ones.
+  CompactID size() const { return Offset + LocalValues.size(); }
   /// Returns the minimum bits required for current amount of local values.
   u32 bits() const {
     // exi_invariant(not LocalValues.empty());
-    return CompactIDLog2(LocalValues.size() + 1);
+    return CompactIDLog2(size() + 1);
   }
   /// Returns the minimum bytes required for current amount of local values.
   u32 bytes() const {
-    if EXI_UNLIKELY(LocalValues.empty())
+    if EXI_UNLIKELY(size() == 0)
       return 0;
     return (bits() / 8) + 1u;
   }
+
+  /// Returns the value with `ID`, which is empty if it was removed.
+  StrRef get(CompactID ID) const {
+    exi_invariant(ID < size());
+    if EXI_UNLIKELY(ID < Offset)
+      return StrRef();
+    return LocalValues[ID - Offset];
+  }
+
+  /// Removes the value with `ID`, leaving it vacant.
+  void vacate(CompactID ID);
 };
 
 /// The string table used for decoding.
@@ -101,7 +120,8 @@ class StringTable {
   mutable exi::BumpPtrAllocator LNPageAllocator;
   /// Allocator used for LocalNames.
   exi::SpecificBumpPtrAllocator<LocalName> LNAllocator;
-  /// Used to unique strings for output.
+  /// Used to unique strings for output. Borrowed strings (added through the
+  /// `*Ref` setters) are not stored here.
   exi::OwningStringSaver NameValueCache;
 
   /// Small size for schema adjacent values.
@@ -131,7 +151,7 @@ class StringTable {
   PagedVec<LNMapType, kLNPageElts> LNMap;
   CompactIDCounter<> LNCount;
 
-  using LNPartition = LocalName::value_type;
+  using LNPartition = LocalName;
   /// Caches a mapping from a QName to a LocalName.
   using LNCacheType = SmallLRUCache<SmallQName, LNPartition*, 4>;
   /// Used to cache recently used values. Since you generally have repetitive
@@ -141,9 +161,62 @@ class StringTable {
 
   /// Used to map LocalName IDs to GlobalValues.
   ///  Eg. `GValueMap[GlobalID]`
-  SmallVec<InlineStr*, 0> GValueMap;
+  SmallVec<StrRef, 0> GValueMap;
   CompactIDCounter<> GValueCount;
 
+  /// The storage and owner of a value in a bounded global partition.
+  struct ValueSlot {
+    /// The copied value, reused once the slot wraps.
+    SmallVec<char, 0> Data;
+    /// The QName of the LocalValue partition holding the value.
+    SmallQName Name;
+    /// The value's LocalID in the partition of `Name`.
+    CompactID LocalID = 0;
+  };
+
+  /// The slots of each GlobalID, only used when `WrappingValues` is set.
+  /// They are kept between streams to reuse their storage.
+  SmallVec<ValueSlot, 0> GValueSlots;
+  /// The total capacity of the `Data` in each slot.
+  usize GValueSlotBytes = 0;
+  /// The next GlobalID assigned, when `WrappingValues` is set.
+  CompactID GValueNext = 0;
+  /// The maximum number of global values, from `ValuePartitionCapacity`.
+  u64 ValueCapacity = max_v<u64>;
+  /// The maximum length of values added, from `ValueMaxLength`.
+  u64 ValueMaxLength = max_v<u64>;
+
+  /// The storage of `TransientValue`, when it is copied.
+  SmallVec<char, 0> TransientData;
+  /// The most recent value which was not added to the tables.
+  StrRef TransientValue;
+
+  /// An addition to a partition since the last `checkpoint`.
+  struct TableChange {
+    enum : u8 { kPrefix, kLocalName, kLocalValue } Kind;
+    /// The previous `PrefixElts` of the URI, for prefixes.
+    u32 PrefixElts = 0;
+    /// The URI of the partition, for prefixes and LocalNames.
+    CompactID URI = 0;
+    /// The partition of a LocalValue.
+    LocalName* Values = nullptr;
+  };
+
+  /// The state of the tables at the last `checkpoint`.
+  struct TableCheckpoint {
+    /// The additions made since, in order.
+    SmallVec<TableChange, 4> Changes;
+    usize NURIs = 0;
+    CompactIDCounter<1> URICount;
+    CompactIDCounter<> LNCount;
+    CompactIDCounter<> GValueCount;
+    CompactID GValueNext = 0;
+    /// If changes are being recorded.
+    bool IsActive = false;
+    /// If a bounded value was replaced, which can't be undone.
+    bool IsLost = false;
+  } Saved;
+
   bool DidSetup : 1 = false;
   /// If the tables should wrap once reaching their capacity.
   bool WrappingValues : 1 = false;
@@ -154,9 +227,28 @@ public:
     this->setup(Opts);
   }
 
-  /// Sets up the initial decoder state.
-  /// The signature will have to change when schemas are introduced.
-  void setup(const ExiOptions& Opts);
+  /// Sets up the initial decoder state. If `Schema` is provided, the
+  /// initial entries are taken from its tables, which must outlive the
+  /// table or its next `reset`.
+  void setup(const ExiOptions& Opts, const SchemaTables* Schema = nullptr);
+
+  /// Returns the table to its state before `setup`. Allocations are kept
+  /// where possible, so the table can be cheaply reused for another stream.
+  /// All strings previously returned by the table are invalidated.
+  void reset();
+
+  /// Starts recording additions to the tables, so they can be undone with
+  /// `rollback`. Any previous checkpoint is discarded.
+  void checkpoint();
+  /// Undoes every addition since the last `checkpoint`. Strings stay
+  /// allocated until `reset`, but are removed from the tables.
+  /// @return `false` if there is no checkpoint, or a bounded value was
+  ///  replaced since.
+  bool rollback();
+
+  /// Returns the bytes held by the table, including those kept by `reset`.
+  /// Storage of the LocalValue partitions is estimated from their sizes.
+  usize getMemoryUsage() const;
 
   /// Gets an `InlineStr` from an interned `StrRef`.
   [[nodiscard]] const InlineStr* getInline(StrRef Str) const {
@@ -176,6 +268,9 @@ public:
   IDPair addPrefix(CompactID URI, StrRef Pfx);
   /// Associates a new LocalName with a URI.
   IDPair addLocalName(CompactID URI, StrRef Name);
+  /// Associates a new LocalName with a URI, without copying.
+  /// `Name` must outlive the table.
+  IDPair addLocalNameRef(CompactID URI, StrRef Name);
 
   /// Creates a new GlobalValue.
   IDPair addGlobalValue(StrRef Value);
@@ -185,16 +280,7 @@ public:
   }
   /// Associates a new LocalValue with a QName.
   IDPair addLocalValue(SmallQName IDs, StrRef Value) {
-    exi_invariant(IDs.isQName());
-
-    LNPartition& Values = *getLVPartition(IDs);
-    const CompactID ID = Values.size();
-    // Add to the global table.
-    InlineStr* Str = createGlobalValue(Value);
-    // Add to the local table for URI:LocalID.
-    Values.push_back(Str);
-
-    return {Str->str(), ID};
+    return this->pushLocalValue(IDs, internStr(Value));
   }
 
   /// Creates a new GlobalValue AND associates a new LocalValue with QName.
@@ -204,12 +290,40 @@ public:
   /// Creates a new GlobalValue AND associates a new LocalValue with QName.
   IDTriple addValue(SmallQName IDs, StrRef Value) {
     exi_invariant(IDs.isQName());
+    if EXI_UNLIKELY(WrappingValues)
+      return this->addWrappingValue(IDs, Value, /*Copy=*/true);
     // auto [Str, GID] = this->addGlobalValue(Value);
     auto [Str, LnID] = this->addLocalValue(IDs, Value);
     const CompactID GID = (*GValueCount - 1);
     return {.Value = Str, .GlobalID = GID, .LocalID = LnID};
   }
 
+  /// Same as `addValue`, but without copying. `Value` must outlive the table.
+  IDTriple addValueRef(SmallQName IDs, StrRef Value) {
+    exi_invariant(IDs.isQName());
+    if EXI_UNLIKELY(WrappingValues)
+      return this->addWrappingValue(IDs, Value, /*Copy=*/false);
+    auto [Str, LnID] = this->pushLocalValue(IDs, Value);
+    const CompactID GID = (*GValueCount - 1);
+    return {.Value = Str, .GlobalID = GID, .LocalID = LnID};
+  }
+
+  /// Checks if a value with `Length` characters is added to the tables.
+  /// Otherwise it must be set with `setTransientValue`.
+  bool isValueAdded(u64 Length) const {
+    return Length <= ValueMaxLength && ValueCapacity != 0;
+  }
+
+  /// Sets the value returned for `EventUID::NewTransientValue`. If `Copy` is
+  /// false, `Value` must live until the next call.
+  StrRef setTransientValue(StrRef Value, bool Copy = true) {
+    if (Copy) {
+      TransientData.assign(Value.begin(), Value.end());
+      Value = StrRef(TransientData.data(), TransientData.size());
+    }
+    return (TransientValue = Value);
+  }
+
   ////////////////////////////////////////////////////////////////////////
   // Validators
 
@@ -217,6 +331,12 @@ public:
     return URI < URIMap.size();
   }
 
+  /// Checks if values may be removed from the tables, or never added. Their
+  /// strings are then only valid until the next value is added.
+  bool hasBoundedValues() const {
+    return WrappingValues || ValueMaxLength != max_v<u64>;
+  }
+
   /// Checks if URI has prefixes.
   bool hasPrefix(CompactID URI) const {
     if EXI_UNLIKELY(!this->hasURI(URI))
@@ -229,7 +349,7 @@ public:
   bool hasPrefix(CompactID URI, CompactID PfxID) const {
     if EXI_UNLIKELY(!this->hasPrefix(URI))
       return false;
-    return PfxID < URIMap[URI].PrefixElts;
+    return PfxID < PrefixMap[URI].size();
   }
 
   ////////////////////////////////////////////////////////////////////////
@@ -283,7 +403,7 @@ public:
   /// Gets a GlobalValue from an ID.
   StrRef getGlobalValue(CompactID GlobalID) const {
     exi_invariant(GlobalID < *GValueCount);
-    return GValueMap[GlobalID]->str();
+    return GValueMap[GlobalID];
   }
 
   /// Gets a LocalValue from a (URI, LocalID, ValueID).
@@ -296,12 +416,16 @@ public:
     exi_assert(IDs.isQName());
     const LNPartition& Values = *getLVPartition(IDs);
     exi_invariant(ValueID < Values.size());
-    return Values[ValueID]->str();
+    return Values.get(ValueID);
   }
 
   /// Gets a Local or Global Value from a ([URI, LocalID]?, ValueID).
   StrRef getValue(EventUID IDs) const {
     exi_relassert(IDs.hasValue());
+    if EXI_UNLIKELY(IDs.isEmptyValue())
+      return ""_str;
+    if EXI_UNLIKELY(IDs.isTransientValue())
+      return TransientValue;
     if (IDs.isGlobal())
       return getGlobalValue(IDs.ValueID);
     else
@@ -375,7 +499,7 @@ private:
 
     // Set the value of the cached partition.
     LocalName* LN = LNMap[URI][LocalID];
-    return (Partition = &LN->LocalValues);
+    return (Partition = LN);
   }
 
   [[nodiscard]] const LNPartition* getLVPartition(SmallQName IDs) const {
@@ -394,30 +518,72 @@ private:
   std::pair<URIInfo*, CompactID>
    createURI(StrRef URI, Option<StrRef> Pfx = std::nullopt);
 
-  /// Gets a new LocalName.
+  /// Gets a new LocalName, `Name` must already be stable.
   [[nodiscard]] LocalName* createLocalName(StrRef Name) {
-    StrRef Str = internStr(Name);
     LocalName* Ptr = LNAllocator.Allocate();
     return new (Ptr) LocalName {
-      .Name = Str, .LocalValues = {}
+      .Name = Name, .LocalValues = {}
     };
   }
 
-  /// Gets a new global value (which is added to the global partition).
-  [[nodiscard]] InlineStr* createGlobalValue(StrRef Value) {
-    InlineStr* Str = intern(Value);
-    exi_invariant(Str, "Invalid allocation??");
-    GValueMap.push_back(Str);
+  /// Adds a LocalName to the URI partition, `Name` must already be stable.
+  IDPair pushLocalName(CompactID URI, StrRef Name);
+
+  /// Adds a value to the global partition, `Value` must already be stable.
+  StrRef pushGlobalValue(StrRef Value) {
+    GValueMap.push_back(Value);
     ++GValueCount;
-    return Str;
+    return Value;
   }
 
+  /// Adds a value to both partitions, `Value` must already be stable.
+  IDPair pushLocalValue(SmallQName IDs, StrRef Value) {
+    exi_invariant(IDs.isQName());
+
+    LNPartition& Values = *getLVPartition(IDs);
+    const CompactID ID = Values.size();
+    // Add to the global table.
+    StrRef Str = pushGlobalValue(Value);
+    // Add to the local table for URI:LocalID.
+    Values.LocalValues.push_back(Str);
+    if EXI_UNLIKELY(Saved.IsActive)
+      this->recordChange({.Kind = TableChange::kLocalValue, .Values = &Values});
+
+    return {Str, ID};
+  }
+
+  /// Records an addition for `rollback`.
+  void recordChange(const TableChange& Change) {
+    Saved.Changes.push_back(Change);
+  }
+
+  /// Adds a value to both partitions of a bounded table. Once the global
+  /// partition is full, IDs wrap and the previous value with the same
+  /// GlobalID is removed from both partitions. If `Copy` is set, the value
+  /// is copied into the storage of its slot.
+  IDTriple addWrappingValue(SmallQName IDs, StrRef Value, bool Copy);
+
+  struct InitialEntriesTag {};
+  /// Creates a table holding only the initial entries.
+  StringTable(InitialEntriesTag, bool UsesSchema);
+
+  /// Returns a table holding only the initial entries. These are created
+  /// once, and shared by every table.
+  static const StringTable& GetInitialEntries(bool UsesSchema);
+
+  /// Copies the initial entries from `Init`.
+  void restoreInitialEntries(const StringTable& Init);
+
   /// Creates the initial entries for the string table. The values inserted
   /// depend on the schema.
   void createInitialEntries(bool UsesSchema);
 
   /// Appends LocalNames to the provided URI.
   void appendLocalNames(CompactID ID, ArrayRef<StrRef> LocalNames);
+
+  /// Creates the initial entries of a schema. LocalNames reference the
+  /// strings of `Schema` directly.
+  void createSchemaEntries(const SchemaTables& Schema);
 };
 
 } // namespace decode
@@ -429,129 +595,109 @@ private:
 /// Defines utilities for encoding EXI.
 namespace encode {
 
-class StringTable;
-
 template <typename Value, bool IsOwned = false>
 using BumpStringMap = StringMap<Value,
   std::conditional_t<IsOwned, BumpPtrAllocator, BumpPtrAllocator&>>;
 
-/// Typed handle for `StringTable::URIEntry`.
-struct TURIEntry;
-/// Typed handle for `StringTable::ValueEntry`.
-struct TValueEntry;
-/// Handle for an `InlineString` representing a QName's data as `"URI$pfx:ln"`.
-struct QualName;
-
-/// Using `u32`, because if you have 4 billion uris... wtf.
-struct PrefixInfo {
-  TURIEntry* Link = nullptr;
-  /// The ID of the URI.
-  u32 URI = 0;
-  /// The ID of the prefix.
-  u16 Pfx = 0;
-  /// The cached prefix log.
-  u16 PfxLog = 0;
-  /// The cached Prefix.
-  //char URITag[6] {};
+/// The value stored for each entry in the Value map. Values are only ever
+/// added once, so they belong to a single LocalValue partition.
+struct ValueInfo {
+  /// The value's GlobalID.
+  CompactID GlobalID = 0;
+  /// The value's LocalID in the partition of `Name`.
+  CompactID LocalID = 0;
+  /// The QName of the LocalValue partition holding the value.
+  SmallQName Name;
 };
 
-#define DECL_MAPPING_I(TO, FROM)                                              \
-  ALWAYS_INLINE static TO* X(FROM* Ptr) {                                     \
-    return reinterpret_cast<TO*>(Ptr);                                        \
-  }                                                                           \
-  ALWAYS_INLINE static TO& X(FROM& Ref) {                                     \
-    return *reinterpret_cast<TO*>(&Ref);                                      \
-  }
-#define DECL_MAPPING(TO, FROM)                                                \
-  DECL_MAPPING_I(TO, FROM)                                                    \
-  DECL_MAPPING_I(const TO, const FROM)
-
-/// TODO: The string table used for encoding.
+/// The string table used for encoding. Unlike the decoding table, this maps
+/// strings to their IDs.
 /// Assumes all inputs it recieves are valid.
 class StringTable {
   /// The allocator shared internally.
   mutable exi::BumpPtrAllocator Alloc;
-  /// Used to unique strings for lookup.
-  // TODO: Figure out if necessary?
-  exi::UniqueStringSaver NameCache;
 
-  /// Used to cache!!
-  static constexpr usize kURIMax = 0xFFFFFF;
-  /// Contains URI's ID and reverse mappings for prefixes.
+  /// Small size for schema adjacent values.
+  static constexpr usize kSchemaElts = 4;
+
+  /// Maps a LocalName to its ID.
+  using LNMapType = BumpStringMap<CompactID>;
+
+  /// The partitions associated with a URI.
   struct URIInfo {
-    u32 URI = 0;
-    /// Iterate while recording the index to find the PfxID.
-    SmallVec<PrefixInfo*, 2> PfxMap;
+    /// The URI, owned by `URIMap`.
+    StrRef Name;
+    /// Prefixes are searched in order to find their ID, as there is
+    /// generally only one.
+    SmallVec<StrRef, 1> Prefixes;
+    /// Maps LocalNames to their ID in the URI partition.
+    LNMapType LocalNames;
+    /// The number of LocalValues for each LocalName.
+    SmallVec<u32, 0> LocalValues;
+  public:
+    URIInfo(StrRef Name, BumpPtrAllocator& Alloc) :
+     Name(Name), LocalNames(0, Alloc) {}
   };
 
   /// Maps a URI to its associated ID.
-  using URIMapType = BumpStringMap<URIInfo>;
-  /// Stores the mapping between a URI and its associated ID.
-  using URIEntry = URIMapType::value_type;
-
-public:
-  /// Maps a Prefix to its corresponding URI(s).
-  using PrefixMapType = BumpStringMap<PrefixInfo>;
-  /// Stores the mapping between a Prefix and its corresponding URI(s).
-  using PrefixEntry = PrefixMapType::value_type;
-
-  EXI_INLINE static StrRef GetURI(const TURIEntry* Entry) {
-    exi_invariant(Entry != nullptr);
-    return X(Entry)->first();
-  }
-  EXI_INLINE static u32 GetID(const TURIEntry* Entry) {
-    exi_invariant(Entry != nullptr);
-    return X(Entry)->second.URI;
-  }
-
-private:
+  using URIMapType = BumpStringMap<CompactID>;
   /// Used to map URIs to IDs.
   URIMapType URIMap;
-  /// Used to map Prefixes to URIs (and their IDs).
-  PrefixMapType PrefixMap;
-  
-  /// Represents nested namespace contexts.
-  using URIStack = SmallVec<PrefixInfo, 1>;
-  /// Maps a PrefixEntry to a stack of URI values.
-  using URIStackMapType = SmallDenseMap<const PrefixEntry*, URIStack, 4>;
-  /// Maps a PrefixEntry to a stack of URIs representing nested namespace contexts.
-  /// This is managed externally, as the string table has no knowledge of the format.
-  URIStackMapType URIStackMap;
-
-  /// Represents LocalValues.
-  using LocalValuesType = SmallDenseMap<TValueEntry*, CompactID, 4>;
-  /// Maps a QName to LocalName data.
-  // TODO: Switch to Mapping `"URI$pfx:ln" -> [LNID, [LV...]]`?
-  DenseMap<const QualName*, LocalValuesType> LVMap;
-  
-  /// The value stored for each entry in the Value map.
-  struct ValueInfo {
-    /// The value's GlobalID.
-    CompactID GID = 0;
-    /// The latest LocalName using this Value.
-    const QualName* Name = nullptr;
-  };
+  /// The partitions for each URI, stable once allocated.
+  SmallVec<URIInfo*, kSchemaElts> URIs;
+  SpecificBumpPtrAllocator<URIInfo> URIAllocator;
+  CompactIDCounter<1> URICount;
 
   /// Maps a Value to its corresponding data.
   using ValueMapType = BumpStringMap<ValueInfo, /*IsOwned=*/true>;
-  /// Stores the mapping between a Value and its corresponding data.
-  using ValueEntry = ValueMapType::value_type;
   /// Handles the mapping from the string representation of a value to the
-  /// value's data. Lookups aren't done through NameCache to reduce the number
-  /// of searches required for that.
+  /// value's data. Values are kept separately from names, as they are
+  /// generally far more numerous.
   ValueMapType GValueMap;
   CompactIDCounter<> GValueCount;
 
+  /// A recently encoded QName. The strings are owned by the tables.
+  struct QNameCacheEntry {
+    StrRef URI;
+    StrRef Name;
+    SmallQName ID;
+  };
+
+  static constexpr usize kQNameCacheSize = 64;
+  /// A direct-mapped cache of QNames, indexed by the hash of the LocalName.
+  /// Hits skip both the URI and LocalName probes.
+  mutable QNameCacheEntry QNameCache[kQNameCacheSize] {};
+
+  /// Maps the addresses of [URI, LocalName] to QNames, if strings are stable.
+  mutable DenseMap<std::pair<const char*, const char*>, SmallQName> QNameAddrs;
+  /// Maps the addresses of values to their entries, if strings are stable.
+  /// Unused when values wrap, as entries are removed.
+  DenseMap<const char*, const ValueInfo*> ValueAddrs;
+
+  /// A value in a bounded global partition.
+  struct ValueSlot {
+    /// The copied value, reused once the slot wraps.
+    SmallVec<char, 0> Data;
+    ValueInfo Info;
+  };
+
+  /// The slots of each GlobalID, used instead of `GValueMap` when
+  /// `WrappingValues` is set. They are kept to reuse their storage.
+  SmallVec<ValueSlot, 0> GValueSlots;
+  /// Maps values in `GValueSlots` to their GlobalID.
+  DenseMap<CachedHashStrRef, CompactID> GValueLookup;
+  /// The next GlobalID assigned, when `WrappingValues` is set.
+  CompactID GValueNext = 0;
+  /// The maximum number of global values, from `ValuePartitionCapacity`.
+  u64 ValueCapacity = max_v<u64>;
+  /// The maximum length of values added, from `ValueMaxLength`.
+  u64 ValueMaxLength = max_v<u64>;
+
   bool DidSetup : 1 = false;
   /// If the tables should wrap once reaching their capacity.
   bool WrappingValues : 1 = false;
-
-  ////////////////////////////////////////////////////////////////////////
-  // Handle Mapping
-
-  DECL_MAPPING(URIEntry, TURIEntry)
-  DECL_MAPPING(ValueEntry, TValueEntry)
-  DECL_MAPPING(InlineStr, QualName)
+  /// If incoming strings are stable, see `setStableStrings`.
+  bool StableStrings : 1 = false;
 
 public:
   StringTable();
@@ -563,13 +709,226 @@ public:
   /// The signature will have to change when schemas are introduced.
   void setup(const ExiOptions& Opts);
 
-  // TODO: Finish design...
+  /// Declares that every string passed to the tables stays alive, and that
+  /// equal addresses always hold equal strings (eg. strings from a decoder's
+  /// tables). QNames and values are then also found by address, so strings
+  /// are only hashed the first time they are seen.
+  void setStableStrings(bool Stable = true) { StableStrings = Stable; }
+  /// Returns if incoming strings are stable.
+  bool hasStableStrings() const { return StableStrings; }
+
+  /// Returns the hash used by every table. Incoming strings should be hashed
+  /// once, and the result passed to each probe.
+  EXI_INLINE static u32 Hash(StrRef Str) {
+    return StringMapImpl::hash(Str);
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Setters
+
+  /// Creates a new URI.
+  CompactID addURI(StrRef URI, Option<StrRef> Pfx = std::nullopt) {
+    return addURI(URI, Hash(URI), Pfx);
+  }
+  /// Creates a new URI, with `Hash(URI)` precomputed.
+  CompactID addURI(StrRef URI, u32 URIHash,
+                   Option<StrRef> Pfx = std::nullopt);
+  /// Associates a new Prefix with a URI.
+  CompactID addPrefix(CompactID URI, StrRef Pfx);
+  /// Associates a new LocalName with a URI.
+  CompactID addLocalName(CompactID URI, StrRef Name) {
+    return addLocalName(URI, Name, Hash(Name));
+  }
+  /// Associates a new LocalName with a URI, with `Hash(Name)` precomputed.
+  CompactID addLocalName(CompactID URI, StrRef Name, u32 NameHash);
+  /// Creates a new GlobalValue AND associates a new LocalValue with QName.
+  void addValue(SmallQName Name, StrRef Value);
+
+  ////////////////////////////////////////////////////////////////////////
+  // Lookup
+
+  /// Finds the ID of a URI.
+  Option<CompactID> findURI(StrRef URI) const {
+    return findURI(URI, Hash(URI));
+  }
+
+  /// Finds the ID of a URI, with `Hash(URI)` precomputed.
+  Option<CompactID> findURI(StrRef URI, u32 URIHash) const {
+    auto It = URIMap.find(URI, URIHash);
+    if (It == URIMap.end())
+      return std::nullopt;
+    return It->second;
+  }
+
+  /// Finds the ID of a Prefix associated with a URI.
+  Option<CompactID> findPrefix(CompactID URI, StrRef Pfx) const {
+    const auto& Prefixes = getInfo(URI).Prefixes;
+    for (usize Ix = 0, E = Prefixes.size(); Ix != E; ++Ix) {
+      if (Prefixes[Ix] == Pfx)
+        return Ix;
+    }
+    return std::nullopt;
+  }
+
+  /// Finds the ID of a LocalName associated with a URI.
+  Option<CompactID> findLocalName(CompactID URI, StrRef Name) const {
+    return findLocalName(URI, Name, Hash(Name));
+  }
+
+  /// Finds the ID of a LocalName associated with a URI, with `Hash(Name)`
+  /// precomputed.
+  Option<CompactID> findLocalName(CompactID URI, StrRef Name,
+                                  u32 NameHash) const {
+    const LNMapType& LocalNames = getInfo(URI).LocalNames;
+    auto It = LocalNames.find(Name, NameHash);
+    if (It == LocalNames.end())
+      return std::nullopt;
+    return It->second;
+  }
+
+  /// Finds a QName, if both the URI and LocalName exist.
+  /// Hits are cached, so repeated lookups skip both probes.
+  Option<SmallQName> findQName(StrRef URI, StrRef Name) const {
+    if (StableStrings) {
+      auto It = QNameAddrs.find({URI.data(), Name.data()});
+      if (It != QNameAddrs.end())
+        return It->second;
+    }
+
+    const u32 NameHash = Hash(Name);
+    if (Option<SmallQName> ID = findCachedQName(URI, Name, NameHash)) {
+      if (StableStrings)
+        QNameAddrs[{URI.data(), Name.data()}] = *ID;
+      return ID;
+    }
+
+    const Option<CompactID> URIID = findURI(URI);
+    if (!URIID)
+      return std::nullopt;
+    const URIInfo& Info = getInfo(*URIID);
+    auto It = Info.LocalNames.find(Name, NameHash);
+    if (It == Info.LocalNames.end())
+      return std::nullopt;
+
+    const auto ID = SmallQName::NewQName(*URIID, It->second);
+    QNameCache[NameHash % kQNameCacheSize] = QNameCacheEntry {
+      .URI = Info.Name, .Name = It->getKey(), .ID = ID
+    };
+    if (StableStrings)
+      QNameAddrs[{URI.data(), Name.data()}] = ID;
+    return ID;
+  }
+
+  /// Finds a QName in the cache, with `Hash(Name)` precomputed. A hit means
+  /// both the URI and LocalName exist.
+  Option<SmallQName> findCachedQName(StrRef URI, StrRef Name,
+                                     u32 NameHash) const {
+    const QNameCacheEntry& Entry = QNameCache[NameHash % kQNameCacheSize];
+    if (Entry.Name == Name && Entry.URI == URI && Entry.ID.isQName())
+      return Entry.ID;
+    return std::nullopt;
+  }
+
+  /// Caches a QName which exists in the tables, with `Hash(Name)`
+  /// precomputed.
+  void cacheQName(SmallQName ID, StrRef Name, u32 NameHash);
+
+  /// Finds a value in the Global partition, its LocalValue partition can be
+  /// checked with `ValueInfo::Name`.
+  const ValueInfo* findValue(StrRef Value) const {
+    if EXI_UNLIKELY(WrappingValues)
+      return findWrappingValue(Value, Hash(Value));
+    auto It = GValueMap.find(Value);
+    if (It == GValueMap.end())
+      return nullptr;
+    return &It->second;
+  }
+
+  /// Finds a value in the Global partition, or adds it to the partitions of
+  /// `Name` if it does not exist. Hits and misses take a single probe.
+  /// Returns null if the value was added, or is never added because the
+  /// tables are bounded.
+  const ValueInfo* findOrAddValue(SmallQName Name, StrRef Value);
+
+  /// Checks if values may be removed from the tables, or never added.
+  bool hasBoundedValues() const {
+    return WrappingValues || ValueMaxLength != max_v<u64>;
+  }
+
+  /// Checks if URI has prefixes.
+  bool hasPrefix(CompactID URI) const {
+    return !getInfo(URI).Prefixes.empty();
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Log Getters
+
+  EXI_INLINE u64 getURILog() const {
+    return URICount.bits();
+  }
+
+  /// Gets the bit number for QName prefixes.
+  u64 getPrefixLogQ(CompactID URI) const {
+    return CompactIDLog2(getInfo(URI).Prefixes.size());
+  }
+
+  /// Gets the bit number for NS prefixes.
+  u64 getPrefixLog(CompactID URI) const {
+    return CompactIDLog2(getInfo(URI).Prefixes.size() + 1);
+  }
+
+  u64 getLocalNameLog(CompactID URI) const {
+    return CompactIDLog2(getInfo(URI).LocalNames.size());
+  }
+
+  EXI_INLINE u64 getGlobalValueLog() const {
+    return GValueCount.bits();
+  }
+
+  u64 getLocalValueLog(SmallQName Name) const {
+    exi_invariant(Name.isQName());
+    const URIInfo& Info = getInfo(Name.URI);
+    exi_invariant(Name.LocalID < Info.LocalValues.size());
+    return CompactIDLog2(Info.LocalValues[Name.LocalID]);
+  }
+
 private:
+  const URIInfo& getInfo(CompactID URI) const {
+    exi_invariant(URI < URIs.size());
+    return *URIs[URI];
+  }
+  URIInfo& getInfo(CompactID URI) {
+    exi_invariant(URI < URIs.size());
+    return *URIs[URI];
+  }
 
-};
+  /// Creates the initial entries for the string table. The values inserted
+  /// depend on the schema.
+  void createInitialEntries(bool UsesSchema);
 
-#undef DECL_MAPPING_I
-#undef DECL_MAPPING
+  /// Appends LocalNames to the provided URI.
+  void appendLocalNames(CompactID ID, ArrayRef<StrRef> LocalNames);
+
+  /// Implements `findOrAddValue`, returning the entry and if it was added.
+  std::pair<const ValueInfo*, bool> probeValue(SmallQName Name, StrRef Value);
+
+  /// Checks if `Value` is added to the tables, based on its length in
+  /// characters and the capacity.
+  bool isValueAdded(StrRef Value) const;
+
+  /// Finds a value when `WrappingValues` is set.
+  const ValueInfo* findWrappingValue(StrRef Value, u32 ValueHash) const {
+    auto It = GValueLookup.find(CachedHashStrRef(Value, ValueHash));
+    if (It == GValueLookup.end())
+      return nullptr;
+    return &GValueSlots[It->second].Info;
+  }
+
+  /// Adds a value when `WrappingValues` is set. Once the global partition
+  /// is full, IDs wrap and the previous value with the same GlobalID is
+  /// removed. Its LocalID is left vacant.
+  void addWrappingValue(SmallQName Name, StrRef Value, u32 ValueHash);
+};
 
 } // namespace encode
 
@@ -0,0 +1,110 @@
+//===- exi/Basic/XMLNames.hpp ---------------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines utilities for resolving names and text in raw XML.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/ArrayRef.hpp>
+#include <core/Common/Option.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Common/StrRef.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <utility>
+
+namespace exi {
+
+class QName;
+
+/// The `xml` prefix, which is always bound to `kXMLNamespaceURI`.
+inline constexpr StrRef kXMLPrefix = "xml";
+inline constexpr StrRef kXMLNamespaceURI
+  = "http://www.w3.org/XML/1998/namespace";
+
+/// Splits a raw name into `[Prefix, LocalName]`.
+std::pair<StrRef, StrRef> splitXMLName(StrRef Raw);
+
+/// If `Raw` is `xmlns` or `xmlns:*`, returns the declared prefix.
+Option<StrRef> getXMLNSPrefix(StrRef Raw);
+
+/// Checks if `Str` only contains XML whitespace.
+bool isXMLWhitespace(StrRef Str);
+
+/// Translates the predefined entities and character references in `Str`.
+/// If there are none, `Str` is returned. Otherwise the result is stored in
+/// `Buffer`. Unknown entities are left as is.
+StrRef translateXMLEntities(StrRef Str, SmallVecImpl<char>& Buffer);
+
+/// The parts of a DOCTYPE, eg. `root PUBLIC "pub" "sys" [subset]`.
+struct XMLDoctype {
+  StrRef Name;
+  StrRef PublicID;
+  StrRef SystemID;
+  /// The internal subset, without brackets.
+  StrRef Text;
+};
+
+/// Splits the contents of a DOCTYPE into its parts.
+XMLDoctype splitXMLDoctype(StrRef Text);
+
+/// Tracks the namespace bindings in scope while walking XML.
+class XMLNamespaceScope {
+public:
+  /// A binding of `[Prefix, URI]`.
+  using Binding = std::pair<StrRef, StrRef>;
+
+private:
+  SmallVec<Binding, 8> Bindings;
+  /// The number of bindings in scope at each open element.
+  SmallVec<u32, 32> Scopes;
+
+public:
+  /// Opens a scope for an element.
+  void push() { Scopes.push_back(Bindings.size()); }
+  /// Closes the innermost scope, removing its bindings.
+  void pop() { Bindings.truncate(Scopes.pop_back_val()); }
+  /// Binds `Pfx` in the innermost scope.
+  void bind(StrRef Pfx, StrRef URI) { Bindings.emplace_back(Pfx, URI); }
+
+  /// Returns the number of open scopes.
+  usize depth() const { return Scopes.size(); }
+  /// Returns the bindings declared in the innermost scope.
+  ArrayRef<Binding> declared() const {
+    if (Scopes.empty())
+      return {};
+    return ArrayRef(Bindings).drop_front(Scopes.back());
+  }
+
+  /// Looks up the URI bound to `Pfx`.
+  Option<StrRef> lookup(StrRef Pfx) const;
+
+  /// Resolves `Raw` into `Name`. Unprefixed attributes have no namespace,
+  /// and undeclared prefixes are an error.
+  ExiError resolve(QName& Name, StrRef Raw, bool IsAttr) const;
+
+  /// Removes all bindings.
+  void clear() {
+    Bindings.clear();
+    Scopes.clear();
+  }
+};
+
+} // namespace exi
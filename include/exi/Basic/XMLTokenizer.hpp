@@ -0,0 +1,102 @@
+//===- exi/Basic/XMLTokenizer.hpp -----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines a streaming XML tokenizer.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/SmallStr.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Common/StrRef.hpp>
+#include <core/Support/Allocator.hpp>
+#include <core/Support/MemoryBufferRef.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Basic/XMLNames.hpp>
+#include <exi/Decode/Serializer.hpp>
+
+namespace exi {
+
+/// Tokenizes XML in place, passing events to a `Serializer` as they are
+/// found rather than building a tree. Delimiters are located with SIMD
+/// where available.
+///
+/// Events match what `ExiEncoder::encodeBody` produces from a parsed
+/// document: namespaces are resolved, entities are translated, whitespace
+/// only data is dropped, and declarations are skipped. Strings passed to the
+/// serializer point into the input or are only valid for the call.
+class XMLTokenizer {
+  /// A raw attribute, before namespaces are resolved.
+  struct RawAttr {
+    StrRef Name;
+    StrRef Value;
+    /// The translated value in `AttrText`, if translated.
+    u32 Offset = 0;
+    u32 Size = 0;
+    bool Translated = false;
+  };
+
+  /// The full input.
+  StrRef Input;
+  /// The current position.
+  const char* Ptr = nullptr;
+  /// The end of the input.
+  const char* End = nullptr;
+
+  /// The in-scope prefix bindings.
+  XMLNamespaceScope Scope;
+  /// The names of the open elements.
+  SmallVec<QName, 32> Open;
+  /// The attributes of the current start tag.
+  SmallVec<RawAttr, 8> Attrs;
+  /// Storage for translated data.
+  SmallStr<256> Text;
+  /// Storage for translated attribute values.
+  SmallStr<256> AttrText;
+  /// Storage for translated namespace URIs, which must outlive their tag.
+  BumpPtrAllocator URIs;
+
+public:
+  explicit XMLTokenizer(StrRef Input) : Input(Input) {}
+  explicit XMLTokenizer(MemoryBufferRef MB) : Input(MB.getBuffer()) {}
+
+  /// Tokenizes the input from SD to ED, passing events to `S`. Returns the
+  /// first error from `S`, or `kInvalidEXIInput` for malformed XML.
+  ExiError tokenize(Serializer& S);
+
+  /// Returns the line of the current position, for diagnostics.
+  usize getLine() const;
+
+private:
+  ExiError tokenizeStart(Serializer& S);
+  ExiError tokenizeEnd(Serializer& S);
+  ExiError tokenizeMarkup(Serializer& S);
+  ExiError tokenizePI(Serializer& S);
+  ExiError tokenizeData(Serializer& S);
+
+  /// Scans a name, stopping at whitespace or delimiters.
+  StrRef scanName();
+  /// Skips to after `Term`, returning the text before it.
+  Option<StrRef> scanUntil(StrRef Term);
+
+  ExiError invalid(StrRef Msg) const;
+};
+
+} // namespace exi
@@ -24,23 +24,31 @@
 #pragma once
 
 #include <core/Common/ArrayRef.hpp>
+#include <core/Common/Box.hpp>
 #include <core/Common/DenseMap.hpp>
 #include <core/Common/Option.hpp>
+#include <core/Common/SmallVec.hpp>
 #include <core/Common/StringMap.hpp>
 #include <core/Common/Vec.hpp>
 #include <core/Support/raw_ostream.hpp>
 #include <exi/Basic/ErrorCodes.hpp>
 #include <exi/Basic/ExiHeader.hpp>
 #include <exi/Basic/StringTables.hpp>
+#include <exi/Decode/ChannelBlock.hpp>
 #include <exi/Decode/HeaderDecoder.hpp>
 // #include <exi/Decode/Serializer.hpp>
 #include <exi/Decode/UnifyBuffer.hpp>
 #include <exi/Grammar/DecoderSchema.hpp>
+#include <exi/Stream/ChannelReader.hpp>
 #include <exi/Stream/OrderedReader.hpp>
 
 namespace exi {
+class ExiEventCursor;
 class Serializer;
 class QName;
+struct SCEntry;
+struct SchemaDatatype;
+struct SchemaTables;
 
 struct DecoderFlags {
   /// If the stream was set externally.
@@ -49,24 +57,74 @@ struct DecoderFlags {
   bool DidHeader : 1 = false;
   /// If init has already been run.
   bool DidInit : 1 = false;
+  /// If strings may reference the input buffer.
+  bool BorrowInput : 1 = false;
+  /// If the body is a fragment, such as the content of an SC element.
+  bool Fragment : 1 = false;
+  /// If values are left as slots in the current `ChannelBlock`.
+  bool DeferValues : 1 = false;
+  /// If the input is inflated into a buffer which is reused, so strings
+  /// may not be borrowed.
+  bool InflatedInput : 1 = false;
+  /// If compressed streams are inflated ahead on a background thread.
+  bool InflateAhead : 1 = false;
+};
+
+/// The bytes held by each part of an `ExiDecoder`.
+struct DecoderMemoryUsage {
+  /// Interned strings and learned grammars, allocated by the decoder.
+  usize Internal = 0;
+  /// The string tables.
+  usize StringTables = 0;
+  /// Productions and other storage of the grammars.
+  usize Grammars = 0;
+  /// Inflated streams and buffered blocks of compressed input.
+  usize Channels = 0;
+  /// Decoders of SC fragments, kept while their strings may be referenced.
+  usize Fragments = 0;
+public:
+  usize total() const {
+    return Internal + StringTables + Grammars + Channels + Fragments;
+  }
 };
 
 /// The EXI decoding processor.
 /// FIXME: Split this up into more implementations.
 class ExiDecoder {
   friend class decode::Schema::Get;
+  friend class ExiEventCursor;
 
   /// The provided Header.
   ExiHeader Header;
   /// The provided `StreamReader`.
   OrdReader Reader;
+  /// Incremental input for the reader, if any.
+  ChunkedInput* Input = nullptr;
+  /// The position in bits of the event being decoded from `Input`, which
+  /// is decoded again from there if the input runs out.
+  u64 EventStart = 0;
+  /// The streams of a compressed or pre-compressed body, if any.
+  Box<ChannelReader> Channels;
+  /// The events of the current block, when `Channels` is set.
+  Box<ChannelBlock> Block;
+  /// Where the locations of SC fragments are recorded, if anywhere.
+  SmallVecImpl<SCEntry>* Index = nullptr;
+  /// Decoders for SC fragments, kept while their strings may be referenced.
+  SmallVec<Box<ExiDecoder>, 0> Fragments;
   /// A BumpPtrAllocator for processor internals.
   exi::BumpPtrAllocator BP;
   /// The table holding decoded string values (QNames, LocalNames, etc.)
   decode::StringTable Idents;
   /// The schema for the current document.
-  /// TODO: Add SchemaResolver...
   Box<decode::Schema> CurrentSchema;
+  /// Resolves the `schemaId` of each stream, if set.
+  SchemaResolverRef Resolver;
+  /// The grammars of the current schema, which the string table references.
+  SchemaGrammarsRef Grammars;
+  /// Schemas generated by `exi-schemac`, checked before `Resolver`.
+  SmallVec<const decode::CompiledSchemaInfo*, 1> CompiledSchemas;
+  /// The compiled schema in use, if any.
+  const decode::CompiledSchemaInfo* CurrentCompiled = nullptr;
   /// The stack of current grammars.
   SmallVec<const InlineStr*> GrammarStack;
 
@@ -77,7 +135,20 @@ class ExiDecoder {
   /// Preserve options.
   ExiOptions::PreserveOpts Preserve;
 
+  /// The most bytes the decoder may hold, or 0 if unbounded.
+  u64 MemoryBudget = 0;
+  /// The bytes left in the budget as of the last check, less the sizes of
+  /// strings added since.
+  u64 MemoryLeft = max_v<u64>;
+  /// The events until usage is next checked against the budget.
+  u32 MemoryCountdown = 1;
+  /// The bytes held by `Fragments`, which don't grow once decoded.
+  usize FragmentBytes = 0;
+
 public:
+  /// The number of events between checks of the memory budget.
+  static constexpr u32 kMemoryCheckInterval = 256;
+
   ExiDecoder(Option<raw_ostream&> OS = std::nullopt) : OS(OS) {}
   ExiDecoder(MaybeBox<ExiOptions> Opts, Option<raw_ostream&> OS = std::nullopt);
   ~ExiDecoder() { os().flush(); }
@@ -86,6 +157,10 @@ public:
   DecoderFlags flags() const { return Flags; }
   /// Returns if the header was successfully decoded.
   bool didHeader() const { return Flags.DidHeader; }
+  /// Returns the string tables.
+  const decode::StringTable& idents() const { return Idents; }
+  /// Returns the bytes currently held by each part of the decoder.
+  DecoderMemoryUsage getMemoryUsage() const;
 
   /// Returns the stream used for diagnostics.
   raw_ostream& os() const EXI_READONLY; // TODO: Remove readonly?
@@ -128,6 +203,65 @@ public:
   ExiError setOptions(MaybeBox<ExiOptions> Opts);
   /// Sets reader out-of-band. Options must be provided.
   ExiError setReader(UnifiedBuffer Buffer);
+  /// Allows new values and LocalNames to reference the input buffer instead
+  /// of being copied. Currently only ASCII strings in byte-aligned streams
+  /// are borrowed. The input must outlive the decoder and any strings it
+  /// has produced.
+  void setBorrowInput(bool Borrow = true) {
+    // Windows of incremental input are invalidated by `feed`.
+    Flags.BorrowInput = Borrow && !Input;
+  }
+  /// Inflates compressed streams on a background thread, ahead of the
+  /// stream being decoded. Must be set before the header is decoded.
+  /// Without threads (`EXI_USE_THREADS`), streams are inflated as they are
+  /// reached, and a warning is logged.
+  void setInflateAhead(bool Ahead = true) { Flags.InflateAhead = Ahead; }
+  /// Limits the memory held by the decoder to `Bytes`, or removes the limit
+  /// if 0. Once exceeded, decoding stops with `kInvalidMemoryAlloc`. Must be
+  /// set before the header is decoded to limit inflated streams.
+  ///
+  /// Usage is checked every `kMemoryCheckInterval` events, and strings are
+  /// checked before being added to the tables. Allocations made by the
+  /// serializer are not counted.
+  void setMemoryBudget(u64 Bytes) {
+    MemoryBudget = Bytes;
+    MemoryLeft = Bytes ? Bytes : max_v<u64>;
+    MemoryCountdown = 1;
+  }
+  /// Returns the memory budget, or 0 if unbounded.
+  u64 getMemoryBudget() const { return MemoryBudget; }
+  /// Records the locations of SC fragments in `Index` while decoding. These
+  /// may then be decoded independently with `setFragmentReader`. Only the
+  /// outermost fragments are recorded, and none are for incremental input.
+  ///
+  /// Fragments don't store their length, so the index costs a full serial
+  /// decode of the stream. Calling `decodeBody` without a serializer is the
+  /// cheapest way to build one.
+  void setSCIndex(SmallVecImpl<SCEntry>* Index) { this->Index = Index; }
+  /// Sets the reader to an SC fragment at `Offset` bytes into `Buffer`, as
+  /// recorded by `setSCIndex`. Options must be provided. Events are then
+  /// decoded as a fragment, starting with SD and ending with ED.
+  ExiError setFragmentReader(UnifiedBuffer Buffer, u64 Offset);
+  /// Sets the resolver used to load the grammars of a `schemaId`. Streams
+  /// with a schema can't be decoded without one. Must be set before the
+  /// header is decoded.
+  void setSchemaResolver(SchemaResolverRef R) { Resolver = std::move(R); }
+  /// Registers a schema generated by `exi-schemac`. Streams with its
+  /// `schemaId` are decoded with it, rather than through the resolver.
+  void addCompiledSchema(const decode::CompiledSchemaInfo& Info) {
+    CompiledSchemas.push_back(&Info);
+  }
+  /// Decodes from incremental input. The header and body are then decoded
+  /// with `decodeAvailable`, as data is fed to `In`.
+  ExiError setInput(ChunkedInput& In);
+
+  /// Prepares the decoder for another stream, keeping its allocations, the
+  /// options, and the settings above. Incremental input must be set again.
+  /// All strings previously produced by the decoder are invalidated.
+  ///
+  /// Reusing a decoder avoids most of the setup cost when decoding many
+  /// small streams with the same options.
+  void reset();
 
   /// Decodes the header from the provided buffer.
   /// Defined in `HeaderDecoder.cpp`.
@@ -136,31 +270,130 @@ public:
   ExiError decodeBody();
   /// Decodes the body from the current stream with the provided serializer.
   ExiError decodeBody(Serializer* S);
+  /// Decodes the body from the current stream with a concrete serializer.
+  /// Calls are dispatched statically, so handlers can be inlined into the
+  /// decoding loop. Types not deriving from `Serializer` may omit callbacks.
+  /// Defined in `BodyDecoderImpl.hpp`.
+  template <class SerializerT>
+  requires(!std::is_pointer_v<SerializerT>)
+  ExiError decodeBody(SerializerT& S);
+
+  /// Decodes as much of the document as the input set by `setInput` allows.
+  /// An event is only started once `ChunkedInput::lookahead` bytes are
+  /// buffered past it (or the input is finished), decoding resumes from
+  /// there on the next call. Events larger than the lookahead are replayed
+  /// once more data arrives, and the lookahead grows to fit them.
+  /// @return `ExiError::FULL` if more data is needed, `ExiError::OK` once
+  ///  the document has been decoded, or some other error.
+  ExiError decodeAvailable(Serializer* S);
+  /// Decodes as much of the document as the input allows, with a concrete
+  /// serializer. Defined in `BodyDecoderImpl.hpp`.
+  template <class SerializerT>
+  requires(!std::is_pointer_v<SerializerT>)
+  ExiError decodeAvailable(SerializerT& S);
 
 protected:
   /// Initializes StringTable and Schema.
   ExiError init();
+  /// Loads the schema with `SchemaID` for the current options.
+  ExiError initSchema(StrRef SchemaID);
   /// Verifies initialization has been completed.
   ExiError prepareForDecoding();
-
+  /// Decodes the header from `Buffer`, which is a window of `Src` if set.
+  /// Defined in `HeaderDecoder.cpp`.
+  ExiError decodeHeaderFrom(ArrayRef<u8> Buffer, ChunkedInput* Src);
+  /// Decodes the header once enough input is available, or moves the
+  /// reader to the latest window of the input.
+  ExiError prepareInput();
+  /// Splits the rest of the input into streams, if it is compressed or
+  /// pre-compressed.
+  ExiError initChannels();
+
+  /// Saves the state before an event from `Input`, so it can be replayed
+  /// with `rewindEvent`.
+  void checkpointEvent();
+  /// Restores the state before the current event, and raises the lookahead
+  /// past the input it has used.
+  /// @return `false` if the state can't be restored.
+  bool rewindEvent();
+
+  /// Decodes a body split into channels, one block at a time.
+  template <class SerializerT>
+  ExiError decodeBlocks(SerializerT& S);
+  /// Begins the next stream, with `Reader` reading from its data.
+  ExiError beginStream();
+  /// Decodes the value channels of the current block.
+  ExiError decodeChannels();
+  /// Replays the events of the current block to the serializer.
+  template <class SerializerT>
+  ExiError replayBlock(SerializerT& S);
+
+  /// Decodes events while enough input is buffered, with the stream type
+  /// known.
+  template <class SerializerT, class StrmT>
+  ExiError decodeAvailableEvents(SerializerT& S, StrmT* Strm);
+
+  /// Decodes events until completion, with the stream type known.
+  template <class SerializerT, class StrmT>
+  ExiError decodeEvents(SerializerT& S, StrmT* Strm);
   /// Decodes events and then dispatches.
-  EXI_HOT ExiError decodeEvent(Serializer* S);
+  template <class SerializerT, class StrmT>
+  EXI_HOT ExiError decodeEvent(SerializerT& S, StrmT* Strm);
   /// Dispatches less common events.
-  EXI_COLD ExiError dispatchUncommonEvent(Serializer* S, EventUID Event);
+  template <class SerializerT, class StrmT>
+  EXI_COLD ExiError dispatchUncommonEvent(SerializerT& S, StrmT* Strm,
+                                          EventUID Event);
 
   ////////////////////////////////////////////////////////////////////////
   // Terms
 
-  ExiError handleSE(Serializer* S, EventUID Event);
-  ExiError handleEE(Serializer* S, EventUID Event);
-  ExiError handleAT(Serializer* S, EventUID Event);
-  ExiError handleNS(Serializer* S, EventUID Event);
-  ExiError handleCH(Serializer* S, EventUID Event);
+  template <class SerializerT>
+  ExiError handleSE(SerializerT& S, EventUID Event);
+  template <class SerializerT>
+  ExiError handleEE(SerializerT& S, EventUID Event);
+  template <class SerializerT, class StrmT>
+  ExiError handleAT(SerializerT& S, StrmT* Strm, EventUID Event);
+  template <class SerializerT, class StrmT>
+  ExiError handleNS(SerializerT& S, StrmT* Strm, EventUID Event);
+  template <class SerializerT>
+  ExiError handleCH(SerializerT& S, EventUID Event);
+
+  template <class SerializerT, class StrmT>
+  ExiError handleCM(SerializerT& S, StrmT* Strm);
+  template <class SerializerT, class StrmT>
+  ExiError handlePI(SerializerT& S, StrmT* Strm);
+  template <class SerializerT, class StrmT>
+  ExiError handleDT(SerializerT& S, StrmT* Strm);
+  template <class SerializerT, class StrmT>
+  ExiError handleER(SerializerT& S, StrmT* Strm);
+  template <class SerializerT, class StrmT>
+  ExiError handleSC(SerializerT& S, StrmT* Strm);
+
+  /// Creates a decoder for an SC fragment in the current stream.
+  Box<ExiDecoder> newFragment();
 
-  ExiError handleCM(Serializer* S);
-  ExiError handlePI(Serializer* S);
-  ExiError handleDT(Serializer* S);
-  ExiError handleER(Serializer* S);
+  ////////////////////////////////////////////////////////////////////////
+  // Memory
+
+  /// Counts down to the next check of the memory budget.
+  ALWAYS_INLINE ExiError tickMemoryBudget() {
+    if EXI_LIKELY(--MemoryCountdown != 0)
+      return ExiError::OK;
+    return this->checkMemoryBudget();
+  }
+  /// Checks if the memory held by the decoder is within the budget.
+  EXI_COLD ExiError checkMemoryBudget();
+
+  /// Checks if a string of `Size` bytes may be added to the tables.
+  ALWAYS_INLINE ExiError reserveMemory(u64 Size) {
+    if EXI_LIKELY(Size < MemoryLeft) {
+      MemoryLeft -= Size;
+      return ExiError::OK;
+    }
+    return this->reserveMemorySlow(Size);
+  }
+  /// Rechecks usage before failing `reserveMemory`.
+  EXI_COLD ExiError reserveMemorySlow(u64 Size);
 
   QName getQName(EventUID Event);
   // TODO: Add optional `UserPrefixLookup*` type.
@@ -169,39 +402,93 @@ protected:
 
   ////////////////////////////////////////////////////////////////////////
   // Values
+  //
+  // These are instantiated for `BitReader` and `ByteReader`, which allows
+  // reads to be devirtualized and inlined.
 
   /// Decodes a QName.
-  ExiResult<EventUID> decodeQName();
+  template <class StrmT>
+  ExiResult<EventUID> decodeQName(StrmT* Strm);
 
   /// Decodes a Namespace.
-  ExiResult<EventUID> decodeNS();
+  template <class StrmT>
+  ExiResult<EventUID> decodeNS(StrmT* Strm);
 
   /// Decodes a QName URI.
-  ExiResult<CompactID> decodeURI();
+  template <class StrmT>
+  ExiResult<CompactID> decodeURI(StrmT* Strm);
 
   /// Decodes a QName LocalName.
   /// @param URI The bucket to search in.
-  ExiResult<CompactID> decodeName(CompactID URI);
+  template <class StrmT>
+  ExiResult<CompactID> decodeName(StrmT* Strm, CompactID URI);
 
   /// Same as `decodeName`, decodes a QName LocalName.
-  ALWAYS_INLINE auto decodeLocalName(CompactID URI) {
-    return this->decodeName(URI);
+  template <class StrmT>
+  ALWAYS_INLINE auto decodeLocalName(StrmT* Strm, CompactID URI) {
+    return this->decodeName(Strm, URI);
   }
 
   /// Decodes a QName Prefix, if `Preserve.Prefixes` is enabled.
   /// @param URI The bucket to search in.
-  ExiResult<Option<CompactID>> decodePfxQ(CompactID URI);
+  template <class StrmT>
+  ExiResult<Option<CompactID>> decodePfxQ(StrmT* Strm, CompactID URI);
 
   /// Decodes a NS Prefix, `Preserve.Prefixes` must be enabled.
   /// @param URI The bucket to search in.
-  ExiResult<CompactID> decodePfx(CompactID URI);
+  template <class StrmT>
+  ExiResult<CompactID> decodePfx(StrmT* Strm, CompactID URI);
 
   /// Decodes a Value.
-  ExiResult<EventUID> decodeValue(CompactID URI, CompactID Name) {
-    return this->decodeValue(SmallQName::NewQName(URI, Name));
+  template <class StrmT>
+  ExiResult<EventUID> decodeValue(StrmT* Strm, CompactID URI, CompactID Name) {
+    return this->decodeValue(Strm, SmallQName::NewQName(URI, Name));
   }
   /// Decodes a Value.
-  ExiResult<EventUID> decodeValue(SmallQName Name);
+  /// @param CharSet The characters of a restricted string, sorted.
+  template <class StrmT>
+  ExiResult<EventUID> decodeValue(StrmT* Strm, SmallQName Name,
+                                  ArrayRef<u32> CharSet = {});
+
+  /// Reads a string as a view of the input, if borrowing is enabled and the
+  /// stream supports it.
+  template <class StrmT>
+  ALWAYS_INLINE Option<StrRef> tryBorrowString(StrmT* Strm, u64 Size) {
+    if constexpr (std::same_as<StrmT, ByteReader>) {
+      if (Flags.BorrowInput && !Flags.InflatedInput)
+        return Strm->readASCIIView(Size);
+    }
+    return std::nullopt;
+  }
+
+  /// Decodes a Value with a schema datatype. Strings are decoded as usual,
+  /// other values are printed and returned as transient values.
+  /// Defined in `TypedValues.cpp`.
+  template <class StrmT>
+  ExiResult<EventUID> decodeTypedValue(StrmT* Strm, SmallQName Name,
+                                       const SchemaTables& Schema,
+                                       u32 Datatype);
+  /// Prints a typed value to `Out`.
+  /// Defined in `TypedValues.cpp`.
+  template <class StrmT>
+  ExiError appendTypedValue(StrmT* Strm, SmallQName Name,
+                            const SchemaTables& Schema,
+                            const SchemaDatatype& DT,
+                            SmallVecImpl<char>& Out);
+
+  /// Decodes the string of a Value miss with a restricted character set.
+  template <class StrmT>
+  EXI_COLD ExiResult<EventUID> decodeRestrictedValue(StrmT* Strm,
+                                                     SmallQName Name,
+                                                     u64 Size,
+                                                     ArrayRef<u32> CharSet);
+
+  /// Reads a string of `Size` characters from a restricted character set.
+  /// Each is an index into `CharSet`, or an escaped code point.
+  template <class StrmT>
+  ExiResult<StrRef> readRestrictedString(StrmT* Strm, u64 Size,
+                                         ArrayRef<u32> CharSet,
+                                         SmallVecImpl<char>& Data);
 
   /// @brief Decodes an encoded string with the default character set.
   /// @return An owning `String`, or an error.
@@ -0,0 +1,525 @@
+//===- exi/Decode/BodyDecoderImpl.hpp -------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements the serializer dispatch of `ExiDecoder`. Include it
+/// when using `ExiDecoder::decodeBody` with a concrete serializer type.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/SmallStr.hpp>
+#include <core/Common/Unwrap.hpp>
+#include <core/Support/Logging.hpp>
+#include <exi/Decode/BodyDecoder.hpp>
+#include <exi/Decode/SelfContained.hpp>
+#include <exi/Decode/Serializer.hpp>
+#include <concepts>
+
+#define DEBUG_TYPE "BodyDecoder"
+
+namespace exi {
+
+/// Dispatches calls to a serializer. When `SerializerT` is `Serializer`, the
+/// usual virtual call is made. Otherwise the call is qualified, which allows
+/// it to be inlined. Types which don't derive from `Serializer` may omit any
+/// of the callbacks, in which case the default is used.
+template <class SerializerT>
+struct SerializerDispatch {
+  static constexpr bool IsDynamic = std::same_as<SerializerT, Serializer>;
+
+#define DISPATCH_METHOD(NAME, DEFAULT)                                        \
+  template <typename...ArgsT>                                                 \
+  ALWAYS_INLINE static auto NAME(SerializerT& S, ArgsT&&...Args) {            \
+    if constexpr (IsDynamic)                                                  \
+      return S.NAME(EXI_FWD(Args)...);                                        \
+    else if constexpr (requires { S.SerializerT::NAME(EXI_FWD(Args)...); })   \
+      return S.SerializerT::NAME(EXI_FWD(Args)...);                           \
+    else                                                                      \
+      return DEFAULT;                                                         \
+  }
+
+  DISPATCH_METHOD(SD, ExiError::OK)
+  DISPATCH_METHOD(ED, ExiError::DONE)
+  DISPATCH_METHOD(SE, ExiError::OK)
+  DISPATCH_METHOD(EE, ExiError::OK)
+  DISPATCH_METHOD(SC, ExiError::OK)
+  DISPATCH_METHOD(AT, ExiError::OK)
+  DISPATCH_METHOD(NS, ExiError::OK)
+  DISPATCH_METHOD(CH, ExiError::OK)
+  DISPATCH_METHOD(CM, ExiError::OK)
+  DISPATCH_METHOD(PI, ExiError::OK)
+  DISPATCH_METHOD(DT, ExiError::OK)
+  DISPATCH_METHOD(ER, ExiError::OK)
+  DISPATCH_METHOD(needsPersistence, false)
+
+#undef DISPATCH_METHOD
+};
+
+/// Forwards the events of an SC fragment to the serializer of the enclosing
+/// document. SD and ED are dropped, as is the root SE of the fragment, which
+/// was already reported before SC.
+template <class SerializerT>
+struct SCFragmentSerializer {
+  using Dispatch = SerializerDispatch<SerializerT>;
+  SerializerT& S;
+  bool SawRoot = false;
+
+  ExiError SD() { return ExiError::OK; }
+  ExiError ED() { return ExiError::OK; }
+  ExiError SE(QName Name) {
+    if EXI_UNLIKELY(!SawRoot) {
+      SawRoot = true;
+      return ExiError::OK;
+    }
+    return Dispatch::SE(S, Name);
+  }
+
+#define FORWARD_METHOD(NAME)                                                  \
+  template <typename...ArgsT>                                                 \
+  ALWAYS_INLINE auto NAME(ArgsT&&...Args) {                                   \
+    return Dispatch::NAME(S, EXI_FWD(Args)...);                               \
+  }
+
+  FORWARD_METHOD(EE)
+  FORWARD_METHOD(SC)
+  FORWARD_METHOD(AT)
+  FORWARD_METHOD(NS)
+  FORWARD_METHOD(CH)
+  FORWARD_METHOD(CM)
+  FORWARD_METHOD(PI)
+  FORWARD_METHOD(DT)
+  FORWARD_METHOD(ER)
+  FORWARD_METHOD(needsPersistence)
+
+#undef FORWARD_METHOD
+};
+
+/// Wraps a serializer for an SC fragment.
+template <class SerializerT>
+SCFragmentSerializer<SerializerT> MakeSCSerializer(SerializerT& S) {
+  return {S};
+}
+
+/// Nested fragments forward directly to the original serializer, which
+/// avoids instantiating a new wrapper for every level.
+template <class SerializerT>
+SCFragmentSerializer<SerializerT>
+ MakeSCSerializer(SCFragmentSerializer<SerializerT>& S) {
+  return {S.S};
+}
+
+template <class SerializerT>
+requires(!std::is_pointer_v<SerializerT>)
+ExiError ExiDecoder::decodeBody(SerializerT& S) {
+  if (ExiError E = prepareForDecoding())
+    return E;
+  if (Channels)
+    return this->decodeBlocks(S);
+
+  // Dispatch on the stream type once, so reads can be inlined.
+  return Reader.visit([this, &S] (auto& Strm) -> ExiError {
+    return this->decodeEvents(S, &Strm);
+  });
+}
+
+template <class SerializerT, class StrmT>
+ExiError ExiDecoder::decodeEvents(SerializerT& S, StrmT* Strm) {
+  // Event codes may be empty (eg. a lone ED), so the body ends on ED rather
+  // than when the stream runs out. Truncated input will report `OOB`.
+  while (true) {
+    ExiError E = this->decodeEvent(S, Strm);
+    if EXI_LIKELY(E == ExiError::OK)
+      continue;
+    else if (E == ExiError::DONE)
+      return ExiError::OK;
+    // Some other error code.
+    return E;
+  }
+}
+
+template <class SerializerT>
+ExiError ExiDecoder::decodeBlocks(SerializerT& S) {
+  exi_invariant(Channels && Block);
+  while (true) {
+    // Record the structure until the block is full, values are left as
+    // slots to be filled once their channels are decoded.
+    Block->clear();
+    if (ExiError E = this->beginStream())
+      return E;
+
+    auto* Strm = &cast<ByteReader>(Reader);
+    bool IsLast = false;
+    Flags.DeferValues = true;
+    while (!Block->isFull()) {
+      ExiError E = this->decodeEvent(*Block, Strm);
+      if EXI_LIKELY(E == ExiError::OK)
+        continue;
+      Flags.DeferValues = false;
+      if (E != ExiError::DONE)
+        return E;
+      IsLast = true;
+      break;
+    }
+    Flags.DeferValues = false;
+
+    if (ExiError E = this->decodeChannels())
+      return E;
+    if (ExiError E = this->replayBlock(S))
+      return (E == ExiError::DONE) ? ExiError::OK : E;
+    if (IsLast)
+      return ExiError::OK;
+  }
+}
+
+template <class SerializerT>
+ExiError ExiDecoder::replayBlock(SerializerT& S) {
+  using Dispatch = SerializerDispatch<SerializerT>;
+  ArrayRef<StrRef> Strs = Block->Strings;
+  ArrayRef<StrRef> Vals = Block->Values;
+  // Values from bounded tables are copied into the block, which is reused.
+  const bool InternValues =
+    Dispatch::needsPersistence(S) && Idents.hasBoundedValues();
+  auto GetValue = [&, this] (u32 Ix) -> StrRef {
+    StrRef Value = Vals[Ix];
+    if EXI_UNLIKELY(InternValues)
+      this->internStrings(Value);
+    return Value;
+  };
+
+  for (const ChannelBlock::Event& Ev : Block->Events) {
+    const u32 Ix = Ev.Index;
+    ExiError E = ExiError::OK;
+    switch (Ev.Term) {
+    case EventTerm::SD:
+      E = Dispatch::SD(S);
+      break;
+    case EventTerm::ED:
+      if (ExiError Done = Dispatch::ED(S))
+        return Done;
+      return ExiError::DONE;
+    case EventTerm::SE:
+      E = Dispatch::SE(S, Ev.Name);
+      break;
+    case EventTerm::EE:
+      E = Dispatch::EE(S, Ev.Name);
+      break;
+    case EventTerm::AT:
+      E = Dispatch::AT(S, Ev.Name, GetValue(Ix));
+      break;
+    case EventTerm::NS:
+      E = Dispatch::NS(S, Strs[Ix], Strs[Ix + 1], Ev.IsLocal);
+      break;
+    case EventTerm::CH:
+      E = Dispatch::CH(S, GetValue(Ix));
+      break;
+    case EventTerm::CM:
+      E = Dispatch::CM(S, Strs[Ix]);
+      break;
+    case EventTerm::PI:
+      E = Dispatch::PI(S, Strs[Ix], Strs[Ix + 1]);
+      break;
+    case EventTerm::DT:
+      E = Dispatch::DT(S, Strs[Ix], Strs[Ix + 1], Strs[Ix + 2], Strs[Ix + 3]);
+      break;
+    case EventTerm::ER:
+      E = Dispatch::ER(S, Strs[Ix]);
+      break;
+    default:
+      exi_unreachable("invalid recorded term");
+    }
+
+    if EXI_UNLIKELY(E)
+      return E;
+  }
+
+  return ExiError::OK;
+}
+
+template <class SerializerT>
+requires(!std::is_pointer_v<SerializerT>)
+ExiError ExiDecoder::decodeAvailable(SerializerT& S) {
+  if (ExiError E = prepareInput())
+    return E;
+
+  return Reader.visit([this, &S] (auto& Strm) -> ExiError {
+    return this->decodeAvailableEvents(S, &Strm);
+  });
+}
+
+template <class SerializerT, class StrmT>
+ExiError ExiDecoder::decodeAvailableEvents(SerializerT& S, StrmT* Strm) {
+  // Only begin an event once the lookahead is buffered, then resume from
+  // the next event when more data arrives. Events which still run out are
+  // rolled back, and decoded again once more than they used is buffered.
+  while (true) {
+    if EXI_UNLIKELY(!Input->hasLookahead(Strm->bitPos() / 8)) {
+      if (!Input->pull(Strm->bitPos() / 8))
+        return ExiError::FULL;
+      Strm->syncInput();
+    }
+
+    this->checkpointEvent();
+    ExiError E = this->decodeEvent(S, Strm);
+    if EXI_LIKELY(E == ExiError::OK)
+      continue;
+    else if (E == ExiError::DONE)
+      return ExiError::OK;
+    else if (E == ExiError::FULL) {
+      if EXI_UNLIKELY(!this->rewindEvent()) {
+        LOG_ERROR("Event exceeded the buffered input, and can't be replayed.");
+        return ErrorCode::kInconsistentProcState;
+      }
+      LOG_EXTRA("Replaying event with lookahead {}", Input->lookahead());
+      continue;
+    }
+    // Some other error code.
+    return E;
+  }
+}
+
+template <class SerializerT, class StrmT>
+EXI_HOT ExiError ExiDecoder::decodeEvent(SerializerT& S, StrmT* Strm) {
+  LOG_EXTRA("@[{}]:", Strm->bitPos());
+  if (ExiError E = this->tickMemoryBudget())
+    return E;
+  const EventUID Event = CurrentSchema->decode(this);
+
+  switch (Event.getTerm()) {
+  case EventTerm::SE:       // Start Element (*)
+  case EventTerm::SEUri:    // Start Element (uri:*)
+  case EventTerm::SEQName:  // Start Element (qname)
+    return this->handleSE(S, Event);
+  case EventTerm::EE:       // End Element
+    return this->handleEE(S, Event);
+  case EventTerm::AT:       // Attribute (*, value)
+  case EventTerm::ATUri:    // Attribute (uri:*, value)
+  case EventTerm::ATQName:  // Attribute (qname, value)
+    return this->handleAT(S, Strm, Event);
+  case EventTerm::NS:       // Namespace Declaration (uri, prefix, local-element-ns)
+    return this->handleNS(S, Strm, Event);
+  case EventTerm::CH:       // Characters (value)
+  case EventTerm::CHExtern: // Characters (external-value)
+    return this->handleCH(S, Event);
+  default:
+    return this->dispatchUncommonEvent(S, Strm, Event);
+  }
+}
+
+template <class SerializerT, class StrmT>
+EXI_COLD ExiError ExiDecoder::dispatchUncommonEvent(SerializerT& S,
+                                                    StrmT* Strm,
+                                                    const EventUID Event) {
+  using Dispatch = SerializerDispatch<SerializerT>;
+  switch (Event.getTerm()) {
+  case EventTerm::SD:       // Start Document
+    return Dispatch::SD(S);
+  case EventTerm::ED:       // End Document
+    if (ExiError E = Dispatch::ED(S))
+      return E;
+    return ExiError::DONE;
+  case EventTerm::CM:       // Comment text (text)
+    return this->handleCM(S, Strm);
+  case EventTerm::PI:       // Processing Instruction (name, text)
+    return this->handlePI(S, Strm);
+  case EventTerm::DT:       // DOCTYPE (name, public, system, text)
+    return this->handleDT(S, Strm);
+  case EventTerm::ER:       // Entity Reference (name)
+    return this->handleER(S, Strm);
+  case EventTerm::SC:       // Self Contained
+    return this->handleSC(S, Strm);
+  case EventTerm::Void:     // Failed to decode
+    // The schema has diagnosed the failure. If the input ran out, the event
+    // can be replayed once more arrives.
+    if (Strm->isStarved())
+      return ExiError::FULL;
+    return ErrorCode::kInvalidEXIInput;
+  default:
+    exi_assert("unknown term");
+    return ErrorCode::kInvalidEXIInput;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Terms
+
+// Start Element (*)
+// Start Element (uri:*)
+// Start Element (qname)
+template <class SerializerT>
+ExiError ExiDecoder::handleSE(SerializerT& S, EventUID Event) {
+  const QName Name = this->getQName(Event);
+  LOG_EXTRA("Decoded SE");
+  return SerializerDispatch<SerializerT>::SE(S, Name);
+}
+
+template <class SerializerT>
+ExiError ExiDecoder::handleEE(SerializerT& S, EventUID Event) {
+  if (!Event.hasQName()) {
+    LOG_EXTRA("Decoded EE");
+    if (hasDbgLogLevel(INFO))
+      dbgs() << '\n';
+    return ExiError::OK;
+  }
+
+  const QName Name = this->getQName(Event);
+  LOG_INFO(">> EE[{}:{}]\n", Name.Prefix, Name.Name);
+  return SerializerDispatch<SerializerT>::EE(S, Name);
+}
+
+// Attribute (*, value)
+// Attribute (uri:*, value)
+// Attribute (qname, value)
+template <class SerializerT, class StrmT>
+ExiError ExiDecoder::handleAT(SerializerT& S, StrmT* Strm, EventUID Event) {
+  exi_invariant(Event.hasQName());
+  // Typed values are decoded by the schema.
+  EventUID ValueID = Event;
+  if (!Event.hasValue()) {
+    Result R = decodeValue(Strm, Event.Name);
+    ValueID = $unwrap(std::move(R));
+  }
+
+  using Dispatch = SerializerDispatch<SerializerT>;
+  const QName Name = this->getQName(Event);
+  StrRef Value = Idents.getValue(ValueID);
+  if (Dispatch::needsPersistence(S)
+      && (Idents.hasBoundedValues() || ValueID.isTransientValue()))
+    // Values may be removed from bounded tables, or replaced.
+    this->internStrings(Value);
+
+  LOG_EXTRA("Decoded AT");
+  return Dispatch::AT(S, Name, Value);
+}
+
+// Namespace Declaration (uri, prefix, local-element-ns)
+template <class SerializerT, class StrmT>
+ExiError ExiDecoder::handleNS(SerializerT& S, StrmT* Strm, EventUID) {
+  const auto Event = $unwrap(decodeNS(Strm));
+  const auto Name = Event.Name;
+
+  StrRef URI = Idents.getURI(Name.URI);
+  StrRef Pfx = Idents.getPrefix(Name.URI, Event.Prefix);
+
+  LOG_EXTRA("Decoded NS");
+  return SerializerDispatch<SerializerT>::NS(S, URI, Pfx, Event.isLocal());
+}
+
+// Characters (value)
+template <class SerializerT>
+ExiError ExiDecoder::handleCH(SerializerT& S, EventUID Event) {
+  using Dispatch = SerializerDispatch<SerializerT>;
+  StrRef Value = Idents.getValue(Event);
+  if (Dispatch::needsPersistence(S)
+      && (Idents.hasBoundedValues() || Event.isTransientValue()))
+    // Values may be removed from bounded tables, or replaced.
+    this->internStrings(Value);
+  LOG_EXTRA("Decoded CH");
+  return Dispatch::CH(S, Value);
+}
+
+#define READ_STRING(NAME, RESERVE, READER)                                    \
+  SmallStr<RESERVE> NAME##_Data;                                              \
+  Result NAME = (READER)->decodeString(NAME##_Data);                          \
+  if EXI_UNLIKELY(NAME.is_err())                                              \
+    return NAME.error();
+
+template <class SerializerT, class StrmT>
+ExiError ExiDecoder::handleCM(SerializerT& S, StrmT* Strm) {
+  using Dispatch = SerializerDispatch<SerializerT>;
+  READ_STRING(Comment, 80, Strm)
+  if (Dispatch::needsPersistence(S))
+    this->internStrings(*Comment);
+  return Dispatch::CM(S, *Comment);
+}
+
+template <class SerializerT, class StrmT>
+ExiError ExiDecoder::handlePI(SerializerT& S, StrmT* Strm) {
+  using Dispatch = SerializerDispatch<SerializerT>;
+  READ_STRING(Target, 16, Strm)
+  READ_STRING(Text,   48, Strm)
+  if (Dispatch::needsPersistence(S))
+    this->internStrings(*Target, *Text);
+  return Dispatch::PI(S, *Target, *Text);
+}
+
+template <class SerializerT, class StrmT>
+ExiError ExiDecoder::handleDT(SerializerT& S, StrmT* Strm) {
+  using Dispatch = SerializerDispatch<SerializerT>;
+  READ_STRING(Name,  16, Strm)
+  READ_STRING(PubID, 16, Strm)
+  READ_STRING(SysID, 16, Strm)
+  READ_STRING(Text,  32, Strm)
+  if (Dispatch::needsPersistence(S))
+    this->internStrings(*Name, *PubID, *SysID, *Text);
+  return Dispatch::DT(S, *Name, *PubID, *SysID, *Text);
+}
+
+template <class SerializerT, class StrmT>
+ExiError ExiDecoder::handleER(SerializerT& S, StrmT* Strm) {
+  using Dispatch = SerializerDispatch<SerializerT>;
+  READ_STRING(Entity, 16, Strm)
+  if (Dispatch::needsPersistence(S))
+    this->internStrings(*Entity);
+  return Dispatch::ER(S, *Entity);
+}
+
+#undef READ_STRING
+
+template <class SerializerT, class StrmT>
+ExiError ExiDecoder::handleSC(SerializerT& S, StrmT* Strm) {
+  using Dispatch = SerializerDispatch<SerializerT>;
+  if (ExiError E = Dispatch::SC(S))
+    return E;
+
+  // The fragment starts on a byte boundary, and has its own string tables
+  // and grammars. Decode it separately, then continue from where it ended.
+  if constexpr (std::same_as<StrmT, BitReader>)
+    Strm->align();
+  const u64 Begin = Strm->bitPos() / 8;
+
+  Box<ExiDecoder> Frag = this->newFragment();
+  Frag->Reader.template emplace<StrmT>(Strm->getProxy());
+  Frag->Reader->setSource(Strm->getSource());
+
+  auto FragS = MakeSCSerializer(S);
+  const ExiError E = Frag->decodeBody(FragS);
+  Strm->setProxy(Frag->Reader->getProxy());
+  if EXI_UNLIKELY(E == ExiError::FULL) {
+    // Its events have already been reported, so it can't be replayed.
+    LOG_ERROR("Self-contained element exceeded the buffered input.");
+    return ErrorCode::kInconsistentProcState;
+  }
+  if EXI_UNLIKELY(E)
+    return E;
+
+  if (Index && !Input) {
+    const u64 End = (Strm->bitPos() + 7) / 8;
+    Index->push_back({.Begin = Begin, .End = End});
+  }
+  if (Dispatch::needsPersistence(S)) {
+    FragmentBytes += Frag->getMemoryUsage().total();
+    Fragments.push_back(std::move(Frag));
+  }
+  return ExiError::OK;
+}
+
+} // namespace exi
+
+#undef DEBUG_TYPE
@@ -0,0 +1,201 @@
+//===- exi/Decode/ChannelBlock.hpp ----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the buffered events of a block in a compressed stream.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/DenseMap.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Common/STLExtras.hpp>
+#include <core/Common/StrRef.hpp>
+#include <core/Support/Allocator.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Basic/EventCodes.hpp>
+#include <exi/Decode/Serializer.hpp>
+
+namespace exi {
+
+/// The events of a block from a compressed or pre-compressed stream.
+///
+/// The structure channel of a block comes before its values, so events are
+/// recorded here first, with each AT and CH value left as an empty slot.
+/// Slots are filled once the value channels are decoded, then the events are
+/// replayed to the serializer.
+///
+/// This is also the serializer used while recording. Strings must outlive
+/// the block, so `needsPersistence` is true.
+class ChannelBlock {
+public:
+  struct Event {
+    EventTerm Term;
+    /// If an NS is local-element-ns.
+    bool IsLocal = false;
+    /// The value slot for AT and CH, otherwise the first string.
+    u32 Index = 0;
+    /// The name of SE, EE and AT.
+    QName Name;
+  };
+
+  /// A value channel, holding the slots with the same QName.
+  struct Channel {
+    SmallQName Name;
+    SmallVec<u32, 0> Slots;
+  };
+
+  /// The recorded events.
+  SmallVec<Event, 0> Events;
+  /// The strings of NS, CM, PI, DT and ER events.
+  SmallVec<StrRef, 0> Strings;
+  /// The channel of each value slot, in order of occurrence.
+  SmallVec<SmallQName, 0> ValueNames;
+  /// The decoded values.
+  SmallVec<StrRef, 0> Values;
+  /// Copies of values which may be removed from the tables before the block
+  /// is replayed.
+  BumpPtrAllocator Storage;
+
+  /// The value channels of the block, the first `NChannels` are active.
+  /// They are kept between blocks to reuse their storage.
+  SmallVec<Channel, 0> Channels;
+  u32 NChannels = 0;
+  /// Maps names to their channel in the current block.
+  DenseMap<SmallQName, u32> Lookup;
+
+  /// The maximum number of values in a block.
+  u64 BlockSize = 1'000'000;
+
+public:
+  /// Returns the number of values in the block.
+  usize numValues() const { return ValueNames.size(); }
+  /// Returns if the block is full.
+  bool isFull() const { return numValues() >= BlockSize; }
+
+  /// Returns the bytes held by the block, including those kept by `clear`.
+  usize getMemoryUsage() const {
+    usize Total = Events.capacity_in_bytes() + Strings.capacity_in_bytes()
+      + ValueNames.capacity_in_bytes() + Values.capacity_in_bytes()
+      + Channels.capacity_in_bytes() + Lookup.getMemorySize()
+      + Storage.getTotalMemory();
+    for (const Channel& C : Channels)
+      Total += C.Slots.capacity_in_bytes();
+    return Total;
+  }
+
+  /// Groups the value slots into channels, in order of first occurrence.
+  ArrayRef<Channel> groupChannels() {
+    for (auto [Ix, Name] : exi::enumerate(ValueNames)) {
+      auto [It, DidInsert] = Lookup.try_emplace(Name, NChannels);
+      if (DidInsert) {
+        if (NChannels == Channels.size())
+          Channels.emplace_back();
+        Channel& New = Channels[NChannels++];
+        New.Name = Name;
+        New.Slots.clear();
+      }
+      Channels[It->second].Slots.push_back(u32(Ix));
+    }
+    return ArrayRef(Channels).take_front(NChannels);
+  }
+
+  /// Copies `Str` into the storage of the block.
+  StrRef save(StrRef Str) { return Str.copy(Storage); }
+
+  /// Removes all events, keeping allocations.
+  void clear() {
+    Events.clear();
+    Strings.clear();
+    ValueNames.clear();
+    Values.clear();
+    Storage.Reset();
+    NChannels = 0;
+    Lookup.clear();
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Recording
+
+  ExiError SD() { return this->push(EventTerm::SD); }
+  ExiError ED() { return this->push(EventTerm::ED); }
+  ExiError SE(QName Name) {
+    return this->push(EventTerm::SE, {}, Name);
+  }
+  ExiError EE(QName Name) {
+    return this->push(EventTerm::EE, {}, Name);
+  }
+  ExiError SC() {
+    // Self-contained elements can't be used with compression.
+    return ErrorCode::kInvalidEXIInput;
+  }
+  ExiError AT(QName Name, StrRef) {
+    return this->pushValue(EventTerm::AT, Name);
+  }
+  ExiError NS(StrRef URI, StrRef Prefix, bool LocalElementNS) {
+    Events.push_back({
+      .Term = EventTerm::NS,
+      .IsLocal = LocalElementNS,
+      .Index = u32(Strings.size())
+    });
+    Strings.append({URI, Prefix});
+    return ExiError::OK;
+  }
+  ExiError CH(StrRef) {
+    return this->pushValue(EventTerm::CH, {});
+  }
+  ExiError CM(StrRef Comment) {
+    return this->push(EventTerm::CM, {Comment});
+  }
+  ExiError PI(StrRef Target, StrRef Text) {
+    return this->push(EventTerm::PI, {Target, Text});
+  }
+  ExiError DT(StrRef Name, StrRef PublicID, StrRef SystemID, StrRef Text) {
+    return this->push(EventTerm::DT, {Name, PublicID, SystemID, Text});
+  }
+  ExiError ER(StrRef Name) {
+    return this->push(EventTerm::ER, {Name});
+  }
+  bool needsPersistence() const { return true; }
+
+private:
+  ExiError push(EventTerm Term, std::initializer_list<StrRef> Strs = {},
+                QName Name = {}) {
+    Events.push_back({
+      .Term = Term,
+      .Index = u32(Strings.size()),
+      .Name = Name
+    });
+    Strings.append(Strs);
+    return ExiError::OK;
+  }
+
+  /// The slot was added by `ExiDecoder::decodeValue`.
+  ExiError pushValue(EventTerm Term, QName Name) {
+    exi_invariant(!ValueNames.empty());
+    Events.push_back({
+      .Term = Term,
+      .Index = u32(ValueNames.size() - 1),
+      .Name = Name
+    });
+    return ExiError::OK;
+  }
+};
+
+} // namespace exi
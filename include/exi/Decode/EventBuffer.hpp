@@ -0,0 +1,178 @@
+//===- exi/Decode/EventBuffer.hpp -----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines a columnar buffer for batches of decoded events.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/ArrayRef.hpp>
+#include <core/Common/MMatch.hpp>
+#include <core/Common/SmallStr.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Common/StrRef.hpp>
+#include <exi/Basic/EventCodes.hpp>
+
+namespace exi {
+
+/// A struct-of-arrays buffer of events, filled by
+/// `ExiEventCursor::nextBatch`. Each column has one entry per event, IDs
+/// refer to the decoder's `decode::StringTable`.
+///
+/// Values the string table can't keep past the next event are copied into
+/// the buffer, see `hasText`. This is the case for transient values, such as
+/// typed or over-length values, and for every value of a bounded table.
+///
+/// The buffer is meant to be reused, `clear` keeps all allocations around so
+/// steady-state decoding doesn't allocate.
+class ExiEventBuffer {
+  /// The term of each event.
+  SmallVec<EventTerm, 0> Terms;
+  /// The QName IDs of each event. For NS this only holds the URI.
+  SmallVec<SmallQName, 0> Names;
+  /// The value IDs of each event, or `kInvalidVID`.
+  /// Where `HasText` is set, this is the index of the first text piece.
+  SmallVec<u64, 0> Values;
+  /// The prefix IDs of each event, or `kInvalidPrefix`.
+  SmallVec<u8, 0> Prefixes;
+  /// If each value is local, or if an NS is local-element-ns.
+  SmallVec<bool, 0> Locals;
+  /// The element depth after each event.
+  SmallVec<u32, 0> Depths;
+  /// If the strings of each event are held in `TextData`.
+  SmallVec<bool, 0> HasText;
+
+  /// Storage for CM/PI/DT/ER strings, and copied values.
+  SmallStr<0> TextData;
+  /// The `[Offset, Size]` of each text piece in `TextData`.
+  SmallVec<std::pair<u32, u32>, 0> TextSpans;
+
+public:
+  ExiEventBuffer() = default;
+  explicit ExiEventBuffer(usize Capacity) { this->reserve(Capacity); }
+
+  /// Returns the number of events in the buffer.
+  usize size() const { return Terms.size(); }
+  /// Returns if the buffer has no events.
+  bool empty() const { return Terms.empty(); }
+
+  /// Removes all events, keeping allocations.
+  void clear() {
+    Terms.clear();
+    Names.clear();
+    Values.clear();
+    Prefixes.clear();
+    Locals.clear();
+    Depths.clear();
+    HasText.clear();
+    TextData.clear();
+    TextSpans.clear();
+  }
+
+  /// Reserves space for `N` events.
+  void reserve(usize N) {
+    Terms.reserve(N);
+    Names.reserve(N);
+    Values.reserve(N);
+    Prefixes.reserve(N);
+    Locals.reserve(N);
+    Depths.reserve(N);
+    HasText.reserve(N);
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Columns
+
+  ArrayRef<EventTerm> terms() const { return Terms; }
+  ArrayRef<SmallQName> names() const { return Names; }
+  ArrayRef<u64> values() const { return Values; }
+  ArrayRef<u8> prefixes() const { return Prefixes; }
+  ArrayRef<bool> locals() const { return Locals; }
+  ArrayRef<u32> depths() const { return Depths; }
+
+  /// Recombines the columns for a single event. Copied values are marked
+  /// as transient, and must be read with `getText`.
+  EventUID getUID(usize Ix) const {
+    exi_invariant(Ix < size());
+    EventUID UID = EventUID::NewNull();
+    UID.setTerm(Terms[Ix]);
+    UID.Name = Names[Ix];
+    UID.ValueID = Values[Ix];
+    UID.Prefix = Prefixes[Ix];
+    UID.IsLocal = Locals[Ix];
+    if (HasText[Ix] && mmatch(UID.getTerm()).is(
+        EventTerm::AT, EventTerm::ATUri, EventTerm::ATQName,
+        EventTerm::CH, EventTerm::CHExtern))
+      UID.ValueID = kTransientVID;
+    return UID;
+  }
+
+  /// Checks if the strings of an event are held in the buffer. This is the
+  /// case for CM/PI/DT/ER, and for AT/CH values which were copied.
+  bool hasText(usize Ix) const {
+    exi_invariant(Ix < size());
+    return HasText[Ix];
+  }
+
+  /// Gets a text piece for a CM/PI/DT/ER event, or a copied value.
+  /// @param Ix The event index.
+  /// @param Piece The piece, in the same order as the `Serializer` methods.
+  StrRef getText(usize Ix, unsigned Piece = 0) const {
+    exi_invariant(hasText(Ix), "event has no text");
+    const usize Span = Values[Ix] + Piece;
+    exi_invariant(Span < TextSpans.size(), "invalid text index");
+    auto [Offset, Size] = TextSpans[Span];
+    return StrRef(TextData.data() + Offset, Size);
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Building
+
+  /// Appends an event.
+  void push(EventUID UID, u32 Depth) {
+    this->pushImpl(UID, Depth, /*Text=*/false);
+  }
+
+  /// Appends an event with text pieces. For AT/CH, the single piece is the
+  /// value, which replaces the value ID.
+  void push(EventUID UID, u32 Depth, ArrayRef<StrRef> Text) {
+    UID.ValueID = TextSpans.size();
+    for (StrRef Str : Text) {
+      TextSpans.emplace_back(
+        static_cast<u32>(TextData.size()),
+        static_cast<u32>(Str.size()));
+      TextData.append(Str);
+    }
+    this->pushImpl(UID, Depth, /*Text=*/true);
+  }
+
+private:
+  void pushImpl(EventUID UID, u32 Depth, bool Text) {
+    Terms.push_back(UID.getTerm());
+    Names.push_back(UID.Name);
+    Values.push_back(UID.ValueID);
+    Prefixes.push_back(static_cast<u8>(UID.Prefix));
+    Locals.push_back(UID.IsLocal);
+    Depths.push_back(Depth);
+    HasText.push_back(Text);
+  }
+};
+
+} // namespace exi
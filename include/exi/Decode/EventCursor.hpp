@@ -0,0 +1,172 @@
+//===- exi/Decode/EventCursor.hpp -----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines a pull-based cursor over the events of an EXI body.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/MMatch.hpp>
+#include <core/Common/SmallStr.hpp>
+#include <core/Common/StrRef.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Basic/EventCodes.hpp>
+#include <exi/Decode/BodyDecoder.hpp>
+#include <exi/Decode/Serializer.hpp>
+
+namespace exi {
+
+class ExiEventBuffer;
+
+/// A compact event record, as returned by `ExiEventCursor::next`.
+/// All IDs in `UID` map directly to the decoder's `decode::StringTable`.
+struct ExiEvent {
+  /// The decoded event. For AT and CH the value IDs are filled in, for NS
+  /// the URI, prefix and locality are.
+  EventUID UID = EventUID::NewNull();
+  /// The element depth after the event, the root element is at 1.
+  u32 Depth = 0;
+
+public:
+  EventTerm getTerm() const { return UID.getTerm(); }
+
+  /// Checks for SE(*), SE(uri:*) and SE(qname).
+  bool isSE() const {
+    return mmatch(getTerm()).is(
+      EventTerm::SE, EventTerm::SEUri, EventTerm::SEQName);
+  }
+  /// Checks for EE.
+  bool isEE() const { return getTerm() == EventTerm::EE; }
+  /// Checks for AT(*), AT(uri:*) and AT(qname).
+  bool isAT() const {
+    return mmatch(getTerm()).is(
+      EventTerm::AT, EventTerm::ATUri, EventTerm::ATQName);
+  }
+  /// Checks for CH.
+  bool isCH() const {
+    return mmatch(getTerm()).is(EventTerm::CH, EventTerm::CHExtern);
+  }
+  /// Checks for NS.
+  bool isNS() const { return getTerm() == EventTerm::NS; }
+  /// Checks for ED.
+  bool isED() const { return getTerm() == EventTerm::ED; }
+
+  /// Checks if the event carries string data not held in the `StringTable`.
+  /// This is the case for CM, PI, DT and ER.
+  bool hasText() const {
+    return mmatch(getTerm()).is(
+      EventTerm::CM, EventTerm::PI, EventTerm::DT, EventTerm::ER);
+  }
+};
+
+/// A pull-based interface to `ExiDecoder`. Events are decoded one at a time
+/// with `next`, using the same schema path as `ExiDecoder::decodeBody`, but
+/// without any virtual dispatch through a `Serializer`.
+///
+/// Strings are not resolved eagerly. IDs in `ExiEvent::UID` are stable for
+/// the lifetime of the decoder, and may be resolved through the cursor's
+/// accessors at any point. Text for CM/PI/DT/ER is only valid until the next
+/// call to `next`. The same applies to transient values (such as typed or
+/// over-length values), and to all values when the string tables are
+/// bounded, as their IDs may be reused. `nextBatch` copies these values into
+/// the buffer.
+///
+/// Not every stream can be read with a cursor. Compressed and pre-compressed
+/// streams reorder values into channels, and SC fragments are decoded by a
+/// nested decoder, so `next` returns `ErrorCode::kUnimplemented` for both.
+/// These must be decoded with `ExiDecoder::decodeBody`.
+class ExiEventCursor {
+  /// The wrapped decoder, must have a decoded header.
+  ExiDecoder* D;
+  /// Storage for CM/PI/DT/ER strings.
+  SmallVec<SmallStr<32>, 4> Text;
+  /// The current element depth.
+  u32 Depth = 0;
+  /// If `prepareForDecoding` has been run.
+  bool DidPrepare : 1 = false;
+  /// If ED has been decoded, or an error occurred.
+  bool IsDone : 1 = false;
+
+public:
+  explicit ExiEventCursor(ExiDecoder& D) : D(&D) {}
+
+  /// Decodes the next event.
+  /// @return The event, `ExiError::DONE` after ED, `kUnimplemented` for
+  ///  unsupported streams (see above), or some other error.
+  ExiResult<ExiEvent> next();
+
+  /// Decodes up to `MaxEvents` events into `Buf`, which is cleared first.
+  /// Values which are only valid until the next event are copied.
+  /// If an error occurs, the events decoded before it are kept.
+  /// @return The number of events, `ExiError::DONE` if the cursor was
+  ///  already finished, or some other error.
+  ExiResult<usize> nextBatch(ExiEventBuffer& Buf, usize MaxEvents);
+
+  /// Skips the rest of the current element, including its end. This is
+  /// intended to be called directly after an SE has been pulled.
+  /// @return `ExiError::OK`, or an error from `next`.
+  ExiError skipSubtree();
+
+  /// Returns the current element depth.
+  u32 depth() const { return Depth; }
+  /// Returns if decoding has been completed.
+  bool done() const { return IsDone; }
+
+  /// Returns the table the event IDs refer to.
+  const decode::StringTable& idents() const;
+
+  ////////////////////////////////////////////////////////////////////////
+  // Resolution
+
+  /// Gets the QName for SE/EE/AT events.
+  QName getQName(const ExiEvent& Event) const;
+  /// Gets the value for AT/CH events.
+  StrRef getValue(const ExiEvent& Event) const;
+  /// Gets the value for an AT/CH event in a batch, copied or not.
+  StrRef getValue(const ExiEventBuffer& Buf, usize Ix) const;
+  /// Gets the URI for NS events.
+  StrRef getURI(const ExiEvent& Event) const;
+  /// Gets the prefix for NS events.
+  StrRef getPrefix(const ExiEvent& Event) const;
+
+  /// Gets the text for CM/PI/DT/ER events. The pieces are in the same order
+  /// as the arguments to their respective `Serializer` methods.
+  StrRef getText(unsigned Ix = 0) const {
+    exi_invariant(Ix < Text.size(), "invalid text index");
+    return Text[Ix].str();
+  }
+  /// Gets the number of text pieces for the current event.
+  usize getTextCount() const { return Text.size(); }
+
+private:
+  /// Decodes `N` strings into `Text`.
+  template <class StrmT>
+  ExiError readText(StrmT* Strm, unsigned N);
+  /// Completes the data for an event decoded by the schema.
+  template <class StrmT>
+  ExiError completeEvent(StrmT* Strm, EventUID& Event);
+  /// Marks the cursor as finished, forwarding the error.
+  ExiError finish(ExiError E) {
+    IsDone = true;
+    return E;
+  }
+};
+
+} // namespace exi
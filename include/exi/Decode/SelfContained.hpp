@@ -0,0 +1,77 @@
+//===- exi/Decode/SelfContained.hpp ---------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines utilities for decoding self-contained (SC) fragments
+/// independently of the rest of the document.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/ArrayRef.hpp>
+#include <core/Common/FunctionRef.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Decode/UnifyBuffer.hpp>
+
+namespace exi {
+
+class ExiOptions;
+class Serializer;
+
+/// The location of an SC fragment, in bytes from the start of the buffer the
+/// document was decoded from. Fragments are byte aligned, and have their own
+/// string tables and grammars, so they may be decoded in any order.
+struct SCEntry {
+  /// The first byte of the fragment.
+  u64 Begin = 0;
+  /// One past the last byte of the fragment.
+  u64 End = 0;
+
+  u64 size() const { return End - Begin; }
+};
+
+/// An index of SC fragments, filled by `ExiDecoder::setSCIndex`.
+using SCIndex = SmallVec<SCEntry, 0>;
+
+/// Decodes a single SC fragment. Events are reported as a fragment, starting
+/// with SD, then the SC element and its content, and ending with ED.
+ExiError decodeSCFragment(UnifiedBuffer Buffer, const SCEntry& Entry,
+                          ExiOptions& Opts, Serializer* S);
+
+/// Decodes every fragment in `Index` on up to `Threads` threads. When
+/// `Threads` is 0, the hardware concurrency is used. `GetSerializer` is
+/// called once per fragment with its position in `Index`, and may be called
+/// from any thread. The serializer must not be shared between fragments.
+/// Without threads (`EXI_USE_THREADS`), fragments are decoded in order on
+/// the calling thread.
+///
+/// Building `Index` already decodes every fragment once, see
+/// `ExiDecoder::setSCIndex`. This only pays off when the index is reused,
+/// such as when it is stored with the stream or the stream is decoded more
+/// than once.
+///
+/// @return The first error encountered. Fragments which have not begun
+///  decoding are skipped after an error.
+ExiError decodeSCFragments(UnifiedBuffer Buffer, ArrayRef<SCEntry> Index,
+                           ExiOptions& Opts,
+                           function_ref<Serializer*(usize)> GetSerializer,
+                           unsigned Threads = 0);
+
+} // namespace exi
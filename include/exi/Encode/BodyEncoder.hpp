@@ -24,29 +24,215 @@
 #pragma once
 
 #include <core/Common/ArrayRef.hpp>
-#include <core/Common/DenseMap.hpp>
+#include <core/Common/Box.hpp>
+#include <core/Common/MaybeBox.hpp>
 #include <core/Common/Option.hpp>
-#include <core/Common/StringMap.hpp>
-#include <core/Common/Vec.hpp>
+#include <core/Common/SmallVec.hpp>
 #include <core/Support/raw_ostream.hpp>
 #include <exi/Basic/ErrorCodes.hpp>
 #include <exi/Basic/ExiHeader.hpp>
 #include <exi/Basic/StringTables.hpp>
-#include <exi/Decode/HeaderDecoder.hpp>
-#include <exi/Decode/UnifyBuffer.hpp>
+#include <exi/Basic/XML.hpp>
 #include <exi/Grammar/Schema.hpp>
 #include <exi/Stream/OrderedWriter.hpp>
 
 namespace exi {
+class QName;
 
 struct EncoderFlags {
-  
+  /// If the header has already been written.
+  bool DidHeader : 1 = false;
+  /// If init has already been run.
+  bool DidInit : 1 = false;
+  /// If this encodes an SC fragment.
+  bool Fragment : 1 = false;
 };
 
 /// The EXI encoding processor.
 /// FIXME: Split this up into more implementations.
 class ExiEncoder {
+  friend class encode::Schema::Get;
+  struct ChannelState;
 
+  /// The provided Header.
+  ExiHeader Header;
+  /// The channels of a compressed or pre-compressed body, if any. `Writer`
+  /// writes to its structure channel, so this must outlive it.
+  Box<ChannelState> Channels;
+  /// The provided `StreamWriter`.
+  OrdWriter Writer;
+  /// A BumpPtrAllocator for processor internals.
+  exi::BumpPtrAllocator BP;
+  /// The table mapping strings to their IDs (QNames, LocalNames, etc.)
+  encode::StringTable Idents;
+  /// The schema for the current document.
+  Box<encode::Schema> CurrentSchema;
+  /// The encoder of the open SC fragment, which is forwarded every event
+  /// until the element it was opened for ends.
+  Box<ExiEncoder> Fragment;
+  /// The number of elements open in `Fragment`.
+  u32 FragmentDepth = 0;
+
+  /// The stream used for diagnostics.
+  Option<raw_ostream&> OS;
+  /// State of the encoder in terms of progression.
+  EncoderFlags Flags;
+  /// Preserve options.
+  ExiOptions::PreserveOpts Preserve;
+
+public:
+  /// The default number of bytes buffered before writing to a stream.
+  static constexpr u64 kDefaultFlushThreshold = 64 * 1024;
+
+  ExiEncoder(Option<raw_ostream&> OS = std::nullopt);
+  ExiEncoder(MaybeBox<ExiOptions> Opts, Option<raw_ostream&> OS = std::nullopt);
+  ~ExiEncoder();
+
+  /// Get the state flags.
+  EncoderFlags flags() const { return Flags; }
+
+  /// Returns the stream used for diagnostics.
+  raw_ostream& os() const;
+  /// Diagnoses errors in the current context.
+  void diagnose(ExiError E) const;
+
+  ////////////////////////////////////////////////////////////////////////
+  // Initialization
+
+  /// Sets options out-of-band. Must be called before the writer is set.
+  ExiError setOptions(MaybeBox<ExiOptions> Opts);
+  /// Sets the writer to append to `Buffer`. Options must be provided.
+  ExiError setWriter(SmallVecImpl<char>& Buffer);
+  /// Sets the writer to `Strm`. Options must be provided. Data is flushed
+  /// incrementally once `FlushThreshold` bytes are buffered, so memory use
+  /// does not grow with the output. Compressed and pre-compressed bodies are
+  /// instead written a block at a time.
+  ExiError setWriter(raw_ostream& Strm,
+                     u64 FlushThreshold = kDefaultFlushThreshold);
+  /// Writes data to the stream on a background thread, while encoding
+  /// continues into the next of `NBuffers` buffers. Each buffer holds about
+  /// `FlushThreshold` bytes. Must be called after `setWriter(raw_ostream&)`.
+  /// Without threads (`EXI_USE_THREADS`), each buffer is written on the
+  /// calling thread once full, and a warning is logged.
+  ExiError setBackgroundFlush(u32 NBuffers = 2);
+  /// Compresses streams on `Threads` worker threads, or the hardware
+  /// concurrency when 0, while encoding continues into the next block.
+  /// Must be called after `setWriter`, with compression enabled. Without
+  /// threads (`EXI_USE_THREADS`), streams are compressed on the calling
+  /// thread, and a warning is logged.
+  ExiError setParallelCompression(unsigned Threads = 0);
+  /// Declares that strings passed to the encoder stay alive until it is
+  /// destroyed, and that equal addresses always hold equal strings. This is
+  /// the case for strings from a decoder's tables, and allows them to be
+  /// found by address. See `StringTable::setStableStrings`.
+  void setStableStrings(bool Stable = true) {
+    Idents.setStableStrings(Stable);
+  }
+
+  /// Writes the header. Options are always provided out-of-band.
+  /// Defined in `HeaderEncoder.cpp`.
+  ExiError encodeHeader(bool HasCookie = false);
+
+  /// Encodes `Doc` as the body, from SD to ED. Whitespace-only data is
+  /// dropped, and comments, PIs, DOCTYPEs and namespace declarations are
+  /// only encoded when preserved. Entities are translated, unless they
+  /// are undeclared.
+  ExiError encodeBody(const XMLDocument& Doc);
+  /// Writes any buffered data.
+  ExiError flush();
+
+  ////////////////////////////////////////////////////////////////////////
+  // Events
+  //
+  // Events which are not preserved by the current options are dropped.
+
+  /// Start Document
+  ExiError encodeSD();
+  /// End Document
+  ExiError encodeED();
+  /// Start Element
+  ExiError encodeSE(const QName& Name);
+  /// End Element
+  ExiError encodeEE();
+  /// Self Contained, for the element `Name` which was just started. Its
+  /// content is encoded as a fragment, ending with its EE.
+  ExiError encodeSC(const QName& Name);
+  /// Attribute
+  ExiError encodeAT(const QName& Name, StrRef Value);
+  /// Namespace Declaration
+  ExiError encodeNS(StrRef URI, StrRef Prefix, bool LocalElementNS);
+  /// Characters
+  ExiError encodeCH(StrRef Value);
+  /// Comment
+  ExiError encodeCM(StrRef Comment);
+  /// Processing Instruction
+  ExiError encodePI(StrRef Target, StrRef Text);
+  /// DOCTYPE
+  ExiError encodeDT(StrRef Name, StrRef PublicID,
+                    StrRef SystemID, StrRef Text);
+  /// Entity Reference
+  ExiError encodeER(StrRef Name);
+
+protected:
+  /// Initializes StringTable and Schema.
+  ExiError init();
+  /// Initializes the encoder if required.
+  ExiError prepareForEncoding() {
+    if EXI_LIKELY(Flags.DidInit)
+      return ExiError::OK;
+    return this->init();
+  }
+
+  /// Splits the body into channels written to `OS`, for compression or
+  /// pre-compression.
+  ExiError setChannelWriter(raw_ostream& OS);
+  /// Writes the structure buffered so far outside of any stream, which is
+  /// how the header is written when the body is split into channels.
+  void flushStructure();
+  /// Writes the current block of channels, and begins the next.
+  ExiError closeBlock();
+
+  /// Creates an encoder for an SC fragment, continuing from the writer.
+  Box<ExiEncoder> newFragment();
+  /// Ends the SC fragment, and continues from where it ended.
+  ExiError closeFragment();
+
+  ////////////////////////////////////////////////////////////////////////
+  // Values
+  //
+  // These are instantiated for `BitWriter` and `ByteWriter`, which allows
+  // writes to be devirtualized and inlined.
+
+  /// Encodes a QName, adding new strings to the tables.
+  template <class StrmT>
+  SmallQName encodeQName(StrmT* Strm, const QName& Name);
+  /// Encodes the fields of a Namespace Declaration.
+  template <class StrmT>
+  void encodeNS(StrmT* Strm, StrRef URI, StrRef Pfx, bool IsLocal);
+
+  /// Encodes a URI.
+  template <class StrmT>
+  CompactID encodeURI(StrmT* Strm, StrRef URI);
+  /// Encodes a LocalName, with `StringTable::Hash(Name)` precomputed.
+  template <class StrmT>
+  CompactID encodeName(StrmT* Strm, CompactID URI,
+                       StrRef Name, u32 NameHash);
+
+  /// Encodes a QName Prefix, if `Preserve.Prefixes` is enabled.
+  template <class StrmT>
+  void encodePfxQ(StrmT* Strm, CompactID URI, StrRef Pfx);
+  /// Encodes a NS Prefix, `Preserve.Prefixes` must be enabled.
+  template <class StrmT>
+  void encodePfx(StrmT* Strm, CompactID URI, StrRef Pfx);
+
+  /// Encodes a Value, or adds it to its channel when the body is split.
+  template <class StrmT>
+  void encodeValue(StrmT* Strm, SmallQName Name, StrRef Value);
+  /// Writes a Value to the stream.
+  template <class StrmT>
+  void writeValue(StrmT* Strm, SmallQName Name, StrRef Value);
+  /// Adds a Value to its channel, closing the block once it is full.
+  EXI_NO_INLINE void deferValue(SmallQName Name, StrRef Value);
 };
 
 } // namespace exi
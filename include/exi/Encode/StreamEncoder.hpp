@@ -0,0 +1,91 @@
+//===- exi/Encode/StreamEncoder.hpp ---------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines an encoder front end which accepts events as they
+/// occur, without building a document.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <exi/Decode/Serializer.hpp>
+#include <exi/Encode/BodyEncoder.hpp>
+
+namespace exi {
+
+/// Encodes events as they are produced, mirroring the `Serializer`
+/// interface. Nothing is retained besides the open element count, the name
+/// of the last element and the encoder's tables, so memory is bounded by
+/// nesting depth and string table size rather than the size of the document.
+///
+/// Since it is a `Serializer`, it may also be passed directly to
+/// `ExiDecoder::decodeBody`.
+class StreamEncoder final : public Serializer {
+  ExiEncoder& Encoder;
+  /// The number of open elements.
+  u32 Depth = 0;
+  /// The name of the last element started, which SC follows.
+  QName LastSE;
+  /// If the header should have the `$EXI` cookie.
+  bool HasCookie = false;
+
+public:
+  /// Creates a front end for `Encoder`, which must have a writer. The header
+  /// is written on `SD` if it has not already been.
+  explicit StreamEncoder(ExiEncoder& Encoder, bool HasCookie = false) :
+   Encoder(Encoder), HasCookie(HasCookie) {
+  }
+
+  /// Returns the number of open elements.
+  u32 depth() const { return Depth; }
+  /// Returns the underlying encoder.
+  ExiEncoder& encoder() const { return Encoder; }
+
+  /// Start Document
+  ExiError SD() override;
+  /// End Document, flushing the writer.
+  ExiError ED() override;
+  /// Start Element
+  ExiError SE(QName Name) override;
+  /// End Element
+  ExiError EE(QName Name) override;
+  /// Self-Contained, for the last element started. Its name must still be
+  /// valid.
+  ExiError SC() override;
+  /// Attribute
+  ExiError AT(QName Name, StrRef Value) override;
+  /// Namespace Declaration
+  ExiError NS(StrRef URI, StrRef Prefix, bool LocalElementNS) override;
+  /// Characters
+  ExiError CH(StrRef Value) override;
+  /// Comment
+  ExiError CM(StrRef Comment) override;
+  /// Processing Instruction
+  ExiError PI(StrRef Target, StrRef Text) override;
+  /// DOCTYPE
+  ExiError DT(StrRef Name, StrRef PublicID,
+              StrRef SystemID, StrRef Text) override;
+  /// Entity Reference
+  ExiError ER(StrRef Name) override;
+
+  /// Strings are copied into the encoder's tables when required.
+  bool needsPersistence() const override { return false; }
+};
+
+} // namespace exi
@@ -0,0 +1,75 @@
+//===- exi/Encode/Transcoder.hpp ------------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines a transcoder, which re-encodes EXI with new options.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/MaybeBox.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Support/MemoryBufferRef.hpp>
+#include <core/Support/raw_ostream.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Basic/ExiOptions.hpp>
+#include <exi/Decode/BodyDecoder.hpp>
+
+namespace exi {
+
+class ExiEncoder;
+
+/// Re-encodes EXI streams with different options, eg. bit-packed to
+/// byte-aligned, or with prefixes dropped. Decoded events are passed
+/// straight to an encoder, without building a document in between.
+///
+/// Strings from the decoder's tables are stable for the whole stream, so the
+/// encoder finds QNames and values by address. Each distinct string is only
+/// hashed the first time it is seen. SC fragments are inlined into the
+/// output.
+class ExiTranscoder {
+  /// The decoder, which is reused between streams.
+  ExiDecoder Decoder;
+  /// If `Decoder` must be reset before the next stream.
+  bool NeedsReset = false;
+
+public:
+  /// Creates a transcoder for input with the options `InOpts`.
+  explicit ExiTranscoder(MaybeBox<ExiOptions> InOpts,
+                         Option<raw_ostream&> OS = std::nullopt);
+
+  /// Transcodes `In`, appending a stream with the options `OutOpts` to
+  /// `Out`. The output header does not include options.
+  ExiError transcode(MemoryBufferRef In, MaybeBox<ExiOptions> OutOpts,
+                     SmallVecImpl<char>& Out, bool HasCookie = false);
+  /// Transcodes `In`, writing a stream with the options `OutOpts` to `Out`.
+  /// The output header does not include options.
+  ExiError transcode(MemoryBufferRef In, MaybeBox<ExiOptions> OutOpts,
+                     raw_ostream& Out, bool HasCookie = false);
+
+  /// Diagnoses errors in the current context.
+  void diagnose(ExiError E) const { Decoder.diagnose(E); }
+
+private:
+  /// Decodes `In` into `Encoder`, which must have a writer.
+  ExiError transcodeTo(MemoryBufferRef In, ExiEncoder& Encoder,
+                       bool HasCookie);
+};
+
+} // namespace exi
@@ -27,6 +27,7 @@
 #include <core/Common/MaybeBox.hpp>
 #include <core/Support/ExtensibleRTTI.hpp>
 #include <exi/Basic/EventCodes.hpp>
+#include <exi/Grammar/SchemaGrammars.hpp>
 
 namespace exi {
 
@@ -42,6 +43,22 @@ public:
   static const char ID;
   /// Gets the terminal symbol at the current position.
   [[nodiscard]] virtual EventUID decode(ExiDecoder* D) = 0;
+  /// Returns the schema to its initial state for another body. Grammars
+  /// learned while decoding are discarded.
+  /// @param IsFragment If the body is a fragment, such as an SC element.
+  virtual void reset(bool IsFragment) = 0;
+
+  /// Saves the state before an event, so it can be restored by `rollback`
+  /// if the event runs out of input.
+  virtual void checkpoint() {}
+  /// Restores the state saved by the last `checkpoint`, forgetting any
+  /// grammars learned since.
+  /// @return `false` if the schema can't be restored.
+  virtual bool rollback() { return false; }
+
+  /// Returns the bytes held by grammars learned while decoding, other than
+  /// those allocated by the decoder.
+  virtual usize getMemoryUsage() const { return 0; }
   virtual void dump() const {}
 protected:
   class Get;
@@ -60,27 +77,36 @@ protected:
     StartTagContent,
     ElementContent,
     Fragment,
-    Last = ElementContent
+    Last = Fragment
   };
   
 public:
   static const char ID;
   /// @brief Gets a builtin schema.
-  [[nodiscard]] static Box<BuiltinSchema> New(const ExiOptions& Opts);
+  /// @param IsFragment If the body is a fragment, such as an SC element.
+  [[nodiscard]] static Box<BuiltinSchema> New(const ExiOptions& Opts,
+                                              bool IsFragment = false);
 private:
   virtual void anchor();
 };
 
 /// A schema which was compiled at runtime.
 class DynamicSchema : public RTTIExtends<DynamicSchema, Schema> {
-  // TODO: Add Grammar.
 public:
   static const char ID;
+  /// @brief Gets a schema-informed schema for the grammars of an XSD.
+  /// The string table must be set up from the same grammars.
+  /// @param IsFragment If the body is a fragment, such as an SC element.
+  /// Defined in `DynamicSchema.cpp`.
+  [[nodiscard]] static Box<DynamicSchema> New(const ExiOptions& Opts,
+                                              SchemaGrammarsRef Grammars,
+                                              bool IsFragment = false);
 private:
   virtual void anchor();
 };
 
-/// A precompiled schema.
+/// A precompiled schema, generated from an XSD by `exi-schemac`. Its tables
+/// are constants, and each state decodes its productions directly.
 class CompiledSchema : public RTTIExtends<CompiledSchema, Schema> {
 public:
   static const char ID;
@@ -88,5 +114,16 @@ private:
   virtual void anchor();
 };
 
+/// Describes a schema generated by `exi-schemac`, which is registered with
+/// `ExiDecoder::addCompiledSchema`.
+struct CompiledSchemaInfo {
+  /// The `schemaId` of streams using the schema.
+  StrRef SchemaID;
+  /// The tables the string table is set up from.
+  const SchemaTables* Tables = nullptr;
+  /// Creates the schema for the alignment of `Opts`.
+  Box<CompiledSchema>(*New)(const ExiOptions& Opts, bool IsFragment) = nullptr;
+};
+
 } // namespace decode
 } // namespace exi
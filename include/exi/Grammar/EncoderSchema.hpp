@@ -0,0 +1,100 @@
+//===- exi/Grammar/EncoderSchema.hpp --------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the base for encoder schemas.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/Box.hpp>
+#include <core/Common/StrRef.hpp>
+#include <core/Support/ExtensibleRTTI.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Basic/EventCodes.hpp>
+
+namespace exi {
+
+struct ExiOptions;
+class ExiEncoder;
+class QName;
+
+namespace encode {
+
+/// The base for all schemas.
+class Schema : public RTTIExtends<Schema, RTTIRoot> {
+  friend class exi::ExiEncoder;
+public:
+  static const char ID;
+
+  /// Encodes a Start Element, learning new productions as required.
+  virtual ExiError encodeSE(ExiEncoder* E, const QName& Name) = 0;
+  /// Encodes an End Element.
+  virtual ExiError encodeEE(ExiEncoder* E) = 0;
+  /// Encodes an Attribute and its value.
+  virtual ExiError encodeAT(ExiEncoder* E, const QName& Name,
+                            StrRef Value) = 0;
+  /// Encodes a Namespace Declaration.
+  virtual ExiError encodeNS(ExiEncoder* E, StrRef URI, StrRef Pfx,
+                            bool IsLocal) = 0;
+  /// Encodes Characters in the current element.
+  virtual ExiError encodeCH(ExiEncoder* E, StrRef Value) = 0;
+  /// Encodes a Self Contained event. The content of the current element is
+  /// encoded as a separate fragment, so the element is treated as ended.
+  virtual ExiError encodeSC(ExiEncoder* E) = 0;
+  /// Encodes the event code of a term with no QName or value (SD, ED, CM,
+  /// PI, DT or ER). The content of the event is written by the encoder.
+  virtual ExiError encodeTerm(ExiEncoder* E, EventTerm Term) = 0;
+
+  /// Returns the schema to its initial state for another body. Grammars
+  /// learned while encoding are discarded.
+  virtual void reset() = 0;
+  virtual void dump() const {}
+protected:
+  class Get;
+private:
+  virtual void anchor();
+};
+
+/// The builtin (or fallback) schema.
+class BuiltinSchema : public RTTIExtends<BuiltinSchema, Schema> {
+protected:
+  /// Possible Grammar states for schemaless.
+  enum class Grammar {
+    Document,
+    DocContent,
+    DocEnd,
+    StartTagContent,
+    ElementContent,
+    Fragment,
+    Last = Fragment
+  };
+
+public:
+  static const char ID;
+  /// @brief Gets a builtin schema, which encodes an SC fragment if
+  /// `IsFragment` is set.
+  [[nodiscard]] static Box<BuiltinSchema> New(const ExiOptions& Opts,
+                                              bool IsFragment = false);
+private:
+  virtual void anchor();
+};
+
+} // namespace encode
+} // namespace exi
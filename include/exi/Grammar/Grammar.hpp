@@ -24,6 +24,7 @@
 #pragma once
 
 #include <core/Common/Box.hpp>
+#include <core/Common/Option.hpp>
 #include <core/Common/Result.hpp>
 #include <core/Common/SmallVec.hpp>
 #include <core/Support/Logging.hpp>
@@ -71,22 +72,20 @@ class BuiltinGrammar final : public Grammar {
   /// One inline element for StartElement or CHaracters. +2
   SmallVec<EventUID, 1> Element;
 
-  static u64 ReadBits(auto* Strm, u32 Bits) {
-    auto Out = Strm->readBits64(Bits);
-    if EXI_UNLIKELY(Out.is_err())
-      exi_unreachable("invalid stream read.");
-    return *Out;
-  }
-
 public:
   BuiltinGrammar() = default;
   explicit BuiltinGrammar(SmallQName Name) : Name(Name) {}
 
+  /// Reads the first part of an event code. If it can't be read, the term
+  /// will be null.
   template <class Strm> GrammarTerm getTerm(OrdReader& Reader, bool IsStart) {
     auto& Elts = this->getElts(IsStart);
     const usize Size = Elts.size();
     const u32 Bits = this->getLog(IsStart);
-    const u64 Out = ReadBits(cast<Strm>(&Reader), Bits);
+    const auto Read = cast<Strm>(&Reader)->readBits64(Bits);
+    if EXI_UNLIKELY(Read.is_err())
+      return Ok(EventUID::NewNull());
+    const u64 Out = *Read;
     // Check if this is a valid offset.
     if (Out < Size) {
       // Values are always pushed in reverse order, so remap the position.
@@ -110,18 +109,34 @@ public:
     this->setLog(IsStart);
   }
 
-  SmallQName getName() const { return Name; }
-  void dump(ExiDecoder* D) const override;
+  /// Finds the event code of a learned production, where the most recent
+  /// has the code 0. Terms with a QName must also match `Name`.
+  Option<u64> findTerm(EventTerm Term, SmallQName Name, bool IsStart) const;
 
-private:
-  /// Sets the log for StartTag or Element.
-  void setLog(bool IsStart);
+  /// Returns the number of learned productions for StartTag or Element.
+  usize size(bool IsStart) const {
+    return getElts(IsStart).size();
+  }
+
+  /// Forgets the most recent productions for StartTag or Element, until
+  /// `Size` remain.
+  void truncate(usize Size, bool IsStart) {
+    getElts(IsStart).truncate(Size);
+    this->setLog(IsStart);
+  }
 
   /// Returns a precalculated log for StartTag or Element.
   u32 getLog(bool IsStart) const {
     return IsStart ? StartTagLog : ElementLog;
   }
 
+  SmallQName getName() const { return Name; }
+  void dump(ExiDecoder* D) const override;
+
+private:
+  /// Sets the log for StartTag or Element.
+  void setLog(bool IsStart);
+
   /// Returns the backing for StartTag or Element.
   SmallVecImpl<EventUID>& getElts(bool IsStart) {
     if (IsStart)
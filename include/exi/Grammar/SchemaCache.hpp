@@ -0,0 +1,61 @@
+//===- exi/Grammar/SchemaCache.hpp ----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines grammar caches, which store the tables of a schema so
+/// later processes can map them instead of loading the XSD again.
+///
+/// A cache is the `SchemaTables` of a schema in their native layout, along
+/// with the paths of every document the schema was loaded from. It is valid
+/// while the MD5 of those documents matches the one it was written with.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/ArrayRef.hpp>
+#include <core/Common/String.hpp>
+#include <core/Support/MD5.hpp>
+#include <exi/Grammar/SchemaGrammars.hpp>
+
+namespace exi {
+
+class raw_ostream;
+class Twine;
+
+/// The version of the cache format, which must be bumped whenever the
+/// layout of `SchemaTables` or the header changes meaning.
+inline constexpr u32 kSchemaCacheVersion = 2;
+
+/// Adds the contents of a single source to `Hash`.
+void hashSchemaSource(MD5& Hash, StrRef Data);
+
+/// Hashes the contents of the files `Sources`, which keys a grammar cache.
+/// This is the same as calling `hashSchemaSource` with each in order.
+Expected<MD5::MD5Result> hashSchemaSources(ArrayRef<String> Sources);
+
+/// Writes the tables `T` of a schema loaded from `Sources` as a grammar
+/// cache, keyed by `Hash`.
+void writeSchemaCache(raw_ostream& OS, const SchemaTables& T,
+                      ArrayRef<String> Sources, const MD5::MD5Result& Hash);
+
+/// Maps the grammar cache at `Path`, and uses its tables in place. Returns
+/// null if the cache is missing, invalid, or its sources have changed.
+SchemaGrammarsRef loadSchemaCache(const Twine& Path);
+
+} // namespace exi
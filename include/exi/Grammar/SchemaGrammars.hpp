@@ -0,0 +1,334 @@
+//===- exi/Grammar/SchemaGrammars.hpp -------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the tables of schema-informed grammars.
+///
+/// Every table is a flat array of plain structs, which only reference each
+/// other by index. This keeps them independent of where they are stored, so
+/// they may be built at runtime, generated as constants, or read from a file.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/ArrayRef.hpp>
+#include <core/Common/Box.hpp>
+#include <core/Common/IntrusiveRefCntPtr.hpp>
+#include <core/Common/Option.hpp>
+#include <core/Common/StrRef.hpp>
+#include <core/Common/Vec.hpp>
+#include <core/Support/Error.hpp>
+#include <exi/Basic/EventCodes.hpp>
+
+namespace exi {
+
+class MemoryBuffer;
+class raw_ostream;
+
+/// A string in `SchemaTables::Chars`.
+struct SchemaStr {
+  u32 Offset = 0;
+  u32 Size = 0;
+};
+
+/// A URI partition of the initial string table.
+struct SchemaURI {
+  SchemaStr Name;
+  /// The first LocalName of the partition in `SchemaTables::LocalNames`.
+  u32 FirstName = 0;
+  /// The number of LocalNames in the partition.
+  u32 NNames = 0;
+};
+
+/// A QName, with IDs from the initial string table.
+struct SchemaQName {
+  u32 URI = 0;
+  u32 LocalID = 0;
+public:
+  constexpr SmallQName get() const {
+    return SmallQName::NewQName(URI, LocalID);
+  }
+  constexpr auto operator<=>(const SchemaQName&) const = default;
+};
+
+/// The representations of schema-typed values.
+enum class SchemaValueKind : u8 {
+  String,       // String, possibly with a restricted character set.
+  Boolean,      // 1 bit, or 2 bits if the type has patterns.
+  Decimal,      // Sign, integral part, then reversed fractional part.
+  Float,        // Integer mantissa and exponent.
+  Integer,      // Sign, then magnitude.
+  Unsigned,     // Unsigned Integer.
+  NBitUnsigned, // n-bit Unsigned Integer, offset by `Min`.
+  Binary,       // Length, then bytes. Printed as base64.
+  HexBinary,    // Length, then bytes. Printed as hex.
+  DateTime,     // Year, MonthDay, Time, FractionalSecs
+  Time,         // Time, FractionalSecs
+  Date,         // Year, MonthDay
+  GYearMonth,   // Year, MonthDay
+  GYear,        // Year
+  GMonthDay,    // MonthDay
+  GDay,         // MonthDay
+  GMonth,       // MonthDay
+  List,         // Length, then items of the datatype `First`.
+  Enumeration,  // n-bit index of a value.
+  Last = Enumeration
+};
+
+/// The representation of a value in the schema.
+struct SchemaDatatype {
+  SchemaValueKind Kind = SchemaValueKind::String;
+  /// The bits of an `NBitUnsigned`, `Enumeration`, or `Boolean`.
+  u8 Bits = 0;
+  u16 Reserved = 0;
+  /// The item datatype of a `List`, the first value of an `Enumeration` in
+  /// `EnumValues`, or the first character of a `String` in `CharSets`.
+  u32 First = 0;
+  /// The number of values of an `Enumeration`, or restricted characters of
+  /// a `String`. A `String` with no characters is unrestricted.
+  u32 Count = 0;
+  /// The lower bound of an `NBitUnsigned`.
+  i64 Min = 0;
+};
+
+/// A type definition, along with its grammars.
+struct SchemaType {
+  enum : u8 {
+    /// The type has a name, and may be used with `xsi:type`.
+    kNamed        = 0b001,
+    /// The type has named sub-types, or is a union.
+    kHasSubTypes  = 0b010,
+    /// The type is simple.
+    kSimple       = 0b100,
+  };
+
+  /// The name of the type, if it has one.
+  SchemaQName Name;
+  /// The first state of the type's grammar.
+  u32 Grammar = 0;
+  /// The first state of the grammar used when `xsi:nil` is true.
+  u32 EmptyGrammar = 0;
+  /// The attribute uses of the type in `AttrUses`, sorted by event code.
+  u32 FirstAttrUse = 0;
+  u32 NAttrUses = 0;
+  u8 Flags = 0;
+public:
+  constexpr bool hasSubTypes() const { return Flags & kHasSubTypes; }
+};
+
+/// An element declaration.
+struct SchemaElement {
+  enum : u8 {
+    kNillable = 0b01,
+    kGlobal   = 0b10,
+  };
+
+  SchemaQName Name;
+  /// The declared type.
+  u32 Type = 0;
+  u8 Flags = 0;
+public:
+  constexpr bool isNillable() const { return Flags & kNillable; }
+};
+
+/// A global attribute declaration.
+struct SchemaAttribute {
+  SchemaQName Name;
+  /// The datatype of its values.
+  u32 Datatype = 0;
+};
+
+/// A state of a grammar, which is a non-terminal in the spec.
+struct SchemaState {
+  enum : u8 {
+    /// The first state of a type's grammar.
+    kStart      = 0b0001,
+    /// The state precedes the content, where undeclared attributes may occur.
+    kAttributes = 0b0010,
+    /// The state has an EE production.
+    kHasEE      = 0b0100,
+    /// The state is part of a grammar used when `xsi:nil` is true.
+    kEmpty      = 0b1000,
+  };
+
+  /// The productions in `Prods`, in event code order.
+  u32 FirstProd = 0;
+  u32 NProds = 0;
+  /// The state after undeclared SE(*), CH, ER, CM, and PI productions. This
+  /// is `content2` for attribute states, and the state itself otherwise.
+  u32 Content2 = 0;
+  /// The type owning the grammar.
+  u32 Type = 0;
+  u8 Flags = 0;
+public:
+  constexpr bool isStart() const { return Flags & kStart; }
+  constexpr bool isAttributes() const { return Flags & kAttributes; }
+  constexpr bool hasEE() const { return Flags & kHasEE; }
+  constexpr bool isEmpty() const { return Flags & kEmpty; }
+};
+
+/// A declared production of a state.
+struct SchemaProd {
+  /// One of `SEQName`, `SEUri`, `SE`, `ATQName`, `ATUri`, `AT`, `EE`, or
+  /// `CH`. Stored as the underlying type, so the layout is fixed.
+  u8 Term = 0;
+  u8 Reserved[3] {};
+  /// The name of `SEQName` and `ATQName`, or the URI of `SEUri`/`ATUri`.
+  SchemaQName Name;
+  /// The element of `SEQName`, or the datatype of `ATQName` and `CH`.
+  u32 Target = 0;
+  /// The state after the production.
+  u32 Next = 0;
+public:
+  constexpr EventTerm getTerm() const { return EventTerm(Term); }
+};
+
+/// A view of the tables of a schema. The grammars are only valid for the
+/// string table created from `URIs` and `LocalNames`.
+struct SchemaTables {
+  /// The characters of every `SchemaStr`.
+  ArrayRef<char> Chars;
+  /// The initial URI partitions, starting with those defined by the spec.
+  ArrayRef<SchemaURI> URIs;
+  /// The initial LocalNames of every URI, sorted within their partitions.
+  ArrayRef<SchemaStr> LocalNames;
+  ArrayRef<SchemaDatatype> Datatypes;
+  /// The values of every `Enumeration`.
+  ArrayRef<SchemaStr> EnumValues;
+  /// The code points of every restricted `String`, sorted.
+  ArrayRef<u32> CharSets;
+  ArrayRef<SchemaType> Types;
+  /// The attribute uses of every type.
+  ArrayRef<SchemaQName> AttrUses;
+  ArrayRef<SchemaElement> Elements;
+  /// The global attributes, sorted by `Name`.
+  ArrayRef<SchemaAttribute> Attributes;
+  ArrayRef<SchemaState> States;
+  ArrayRef<SchemaProd> Prods;
+  /// The global elements, in event code order of `DocContent`.
+  ArrayRef<u32> DocElements;
+  /// The elements of the fragment grammar, in event code order.
+  ArrayRef<u32> FragmentElements;
+  /// The global elements, sorted by `Name`.
+  ArrayRef<u32> GlobalElements;
+  /// The named types, sorted by `Name`.
+  ArrayRef<u32> NamedTypes;
+  /// The type used for undeclared elements with no global declaration in
+  /// the fragment grammar, `xs:anyType`.
+  u32 AnyType = 0;
+public:
+  StrRef getStr(SchemaStr S) const {
+    return StrRef(Chars.data() + S.Offset, S.Size);
+  }
+  StrRef getURI(u32 URI) const { return getStr(URIs[URI].Name); }
+  StrRef getLocalName(SchemaQName Name) const {
+    return getStr(LocalNames[URIs[Name.URI].FirstName + Name.LocalID]);
+  }
+
+  /// Returns the code points of a restricted `String`.
+  ArrayRef<u32> getCharSet(const SchemaDatatype& DT) const {
+    return CharSets.slice(DT.First, DT.Count);
+  }
+  /// Returns the values of an `Enumeration`.
+  ArrayRef<SchemaStr> getEnumValues(const SchemaDatatype& DT) const {
+    return EnumValues.slice(DT.First, DT.Count);
+  }
+  /// Returns the declared productions of a state.
+  ArrayRef<SchemaProd> getProds(const SchemaState& S) const {
+    return Prods.slice(S.FirstProd, S.NProds);
+  }
+  /// Returns the attribute uses of a type.
+  ArrayRef<SchemaQName> getAttrUses(const SchemaType& T) const {
+    return AttrUses.slice(T.FirstAttrUse, T.NAttrUses);
+  }
+
+  /// Finds the global element with `Name`.
+  Option<u32> findElement(SmallQName Name) const;
+  /// Finds the global attribute with `Name`.
+  Option<u32> findAttribute(SmallQName Name) const;
+  /// Finds the named type with `Name`.
+  Option<u32> findType(SmallQName Name) const;
+  /// Finds the LocalID of `Local` in the partition `URI`.
+  Option<u32> findLocalName(u32 URI, StrRef Local) const;
+
+  void dump(raw_ostream& OS) const;
+  void dump() const;
+};
+
+/// Storage for the tables of a schema.
+struct SchemaTableData {
+  Vec<char> Chars;
+  Vec<SchemaURI> URIs;
+  Vec<SchemaStr> LocalNames;
+  Vec<SchemaDatatype> Datatypes;
+  Vec<SchemaStr> EnumValues;
+  Vec<u32> CharSets;
+  Vec<SchemaType> Types;
+  Vec<SchemaQName> AttrUses;
+  Vec<SchemaElement> Elements;
+  Vec<SchemaAttribute> Attributes;
+  Vec<SchemaState> States;
+  Vec<SchemaProd> Prods;
+  Vec<u32> DocElements;
+  Vec<u32> FragmentElements;
+  Vec<u32> GlobalElements;
+  Vec<u32> NamedTypes;
+  u32 AnyType = 0;
+public:
+  /// Appends `Str` to `Chars`.
+  SchemaStr addStr(StrRef Str);
+  /// Returns a view of the tables.
+  SchemaTables view() const;
+  /// Returns the bytes held by the tables.
+  usize getMemoryUsage() const;
+};
+
+/// The compiled grammars of a schema, shared by every decoder using it.
+class SchemaGrammars : public ThreadSafeRefCountedBase<SchemaGrammars> {
+  SchemaTableData Data;
+  /// The grammar cache `Tables` points into, if loaded from one.
+  Box<MemoryBuffer> Mapped;
+  SchemaTables Tables;
+public:
+  explicit SchemaGrammars(SchemaTableData&& Data);
+  /// Uses `Tables` in place, which must point into `Mapped`.
+  SchemaGrammars(Box<MemoryBuffer> Mapped, const SchemaTables& Tables);
+  SchemaGrammars(const SchemaGrammars&) = delete;
+  SchemaGrammars& operator=(const SchemaGrammars&) = delete;
+  ~SchemaGrammars();
+
+  const SchemaTables& tables() const { return Tables; }
+  /// If the tables were mapped from a grammar cache.
+  bool isMapped() const { return bool(Mapped); }
+  usize getMemoryUsage() const;
+};
+
+using SchemaGrammarsRef = IntrusiveRefCntPtr<SchemaGrammars>;
+
+/// Resolves the `schemaId` of a stream to its grammars.
+class SchemaResolver : public ThreadSafeRefCountedBase<SchemaResolver> {
+public:
+  virtual ~SchemaResolver();
+  /// Gets the grammars of the schema with `SchemaID`.
+  virtual Expected<SchemaGrammarsRef> resolve(StrRef SchemaID) = 0;
+};
+
+using SchemaResolverRef = IntrusiveRefCntPtr<SchemaResolver>;
+
+} // namespace exi
@@ -0,0 +1,88 @@
+//===- exi/Grammar/SchemaLoader.hpp ---------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the loading of XSD schemas into grammars.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/StringMap.hpp>
+#include <core/Common/String.hpp>
+#include <core/Common/Vec.hpp>
+#include <core/Support/MD5.hpp>
+#include <exi/Basic/XMLManager.hpp>
+#include <exi/Grammar/SchemaGrammars.hpp>
+#include <mutex>
+
+namespace exi {
+
+class Twine;
+
+/// The documents a schema was loaded from.
+struct XSDSources {
+  /// The paths of every loaded document, in load order.
+  Vec<String> Paths;
+  /// The hash of each document as it was parsed, see `hashSchemaSource`.
+  MD5 Hash;
+  /// If every document was hashed. Documents which `Mgr` had already parsed
+  /// in place can't be, as their text is gone.
+  bool IsComplete = true;
+};
+
+/// Loads the XSD schema at `Path` with `Mgr`, along with the schemas it
+/// includes and imports, and builds its grammars.
+///
+/// Included and imported schemas are resolved relative to the including
+/// file. Remote locations are not fetched, any components they define are
+/// treated as undeclared.
+///
+/// @param Sources If set, every loaded document is recorded.
+Expected<SchemaGrammarsRef> loadXSDGrammars(XMLManager& Mgr,
+                                            const Twine& Path,
+                                            XSDSources* Sources = nullptr);
+
+/// Resolves each `schemaId` as the path of an XSD schema. Grammars are built
+/// once per path, and shared by every decoder using the resolver. An empty
+/// `schemaId` resolves to grammars with only the builtin types.
+class XSDSchemaResolver final : public SchemaResolver {
+  XMLManagerRef Mgr;
+  /// The directory relative paths are resolved from.
+  String BaseDir;
+  /// The directory grammar caches are kept in, if any.
+  String CacheDir;
+  StringMap<SchemaGrammarsRef> Cache;
+  std::mutex Lock;
+public:
+  explicit XSDSchemaResolver(XMLManagerRef Mgr, StrRef BaseDir = "");
+  ~XSDSchemaResolver() override;
+
+  /// Keeps grammar caches in `Dir`, which must exist. Schemas are mapped
+  /// from their cache when it is up to date, and cached once built
+  /// otherwise. See `SchemaCache.hpp`.
+  void setCacheDir(StrRef Dir);
+
+  Expected<SchemaGrammarsRef> resolve(StrRef SchemaID) override;
+
+private:
+  /// Gets the path of the grammar cache for the schema at `Path`.
+  void getCachePath(StrRef Path, SmallVecImpl<char>& Out) const;
+};
+
+} // namespace exi
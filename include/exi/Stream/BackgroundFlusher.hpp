@@ -0,0 +1,107 @@
+//===- exi/Stream/BackgroundFlusher.hpp -----------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines a ring of buffers which are written on another thread.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/SmallVec.hpp>
+#include <core/Support/raw_ostream.hpp>
+#include <Config/Config.inc>
+#if EXI_USE_THREADS
+# include <condition_variable>
+# include <mutex>
+# include <thread>
+#endif
+
+namespace exi {
+
+/// Writes filled buffers to a stream on a background thread, so the writer
+/// can continue into the next buffer while slow storage catches up.
+///
+/// Buffers form a ring, and are written in the order they are submitted.
+/// Once written they are cleared and reused, so their capacity is kept. If
+/// every other buffer is still waiting to be written, `submit` blocks.
+///
+/// The stream must not be touched by anything else until `drain` returns.
+///
+/// Without threads (`EXI_USE_THREADS`), buffers are written as they are
+/// submitted, so the interface is the same but nothing overlaps.
+class BackgroundFlusher {
+  using buffer_t = SmallVecImpl<char>;
+
+  /// The stream buffers are written to.
+  raw_ostream& OS;
+  /// The ring of buffers, never resized after construction.
+  SmallVec<SmallVec<char, 0>, 4> Buffers;
+
+  /// The number of buffers submitted. Only modified by the writer.
+  u64 Submitted = 0;
+  /// The number of buffers written to the stream.
+  u64 Written = 0;
+
+#if EXI_USE_THREADS
+  std::mutex Lock;
+  /// Signaled when a buffer is submitted or written.
+  std::condition_variable Signal;
+  /// If the thread should exit once everything is written.
+  bool IsStopping = false;
+
+  /// Writes submitted buffers, started last.
+  std::thread Worker;
+#endif
+
+public:
+  /// The smallest number of buffers, which allows one to be filled while
+  /// the other is written.
+  static constexpr u32 kMinBuffers = 2;
+
+  /// Creates a flusher writing to `OS` with a ring of `NBuffers` buffers.
+  explicit BackgroundFlusher(raw_ostream& OS, u32 NBuffers = kMinBuffers);
+  /// Writes every submitted buffer, then stops the thread.
+  ~BackgroundFlusher();
+
+  BackgroundFlusher(const BackgroundFlusher&) = delete;
+  BackgroundFlusher& operator=(const BackgroundFlusher&) = delete;
+
+  /// The number of buffers in the ring.
+  u32 size() const { return Buffers.size(); }
+
+  /// Returns the buffer currently being filled.
+  buffer_t& current() {
+    return Buffers[Submitted % Buffers.size()];
+  }
+
+  /// Queues the current buffer to be written, and returns the next one
+  /// once it is free.
+  buffer_t& submit();
+
+  /// Waits until every submitted buffer has been written.
+  void drain();
+
+#if EXI_USE_THREADS
+private:
+  /// The loop run by `Worker`.
+  void run();
+#endif
+};
+
+} // namespace exi
@@ -1,4 +1,4 @@
-//===- exi/Stream/OrderedReader.hpp ---------------------------------===//
+//===- exi/Stream/ChannelReader.hpp ---------------------------------===//
 //
 // Copyright (C) 2024 Eightfold
 //
@@ -17,16 +17,195 @@
 //===----------------------------------------------------------------===//
 ///
 /// \file
-/// This file defines the in-order readers.
+/// This file defines the readers for streams split into channels.
 ///
 //===----------------------------------------------------------------===//
 
 #pragma once
 
-#include <exi/Stream/Reader.hpp>
+#include <core/Common/ArrayRef.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Stream/Stream.hpp>
+#include <Config/Config.inc>
+#if EXI_USE_THREADS
+# include <condition_variable>
+# include <mutex>
+# include <thread>
+#endif
 
-#define EXI_HAS_CHANNEL_READER 0
+#define EXI_HAS_CHANNEL_READER 1
+
+struct z_stream_s;
 
 namespace exi {
 
+/// The base for readers of bodies split into channels, which is the case
+/// with compression or pre-compression. Channels are grouped into streams,
+/// which are handed out in order. Their contents are byte-aligned, and are
+/// read with a `ByteReader` over the data returned by `beginStream`.
+class ChannelReader : public StreamBase {
+protected:
+  /// The input following the current stream.
+  ArrayRef<u8> Input;
+  /// The largest a stream may be once inflated.
+  usize StreamLimit = max_v<usize>;
+
+public:
+  /// The maximum number of values in a block before its value channels are
+  /// split into separate streams.
+  static constexpr u64 kMaxGroupedValues = 100;
+
+  explicit ChannelReader(ArrayRef<u8> Input,
+                         usize StreamLimit = max_v<usize>) :
+   Input(Input), StreamLimit(StreamLimit) {}
+  virtual ~ChannelReader() = default;
+
+  /// Begins the next stream, and returns the data to read it from.
+  virtual ExiResult<ArrayRef<u8>> beginStream() = 0;
+  /// Ends the current stream, after `Bytes` of its data were read.
+  virtual void endStream(usize Bytes) = 0;
+
+  /// Returns the bytes of inflated streams held by the reader.
+  virtual usize getMemoryUsage() const { return 0; }
+
+  virtual StreamKind getStreamKind() const = 0;
+
+private:
+  virtual void anchor();
+};
+
+/// Reads pre-compressed streams, which directly follow one another.
+class BlockReader final : public ChannelReader {
+public:
+  using ChannelReader::ChannelReader;
+
+  ExiResult<ArrayRef<u8>> beginStream() override { return Input; }
+  void endStream(usize Bytes) override { Input = Input.drop_front(Bytes); }
+
+  StreamKind getStreamKind() const override {
+    return SK_Block;
+  }
+
+private:
+  void anchor() override;
+};
+
+/// Inflates raw DEFLATE streams.
+class Inflater {
+  /// The zlib state, reused between streams.
+  z_stream_s* Z = nullptr;
+
+public:
+  Inflater();
+  ~Inflater();
+
+  Inflater(const Inflater&) = delete;
+  Inflater& operator=(const Inflater&) = delete;
+
+  /// Inflates the stream at the start of `Input` into `Out`, replacing its
+  /// contents. Returns the number of bytes of `Input` consumed, or an error
+  /// if the stream inflates to more than `Limit` bytes.
+  ExiResult<usize> inflate(ArrayRef<u8> Input, SmallVecImpl<u8>& Out,
+                           usize Limit = max_v<usize>);
+};
+
+/// Reads compressed streams, each of which is a raw DEFLATE stream. They are
+/// inflated one at a time, the data of the last is kept until the next.
+class DeflateReader final : public ChannelReader {
+  /// The inflated data of the current stream.
+  SmallVec<u8, 0> Buffer;
+  Inflater Z;
+
+public:
+  using ChannelReader::ChannelReader;
+
+  ExiResult<ArrayRef<u8>> beginStream() override;
+  void endStream(usize Bytes) override {}
+
+  usize getMemoryUsage() const override {
+    return Buffer.capacity_in_bytes();
+  }
+
+  StreamKind getStreamKind() const override {
+    return SK_Deflate;
+  }
+
+private:
+  void anchor() override;
+};
+
+#if EXI_USE_THREADS
+
+/// Reads compressed streams like `DeflateReader`, but inflates them ahead
+/// of time on a background thread. The end of a raw DEFLATE stream is only
+/// known once it has been inflated, so streams are inflated in order, while
+/// the decoder parses earlier ones.
+///
+/// Inflated streams are kept in a ring. The data of the current stream is
+/// kept until the next call to `beginStream`, so the ring holds at most
+/// `size() - 1` streams ahead of it.
+class ParallelDeflateReader final : public ChannelReader {
+  struct Slot {
+    SmallVec<u8, 0> Data;
+    ExiError Error = ExiError::OK;
+    /// The capacity of `Data`, updated under `Lock` once inflated.
+    usize Capacity = 0;
+  };
+
+  /// The ring of inflated streams, never resized after construction.
+  SmallVec<Slot, 4> Slots;
+
+  mutable std::mutex Lock;
+  /// Signaled when a stream is inflated or released.
+  std::condition_variable Signal;
+  /// The number of streams inflated, including the one which failed.
+  u64 Inflated = 0;
+  /// The number of streams returned by `beginStream`.
+  u64 Taken = 0;
+  /// If the thread has stopped, at the end of the input or an error.
+  bool IsDone = false;
+  /// If the thread should exit.
+  bool IsStopping = false;
+
+  /// Inflates streams, started last.
+  std::thread Worker;
+
+public:
+  /// The smallest number of slots, which allows one stream to be inflated
+  /// while the current one is decoded.
+  static constexpr u32 kMinSlots = 2;
+  static constexpr u32 kDefaultSlots = 4;
+
+  /// Creates a reader with a ring of `NSlots` streams, each of which may
+  /// inflate to at most `StreamLimit` bytes.
+  explicit ParallelDeflateReader(ArrayRef<u8> Input,
+                                 u32 NSlots = kDefaultSlots,
+                                 usize StreamLimit = max_v<usize>);
+  /// Stops the thread, discarding streams which were not read.
+  ~ParallelDeflateReader() override;
+
+  ParallelDeflateReader(const ParallelDeflateReader&) = delete;
+  ParallelDeflateReader& operator=(const ParallelDeflateReader&) = delete;
+
+  /// The number of streams in the ring.
+  u32 size() const { return Slots.size(); }
+
+  ExiResult<ArrayRef<u8>> beginStream() override;
+  void endStream(usize Bytes) override {}
+
+  usize getMemoryUsage() const override;
+
+  StreamKind getStreamKind() const override {
+    return SK_Deflate;
+  }
+
+private:
+  /// The loop run by `Worker`.
+  void run();
+  void anchor() override;
+};
+
+#endif // EXI_USE_THREADS
+
 } // namespace exi
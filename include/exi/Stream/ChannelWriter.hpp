@@ -0,0 +1,201 @@
+//===- exi/Stream/ChannelWriter.hpp ---------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the writers for streams split into channels.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/ArrayRef.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Common/StrRef.hpp>
+#include <core/Support/raw_ostream.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Stream/Stream.hpp>
+#include <Config/Config.inc>
+#if EXI_USE_THREADS
+# include <condition_variable>
+# include <mutex>
+# include <thread>
+#endif
+
+struct z_stream_s;
+
+namespace exi {
+
+/// The base for writers of bodies split into channels, which is the case
+/// with compression or pre-compression. Channels are encoded into buffers
+/// by the encoder, then grouped into streams which are written here.
+class ChannelWriter : public StreamBase {
+protected:
+  /// The output stream.
+  raw_ostream& OS;
+
+public:
+  explicit ChannelWriter(raw_ostream& OS) : OS(OS) {}
+  virtual ~ChannelWriter() = default;
+
+  /// Returns the output stream.
+  raw_ostream& os() const { return OS; }
+
+  /// Writes data which is not part of a stream, such as the header.
+  virtual void writeRaw(StrRef Data) { OS << Data; }
+  /// Writes a stream made up of `Parts`, in order.
+  virtual ExiError writeStream(ArrayRef<StrRef> Parts) = 0;
+  /// Waits until every stream has been written, returning the first error.
+  virtual ExiError flush() { return ExiError::OK; }
+
+  virtual StreamKind getStreamKind() const = 0;
+
+private:
+  virtual void anchor();
+};
+
+/// Writes pre-compressed streams, which directly follow one another.
+class BlockWriter final : public ChannelWriter {
+public:
+  using ChannelWriter::ChannelWriter;
+
+  ExiError writeStream(ArrayRef<StrRef> Parts) override {
+    for (StrRef Part : Parts)
+      OS << Part;
+    return ExiError::OK;
+  }
+
+  StreamKind getStreamKind() const override {
+    return SK_Block;
+  }
+
+private:
+  void anchor() override;
+};
+
+/// Compresses data into raw DEFLATE streams.
+class Deflater {
+  /// The zlib state, reused between streams.
+  z_stream_s* Z = nullptr;
+
+public:
+  /// The default compression level of zlib.
+  static constexpr int kDefaultLevel = -1;
+
+  explicit Deflater(int Level = kDefaultLevel);
+  ~Deflater();
+
+  Deflater(const Deflater&) = delete;
+  Deflater& operator=(const Deflater&) = delete;
+
+  /// Compresses `Parts` into a single stream, appended to `Out`.
+  ExiError deflate(ArrayRef<StrRef> Parts, SmallVecImpl<char>& Out);
+};
+
+/// Writes compressed streams, each of which is a raw DEFLATE stream.
+class DeflateWriter final : public ChannelWriter {
+  /// Compressed data, before it is written to the output.
+  SmallVec<char, 0> Buffer;
+  Deflater Z;
+
+public:
+  explicit DeflateWriter(raw_ostream& OS,
+                         int Level = Deflater::kDefaultLevel) :
+   ChannelWriter(OS), Z(Level) {}
+
+  ExiError writeStream(ArrayRef<StrRef> Parts) override;
+
+  StreamKind getStreamKind() const override {
+    return SK_Deflate;
+  }
+
+private:
+  void anchor() override;
+};
+
+#if EXI_USE_THREADS
+
+/// Writes compressed streams like `DeflateWriter`, but compresses them on a
+/// pool of worker threads. Streams are independent, so each worker has its
+/// own `Deflater`.
+///
+/// Streams are copied into a ring of jobs, which workers take in order.
+/// Finished jobs are written to the output in the order they were queued,
+/// by the thread calling `writeStream` or `flush`. Once every job is in
+/// flight, `writeStream` waits for the oldest.
+class ParallelDeflateWriter final : public ChannelWriter {
+  struct Job {
+    /// The uncompressed stream.
+    SmallVec<char, 0> Input;
+    /// The compressed stream.
+    SmallVec<char, 0> Output;
+    ExiError Error = ExiError::OK;
+    bool IsDone = false;
+  };
+
+  /// The ring of jobs, never resized after construction.
+  SmallVec<Job, 0> Jobs;
+
+  std::mutex Lock;
+  /// Signaled when a job is queued or finished.
+  std::condition_variable Signal;
+  /// The number of jobs queued. Only modified by the writer.
+  u64 Submitted = 0;
+  /// The number of jobs taken by workers.
+  u64 Started = 0;
+  /// The number of jobs written to the output. Only modified by the writer.
+  u64 Written = 0;
+  /// If workers should exit once every job is taken.
+  bool IsStopping = false;
+  /// The first error from a job.
+  ExiError Error = ExiError::OK;
+
+  /// The worker pool, started last.
+  SmallVec<std::thread, 0> Workers;
+
+public:
+  /// Creates a writer with `Threads` workers. When `Threads` is 0, the
+  /// hardware concurrency is used.
+  explicit ParallelDeflateWriter(raw_ostream& OS, unsigned Threads = 0,
+                                 int Level = Deflater::kDefaultLevel);
+  /// Writes every queued stream, then stops the workers.
+  ~ParallelDeflateWriter() override;
+
+  /// Writes queued streams first, so the output stays in order.
+  void writeRaw(StrRef Data) override;
+  ExiError writeStream(ArrayRef<StrRef> Parts) override;
+  ExiError flush() override;
+
+  /// The number of worker threads.
+  unsigned threads() const { return Workers.size(); }
+
+  StreamKind getStreamKind() const override {
+    return SK_Deflate;
+  }
+
+private:
+  /// Writes finished jobs from the front of the ring. If `Wait` is set,
+  /// waits until at least one job can be queued.
+  void writeFinished(std::unique_lock<std::mutex>& L, bool Wait);
+  /// The loop run by each worker.
+  void run(int Level);
+  void anchor() override;
+};
+
+#endif // EXI_USE_THREADS
+
+} // namespace exi
@@ -0,0 +1,133 @@
+//===- exi/Stream/ChunkedInput.hpp ----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines input which is provided to readers in chunks.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/ArrayRef.hpp>
+#include <core/Common/Option.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Common/StringExtras.hpp>
+#include <core/Support/ErrorHandle.hpp>
+
+namespace exi {
+
+/// Input which arrives in pieces, such as from a socket or pipe. Data is
+/// appended with `feed`, and readers attached to the input see a window of
+/// everything which has not been consumed yet. Consumed data is dropped on
+/// the next `feed`, so memory use is bounded by the amount of data buffered
+/// at once rather than the size of the document.
+///
+/// Data past a `mark` is kept until the mark moves, so a reader which runs
+/// out of input partway through an event can `rewind` and try again once
+/// more has been fed.
+///
+/// Sources which can block (eg. files) should override `underflow`, which
+/// is called whenever a reader runs out of data.
+class ChunkedInput {
+  /// The buffered data, the window starts at `Start`.
+  SmallVec<u8, 0> Buffer;
+  /// The offset of the current window.
+  usize Start = 0;
+  /// The position of `Buffer[0]` in the input, the amount of data dropped.
+  u64 Offset = 0;
+  /// The position in the input which must not be dropped, if any.
+  Option<u64> Mark;
+  /// The amount of data required to begin decoding an event.
+  usize Lookahead;
+  /// If no more data will be provided.
+  bool IsFinished = false;
+
+public:
+  static constexpr usize kDefaultLookahead = 4096;
+
+  ChunkedInput(usize Lookahead = kDefaultLookahead) : Lookahead(Lookahead) {}
+  virtual ~ChunkedInput() = default;
+
+  /// Appends a chunk of data. Any windows previously returned by the input
+  /// are invalidated.
+  void feed(ArrayRef<u8> Chunk);
+  /// Appends a chunk of data.
+  void feed(StrRef Chunk) { this->feed(arrayRefFromStringRef(Chunk)); }
+  /// Marks the end of the input.
+  void finish() { IsFinished = true; }
+
+  /// Returns if the end of the input has been marked.
+  bool finished() const { return IsFinished; }
+  /// Returns the amount of unconsumed data.
+  usize size() const { return Buffer.size() - Start; }
+  /// Returns the current window.
+  ArrayRef<u8> data() const {
+    return ArrayRef<u8>(Buffer).drop_front(Start);
+  }
+  /// Returns the position of the current window in the input.
+  u64 position() const { return Offset + Start; }
+
+  /// Keeps the data from `Pos` buffered, so it can be returned to with
+  /// `rewind`. Only one position is kept at a time.
+  void mark(u64 Pos) {
+    exi_invariant(Pos >= Offset && Pos <= Offset + Buffer.size());
+    Mark = Pos;
+  }
+  /// Moves the window to `Pos`, which is at or after the mark, and returns
+  /// it. Any windows previously returned by the input are invalidated.
+  ArrayRef<u8> rewind(u64 Pos) {
+    exi_invariant(Mark && Pos >= *Mark && Pos <= Offset + Buffer.size());
+    Start = usize(Pos - Offset);
+    return this->data();
+  }
+
+  /// Sets the amount of data which must be buffered past the current
+  /// position before an event is decoded. Events which don't fit are
+  /// replayed by the decoder, which raises the lookahead as needed.
+  void setLookahead(usize Bytes) { Lookahead = Bytes; }
+  /// Returns the lookahead in bytes.
+  usize lookahead() const { return Lookahead; }
+  /// Raises the lookahead past the data buffered from `Pos`, after it was
+  /// too small to decode from there.
+  void growLookahead(u64 Pos);
+
+  /// Checks if there is enough data to decode from `Pos` in the window.
+  bool hasLookahead(usize Pos) const {
+    return IsFinished || (size() - Pos) >= Lookahead;
+  }
+
+  /// Requests data until `hasLookahead(Pos)` is satisfied.
+  /// @return `false` if the source ran dry, in which case more must be fed.
+  bool pull(usize Pos) { return this->request(Pos + Lookahead); }
+
+  /// Consumes the first `Consumed` bytes of the window, and returns the
+  /// rest. If less than a word remains, more data will be requested first.
+  ArrayRef<u8> refill(usize Consumed);
+
+private:
+  /// Calls `underflow` until `Bytes` are buffered or the input is finished.
+  /// @return `false` if the source stopped providing data first.
+  bool request(usize Bytes);
+
+protected:
+  /// Called when a reader runs low on data. Sources which can block may
+  /// `feed` or `finish` here. The default does nothing.
+  virtual void underflow() {}
+};
+
+} // namespace exi
@@ -24,9 +24,14 @@
 #pragma once
 
 #include <core/Common/Poly.hpp>
+#include <core/Common/bit.hpp>
 #include <core/Support/Logging.hpp>
 #include <exi/Basic/Runes.hpp>
+#include <exi/Stream/ChunkedInput.hpp>
 #include <exi/Stream/Reader.hpp>
+#if defined(__BMI2__)
+# include <immintrin.h>
+#endif
 #if EXI_LOGGING
 # include <fmt/ranges.h>
 #endif
@@ -47,6 +52,8 @@ protected:
   size_type ByteOffset = 0;
   /// The current word, cached data from the stream.
   word_t Store = 0;
+  /// Incremental input, `Stream` is a window of its data when set.
+  ChunkedInput* Source = nullptr;
 
   static_assert(kBitsPerWord >= 64, "Work on this...");
   /// Masks shifts to align to byte boundaries.
@@ -68,6 +75,52 @@ protected:
     return ((Bits - 1) >> 3) + 1zu;
   }
 
+  /// Decodes a UInt from the octets at the top of `Word`, in stream order.
+  /// Only the first `Avail` octets are considered, so the caller can bound
+  /// both the valid data and the maximum length.
+  /// @return `{Value, Octets}`, where `Octets` is 0 if no terminating octet
+  ///  was found. In that case the caller must use the slow path.
+  inline static std::pair<u64, size_type>
+   DecodeUIntWord(word_t Word, size_type Avail) EXI_READNONE {
+    static_assert(sizeof(word_t) == sizeof(u64));
+    constexpr word_t HiBits = 0x8080'8080'8080'8080;
+    constexpr word_t LoBits = 0x7F7F'7F7F'7F7F'7F7F;
+
+    // Every octet without a continuation bit is a terminator.
+    const word_t AvailMask = (Avail < sizeof(word_t))
+      ? ~(~word_t(0) >> (Avail * 8)) : ~word_t(0);
+    const word_t Stops = ~Word & HiBits & AvailMask;
+    if EXI_UNLIKELY(Stops == 0)
+      return {0, 0};
+
+    const size_type Octets = (exi::countl_zero(Stops) >> 3) + 1;
+    // Put the first octet in the low byte, then drop the unused octets.
+    word_t X = exi::byteswap(Word);
+    if (Octets < sizeof(word_t))
+      X &= (word_t(1) << (Octets * 8)) - 1;
+
+#if defined(__BMI2__)
+    return {_pext_u64(X, LoBits), Octets};
+#else
+    // Compact the 7-bit groups, doubling the group size each step.
+    X &= LoBits;
+    X = ((X & 0x7F00'7F00'7F00'7F00) >> 1) | (X & 0x007F'007F'007F'007F);
+    X = ((X & 0x3FFF'0000'3FFF'0000) >> 2) | (X & 0x0000'3FFF'0000'3FFF);
+    X = ((X & 0x0FFF'FFFF'0000'0000) >> 4) | (X & 0x0000'0000'0FFF'FFFF);
+    return {X, Octets};
+#endif
+  }
+
+  /// Counts the leading octets of `Word` without a continuation bit, which
+  /// are single octet (ASCII) codepoints. At most `Avail` are considered.
+  inline static size_type CountASCIIWord(word_t Word,
+                                         size_type Avail) EXI_READNONE {
+    const word_t Cont = Word & 0x8080'8080'8080'8080;
+    if (Cont == 0)
+      return Avail;
+    return std::min<size_type>(exi::countl_zero(Cont) >> 3, Avail);
+  }
+
 public:
   OrderedReader() = default;
   OrderedReader(proxy_t Proxy) : OrderedReader(Proxy.Bytes) {
@@ -91,6 +144,10 @@ public:
   virtual ExiResult<StrRef> readString(
     u64 Size, SmallVecImpl<char>& Data) = 0;
 
+  /// The most bytes reserved up front for a string. Sizes come from the
+  /// input, so longer strings grow as they are read instead.
+  static constexpr u64 kMaxStringReserve = 64 * 1024;
+
   virtual proxy_t getProxy() const = 0;
   virtual void setProxy(proxy_t Proxy) = 0;
 
@@ -103,14 +160,48 @@ public:
   usize sizeInBytes() const { return Stream.size(); }
 
   /// Return if the stream has data or not.
-  bool hasData() const { return Stream.size() >= ByteOffset; }
+  virtual bool hasData() const { return ByteOffset < Stream.size(); }
+
+  /// Checks if `Bits` more bits may be in the stream. Incremental input
+  /// which isn't finished may still grow, so is always assumed to.
+  bool canRead(u64 Bits) const {
+    if (Source && !Source->finished())
+      return true;
+    const u64 Total = u64(Stream.size()) * 8;
+    return Bits <= Total - std::min<u64>(bitPos(), Total);
+  }
+
+  /// Returns the error for a read past the end of the stream. When more
+  /// input may arrive, this is `ExiError::FULL` rather than `OOB`.
+  ExiError getEndError() const {
+    if (Source && !Source->finished())
+      return ExiError::FULL;
+    return ExiError::OOB;
+  }
+
+  /// Checks if all buffered input has been read, and more may arrive.
+  bool isStarved() const {
+    return Source && !Source->finished() && ByteOffset >= Stream.size();
+  }
+
+  /// Reads from `Src` instead of a fixed buffer. The current stream must be
+  /// a window of `Src`.
+  void setSource(ChunkedInput* Src) { this->Source = Src; }
+  /// Returns the incremental input, if any.
+  ChunkedInput* getSource() const { return Source; }
 
 protected:
   // TODO: EXI_PRESERVE_MOST?
   ExiResult<size_type> fillStoreImpl() {
-    if EXI_UNLIKELY(ByteOffset >= Stream.size())
-      // Read of an empty buffer.
-      return Err(ExiError::OOB);
+    if EXI_UNLIKELY(Source && Stream.size() - ByteOffset < sizeof(word_t))
+      // Window is running out, ask for more data.
+      this->refillStream(0);
+
+    if EXI_UNLIKELY(ByteOffset >= Stream.size()) {
+      // Read of an empty buffer. When more input may arrive, report that
+      // instead of reading out of bounds.
+      return Err(this->getEndError());
+    }
 
     // Read the next "word" from the stream.
     const u8* WordPtr = Stream.data() + ByteOffset;
@@ -124,19 +215,23 @@ protected:
     } else {
       // Partial read.
       BytesRead = Stream.size() - ByteOffset;
-      ByteOffset = 0;
+      Store = 0;
       for (size_type Ix = 0; Ix != BytesRead; ++Ix)
         Store |= word_t(WordPtr[Ix]) << (Ix * 8);
     }
 
     ByteOffset += BytesRead;
-    if (ByteOffset == Stream.size())
-      // Set the byte offset larger than the stream size.
-      // This will allow us to introspect on the state later.
-      ++ByteOffset;
     return Ok(BytesRead);
   }
 
+  /// Consumes the window up to `ByteOffset`, keeping the last `Keep` bytes,
+  /// and moves to the new window.
+  EXI_NO_INLINE void refillStream(size_type Keep) {
+    exi_invariant(Source && Keep <= ByteOffset);
+    this->Stream = Source->refill(ByteOffset - Keep);
+    this->ByteOffset = Keep;
+  }
+
   void setProxyBase(proxy_t Proxy) {
     auto [Bytes, NBits] = Proxy;
     this->Stream = Bytes;
@@ -224,8 +319,13 @@ public:
     if (Size == 0)
       return ""_str;
 
-    Data.reserve(Size);
+    Data.reserve(std::min(Size, BaseT::kMaxStringReserve));
     for (u64 Ix = 0; Ix < Size; ++Ix) {
+      // Most text is ASCII, copy runs of it in bulk.
+      Ix += this->appendASCII(Size - Ix, Data);
+      if (Ix == Size)
+        break;
+
       ExiResult<u64> Rune = this->readNByteUInt<UnicodeReads>();
       if EXI_UNLIKELY(Rune.is_err()) {
         LOG_ERROR("Invalid Rune at [{}:{}].", Ix, Size);
@@ -261,17 +361,33 @@ public:
     return {BaseT::Stream, (ByteOffset * 8) - BitsInStore};
   }
 
+  bool hasData() const override {
+    return BitsInStore != 0 || BaseT::hasData();
+  }
+
+  /// Moves to the current window of the source, which may have changed
+  /// after data was fed. The bytes still in the store are kept.
+  void syncInput() {
+    if (BaseT::Source)
+      BaseT::refillStream((BitsInStore + 7) / 8);
+  }
+
   void setProxy(proxy_t Proxy) override {
     BaseT::setProxyBase(Proxy);
-    // Align to the old offset.
-    BaseT::ByteOffset -= (BaseT::ByteOffset % sizeof(word_t));
+    // Align to the word containing the old offset.
+    BaseT::ByteOffset = (Proxy.NBits / kBitsPerWord) * sizeof(word_t);
+    BitsInStore = 0;
+    const auto Off = (Proxy.NBits % kBitsPerWord);
+    if (Off == 0)
+      // The store will be loaded on the next read.
+      return;
+
     // Load data into store.
     if (auto E = fillStore()) {
       dbgs() << E << '\n';
       exi_unreachable("unable to load store");
     }
 
-    const auto Off = (Proxy.NBits % kBitsPerWord);
     Store <<= Off;
     BitsInStore -= Off;
   }
@@ -321,13 +437,26 @@ private:
   inline ExiResult<u64> readNByteUInt() {
     static_assert(Bytes <= sizeof(word_t), "Read is too large!");
 
+    // Most UInts are a single octet, and the branch predicts well.
+    if EXI_LIKELY(BitsInStore >= 8 && !(Store >> (kBitsPerWord - 1)))
+      return Ok(readFullBits64V(8));
+
+    // Otherwise decode the whole UInt at once if it's in the store.
+    const size_type Avail = std::min(BitsInStore >> 3, Bytes);
+    if (const auto [Value, Octets] = DecodeUIntWord(Store, Avail); Octets) {
+      const size_type Bits = Octets * 8;
+      Store = (Bits < kBitsPerWord) ? (Store << Bits) : 0;
+      BitsInStore -= Bits;
+      return Ok(Value);
+    }
+
     // While the codegen for this loop is identical for the multiplication/bitwise
     // variants on Clang, it makes a difference on GCC. Because of this, I've
     // updated it to use bitwise operations.
 
     u64 Multiplier = 0, Value = 0;
 
-    // TODO: Add some bit hacks to this?
+    // Slow path, for UInts crossing the end of the store.
     for (isize N = 0; N < isize(Bytes); ++N) {
       const Result R = this->readNBits<8>();
       if EXI_UNLIKELY(R.is_err())
@@ -351,6 +480,27 @@ private:
     tail_return this->failUInt<Bytes>();
   }
 
+  /// Appends up to `Max` ASCII codepoints from the store, a word at a time.
+  /// @return The number of codepoints appended.
+  usize appendASCII(u64 Max, SmallVecImpl<char>& Data) {
+    const size_type Avail = std::min<u64>(BitsInStore >> 3, Max);
+    const size_type Run = CountASCIIWord(Store, Avail);
+    if (Run == 0)
+      return 0;
+
+    // Octets are in stream order starting from the high byte.
+    // TODO: Update this for big endian systems.
+    const word_t Chars = exi::byteswap(Store);
+    char Buf[sizeof(word_t)];
+    std::memcpy(Buf, &Chars, sizeof(word_t));
+    Data.append(Buf, Buf + Run);
+
+    const size_type Bits = Run * 8;
+    Store = (Bits < kBitsPerWord) ? (Store << Bits) : 0;
+    BitsInStore -= Bits;
+    return Run;
+  }
+
   ////////////////////////////////////////////////////////////////////////
   // Dynamic Reads
 
@@ -383,7 +533,7 @@ private:
     exi_try_r(fillStore());
     // Check for overlong reads of the buffer.
     if EXI_UNLIKELY(HeadBits > BitsInStore)
-      return Err(ExiError::OOB);
+      return Err(BaseT::getEndError());
     
     // Always starts off aligned.
     const u64 R = readFullBits64V(HeadBits);
@@ -455,12 +605,19 @@ public:
       return 0;
 
     const size_type Bytes = MakeByteCount(Bits);
-    if (Bytes <= BytesInStore)
-      // Handle cases which don't need loading.
-      tail_return this->readFullBytes64(Bytes);
+    if (Bytes == 1)
+      tail_return this->readNBits<8>();
 
-    // Handle cases which need loading.
-    tail_return this->readPartialBytes64(Bytes);
+    const ExiResult<u64> Out = (Bytes <= BytesInStore)
+      // Handle cases which don't need loading.
+      ? this->readFullBytes64(Bytes)
+      // Handle cases which need loading.
+      : this->readPartialBytes64(Bytes);
+    if EXI_UNLIKELY(Out.is_err())
+      return Out;
+    
+    // Bytes are ordered from least to most significant.
+    return exi::byteswap(*Out) >> (kBitsPerWord - Bytes * 8);
   }
 
   ExiResult<u64> readUInt() override {
@@ -480,8 +637,13 @@ public:
     if (Size == 0)
       return ""_str;
 
-    Data.reserve(Size);
+    Data.reserve(std::min(Size, BaseT::kMaxStringReserve));
     for (u64 Ix = 0; Ix < Size; ++Ix) {
+      // Most text is ASCII, copy runs of it in bulk.
+      Ix += this->appendASCII(Size - Ix, Data);
+      if (Ix == Size)
+        break;
+
       ExiResult<u64> Rune = this->readNByteUInt<UnicodeReads>();
       if EXI_UNLIKELY(Rune.is_err()) {
         LOG_ERROR("Invalid Rune at [{}:{}].", Ix, Size);
@@ -498,6 +660,21 @@ public:
     return StrRef(Data.data(), Data.size());
   }
 
+  /// Reads a string of `Size` codepoints as a view of the stream. This only
+  /// succeeds if every codepoint is ASCII, otherwise nothing is consumed.
+  Option<StrRef> readASCIIView(u64 Size) {
+    const size_type Pos = ByteOffset - BytesInStore;
+    if EXI_UNLIKELY(Size > Stream.size() - Pos)
+      return std::nullopt;
+
+    const auto Bytes = Stream.slice(Pos, Size);
+    if (countASCIIPrefix(Bytes) != Size)
+      return std::nullopt;
+
+    this->skipBytes(Size);
+    return StrRef(reinterpret_cast<const char*>(Bytes.data()), Size);
+  }
+
   ExiError fillStore() {
     const auto R = BaseT::fillStoreImpl();
     if EXI_UNLIKELY(R.is_err())
@@ -515,6 +692,23 @@ public:
     return {BaseT::Stream, (ByteOffset - BytesInStore) * 8};
   }
 
+  bool hasData() const override {
+    return BytesInStore != 0 || BaseT::hasData();
+  }
+
+  /// Moves to the current window of the source, which may have changed
+  /// after data was fed. The bytes still in the store are kept, as they
+  /// may be copied directly from the stream.
+  void syncInput() {
+    if (BaseT::Source)
+      BaseT::refillStream(BytesInStore);
+  }
+
+  /// The position in bits.
+  size_type bitPos() const override {
+    return (ByteOffset - BytesInStore) * 8;
+  }
+
   // TODO: Make this return an `Error`.
   void setProxy(proxy_t Proxy) override {
     // TODO: check if aligned
@@ -524,6 +718,11 @@ public:
     const size_type Off = BaseT::ByteOffset % sizeof(word_t);
     // Align to the old offset.
     BaseT::ByteOffset -= Off;
+    BytesInStore = 0;
+    if (Off == 0)
+      // The store will be loaded on the next read.
+      return;
+
     // Load data into store.
     if (auto E = fillStore()) {
       dbgs() << E << '\n';
@@ -569,13 +768,25 @@ private:
   inline ExiResult<u64> readNByteUInt() {
     static_assert(Bytes <= sizeof(word_t), "Read is too large!");
 
+    // Most UInts are a single octet, and the branch predicts well.
+    if EXI_LIKELY(BytesInStore >= 1 && !(Store >> (kBitsPerWord - 1)))
+      return Ok(readFullBytes64V(1));
+
+    // Otherwise decode the whole UInt at once if it's in the store.
+    const size_type Avail = std::min(BytesInStore, Bytes);
+    if (const auto [Value, Octets] = DecodeUIntWord(Store, Avail); Octets) {
+      Store = (Octets < sizeof(word_t)) ? (Store << (Octets * 8)) : 0;
+      BytesInStore -= Octets;
+      return Ok(Value);
+    }
+
     // While the codegen for this loop is identical for the multiplication/bitwise
     // variants on Clang, it makes a difference on GCC. Because of this, I've
     // updated it to use bitwise operations.
 
     u64 Multiplier = 0, Value = 0;
 
-    // TODO: Add some bit hacks to this?
+    // Slow path, for UInts crossing the end of the store.
     for (isize N = 0; N < isize(Bytes); ++N) {
       const Result R = this->readNBits<8>();
       if EXI_UNLIKELY(R.is_err())
@@ -599,6 +810,41 @@ private:
     tail_return this->failUInt<Bytes>();
   }
 
+  /// Appends up to `Max` ASCII codepoints, copied directly from the stream.
+  /// @return The number of codepoints appended.
+  usize appendASCII(u64 Max, SmallVecImpl<char>& Data) {
+    const size_type Pos = ByteOffset - BytesInStore;
+    usize Run = CountASCIIWord(Store, std::min<u64>(BytesInStore, Max));
+    if (Run == BytesInStore && Run < Max) {
+      // The rest of the store is ASCII, continue scanning the stream.
+      const auto Rest = Stream.drop_front(ByteOffset);
+      Run += countASCIIPrefix(
+        Rest.take_front(std::min<u64>(Max - Run, Rest.size())));
+    }
+    if (Run == 0)
+      return 0;
+
+    // The store holds the bytes at `Pos`, so everything is contiguous.
+    const char* Chars = reinterpret_cast<const char*>(Stream.data() + Pos);
+    Data.append(Chars, Chars + Run);
+    this->skipBytes(Run);
+    return Run;
+  }
+
+  /// Advances the stream by `Bytes`, which must be in bounds.
+  void skipBytes(size_type Bytes) {
+    if (Bytes < BytesInStore) {
+      Store <<= (Bytes * 8);
+      BytesInStore -= Bytes;
+      return;
+    }
+
+    // Skip past the store, the next read will refill it.
+    ByteOffset = (ByteOffset - BytesInStore) + Bytes;
+    Store = 0;
+    BytesInStore = 0;
+  }
+
   ////////////////////////////////////////////////////////////////////////
   // Dynamic Reads
 
@@ -632,7 +878,7 @@ private:
     exi_try_r(fillStore());
     // Check for overlong reads of the buffer.
     if EXI_UNLIKELY(HeadBytes > BytesInStore)
-      return Err(ExiError::OOB);
+      return Err(BaseT::getEndError());
     
     // Always starts off aligned.
     const u64 R = readFullBytes64V(HeadBytes);
@@ -32,12 +32,14 @@
 
 #pragma once
 
+#include <core/Common/Box.hpp>
 #include <core/Common/ManualRebind.hpp>
 #include <core/Common/Poly.hpp>
 #include <core/Common/Ref.hpp>
 #include <core/Support/Casting.hpp>
 #include <core/Support/Logging.hpp>
 #include <exi/Basic/Runes.hpp>
+#include <exi/Stream/BackgroundFlusher.hpp>
 #include <exi/Stream/Writer.hpp>
 #if EXI_LOGGING
 # include <fmt/ranges.h>
@@ -72,8 +74,8 @@ public:
   using refproxy_t = StreamProxy<BufferRef>;
   using RefProxyT  = refproxy_t;
 
-  /// @brief Currently uses MB.
-  static constexpr size_type kFlushUnits = 20;
+  /// The default threshold (unit B) to flush to a file stream.
+  static constexpr u64 kDefaultFlushThreshold = u64(512) << 20;
 
 protected:
   /// Owned buffer, used as the buffer if the input stream is not
@@ -83,18 +85,22 @@ protected:
   /// to, case in which these are "the bytes").
   Ref<buffer_t> Buffer;
 
-  /// The file stream that Buffer flushes to. If FS is a `raw_fd_stream`, the
-  /// writer will incrementally flush. Otherwise flushing will happen at the end
-  /// of the object's lifetime.
+  /// The file stream that Buffer flushes to. The writer will incrementally
+  /// flush once the buffer passes `FlushThreshold`, and at the end of the
+  /// object's lifetime.
   ManualRebindPtr<raw_ostream> FS = nullptr;
 
-  /// The threshold (unit B) to flush to FS, if FS is a `raw_fd_stream`.
+  /// The threshold (unit B) to flush to FS.
   ManualRebind<u64> FlushThreshold = 0;
 
+  /// If set, full buffers are written to FS on a background thread, and
+  /// `Buffer` is always one of the flusher's buffers.
+  Box<BackgroundFlusher> Flusher;
+
   /// A value in the range [0, 64), specifies the next bit to use.
   size_type BitsInStore = 0;
 
-  /// The current value. Only bits < BitsInStore are valid.
+  /// The current value. Only the top BitsInStore bits are valid.
   word_t Store = 0;
 
   ////////////////////////////////////////////////////////////////////////
@@ -104,6 +110,11 @@ private:
   void flushAndClear() {
     exi_assert(FS);
     exi_assert(!Buffer->empty());
+    if (Flusher) {
+      // Hand the buffer off, and continue in the next free one.
+      this->Buffer = Flusher->submit();
+      return;
+    }
     FS->write(Buffer->data(), Buffer->size());
     Buffer->clear();
   }
@@ -116,26 +127,37 @@ private:
 
   bool isOwnBuffer() const {
     auto* SelfBuf = static_cast<const buffer_t*>(&OwnBuffer);
-    return Buffer.data() == SelfBuf;
+    // The flusher's buffers are owned as well.
+    return Buffer.data() == SelfBuf || Flusher;
   }
 
 protected:
-  /// If the related file stream is a `raw_fd_stream`, flush the buffer if its
-  /// size is above a threshold. If \p OnClosing is true, flushing happens
-  /// regardless of thresholds.
+  /// If there is a related file stream, flush the buffer if its size is
+  /// above a threshold. If \p OnClosing is true, flushing happens regardless
+  /// of thresholds. Nothing is ever backpatched, so any stream will do.
   void flushToFile(bool OnClosing = false) {
-    if (!FS || Buffer->empty())
+    if (!FS)
       return;
-    if (OnClosing)
-      return flushAndClear();
-    if (fdStream() && Buffer->size() > FlushThreshold)
+    if (OnClosing) {
+      if (!Buffer->empty())
+        flushAndClear();
+      // Everything must have reached the stream when this returns.
+      if (Flusher)
+        Flusher->drain();
+      return;
+    }
+    if (Buffer->size() > FlushThreshold)
       flushAndClear();
   }
 
-  void writeWord(word_t Val) {
-    Val = support::endian::byte_swap<word_t, endianness::little>(Val);
-    Buffer->append(reinterpret_cast<const char*>(&Val),
-                   reinterpret_cast<const char*>(&Val + 1));
+  /// Writes the first `Bytes` bytes of `Val`, starting from the most
+  /// significant byte.
+  void writeWord(word_t Val, size_type Bytes = kWordSize) {
+    exi_invariant(Bytes <= kWordSize);
+    // Switch to "big endian".
+    Val = support::endian::byte_swap<word_t, endianness::big>(Val);
+    const char* Data = reinterpret_cast<const char*>(&Val);
+    Buffer->append(Data, Data + Bytes);
   }
 
   void writeBytes(ArrayRef<char> Bytes) {
@@ -160,11 +182,12 @@ public:
   /// (besides write), the BitstreamWriter will also flush incrementally, when a
   /// subblock is finished, and if the FlushThreshold is passed.
   ///
-  /// NOTE: \p FlushThreshold's unit is MB.
-  OrderedWriter(raw_ostream& Strm, u32 FlushThreshold = 512)
+  /// NOTE: \p FlushThreshold's unit is B.
+  OrderedWriter(raw_ostream& Strm,
+                u64 FlushThreshold = kDefaultFlushThreshold)
       : Buffer(getInternalBufferFromStream(Strm)),
         FS(!isa<raw_svector_ostream>(Strm) ? &Strm : nullptr),
-        FlushThreshold(u64(FlushThreshold) << kFlushUnits) {}
+        FlushThreshold(FlushThreshold) {}
 
   /// Convenience constructor for users that start with a vector - avoids
   /// needing to wrap it in a raw_svector_ostream.
@@ -193,6 +216,16 @@ public:
     };
   }
 
+  /// Returns a proxy, and forgets the bits in the store. They are handed to
+  /// another writer with `setProxy`, rather than written when this one is
+  /// destroyed.
+  proxy_t takeProxy() {
+    const proxy_t Out = this->getProxy();
+    this->BitsInStore = 0;
+    this->Store = 0;
+    return Out;
+  }
+
   refproxy_t getRefProxy() const {
     return {
       { *Buffer, Store },
@@ -202,12 +235,17 @@ public:
 
   // TODO: Add different modes? eg. emplace, append, etc.
   void setProxy(proxy_t Proxy) {
-    // TODO: Improve this logic more later. For now, just overwrite fancily.
-    this->Buffer = Proxy->Buffer;
-    if (Proxy->ExternBuffer)
-      FS.assign(Proxy->FS);
-    else if (!this->isOwnBuffer())
-      FS.assign(nullptr);
+    // Proxies of our own buffer may be handed back, eg. after the header is
+    // written with a different writer. Then the file stream is unchanged.
+    if (&Proxy->Buffer != Buffer.data()) {
+      this->stopBackgroundFlush();
+      // TODO: Improve this logic more later. For now, just overwrite fancily.
+      this->Buffer = Proxy->Buffer;
+      if (Proxy->ExternBuffer)
+        FS.assign(Proxy->FS);
+      else if (!this->isOwnBuffer())
+        FS.assign(nullptr);
+    }
     FlushThreshold.assign(Proxy->FlushThreshold);
     
     this->BitsInStore = Proxy.NBits;
@@ -219,6 +257,7 @@ public:
   // TODO: Rethink implementation
   void setProxy(refproxy_t Proxy) {
     this->flushToFile(/*OnClosing=*/true);
+    this->stopBackgroundFlush();
     this->Buffer = Proxy->Buffer;
     FS.assign(nullptr);
     
@@ -226,17 +265,64 @@ public:
     this->Store = Proxy->Store;
   }
 
+  /// Writes out any bits left in the store, padding to the next byte.
   void flushToWord() {
     if EXI_UNLIKELY(!BitsInStore)
       return;
     
-    // Switch to "big endian".
-    // TODO: Update this for big endian systems.
-    writeWord(exi::byteswap(Store));
+    writeWord(Store, MakeByteCount(BitsInStore));
     BitsInStore = 0;
     Store = 0;
   }
 
+  /// Sets the size (unit B) the buffer may reach before it is written to
+  /// the file stream.
+  void setFlushThreshold(u64 Bytes) {
+    FlushThreshold.assign(Bytes);
+  }
+
+  /// Writes buffers which pass the threshold on a background thread, while
+  /// writing continues into the next of \p NBuffers buffers. This helps
+  /// most with slow storage. Returns false if there is no file stream.
+  /// Without threads, buffers are written as they are submitted.
+  bool setBackgroundFlush(u32 NBuffers = BackgroundFlusher::kMinBuffers) {
+    if (!FS)
+      return false;
+    this->stopBackgroundFlush();
+    // Anything already buffered is written first, to keep the order.
+    this->flushToFile(/*OnClosing=*/true);
+    Flusher = std::make_unique<BackgroundFlusher>(*FS, NBuffers);
+    this->Buffer = Flusher->current();
+    return true;
+  }
+
+  /// Writes everything buffered, and returns to flushing on the current
+  /// thread. Does nothing if background flushing is disabled.
+  void stopBackgroundFlush() {
+    if (!Flusher)
+      return;
+    this->flushToFile(/*OnClosing=*/true);
+    this->Buffer = OwnBuffer;
+    Flusher.reset();
+  }
+
+  /// Writes the buffer to the file stream if it has passed the threshold.
+  /// Bits in the store are kept, so this may be used mid-stream.
+  void flushIfFull() {
+    this->flushToFile();
+  }
+
+  /// Writes out the store, and flushes the buffer to the file stream.
+  void flush() {
+    this->flushToWord();
+    this->flushToFile(/*OnClosing=*/true);
+  }
+
+  /// The position in bits.
+  size_type bitPos() const {
+    return (Buffer->size() * 8) + BitsInStore;
+  }
+
   ////////////////////////////////////////////////////////////////////////
   // Implementation
 
@@ -254,20 +340,23 @@ public:
   /// Decodes a UInt size, then writes a unicode string to the buffer.
   /// Should only be used for URIs and Prefixes.
   void encodeString(StrRef Str) {
-    this->writeUInt(Str.size());
+    this->writeUInt(exi::countRunes(Str));
     tail_return this->writeString(Str);
   }
 
   /// Writes a unicode string to the buffer.
   void writeString(StrRef Str) {
-    if (Str.empty())
-      return;
-    
-    RuneDecoder Decoder(Str);
-    for (Rune Val : Decoder) {
-      this->writeNByteUInt<UnicodeReads>(Val);
-      // TODO: Log!!
+    // ASCII codepoints are written as single octets, so when the store is
+    // empty they can be copied directly.
+    if (BitsInStore == 0) {
+      const usize ASCII = exi::countASCIIPrefix(arrayRefFromStringRef(Str));
+      this->writeBytes(ArrayRef<char>(Str.data(), ASCII));
+      Str = Str.drop_front(ASCII);
     }
+
+    RuneDecoder Decoder(Str);
+    while (Decoder)
+      this->writeNByteUInt<UnicodeReads>(Decoder.decode());
   }
 
   /// Writes a static number of bits (max of 64).
@@ -278,21 +367,27 @@ public:
 
 protected:
   /// Writes a variable number of bits (max of 64).
+  /// Bits are packed from the most significant bit of the store down, so
+  /// the store can be written out as a big endian word.
   template <typename IntT = u64>
-  ALWAYS_INLINE void writeNBits(IntT Val, size_type Bits) {
-    Store |= Val << BitsInStore;
-    if (Bits + BitsInStore < kBitsPerWord) {
+  ALWAYS_INLINE void writeNBits(IntT Raw, size_type Bits) {
+    exi_invariant(Bits != 0 && Bits <= kBitsPerWord);
+    const word_t Val = word_t(Raw) & MakeNBitMask(Bits);
+    const size_type Free = (kBitsPerWord - BitsInStore);
+
+    if (Bits < Free) {
+      Store |= Val << (Free - Bits);
       BitsInStore += Bits;
       return;
     }
 
+    // Fill the rest of the store, and put the remainder in the next one.
+    const size_type Rest = (Bits - Free);
+    Store |= (Rest < kBitsPerWord) ? (Val >> Rest) : 0;
     this->writeWord(Store);
 
-    if (BitsInStore)
-      Store = Val >> (kBitsPerWord - BitsInStore);
-    else
-      Store = 0;
-    BitsInStore = (BitsInStore + Bits) & ShiftMask;
+    Store = Rest ? (Val << (kBitsPerWord - Rest)) : 0;
+    BitsInStore = Rest;
   }
 
   template <size_type Bytes = 8>
@@ -316,8 +411,9 @@ protected:
   }
 
   void align() {
-    const auto Bits = (BitsInStore & ByteAlignMask);
-    this->writeBits64(0, Bits);
+    const auto Bits = (-BitsInStore & ByteAlignMask);
+    if (Bits != 0)
+      this->writeNBits(0, Bits);
   }
 
 private:
@@ -381,6 +477,7 @@ class ByteWriter final : public OrderedWriter {
   using StreamBase::MakeByteCount;
 public:
   using OrderedWriter::OrderedWriter;
+  ByteWriter(proxy_t Proxy) : OrderedWriter(Proxy) {}
 
   /// Writes a single bit.
   void writeBit(bool Val) override {
@@ -396,8 +493,12 @@ public:
       // Do nothing...
       return;
     
-    const size_type Off = MakeByteCount(Bits);
-    BaseT::writeNBits(Val, Off);
+    // Bytes are written from least to most significant.
+    const size_type Bytes = MakeByteCount(Bits);
+    for (size_type Ix = 0; Ix < Bytes; ++Ix) {
+      BaseT::writeNBits(Val & 0xFF, 8);
+      Val >>= 8;
+    }
   }
 
   StreamKind getStreamKind() const override {
@@ -24,6 +24,11 @@
 #include <exi/Basic/Runes.hpp>
 #include <core/Common/ArrayRef.hpp>
 #include <core/Common/SmallVec.hpp>
+#include <core/Common/bit.hpp>
+#include <core/Support/Endian.hpp>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
 
 using namespace exi;
 
@@ -96,3 +101,48 @@ bool exi::encodeRunesUnchecked(ArrayRef<Rune> Runes,
 
   return true;
 }
+
+usize exi::countASCIIPrefix(ArrayRef<u8> Bytes) {
+  const u8* const Begin = Bytes.begin();
+  const u8* const End = Bytes.end();
+  const u8* Ptr = Begin;
+
+#if defined(__SSE2__)
+  // Check the high bits of 16 bytes at a time.
+  for (; End - Ptr >= 16; Ptr += 16) {
+    const __m128i Chunk
+      = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Ptr));
+    if (const unsigned Mask = _mm_movemask_epi8(Chunk))
+      return (Ptr - Begin) + exi::countr_zero(Mask);
+  }
+#endif
+
+  for (; End - Ptr >= 8; Ptr += 8) {
+    const u64 Word = support::endian::read<u64, endianness::little>(Ptr);
+    if (const u64 Mask = Word & 0x8080'8080'8080'8080)
+      return (Ptr - Begin) + (exi::countr_zero(Mask) >> 3);
+  }
+
+  for (; Ptr != End; ++Ptr) {
+    if (*Ptr & 0x80)
+      break;
+  }
+  return Ptr - Begin;
+}
+
+usize exi::countRunes(StrRef Str) {
+  const auto* Ptr = reinterpret_cast<const u8*>(Str.data());
+  const auto* const End = Ptr + Str.size();
+  usize Continuations = 0;
+
+  // Every byte which isn't of the form 0b10xxxxxx starts a codepoint.
+  for (; End - Ptr >= 8; Ptr += 8) {
+    const u64 Word = support::endian::read<u64, endianness::little>(Ptr);
+    const u64 Mask = Word & ~(Word << 1) & 0x8080'8080'8080'8080;
+    Continuations += exi::popcount(Mask);
+  }
+
+  for (; Ptr != End; ++Ptr)
+    Continuations += ((*Ptr & 0xC0) == 0x80);
+  return Str.size() - Continuations;
+}
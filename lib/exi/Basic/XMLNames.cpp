@@ -0,0 +1,191 @@
+//===- exi/Basic/XMLNames.cpp ---------------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements utilities for resolving names and text in raw XML.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Basic/XMLNames.hpp>
+#include <core/Common/STLExtras.hpp>
+#include <core/Common/StringExtras.hpp>
+#include <core/Support/Logging.hpp>
+#include <exi/Basic/Runes.hpp>
+#include <exi/Decode/Serializer.hpp>
+#include <algorithm>
+
+#define DEBUG_TYPE "XMLNames"
+
+using namespace exi;
+
+std::pair<StrRef, StrRef> exi::splitXMLName(StrRef Raw) {
+  const usize Pos = Raw.find(':');
+  if (Pos == StrRef::npos)
+    return {""_str, Raw};
+  return {Raw.take_front(Pos), Raw.drop_front(Pos + 1)};
+}
+
+Option<StrRef> exi::getXMLNSPrefix(StrRef Raw) {
+  if (!Raw.consume_front("xmlns"))
+    return std::nullopt;
+  if (Raw.empty())
+    return ""_str;
+  if (Raw.consume_front(":"))
+    return Raw;
+  return std::nullopt;
+}
+
+bool exi::isXMLWhitespace(StrRef Str) {
+  // Called on every data node, so avoid building a set of characters.
+  return std::all_of(Str.begin(), Str.end(), [] (char C) {
+    return C == ' ' || C == '\t' || C == '\n' || C == '\r';
+  });
+}
+
+static Option<u32> DecodeCharRef(StrRef Ref) {
+  u32 Radix = 10;
+  if (Ref.consume_front("x") || Ref.consume_front("X"))
+    Radix = 16;
+  u32 Out = 0;
+  if (Ref.empty() || Ref.getAsInteger(Radix, Out))
+    return std::nullopt;
+  return Out;
+}
+
+static char DecodeSimpleEntity(StrRef Ref) {
+  if (Ref == "lt")
+    return '<';
+  else if (Ref == "gt")
+    return '>';
+  else if (Ref == "amp")
+    return '&';
+  else if (Ref == "quot")
+    return '"';
+  else if (Ref == "apos")
+    return '\'';
+  return '\0';
+}
+
+StrRef exi::translateXMLEntities(StrRef Str, SmallVecImpl<char>& Buffer) {
+  usize Pos = Str.find('&');
+  if EXI_LIKELY(Pos == StrRef::npos)
+    return Str;
+
+  Buffer.clear();
+  while (Pos != StrRef::npos) {
+    Buffer.append(Str.begin(), Str.begin() + Pos);
+    Str = Str.drop_front(Pos);
+
+    const usize End = Str.find(';');
+    const StrRef Ref = Str.slice(1, End);
+    if (const char Simple = DecodeSimpleEntity(Ref)) {
+      Buffer.push_back(Simple);
+      Str = Str.drop_front(End + 1);
+    } else if (Option<u32> C = Ref.starts_with("#")
+               ? DecodeCharRef(Ref.drop_front()) : std::nullopt) {
+      const RuneBuf Encoded = RuneEncoder::Encode(*C);
+      Buffer.append(Encoded.data(), Encoded.data() + Encoded.size());
+      Str = Str.drop_front(End + 1);
+    } else {
+      // Leave unknown entities as is.
+      Buffer.push_back('&');
+      Str = Str.drop_front();
+    }
+
+    Pos = Str.find('&');
+  }
+
+  Buffer.append(Str.begin(), Str.end());
+  return StrRef(Buffer.data(), Buffer.size());
+}
+
+XMLDoctype exi::splitXMLDoctype(StrRef Text) {
+  auto NextToken = [&Text] () -> StrRef {
+    Text = Text.ltrim();
+    if (Text.empty())
+      return ""_str;
+    if (Text.front() == '"' || Text.front() == '\'') {
+      const usize End = Text.find(Text.front(), 1);
+      StrRef Out = Text.slice(1, End);
+      Text = Text.drop_front(std::min(End + 1, Text.size()));
+      return Out;
+    }
+    const usize End = Text.find_first_of(" \t\r\n[");
+    StrRef Out = Text.take_front(End);
+    Text = Text.drop_front(Out.size());
+    return Out;
+  };
+
+  XMLDoctype Out {};
+  Out.Name = NextToken();
+  const StrRef Kind = Text.ltrim().take_while([] (char C) {
+    return exi::isAlpha(C);
+  });
+  if (Kind == "PUBLIC") {
+    Text = Text.ltrim().drop_front(Kind.size());
+    Out.PublicID = NextToken();
+    Out.SystemID = NextToken();
+  } else if (Kind == "SYSTEM") {
+    Text = Text.ltrim().drop_front(Kind.size());
+    Out.SystemID = NextToken();
+  }
+
+  StrRef Subset = Text.trim();
+  if (Subset.consume_front("["))
+    Subset = Subset.take_front(Subset.rfind(']'));
+  Out.Text = Subset;
+  return Out;
+}
+
+//===----------------------------------------------------------------===//
+// XMLNamespaceScope
+//===----------------------------------------------------------------===//
+
+Option<StrRef> XMLNamespaceScope::lookup(StrRef Pfx) const {
+  for (auto [BPfx, URI] : exi::reverse(Bindings)) {
+    if (BPfx == Pfx)
+      return URI;
+  }
+
+  if (Pfx.empty())
+    return ""_str;
+  else if (Pfx == kXMLPrefix)
+    return kXMLNamespaceURI;
+  return std::nullopt;
+}
+
+ExiError XMLNamespaceScope::resolve(QName& Name, StrRef Raw,
+                                    bool IsAttr) const {
+  auto [Pfx, Local] = splitXMLName(Raw);
+  Name.Name = Local;
+  Name.Prefix = Pfx;
+
+  // Unprefixed attributes have no namespace.
+  if (IsAttr && Pfx.empty()) {
+    Name.URI = ""_str;
+    return ExiError::OK;
+  }
+
+  if (Option<StrRef> URI = this->lookup(Pfx)) {
+    Name.URI = *URI;
+    return ExiError::OK;
+  }
+
+  LOG_ERROR("Undeclared prefix '{}' in '{}'.", Pfx, Raw);
+  return ErrorCode::kInvalidEXIInput;
+}
@@ -0,0 +1,414 @@
+//===- exi/Basic/XMLTokenizer.cpp -----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements a streaming XML tokenizer.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Basic/XMLTokenizer.hpp>
+#include <core/Common/bit.hpp>
+#include <core/Support/Endian.hpp>
+#include <core/Support/Logging.hpp>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#define DEBUG_TYPE "XMLTokenizer"
+
+using namespace exi;
+
+static constexpr u64 kLowBits  = 0x0101'0101'0101'0101;
+static constexpr u64 kHighBits = 0x8080'8080'8080'8080;
+
+/// Sets the high bit of each zero byte. Only the lowest bit is exact, as
+/// borrows may set bits above it.
+static constexpr u64 HasZero(u64 Word) {
+  return (Word - kLowBits) & ~Word & kHighBits;
+}
+
+/// Returns the first of `Cs` in `[Ptr, End)`, or `End`.
+template <char...Cs>
+static const char* FindFirstOf(const char* Ptr, const char* End) {
+#if defined(__SSE2__)
+  // Compare 16 bytes at a time against each delimiter.
+  for (; End - Ptr >= 16; Ptr += 16) {
+    const __m128i Chunk
+      = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Ptr));
+    __m128i Hits = _mm_setzero_si128();
+    ((Hits = _mm_or_si128(Hits,
+      _mm_cmpeq_epi8(Chunk, _mm_set1_epi8(Cs)))), ...);
+    if (const unsigned Mask = _mm_movemask_epi8(Hits))
+      return Ptr + exi::countr_zero(Mask);
+  }
+#endif
+
+  for (; End - Ptr >= 8; Ptr += 8) {
+    const u64 Word = support::endian::read<u64, endianness::little>(Ptr);
+    const u64 Mask = (HasZero(Word ^ (kLowBits * u8(Cs))) | ...);
+    if (Mask)
+      return Ptr + (exi::countr_zero(Mask) >> 3);
+  }
+
+  for (; Ptr != End; ++Ptr) {
+    if (((*Ptr == Cs) || ...))
+      break;
+  }
+  return Ptr;
+}
+
+static constexpr bool IsSpace(char C) {
+  return C == ' ' || C == '\t' || C == '\n' || C == '\r';
+}
+
+/// Characters which end a name, looked up rather than compared in turn.
+static constexpr auto kNameEnd = [] {
+  std::array<bool, 256> Table {};
+  for (char C : " \t\n\r>/=?")
+    Table[u8(C)] = true;
+  return Table;
+}();
+
+static constexpr bool IsNameEnd(char C) {
+  return kNameEnd[u8(C)];
+}
+
+//===----------------------------------------------------------------===//
+// Tokenizer
+//===----------------------------------------------------------------===//
+
+usize XMLTokenizer::getLine() const {
+  if (!Ptr)
+    return 0;
+  const char* Begin = Input.data();
+  return std::count(Begin, std::min(Ptr, End), '\n') + 1;
+}
+
+ExiError XMLTokenizer::invalid(StrRef Msg) const {
+  LOG_ERROR("{} at line {}.", Msg, getLine());
+  return ErrorCode::kInvalidEXIInput;
+}
+
+StrRef XMLTokenizer::scanName() {
+  const char* Begin = Ptr;
+  while (Ptr != End && !IsNameEnd(*Ptr))
+    ++Ptr;
+  return StrRef(Begin, Ptr - Begin);
+}
+
+Option<StrRef> XMLTokenizer::scanUntil(StrRef Term) {
+  if EXI_UNLIKELY(usize(End - Ptr) < Term.size())
+    return std::nullopt;
+
+  const char* Begin = Ptr;
+  const char* Last = End - Term.size();
+  // Terminators are short, so check each occurrence of the first character.
+  for (const char* At = Ptr; At <= Last; ++At) {
+    At = static_cast<const char*>(
+      std::memchr(At, Term.front(), (Last - At) + 1));
+    if (!At)
+      break;
+    if (std::memcmp(At, Term.data(), Term.size()) == 0) {
+      Ptr = At + Term.size();
+      return StrRef(Begin, At - Begin);
+    }
+  }
+  return std::nullopt;
+}
+
+ExiError XMLTokenizer::tokenize(Serializer& S) {
+  Ptr = Input.begin();
+  End = Input.end();
+  Scope.clear();
+  Open.clear();
+  URIs.Reset();
+
+  // Skip the UTF-8 byte order mark.
+  if (Input.starts_with("\xEF\xBB\xBF"))
+    Ptr += 3;
+  exi_try(S.SD());
+
+  while (Ptr != End) {
+    if (*Ptr != '<') {
+      // Skip indentation without scanning for entities.
+      const char* Begin = Ptr;
+      while (Ptr != End && IsSpace(*Ptr))
+        ++Ptr;
+      if (Ptr == End)
+        break;
+      if (*Ptr != '<') {
+        Ptr = Begin;
+        exi_try(this->tokenizeData(S));
+        continue;
+      }
+    }
+
+    if EXI_UNLIKELY(End - Ptr < 2)
+      return invalid("Unexpected end of input");
+
+    switch (Ptr[1]) {
+    case '/':
+      exi_try(this->tokenizeEnd(S));
+      break;
+    case '!':
+      exi_try(this->tokenizeMarkup(S));
+      break;
+    case '?':
+      exi_try(this->tokenizePI(S));
+      break;
+    default:
+      exi_try(this->tokenizeStart(S));
+    }
+  }
+
+  if EXI_UNLIKELY(!Open.empty()) {
+    LOG_ERROR("Unclosed element '{}'.", Open.back().Name);
+    return ErrorCode::kInvalidEXIInput;
+  }
+
+  if (ExiError E = S.ED(); E != ExiError::DONE)
+    return E;
+  return ExiError::OK;
+}
+
+ExiError XMLTokenizer::tokenizeData(Serializer& S) {
+  const char* Begin = Ptr;
+  bool HasEntity = false;
+  while (true) {
+    Ptr = FindFirstOf<'<', '&'>(Ptr, End);
+    if (Ptr == End || *Ptr == '<')
+      break;
+    HasEntity = true;
+    ++Ptr;
+  }
+
+  const StrRef Raw(Begin, Ptr - Begin);
+  // Whitespace only data is dropped.
+  if (exi::isXMLWhitespace(Raw))
+    return ExiError::OK;
+  if EXI_UNLIKELY(Open.empty())
+    return invalid("Data outside of the root element");
+
+  if (!HasEntity)
+    return S.CH(Raw);
+  return S.CH(exi::translateXMLEntities(Raw, Text));
+}
+
+ExiError XMLTokenizer::tokenizeStart(Serializer& S) {
+  ++Ptr;
+  const StrRef Raw = scanName();
+  if EXI_UNLIKELY(Raw.empty())
+    return invalid("Expected an element name");
+
+  Attrs.clear();
+  AttrText.clear();
+  bool SelfClosing = false;
+
+  while (true) {
+    while (Ptr != End && IsSpace(*Ptr))
+      ++Ptr;
+    if EXI_UNLIKELY(Ptr == End)
+      return invalid("Unterminated start tag");
+
+    if (*Ptr == '>') {
+      ++Ptr;
+      break;
+    } else if (*Ptr == '/') {
+      if EXI_UNLIKELY(End - Ptr < 2 || Ptr[1] != '>')
+        return invalid("Expected '/>'");
+      Ptr += 2;
+      SelfClosing = true;
+      break;
+    }
+
+    RawAttr& Attr = Attrs.emplace_back();
+    Attr.Name = scanName();
+    if EXI_UNLIKELY(Attr.Name.empty())
+      return invalid("Expected an attribute name");
+
+    while (Ptr != End && IsSpace(*Ptr))
+      ++Ptr;
+    if EXI_UNLIKELY(Ptr == End || *Ptr != '=')
+      return invalid("Expected '=' after attribute");
+    ++Ptr;
+    while (Ptr != End && IsSpace(*Ptr))
+      ++Ptr;
+    if EXI_UNLIKELY(Ptr == End || (*Ptr != '"' && *Ptr != '\''))
+      return invalid("Expected a quoted attribute value");
+
+    const char Quote = *Ptr++;
+    const char* Begin = Ptr;
+    bool HasEntity = false;
+    while (true) {
+      Ptr = (Quote == '"')
+        ? FindFirstOf<'"', '&'>(Ptr, End)
+        : FindFirstOf<'\'', '&'>(Ptr, End);
+      if (Ptr == End || *Ptr == Quote)
+        break;
+      HasEntity = true;
+      ++Ptr;
+    }
+    if EXI_UNLIKELY(Ptr == End)
+      return invalid("Unterminated attribute value");
+
+    Attr.Value = StrRef(Begin, Ptr - Begin);
+    ++Ptr;
+
+    if (HasEntity) {
+      // Translated values are referenced by offset, as `AttrText` may grow.
+      const StrRef Value = exi::translateXMLEntities(Attr.Value, Text);
+      Attr.Offset = AttrText.size();
+      Attr.Size = Value.size();
+      Attr.Translated = true;
+      AttrText.append(Value.begin(), Value.end());
+    }
+  }
+
+  for (RawAttr& Attr : Attrs) {
+    if (Attr.Translated)
+      Attr.Value = StrRef(AttrText.data() + Attr.Offset, Attr.Size);
+  }
+
+  Scope.push();
+  for (const RawAttr& Attr : Attrs) {
+    Option<StrRef> Pfx = exi::getXMLNSPrefix(Attr.Name);
+    if (!Pfx)
+      continue;
+    StrRef URI = Attr.Value;
+    if (Attr.Translated) {
+      // Bindings outlive the tag, so translated URIs must be copied.
+      char* Data = URIs.Allocate<char>(URI.size());
+      std::memcpy(Data, URI.data(), URI.size());
+      URI = StrRef(Data, URI.size());
+    }
+    Scope.bind(*Pfx, URI);
+  }
+
+  QName Name;
+  exi_try(Scope.resolve(Name, Raw, /*IsAttr=*/false));
+  exi_try(S.SE(Name));
+
+  // Namespace declarations are always passed before attributes.
+  bool FoundLocal = false;
+  for (auto [Pfx, URI] : Scope.declared()) {
+    const bool IsLocal = !FoundLocal
+      && (Pfx == Name.Prefix) && (URI == Name.URI);
+    FoundLocal |= IsLocal;
+    exi_try(S.NS(URI, Pfx, IsLocal));
+  }
+
+  for (const RawAttr& Attr : Attrs) {
+    if (exi::getXMLNSPrefix(Attr.Name))
+      continue;
+    QName AttrName;
+    exi_try(Scope.resolve(AttrName, Attr.Name, /*IsAttr=*/true));
+    exi_try(S.AT(AttrName, Attr.Value));
+  }
+
+  if (SelfClosing) {
+    Scope.pop();
+    return S.EE(Name);
+  }
+
+  Open.push_back(Name);
+  return ExiError::OK;
+}
+
+ExiError XMLTokenizer::tokenizeEnd(Serializer& S) {
+  Ptr += 2;
+  const StrRef Raw = scanName();
+  while (Ptr != End && IsSpace(*Ptr))
+    ++Ptr;
+  if EXI_UNLIKELY(Ptr == End || *Ptr != '>')
+    return invalid("Unterminated end tag");
+  ++Ptr;
+
+  if EXI_UNLIKELY(Open.empty())
+    return invalid("End tag without a matching start tag");
+
+  const QName Name = Open.pop_back_val();
+  auto [Pfx, Local] = exi::splitXMLName(Raw);
+  if EXI_UNLIKELY(Pfx != Name.Prefix || Local != Name.Name) {
+    LOG_ERROR("Mismatched end tag '{}' at line {}.", Raw, getLine());
+    return ErrorCode::kInvalidEXIInput;
+  }
+
+  Scope.pop();
+  return S.EE(Name);
+}
+
+ExiError XMLTokenizer::tokenizeMarkup(Serializer& S) {
+  const StrRef Rest(Ptr, End - Ptr);
+  if (Rest.starts_with("<!--")) {
+    Ptr += 4;
+    Option<StrRef> Comment = scanUntil("-->");
+    if EXI_UNLIKELY(!Comment)
+      return invalid("Unterminated comment");
+    return S.CM(*Comment);
+  } else if (Rest.starts_with("<![CDATA[")) {
+    Ptr += 9;
+    Option<StrRef> Data = scanUntil("]]>");
+    if EXI_UNLIKELY(!Data)
+      return invalid("Unterminated CDATA section");
+    if EXI_UNLIKELY(Open.empty())
+      return invalid("CDATA outside of the root element");
+    return S.CH(*Data);
+  } else if (!Rest.starts_with("<!DOCTYPE")) {
+    return invalid("Unknown markup declaration");
+  }
+
+  Ptr += 9;
+  const char* Begin = Ptr;
+  // Skip to the closing '>', ignoring any in the internal subset.
+  for (usize Depth = 0; Ptr != End; ++Ptr) {
+    if (*Ptr == '[')
+      ++Depth;
+    else if (*Ptr == ']')
+      Depth -= (Depth > 0);
+    else if (*Ptr == '>' && Depth == 0)
+      break;
+  }
+  if EXI_UNLIKELY(Ptr == End)
+    return invalid("Unterminated DOCTYPE");
+
+  const XMLDoctype DT
+    = exi::splitXMLDoctype(StrRef(Begin, Ptr - Begin));
+  ++Ptr;
+  return S.DT(DT.Name, DT.PublicID, DT.SystemID, DT.Text);
+}
+
+ExiError XMLTokenizer::tokenizePI(Serializer& S) {
+  Ptr += 2;
+  const StrRef Target = scanName();
+  while (Ptr != End && IsSpace(*Ptr))
+    ++Ptr;
+
+  Option<StrRef> Text = scanUntil("?>");
+  if EXI_UNLIKELY(!Text)
+    return invalid("Unterminated processing instruction");
+
+  // Declarations aren't part of the infoset.
+  if (Target == "xml")
+    return ExiError::OK;
+  if EXI_UNLIKELY(Target.empty())
+    return invalid("Expected a processing instruction target");
+  return S.PI(Target, *Text);
+}
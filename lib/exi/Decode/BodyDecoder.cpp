@@ -22,11 +22,13 @@
 //===----------------------------------------------------------------===//
 
 #include <exi/Decode/BodyDecoder.hpp>
+#include <exi/Decode/BodyDecoderImpl.hpp>
 #include <core/Common/MMatch.hpp>
 #include <core/Common/Unwrap.hpp>
 #include <core/Support/Casting.hpp>
 #include <core/Support/Format.hpp>
 #include <core/Support/Logging.hpp>
+#include <core/Support/MathExtras.hpp>
 #include <exi/Basic/ErrorCodes.hpp>
 #include <exi/Basic/Runes.hpp>
 #include <exi/Decode/Serializer.hpp>
@@ -37,7 +39,7 @@
 #if 1
 // FIXME: Update if needed...
 # define LOG_POSITION(...)                                                    \
-  LOG_EXTRA("@[{}]:", ((__VA_ARGS__)->Reader->bitPos()))
+  LOG_EXTRA("@[{}]:", ((__VA_ARGS__)->bitPos()))
 # define LOG_META(...) LOG_EXTRA(__VA_ARGS__)
 #else
 # define LOG_POSITION(...) ((void)(0))
@@ -68,6 +70,9 @@ ExiError ExiDecoder::setOptions(MaybeBox<ExiOptions> Opts) {
     exi_invariant(Header.Opts, "Options not initialized!");
     return this->readerExists();
   }
+  if (Opts.get() != Header.Opts.get())
+    // The schema was built for the old options.
+    CurrentSchema.reset();
   Header.Opts = std::move(Opts);
   if (!Reader.empty())
     Flags.DidHeader = true;
@@ -94,6 +99,72 @@ ExiError ExiDecoder::setReader(UnifiedBuffer Buffer) {
   return ExiError::OK;
 }
 
+ExiError ExiDecoder::setFragmentReader(UnifiedBuffer Buffer, u64 Offset) {
+  const ArrayRef<u8> Data = Buffer.arr();
+  if (Offset > Data.size()) {
+    LOG_ERROR("Fragment is out of bounds.");
+    return ErrorCode::kOutOfBounds;
+  }
+
+  if (ExiError E = this->setReader(Data.drop_front(Offset)))
+    return E;
+  Flags.Fragment = true;
+  return ExiError::OK;
+}
+
+Box<ExiDecoder> ExiDecoder::newFragment() {
+  exi_invariant(Header.Opts, "Options not initialized!");
+  auto Frag = std::make_unique<ExiDecoder>(*Header.Opts, OS);
+  // Nested fragments are decoded along with this one, so they aren't
+  // recorded in the index.
+  Frag->Input = Input;
+  Frag->Flags.SetReader = true;
+  Frag->Flags.DidHeader = true;
+  Frag->Flags.BorrowInput = Flags.BorrowInput;
+  Frag->Flags.Fragment = true;
+  Frag->Resolver = Resolver;
+  Frag->CompiledSchemas = CompiledSchemas;
+  // Fragments are limited to what is left of the budget.
+  if (MemoryBudget)
+    Frag->setMemoryBudget(std::max<u64>(MemoryLeft, 1));
+  return Frag;
+}
+
+ExiError ExiDecoder::setInput(ChunkedInput& In) {
+  if (ExiError E = this->readerExists())
+    return E;
+  
+  this->Input = &In;
+  Flags.BorrowInput = false;
+
+  LOG_EXTRA("Input set.");
+  return ExiError::OK;
+}
+
+void ExiDecoder::reset() {
+  // Grammars are allocated with `BP`, so the schema must be reset first.
+  if (CurrentSchema)
+    CurrentSchema->reset(/*IsFragment=*/false);
+  Idents.reset();
+  BP.Reset();
+
+  Header = ExiHeader { .Opts = std::move(Header.Opts) };
+  Reader.reset();
+  Input = nullptr;
+  Channels.reset();
+  Fragments.clear();
+  FragmentBytes = 0;
+  GrammarStack.clear();
+  Flags = DecoderFlags {
+    .BorrowInput = Flags.BorrowInput,
+    .InflateAhead = Flags.InflateAhead
+  };
+  // Allocations are kept, so usage is checked before the first event.
+  this->setMemoryBudget(MemoryBudget);
+
+  LOG_EXTRA("Decoder reset.");
+}
+
 ExiError ExiDecoder::init() {
   if (Flags.DidInit) {
     exi_assert(Header.Opts);
@@ -106,10 +177,16 @@ ExiError ExiDecoder::init() {
   }
 
   auto& Opts = *Header.Opts;
-  if (!Opts.SchemaID.expect("schema is required"))
-    CurrentSchema = BuiltinSchema::New(Opts);
-  else
-    exi_unreachable("schemas are currently unsupported");
+  if (const auto& ID = Opts.SchemaID.expect("schema is required"); !ID) {
+    Grammars.reset();
+    CurrentCompiled = nullptr;
+    if (CurrentSchema && isa<BuiltinSchema>(*CurrentSchema))
+      // Reuse the schema from before `reset`.
+      CurrentSchema->reset(Flags.Fragment);
+    else
+      CurrentSchema = BuiltinSchema::New(Opts, Flags.Fragment);
+  } else if (ExiError E = this->initSchema(*ID))
+    return E;
   
   if (!CurrentSchema) {
     LOG_ERROR("Schema could not be allocated.");
@@ -118,8 +195,15 @@ ExiError ExiDecoder::init() {
 
   if (hasDbgLogLevel(INFO))
     CurrentSchema->dump();
-  // TODO: Load schema
-  Idents.setup(Opts);
+  if (CurrentCompiled)
+    Idents.setup(Opts, CurrentCompiled->Tables);
+  else
+    Idents.setup(Opts, Grammars ? &Grammars->tables() : nullptr);
+
+  if (Opts.Alignment == AlignKind::PreCompression) {
+    if (ExiError E = this->initChannels())
+      return E;
+  }
 
   Preserve = Opts.Preserve;
   Flags.DidHeader = true;
@@ -129,6 +213,54 @@ ExiError ExiDecoder::init() {
   return ExiError::OK;
 }
 
+ExiError ExiDecoder::initSchema(StrRef SchemaID) {
+  const auto& Opts = *Header.Opts;
+  if (Opts.Compression || Opts.Alignment == AlignKind::PreCompression) {
+    LOG_ERROR("Compression is unsupported with schemas.");
+    return ErrorCode::kUnimplemented;
+  } else if (Opts.Preserve.LexicalValues) {
+    LOG_ERROR("Lexical values are unsupported with schemas.");
+    return ErrorCode::kUnimplemented;
+  }
+
+  for (const CompiledSchemaInfo* Info : CompiledSchemas) {
+    if (Info->SchemaID != SchemaID)
+      continue;
+    Grammars.reset();
+    if (CurrentSchema && CurrentCompiled == Info) {
+      // Reuse the schema from before `reset`.
+      CurrentSchema->reset(Flags.Fragment);
+      return ExiError::OK;
+    }
+    CurrentCompiled = Info;
+    CurrentSchema = Info->New(Opts, Flags.Fragment);
+    return ExiError::OK;
+  }
+
+  CurrentCompiled = nullptr;
+  if (!Resolver) {
+    LOG_ERROR("No resolver for schema '{}'.", SchemaID);
+    return ErrorCode::kInvalidConfig;
+  }
+
+  Expected<SchemaGrammarsRef> Loaded = Resolver->resolve(SchemaID);
+  if (!Loaded) {
+    logAllUnhandledErrors(Loaded.takeError(), this->os());
+    return ErrorCode::kInvalidConfig;
+  }
+
+  if (CurrentSchema && isa<DynamicSchema>(*CurrentSchema)
+      && Grammars == *Loaded) {
+    // Reuse the schema from before `reset`.
+    CurrentSchema->reset(Flags.Fragment);
+    return ExiError::OK;
+  }
+
+  Grammars = std::move(*Loaded);
+  CurrentSchema = DynamicSchema::New(Opts, Grammars, Flags.Fragment);
+  return ExiError::OK;
+}
+
 ExiError ExiDecoder::prepareForDecoding() {
   if (!Flags.DidInit && !Flags.SetReader) {
     // No init because required options were not provided.
@@ -144,245 +276,239 @@ ExiError ExiDecoder::prepareForDecoding() {
   }
 
   exi_invariant(Header.Opts && CurrentSchema);
-  auto* SchemaPtr = CurrentSchema.get();
-
-  if (!isa<BuiltinSchema>(*SchemaPtr)) {
-    // TODO: Schemas!!!
-    exi_unreachable("dynamic and compiled schemas currently unsupported.");
-  }
-
   return ExiError::OK;
 }
 
-ExiError ExiDecoder::decodeBody() {
-  Serializer S{};
-  return this->decodeBody(&S);
-}
-
-ExiError ExiDecoder::decodeBody(Serializer* S) {
-  if (S == nullptr) {
-    // TODO: Allow defaulting in permissive mode?
-    LOG_ERROR("Serializer cannot be null!");
-    return ErrorCode::kInvalidEXIInput;
+ExiError ExiDecoder::prepareInput() {
+  if (!Input) {
+    LOG_ERROR("Input has not been set.");
+    return ErrorCode::kInvalidConfig;
   }
 
-  if (ExiError E = prepareForDecoding())
-    return E;
+  if (!Reader.empty()) {
+    // Data may have been fed since the last call.
+    Reader.visit([] (auto& Strm) -> void { Strm.syncInput(); });
+    return this->prepareForDecoding();
+  }
 
-  //LOG_EXTRA("Beginning decoding...");
-  while (Reader->hasData()) {
-    ExiError E = this->decodeEvent(S);
-    if EXI_LIKELY(E == ExiError::OK)
-      continue;
-    else if (E == ExiError::DONE)
+  // The header must be decoded in one go, so it is decoded again if it runs
+  // out of input.
+  const u64 Start = Input->position();
+  Input->mark(Start);
+  while (true) {
+    if (!Input->pull(0))
+      return ExiError::FULL;
+    const ExiError E = this->decodeHeaderFrom(Input->data(), Input);
+    if EXI_LIKELY(E != ExiError::FULL) {
+      if (E)
+        return E;
       break;
-    // Some other error code.
-    return E;
+    }
+    Reader.reset();
+    Input->growLookahead(Start);
+    (void) Input->rewind(Start);
   }
 
-  //LOG_EXTRA("Completed decoding!");
-  return ExiError::OK;
+  return this->prepareForDecoding();
 }
 
-EXI_HOT ExiError ExiDecoder::decodeEvent(Serializer* S) {
-  LOG_POSITION(this);
-  const EventUID Event = CurrentSchema->decode(this);
-  
-  switch (Event.getTerm()) {
-  case EventTerm::SE:       // Start Element (*)
-  case EventTerm::SEUri:    // Start Element (uri:*)
-  case EventTerm::SEQName:  // Start Element (qname)
-    return this->handleSE(S, Event);
-  case EventTerm::EE:       // End Element
-    return this->handleEE(S, Event);
-  case EventTerm::AT:       // Attribute (*, value)
-  case EventTerm::ATUri:    // Attribute (uri:*, value)
-  case EventTerm::ATQName:  // Attribute (qname, value)
-    return this->handleAT(S, Event);
-  case EventTerm::NS:       // Namespace Declaration (uri, prefix, local-element-ns)
-    return this->handleNS(S, Event);
-  case EventTerm::CH:       // Characters (value)
-  case EventTerm::CHExtern: // Characters (external-value)
-    return this->handleCH(S, Event);
-  default:
-    return this->dispatchUncommonEvent(S, Event);
-  }
-}
-
-EXI_COLD ExiError ExiDecoder::dispatchUncommonEvent(Serializer* S,
-                                                    const EventUID Event) {
-  // ...
-  switch (Event.getTerm()) {
-  case EventTerm::SD:       // Start Document
-    return S->SD();
-  case EventTerm::ED:       // End Document
-    if (ExiError E = S->ED())
-      return E;
-    return ExiError::DONE;
-  case EventTerm::CM:       // Comment text (text)
-    return this->handleCM(S);
-  case EventTerm::PI:       // Processing Instruction (name, text)
-    return this->handlePI(S);
-  case EventTerm::DT:       // DOCTYPE (name, public, system, text)
-    return this->handleDT(S);
-  case EventTerm::ER:       // Entity Reference (name)
-    return this->handleER(S);
-  case EventTerm::SC:       // Self Contained
-    return ErrorCode::kUnimplemented;
-  default:
-    exi_assert("unknown term");
-    return ErrorCode::kInvalidEXIInput;
-  }
+void ExiDecoder::checkpointEvent() {
+  exi_invariant(Input && !Reader.empty());
+  EventStart = Input->position() * 8 + Reader->bitPos();
+  Input->mark(EventStart / 8);
+  Idents.checkpoint();
+  CurrentSchema->checkpoint();
 }
 
-//////////////////////////////////////////////////////////////////////////
-// Terms
-
-#if 0
-// Start Element (*)
-// Start Element (uri:*)
-// Start Element (qname)
-ExiError ExiDecoder::handleSE(EventUID Event) {
-  LOG_EXTRA("Decoded SE");
-  return ExiError::OK;
+bool ExiDecoder::rewindEvent() {
+  exi_invariant(Input && !Reader.empty());
+  // Tables are restored first, as they refuse when values were replaced.
+  if (!Idents.rollback() || !CurrentSchema->rollback())
+    return false;
+
+  const u64 Start = EventStart / 8;
+  Input->growLookahead(Start);
+  Reader->setProxy({Input->rewind(Start), EventStart % 8});
+  return true;
 }
 
-ExiError ExiDecoder::handleEE(EventUID Event) {
-#if EXI_LOGGING
-  if (Event.hasQName()) {
-    StrRef URI = this->getPfxOrURI(Event);
-    StrRef LocalName = Idents.getLocalName(Event.Name);
-    LOG_INFO(">> EE[{}:{}]\n", URI, LocalName);
-  } else {
-    LOG_EXTRA("Decoded EE");
-    if (hasDbgLogLevel(INFO))
-      dbgs() << '\n';
+ExiError ExiDecoder::initChannels() {
+  if (Input) {
+    LOG_ERROR("Compressed streams cannot be decoded incrementally.");
+    return ErrorCode::kUnimplemented;
   }
+
+  // The header is byte-aligned, streams begin directly after it.
+  auto [Bytes, NBits] = Reader->getProxy();
+  const ArrayRef<u8> Body = Bytes.drop_front(NBits / 8);
+  if (Header.Opts->Compression) {
+    // No single stream may inflate past the budget.
+    const usize Limit = MemoryBudget ? MemoryBudget : max_v<usize>;
+#if EXI_USE_THREADS
+    if (Flags.InflateAhead) {
+      constexpr u32 NSlots = ParallelDeflateReader::kDefaultSlots;
+      Channels = std::make_unique<ParallelDeflateReader>(
+        Body, NSlots, MemoryBudget ? (Limit / NSlots) : Limit);
+    } else
+#else
+    if (Flags.InflateAhead) {
+      LOG_WARN("Threads are disabled (EXI_USE_THREADS), "
+               "inflating on the calling thread.");
+    }
 #endif
+      Channels = std::make_unique<DeflateReader>(Body, Limit);
+    // Streams are inflated into a reused buffer.
+    Flags.InflatedInput = true;
+  } else
+    Channels = std::make_unique<BlockReader>(Body);
+
+  if (!Block)
+    Block = std::make_unique<ChannelBlock>();
+  Block->BlockSize = std::max<u64>(Header.Opts->BlockSize, 1);
   return ExiError::OK;
 }
 
-// Attribute (*, value)
-// Attribute (uri:*, value)
-// Attribute (qname, value)
-ExiError ExiDecoder::handleAT(EventUID Event) {
-  exi_invariant(Event.hasQName());
-  Result R = decodeValue(Event.Name);
-  const auto Value = $unwrap(std::move(R));
-  LOG_EXTRA("Decoded AT");
+ExiError ExiDecoder::beginStream() {
+  Result R = Channels->beginStream();
+  if EXI_UNLIKELY(R.is_err())
+    return R.error();
+  Reader.emplace<ByteReader>(*R);
   return ExiError::OK;
 }
 
-// Namespace Declaration (uri, prefix, local-element-ns)
-ExiError ExiDecoder::handleNS(EventUID) {
-  const auto Event = $unwrap(decodeNS());
-  LOG_EXTRA("Decoded NS");
-  return ExiError::OK;
-}
+ExiError ExiDecoder::decodeChannels() {
+  using ChannelT = ChannelBlock::Channel;
+  ChannelBlock& B = *Block;
+  auto* Strm = &cast<ByteReader>(Reader);
+  B.Values.resize(B.numValues());
+  // Bounded tables may reuse storage before the block is replayed.
+  const bool SaveValues = Idents.hasBoundedValues();
+
+  auto DecodeChannel = [&, this] (const ChannelT& C) -> ExiError {
+    for (u32 Slot : C.Slots) {
+      Result R = this->decodeValue(Strm, C.Name);
+      if EXI_UNLIKELY(R.is_err())
+        return R.error();
+      StrRef Value = Idents.getValue(*R);
+      B.Values[Slot] = SaveValues ? B.save(Value) : Value;
+    }
+    return ExiError::OK;
+  };
 
-// Characters (value)
-ExiError ExiDecoder::handleCH(EventUID Event) {
-  LOG_EXTRA("Decoded CH");
-  return ExiError::OK;
-}
-#endif
+  ArrayRef<ChannelT> Chans = B.groupChannels();
+  if (B.numValues() <= ChannelReader::kMaxGroupedValues) {
+    // Values directly follow the structure, in a single stream.
+    for (const auto& C : Chans)
+      exi_try(DecodeChannel(C));
+    Channels->endStream(Strm->bitPos() / 8);
+    return ExiError::OK;
+  }
 
-// Start Element (*)
-// Start Element (uri:*)
-// Start Element (qname)
-ExiError ExiDecoder::handleSE(Serializer* S, EventUID Event) {
-  const QName Name = this->getQName(Event);
-  LOG_EXTRA("Decoded SE");
-  return S->SE(Name);
-}
+  // Small channels are combined into one stream, then every large channel
+  // has its own stream.
+  Channels->endStream(Strm->bitPos() / 8);
+  auto IsSmall = [] (const ChannelT& C) {
+    return C.Slots.size() <= ChannelReader::kMaxGroupedValues;
+  };
 
-ExiError ExiDecoder::handleEE(Serializer* S, EventUID Event) {
-  if (!Event.hasQName()) {
-    LOG_EXTRA("Decoded EE");
-    if (hasDbgLogLevel(INFO))
-      dbgs() << '\n';
-    return ExiError::OK;
+  if (exi::any_of(Chans, IsSmall)) {
+    exi_try(this->beginStream());
+    Strm = &cast<ByteReader>(Reader);
+    for (const auto& C : Chans) {
+      if (IsSmall(C))
+        exi_try(DecodeChannel(C));
+    }
+    Channels->endStream(Strm->bitPos() / 8);
+  }
+
+  for (const auto& C : Chans) {
+    if (IsSmall(C))
+      continue;
+    exi_try(this->beginStream());
+    Strm = &cast<ByteReader>(Reader);
+    exi_try(DecodeChannel(C));
+    Channels->endStream(Strm->bitPos() / 8);
   }
 
-  const QName Name = this->getQName(Event);
-  LOG_INFO(">> EE[{}:{}]\n", Name.Prefix, Name.Name);
-  return S->EE(Name);
+  return ExiError::OK;
 }
 
-// Attribute (*, value)
-// Attribute (uri:*, value)
-// Attribute (qname, value)
-ExiError ExiDecoder::handleAT(Serializer* S, EventUID Event) {
-  exi_invariant(Event.hasQName());
-  Result R = decodeValue(Event.Name);
-  const auto ValueID = $unwrap(std::move(R));
+ExiError ExiDecoder::decodeBody() {
+  Serializer S{};
+  return this->decodeBody(&S);
+}
 
-  const QName Name = this->getQName(Event);
-  StrRef Value = Idents.getValue(ValueID);
+ExiError ExiDecoder::decodeBody(Serializer* S) {
+  if (S == nullptr) {
+    // TODO: Allow defaulting in permissive mode?
+    LOG_ERROR("Serializer cannot be null!");
+    return ErrorCode::kInvalidEXIInput;
+  }
 
-  LOG_EXTRA("Decoded AT");
-  return S->AT(Name, Value);
+  return this->decodeBody<Serializer>(*S);
 }
 
-// Namespace Declaration (uri, prefix, local-element-ns)
-ExiError ExiDecoder::handleNS(Serializer* S, EventUID) {
-  const auto Event = $unwrap(decodeNS());
-  const auto Name = Event.Name;
-  
-  StrRef URI = Idents.getURI(Name.URI);
-  StrRef Pfx = Idents.getPrefix(Name.URI, Event.Prefix);
+ExiError ExiDecoder::decodeAvailable(Serializer* S) {
+  if (S == nullptr) {
+    LOG_ERROR("Serializer cannot be null!");
+    return ErrorCode::kInvalidConfig;
+  }
 
-  LOG_EXTRA("Decoded NS");
-  return S->NS(URI, Pfx, Event.isLocal());
+  return this->decodeAvailable<Serializer>(*S);
 }
 
-// Characters (value)
-ExiError ExiDecoder::handleCH(Serializer* S, EventUID Event) {
-  StrRef Value = Idents.getValue(Event);
-  LOG_EXTRA("Decoded CH");
-  return S->CH(Value);
-}
+//////////////////////////////////////////////////////////////////////////
+// Memory
 
-#define READ_STRING(NAME, RESERVE, READER)                                    \
-  SmallStr<RESERVE> NAME##_Data;                                              \
-  Result NAME = (READER)->decodeString(NAME##_Data);                          \
-  if EXI_UNLIKELY(NAME.is_err())                                              \
-    return NAME.error();
+DecoderMemoryUsage ExiDecoder::getMemoryUsage() const {
+  DecoderMemoryUsage Usage {
+    .Internal = BP.getTotalMemory(),
+    .StringTables = Idents.getMemoryUsage(),
+    .Fragments = FragmentBytes,
+  };
+  if (CurrentSchema)
+    Usage.Grammars = CurrentSchema->getMemoryUsage();
+  if (Channels)
+    Usage.Channels += Channels->getMemoryUsage();
+  if (Block)
+    Usage.Channels += Block->getMemoryUsage();
+  return Usage;
+}
+
+ExiError ExiDecoder::checkMemoryBudget() {
+  MemoryCountdown = kMemoryCheckInterval;
+  if (MemoryBudget == 0) {
+    MemoryLeft = max_v<u64>;
+    return ExiError::OK;
+  }
 
-ExiError ExiDecoder::handleCM(Serializer* S) {
-  READ_STRING(Comment, 80, Reader)
-  if (S->needsPersistence())
-    this->internStrings(*Comment);
-  return S->CM(*Comment);
-}
+  const u64 Used = this->getMemoryUsage().total();
+  if EXI_UNLIKELY(Used > MemoryBudget) {
+    LOG_ERROR("Decoder holds {} bytes, exceeding its budget of {}.",
+              Used, MemoryBudget);
+    MemoryLeft = 0;
+    return ErrorCode::kInvalidMemoryAlloc;
+  }
 
-ExiError ExiDecoder::handlePI(Serializer* S) {
-  return Reader.visit([this, S] (auto& Strm) -> ExiError {
-    READ_STRING(Target, 16, &Strm)
-    READ_STRING(Text,   48, &Strm)
-    if (S->needsPersistence())
-      this->internStrings(*Target, *Text);
-    return S->PI(*Target, *Text);
-  });
+  MemoryLeft = MemoryBudget - Used;
+  return ExiError::OK;
 }
 
-ExiError ExiDecoder::handleDT(Serializer* S) {
-  return Reader.visit([this, S] (auto& Strm) -> ExiError {
-    READ_STRING(Name,  16, &Strm)
-    READ_STRING(PubID, 16, &Strm)
-    READ_STRING(SysID, 16, &Strm)
-    READ_STRING(Text,  32, &Strm)
-    if (S->needsPersistence())
-      this->internStrings(*Name, *PubID, *SysID, *Text);
-    return S->DT(*Name, *PubID, *SysID, *Text);
-  });
-}
+ExiError ExiDecoder::reserveMemorySlow(u64 Size) {
+  // Strings are only estimates, so check the actual usage first.
+  if (ExiError E = this->checkMemoryBudget())
+    return E;
+  if (MemoryBudget == 0)
+    return ExiError::OK;
 
-ExiError ExiDecoder::handleER(Serializer* S) {
-  READ_STRING(Entity, 16, Reader)
-  if (S->needsPersistence())
-    this->internStrings(*Entity);
-  return S->CM(*Entity);
+  if EXI_UNLIKELY(Size >= MemoryLeft) {
+    LOG_ERROR("String of {} bytes exceeds the memory budget.", Size);
+    MemoryLeft = 0;
+    return ErrorCode::kInvalidMemoryAlloc;
+  }
+
+  MemoryLeft -= Size;
+  return ExiError::OK;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -455,44 +581,46 @@ Option<StrRef> ExiDecoder::tryGetPfx(CompactID URI, CompactID PfxID) {
 //////////////////////////////////////////////////////////////////////////
 // Values
 
-ExiResult<EventUID> ExiDecoder::decodeQName() {
-  const CompactID URI = $unwrap(decodeURI());
-  const CompactID LNI = $unwrap(decodeName(URI));
-  Option Pfx = $unwrap(decodePfxQ(URI));
+template <class StrmT>
+ExiResult<EventUID> ExiDecoder::decodeQName(StrmT* Strm) {
+  const CompactID URI = $unwrap(decodeURI(Strm));
+  const CompactID LNI = $unwrap(decodeName(Strm, URI));
+  Option Pfx = $unwrap(decodePfxQ(Strm, URI));
 
   auto QName = SmallQName::NewQName(URI, LNI);
   return Ok(EventUID::NewQName(QName, Pfx));
 }
 
-ExiResult<EventUID> ExiDecoder::decodeNS() {
-  const CompactID URI = $unwrap(decodeURI());
-  const CompactID PfxID = $unwrap(decodePfx(URI));
+template <class StrmT>
+ExiResult<EventUID> ExiDecoder::decodeNS(StrmT* Strm) {
+  const CompactID URI = $unwrap(decodeURI(Strm));
+  const CompactID PfxID = $unwrap(decodePfx(Strm, URI));
 
   bool IsLocal = false;
-  exi_try_r(Reader->readBit(IsLocal));
-  if (!IsLocal) {
-    LOG_INFO(">> NONLOCAL");
-    return Err(ErrorCode::kUnimplemented);
-  }
+  exi_try_r(Strm->readBit(IsLocal));
+  LOG_INFO(">> NS local-element-ns: {}", IsLocal);
 
   auto QName = SmallQName::NewURI(URI);
   return Ok(EventUID::NewNS(QName, PfxID, IsLocal));
 }
 
-ExiResult<CompactID> ExiDecoder::decodeURI() {
+template <class StrmT>
+ExiResult<CompactID> ExiDecoder::decodeURI(StrmT* Strm) {
   CompactID URI; {
     const u64 NBits = Idents.getURILog();
-    LOG_POSITION(this);
+    LOG_POSITION(Strm);
     LOG_EXTRA("Decoding <{}>", NBits);
-    exi_try_r(Reader->readBits64(URI, NBits));
+    exi_try_r(Strm->readBits64(URI, NBits));
   }
 
   if (URI == 0) {
     // Cache miss
     StrRef URIStr;
     SmallStr<32> Data;
-    LOG_POSITION(this);
-    StrRef Str = $unwrap(Reader->decodeString(Data));
+    LOG_POSITION(Strm);
+    StrRef Str = $unwrap(Strm->decodeString(Data));
+    if (ExiError E = this->reserveMemory(Str.size()))
+      return Err(E);
     std::tie(URIStr, URI) = Idents.addURI(Str);
     LOG_INFO(">> URI(Miss) @{}: \"{}\"", URI, URIStr);
   } else {
@@ -507,11 +635,12 @@ ExiResult<CompactID> ExiDecoder::decodeURI() {
   return URI;
 }
 
-ExiResult<CompactID> ExiDecoder::decodeName(CompactID URI) {
+template <class StrmT>
+ExiResult<CompactID> ExiDecoder::decodeName(StrmT* Strm, CompactID URI) {
   CompactID LnID; {
-    LOG_POSITION(this);
+    LOG_POSITION(Strm);
     LOG_EXTRA("Decoding UInt");
-    exi_try_r(Reader->readUInt(LnID));
+    exi_try_r(Strm->readUInt(LnID));
     LOG_EXTRA(">>> UInt {}", LnID);
   }
 
@@ -519,25 +648,33 @@ ExiResult<CompactID> ExiDecoder::decodeName(CompactID URI) {
   if (LnID == 0) {
     // Cache hit
     const u64 NBits = Idents.getLocalNameLog(URI);
-    LOG_POSITION(this);
+    LOG_POSITION(Strm);
     LOG_EXTRA("Decoding <{}>", NBits);
-    exi_try_r(Reader->readBits64(LnID, NBits));
+    exi_try_r(Strm->readBits64(LnID, NBits));
 #if EXI_LOGGING
     LocalName = Idents.getLocalName(URI, LnID);
 #endif
   } else {
     // Cache miss
     LnID -= 1;
-    SmallStr<32> Data;
-    StrRef Str = $unwrap(Reader->readString(LnID, Data));
-    std::tie(LocalName, LnID) = Idents.addLocalName(URI, Str);
+    if (ExiError E = this->reserveMemory(LnID))
+      return Err(E);
+    if (Option<StrRef> View = this->tryBorrowString(Strm, LnID)) {
+      std::tie(LocalName, LnID) = Idents.addLocalNameRef(URI, *View);
+    } else {
+      SmallStr<32> Data;
+      StrRef Str = $unwrap(Strm->readString(LnID, Data));
+      std::tie(LocalName, LnID) = Idents.addLocalName(URI, Str);
+    }
   }
 
   LOG_INFO(">> LN @{}: \"{}\"", LnID, LocalName);
   return LnID;
 }
 
-ExiResult<Option<CompactID>> ExiDecoder::decodePfxQ(CompactID URI) {
+template <class StrmT>
+ExiResult<Option<CompactID>>
+ ExiDecoder::decodePfxQ(StrmT* Strm, CompactID URI) {
   if (!Preserve.Prefixes)
     return Ok(std::nullopt);
   if (!Idents.hasPrefix(URI))
@@ -547,9 +684,9 @@ ExiResult<Option<CompactID>> ExiDecoder::decodePfxQ(CompactID URI) {
   const u64 NBits = Idents.getPrefixLogQ(URI);
 
   if (NBits) {
-    LOG_POSITION(this);
+    LOG_POSITION(Strm);
     LOG_EXTRA("Decoding <{}>", NBits);
-    exi_try_r(Reader->readBits64(PfxID, NBits));
+    exi_try_r(Strm->readBits64(PfxID, NBits));
   }
 
 #if EXI_LOGGING
@@ -560,14 +697,15 @@ ExiResult<Option<CompactID>> ExiDecoder::decodePfxQ(CompactID URI) {
   return Ok(PfxID);
 }
 
-ExiResult<CompactID> ExiDecoder::decodePfx(CompactID URI) {
+template <class StrmT>
+ExiResult<CompactID> ExiDecoder::decodePfx(StrmT* Strm, CompactID URI) {
   exi_invariant(Preserve.Prefixes, "NS event occurred without prefixes.");
   CompactID PfxID = 0;
   const u64 NBits = Idents.getPrefixLog(URI);
 
-  LOG_POSITION(this);
+  LOG_POSITION(Strm);
   LOG_EXTRA("Decoding <{}>", NBits);
-  exi_try_r(Reader->readBits64(PfxID, NBits));
+  exi_try_r(Strm->readBits64(PfxID, NBits));
 
   StrRef Pfx;
   if (PfxID != 0) {
@@ -581,7 +719,9 @@ ExiResult<CompactID> ExiDecoder::decodePfx(CompactID URI) {
   } else {
     // Cache miss
     SmallStr<32> Data;
-    StrRef Str = $unwrap(Reader->decodeString(Data));
+    StrRef Str = $unwrap(Strm->decodeString(Data));
+    if (ExiError E = this->reserveMemory(Str.size()))
+      return Err(E);
     std::tie(Pfx, PfxID) = Idents.addPrefix(URI, Str);
   }
 
@@ -589,21 +729,29 @@ ExiResult<CompactID> ExiDecoder::decodePfx(CompactID URI) {
   return Ok(PfxID);
 }
 
-ExiResult<EventUID> ExiDecoder::decodeValue(SmallQName Name) {
+template <class StrmT>
+ExiResult<EventUID> ExiDecoder::decodeValue(StrmT* Strm, SmallQName Name,
+                                            ArrayRef<u32> CharSet) {
   exi_invariant(Name.isQName());
+  if EXI_UNLIKELY(Flags.DeferValues) {
+    // The value is in a channel, which follows the structure.
+    Block->ValueNames.push_back(Name);
+    return EventUID::NewEmptyValue();
+  }
+
   CompactID ValID; {
-    LOG_POSITION(this);
+    LOG_POSITION(Strm);
     LOG_EXTRA("Decoding UInt");
-    exi_try_r(Reader->readUInt(ValID));
+    exi_try_r(Strm->readUInt(ValID));
     LOG_EXTRA(">>> UInt {}", ValID);
   }
 
   if (ValID == 0) {
     // LocalValue hit
     const u64 NBits = Idents.getLocalValueLog(Name);
-    LOG_POSITION(this);
+    LOG_POSITION(Strm);
     LOG_EXTRA("Decoding <{}>", NBits);
-    exi_try_r(Reader->readBits64(ValID, NBits));
+    exi_try_r(Strm->readBits64(ValID, NBits));
 
 #if EXI_LOGGING
     auto [URI, LocalName] = Idents.getQName(Name);
@@ -616,9 +764,9 @@ ExiResult<EventUID> ExiDecoder::decodeValue(SmallQName Name) {
   } else if (ValID == 1) {
     // GlobalValue hit
     const u64 NBits = Idents.getGlobalValueLog();
-    LOG_POSITION(this);
+    LOG_POSITION(Strm);
     LOG_EXTRA("Decoding <{}>", NBits);
-    exi_try_r(Reader->readBits64(ValID, NBits));
+    exi_try_r(Strm->readBits64(ValID, NBits));
 
 #if EXI_LOGGING
     StrRef GlobalVal = Idents.getGlobalValue(ValID);
@@ -629,9 +777,40 @@ ExiResult<EventUID> ExiDecoder::decodeValue(SmallQName Name) {
   } else {
     // Cache miss
     const u64 Size = (ValID - 2);
-    SmallStr<32> Data;
-    StrRef Str = $unwrap(readString(Size, Data));
-    auto [Value, GID, LnID] = Idents.addValue(Name, Str);
+    if EXI_UNLIKELY(Size == 0) {
+      // Empty values are never added to the tables.
+      LOG_INFO(">> V: \"\"");
+      return EventUID::NewEmptyValue();
+    }
+
+    if EXI_UNLIKELY(!CharSet.empty())
+      return this->decodeRestrictedValue(Strm, Name, Size, CharSet);
+
+    if EXI_UNLIKELY(!Idents.isValueAdded(Size)) {
+      // The value is too long, or the tables have no capacity.
+      StrRef Value;
+      if (Option<StrRef> View = this->tryBorrowString(Strm, Size)) {
+        Value = Idents.setTransientValue(*View, /*Copy=*/false);
+      } else {
+        SmallStr<32> Data;
+        StrRef Str = $unwrap(Strm->readString(Size, Data));
+        Value = Idents.setTransientValue(Str);
+      }
+      LOG_INFO(">> V: \"{}\"", Value);
+      return EventUID::NewTransientValue();
+    }
+
+    if (ExiError E = this->reserveMemory(Size))
+      return Err(E);
+    decode::IDTriple Added;
+    if (Option<StrRef> View = this->tryBorrowString(Strm, Size)) {
+      Added = Idents.addValueRef(Name, *View);
+    } else {
+      SmallStr<32> Data;
+      StrRef Str = $unwrap(Strm->readString(Size, Data));
+      Added = Idents.addValue(Name, Str);
+    }
+    auto [Value, GID, LnID] = Added;
 
 #if EXI_LOGGING
     auto [URI, LocalName] = Idents.getQName(Name);
@@ -644,6 +823,68 @@ ExiResult<EventUID> ExiDecoder::decodeValue(SmallQName Name) {
   }
 }
 
+template <class StrmT>
+ExiResult<EventUID> ExiDecoder::decodeRestrictedValue(StrmT* Strm,
+                                                      SmallQName Name,
+                                                      u64 Size,
+                                                      ArrayRef<u32> CharSet) {
+  SmallStr<32> Data;
+  StrRef Str = $unwrap(readRestrictedString(Strm, Size, CharSet, Data));
+  if EXI_UNLIKELY(!Idents.isValueAdded(Size)) {
+    StrRef Value = Idents.setTransientValue(Str);
+    LOG_INFO(">> V: \"{}\"", Value);
+    return EventUID::NewTransientValue();
+  }
+
+  if (ExiError E = this->reserveMemory(Size))
+    return Err(E);
+  auto [Value, GID, LnID] = Idents.addValue(Name, Str);
+  LOG_INFO(">> LV @{}: \"{}\"", LnID, Value);
+  return EventUID::NewLocalValue(Name, LnID);
+}
+
+template <class StrmT>
+ExiResult<StrRef> ExiDecoder::readRestrictedString(StrmT* Strm, u64 Size,
+                                                   ArrayRef<u32> CharSet,
+                                                   SmallVecImpl<char>& Data) {
+  // Index `CharSet.size()` escapes a code point outside of the set.
+  const u64 NBits = Log2_64_Ceil(CharSet.size() + 1);
+  Data.clear();
+  Data.reserve(std::min<u64>(Size, 1024));
+  for (u64 Ix = 0; Ix != Size; ++Ix) {
+    u64 Code = 0;
+    exi_try_r(Strm->readBits64(Code, NBits));
+    if (Code == CharSet.size())
+      exi_try_r(Strm->readUInt(Code));
+    else if EXI_UNLIKELY(Code > CharSet.size())
+      return Err(ErrorCode::kInvalidEXIInput);
+    else
+      Code = CharSet[Code];
+
+    auto Buf = RuneEncoder::Encode(Code);
+    Data.append(Buf.data(), Buf.data() + Buf.size());
+  }
+  return StrRef(Data.data(), Data.size());
+}
+
+#define INSTANTIATE_DECODERS(STRM)                                            \
+  template ExiResult<EventUID> ExiDecoder::decodeQName(STRM*);                \
+  template ExiResult<EventUID> ExiDecoder::decodeNS(STRM*);                   \
+  template ExiResult<CompactID> ExiDecoder::decodeURI(STRM*);                 \
+  template ExiResult<CompactID> ExiDecoder::decodeName(STRM*, CompactID);     \
+  template ExiResult<Option<CompactID>>                                       \
+    ExiDecoder::decodePfxQ(STRM*, CompactID);                                 \
+  template ExiResult<CompactID> ExiDecoder::decodePfx(STRM*, CompactID);      \
+  template ExiResult<EventUID>                                                \
+    ExiDecoder::decodeValue(STRM*, SmallQName, ArrayRef<u32>);                \
+  template ExiResult<StrRef> ExiDecoder::readRestrictedString(                \
+    STRM*, u64, ArrayRef<u32>, SmallVecImpl<char>&);
+
+INSTANTIATE_DECODERS(BitReader)
+INSTANTIATE_DECODERS(ByteReader)
+
+#undef INSTANTIATE_DECODERS
+
 ExiResult<String> ExiDecoder::decodeString() {
   SmallStr<64> Data;
   if (auto E = this->decodeString(Data)
@@ -665,6 +906,9 @@ void ExiDecoder::diagnose(ExiError E, bool Force) const {
     return;
   if (!Force && !OS)
     return;
+  // Events which run out of incremental input are replayed, not reported.
+  if (E == ExiError::FULL && Input)
+    return;
   
   if EXI_LIKELY(!Reader.empty()) {
     // os() << "At [" << Reader->bitPos() << "]: ";
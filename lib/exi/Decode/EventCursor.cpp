@@ -0,0 +1,205 @@
+//===- exi/Decode/EventCursor.cpp -----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements a pull-based cursor over the events of an EXI body.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Decode/EventCursor.hpp>
+#include <exi/Decode/EventBuffer.hpp>
+#include <core/Common/Unwrap.hpp>
+#include <core/Support/Logging.hpp>
+
+#define DEBUG_TYPE "EventCursor"
+
+using namespace exi;
+
+ExiResult<ExiEvent> ExiEventCursor::next() {
+  if EXI_UNLIKELY(IsDone)
+    return Err(ExiError::DONE);
+
+  if EXI_UNLIKELY(!DidPrepare) {
+    if (ExiError E = D->prepareForDecoding())
+      return Err(finish(E));
+    if EXI_UNLIKELY(D->Channels) {
+      LOG_ERROR("Compressed streams cannot be read with a cursor.");
+      return Err(finish(ErrorCode::kUnimplemented));
+    }
+    DidPrepare = true;
+  }
+
+  Text.clear();
+  if (ExiError E = D->tickMemoryBudget())
+    return Err(finish(E));
+  EventUID Event = D->CurrentSchema->decode(D);
+  ExiError E = D->Reader.visit([this, &Event] (auto& Strm) -> ExiError {
+    return this->completeEvent(&Strm, Event);
+  });
+  if EXI_UNLIKELY(E)
+    return Err(finish(E));
+
+  if (Event.getTerm() == EventTerm::ED)
+    IsDone = true;
+  return ExiEvent {
+    .UID = Event,
+    .Depth = Depth
+  };
+}
+
+ExiResult<usize> ExiEventCursor::nextBatch(ExiEventBuffer& Buf,
+                                           usize MaxEvents) {
+  Buf.clear();
+  if EXI_UNLIKELY(IsDone)
+    return Err(ExiError::DONE);
+
+  SmallVec<StrRef, 4> Pieces;
+  for (usize Ix = 0; Ix < MaxEvents; ++Ix) {
+    auto Event = this->next();
+    if EXI_UNLIKELY(Event.is_err()) {
+      if (Event.error() == ExiError::DONE)
+        break;
+      return Err(Event.error());
+    }
+
+    if EXI_LIKELY(!Event->hasText()) {
+      // Values which may not outlive the next event are copied.
+      if (Event->UID.hasValue() && (Event->UID.isTransientValue()
+          || D->Idents.hasBoundedValues())) {
+        const StrRef Value = this->getValue(*Event);
+        Buf.push(Event->UID, Event->Depth, ArrayRef(&Value, 1));
+        continue;
+      }
+      Buf.push(Event->UID, Event->Depth);
+      continue;
+    }
+
+    Pieces.clear();
+    for (const SmallStr<32>& Str : Text)
+      Pieces.push_back(Str.str());
+    Buf.push(Event->UID, Event->Depth, Pieces);
+  }
+
+  return Ok(Buf.size());
+}
+
+ExiError ExiEventCursor::skipSubtree() {
+  exi_invariant(Depth > 0, "skipSubtree called outside of an element.");
+  const u32 Target = Depth - 1;
+  while (Depth > Target) {
+    auto Event = this->next();
+    if EXI_UNLIKELY(Event.is_err())
+      return Event.error();
+  }
+  return ExiError::OK;
+}
+
+const decode::StringTable& ExiEventCursor::idents() const {
+  return D->Idents;
+}
+
+template <class StrmT>
+ExiError ExiEventCursor::readText(StrmT* Strm, unsigned N) {
+  Text.resize(N);
+  for (SmallStr<32>& Str : Text) {
+    Result R = Strm->decodeString(Str);
+    if EXI_UNLIKELY(R.is_err())
+      return R.error();
+  }
+  return ExiError::OK;
+}
+
+template <class StrmT>
+ExiError ExiEventCursor::completeEvent(StrmT* Strm, EventUID& Event) {
+  switch (Event.getTerm()) {
+  case EventTerm::SE:       // Start Element (*)
+  case EventTerm::SEUri:    // Start Element (uri:*)
+  case EventTerm::SEQName:  // Start Element (qname)
+    ++Depth;
+    return ExiError::OK;
+  case EventTerm::EE:       // End Element
+    exi_invariant(Depth > 0, "invalid nesting");
+    --Depth;
+    return ExiError::OK;
+  case EventTerm::AT:       // Attribute (*, value)
+  case EventTerm::ATUri:    // Attribute (uri:*, value)
+  case EventTerm::ATQName:  // Attribute (qname, value)
+  {
+    exi_invariant(Event.hasQName());
+    if (Event.hasValue())
+      // Typed values are decoded by the schema.
+      return ExiError::OK;
+    const EventUID Value = $unwrap(D->decodeValue(Strm, Event.Name));
+    Event.ValueID = Value.ValueID;
+    Event.IsLocal = Value.IsLocal;
+    return ExiError::OK;
+  }
+  case EventTerm::NS:       // Namespace Declaration (uri, prefix, local-element-ns)
+  {
+    const EventUID NS = $unwrap(D->decodeNS(Strm));
+    Event.Prefix = NS.Prefix;
+    Event.IsLocal = NS.IsLocal;
+    Event.Name = NS.Name;
+    return ExiError::OK;
+  }
+  case EventTerm::CH:       // Characters (value)
+  case EventTerm::CHExtern: // Characters (external-value)
+  case EventTerm::SD:       // Start Document
+  case EventTerm::ED:       // End Document
+    return ExiError::OK;
+  case EventTerm::CM:       // Comment text (text)
+  case EventTerm::ER:       // Entity Reference (name)
+    return this->readText(Strm, 1);
+  case EventTerm::PI:       // Processing Instruction (name, text)
+    return this->readText(Strm, 2);
+  case EventTerm::DT:       // DOCTYPE (name, public, system, text)
+    return this->readText(Strm, 4);
+  case EventTerm::SC:       // Self Contained
+    LOG_ERROR("Self-contained elements cannot be read with a cursor.");
+    return ErrorCode::kUnimplemented;
+  default:
+    LOG_ERROR("Invalid event decoded.");
+    return ErrorCode::kInvalidEXIInput;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Resolution
+
+QName ExiEventCursor::getQName(const ExiEvent& Event) const {
+  return D->getQName(Event.UID);
+}
+
+StrRef ExiEventCursor::getValue(const ExiEvent& Event) const {
+  exi_invariant(Event.UID.hasValue());
+  return D->Idents.getValue(Event.UID);
+}
+
+StrRef ExiEventCursor::getValue(const ExiEventBuffer& Buf, usize Ix) const {
+  if (Buf.hasText(Ix))
+    return Buf.getText(Ix);
+  return D->Idents.getValue(Buf.getUID(Ix));
+}
+
+StrRef ExiEventCursor::getURI(const ExiEvent& Event) const {
+  return D->Idents.getURI(Event.UID.getURI());
+}
+
+StrRef ExiEventCursor::getPrefix(const ExiEvent& Event) const {
+  return D->Idents.getPrefix(Event.UID.getURI(), Event.UID.getPrefix());
+}
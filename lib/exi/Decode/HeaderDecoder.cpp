@@ -65,7 +65,8 @@ static ExiError DecodeCookieAndBits(ExiHeader& Header, BitReader* Strm) {
 
   exi_try(Strm->readBits(DistinguishingBits));
   if (DistinguishingBits == 0b00) {
-    const u64 First = *Strm->readBits<6>();
+    u64 First = 0;
+    exi_try(Strm->readBits64(First, 6));
     char Read = promotion_cast<char>(First);
     if EXI_UNLIKELY('$' != Read) {
       LOG_ERROR("invalid cookie byte at '$'");
@@ -74,7 +75,9 @@ static ExiError DecodeCookieAndBits(ExiHeader& Header, BitReader* Strm) {
 
     // Consume [EXI Cookie], if possible.
     for (const char C : "EXI"_str) {
-      Read = promotion_cast<char>(*Strm->readByte());
+      u8 Byte = 0;
+      exi_try(Strm->readByte(Byte));
+      Read = promotion_cast<char>(Byte);
       if EXI_UNLIKELY(C != Read) {
         LOG_ERROR("invalid cookie byte at '{}'", C);
         return ExiError::HeaderSig(Read);
@@ -193,12 +196,18 @@ ExiError exi::decodeHeader(ExiHeader& Header, OrdReader& In) {
 }
 
 ExiError ExiDecoder::decodeHeader(UnifiedBuffer Buffer) {
+  return this->decodeHeaderFrom(Buffer.arr(), nullptr);
+}
+
+ExiError ExiDecoder::decodeHeaderFrom(ArrayRef<u8> Buffer,
+                                      ChunkedInput* Src) {
   if (Flags.DidHeader) {
     exi_assert(!Reader.empty(), "Invalid processor state");
     return this->readerExists();
   }
 
-  BitReader Strm(Buffer.arr());
+  BitReader Strm(Buffer);
+  Strm.setSource(Src);
   ExiError Out = decodeHeaderImpl(Header, Strm);
 
   Flags.SetReader = false;
@@ -210,6 +219,8 @@ ExiError ExiDecoder::decodeHeader(UnifiedBuffer Buffer) {
     // exi_assert(Strm.bitOffset() == 0, "Misaligned stream!");
     Reader.emplace<ByteReader>(Pos);
   }
+  // The proxy is a window of the source, so reads may continue from it.
+  Reader->setSource(Src);
   
   if (Out == ExiError::OK) {
     if (ExiError E = this->init())
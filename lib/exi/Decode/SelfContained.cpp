@@ -0,0 +1,116 @@
+//===- exi/Decode/SelfContained.cpp ---------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements decoding of self-contained (SC) fragments.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Decode/SelfContained.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Support/Logging.hpp>
+#include <exi/Basic/ExiOptions.hpp>
+#include <exi/Decode/BodyDecoder.hpp>
+#include <Config/Config.inc>
+#if EXI_USE_THREADS
+# include <atomic>
+# include <mutex>
+# include <thread>
+#endif
+
+#define DEBUG_TYPE "SelfContained"
+
+using namespace exi;
+
+ExiError exi::decodeSCFragment(UnifiedBuffer Buffer, const SCEntry& Entry,
+                               ExiOptions& Opts, Serializer* S) {
+  const ArrayRef<u8> Data = Buffer.arr();
+  if (Entry.Begin > Entry.End || Entry.End > Data.size()) {
+    LOG_ERROR("Fragment [{}, {}) is out of bounds.", Entry.Begin, Entry.End);
+    return ErrorCode::kOutOfBounds;
+  }
+
+  ExiDecoder Decoder(Opts);
+  // Restrict the reader to the fragment, so a bad index can't read into
+  // the following data.
+  const ArrayRef<u8> Fragment = Data.slice(Entry.Begin, Entry.size());
+  if (ExiError E = Decoder.setFragmentReader(Fragment, 0))
+    return E;
+  return Decoder.decodeBody(S);
+}
+
+#if EXI_USE_THREADS
+
+ExiError exi::decodeSCFragments(UnifiedBuffer Buffer, ArrayRef<SCEntry> Index,
+                                ExiOptions& Opts,
+                                function_ref<Serializer*(usize)> GetSerializer,
+                                unsigned Threads) {
+  if (Index.empty())
+    return ExiError::OK;
+  if (Threads == 0)
+    Threads = std::max(std::thread::hardware_concurrency(), 1u);
+  Threads = std::min<usize>(Threads, Index.size());
+
+  std::atomic<usize> Next = 0;
+  std::atomic<bool> Failed = false;
+  std::mutex ErrorLock;
+  ExiError Error = ExiError::OK;
+
+  // Fragments are claimed one at a time, as their sizes may vary wildly.
+  auto Worker = [&] () {
+    while (!Failed.load(std::memory_order_relaxed)) {
+      const usize Ix = Next.fetch_add(1, std::memory_order_relaxed);
+      if (Ix >= Index.size())
+        return;
+
+      const ExiError E
+        = exi::decodeSCFragment(Buffer, Index[Ix], Opts, GetSerializer(Ix));
+      if EXI_UNLIKELY(E) {
+        std::scoped_lock Lock(ErrorLock);
+        if (!Failed.exchange(true))
+          Error = E;
+        return;
+      }
+    }
+  };
+
+  SmallVec<std::thread, 8> Workers;
+  Workers.reserve(Threads - 1);
+  for (unsigned Ix = 1; Ix < Threads; ++Ix)
+    Workers.emplace_back(Worker);
+  // The calling thread does its share of the work.
+  Worker();
+
+  for (std::thread& T : Workers)
+    T.join();
+  return Error;
+}
+
+#else // !EXI_USE_THREADS
+
+ExiError exi::decodeSCFragments(UnifiedBuffer Buffer, ArrayRef<SCEntry> Index,
+                                ExiOptions& Opts,
+                                function_ref<Serializer*(usize)> GetSerializer,
+                                unsigned Threads) {
+  // Fragments are decoded in order on the calling thread.
+  for (usize Ix = 0, E = Index.size(); Ix < E; ++Ix)
+    exi_try(exi::decodeSCFragment(Buffer, Index[Ix], Opts, GetSerializer(Ix)));
+  return ExiError::OK;
+}
+
+#endif // EXI_USE_THREADS
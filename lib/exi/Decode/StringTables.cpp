@@ -22,10 +22,12 @@
 //===----------------------------------------------------------------===//
 
 #include <exi/Basic/StringTables.hpp>
+#include <core/Common/STLExtras.hpp>
 #include <core/Common/Twine.hpp>
 #include <core/Support/ErrorHandle.hpp>
 #include <core/Support/Logging.hpp>
 #include <exi/Basic/ExiOptions.hpp>
+#include <exi/Grammar/SchemaGrammars.hpp>
 #include <algorithm>
 
 #define DEBUG_TYPE "StringTables"
@@ -67,41 +69,111 @@ static const Option<String&> PullSchemaID(const Option<MaybeBox<String>>& ID) {
 
 namespace exi::decode {
 
+void LocalName::vacate(CompactID ID) {
+  exi_invariant(ID < size());
+  if (ID < Offset)
+    return;
+  LocalValues[ID - Offset] = StrRef();
+
+  // Values are removed in about the order they were added, so vacant IDs
+  // collect at the front. They are trimmed once they make up half of the
+  // partition, keeping the cost constant per value.
+  while (NVacant < LocalValues.size() && !LocalValues[NVacant].data())
+    ++NVacant;
+  if (NVacant * 2 < LocalValues.size())
+    return;
+  LocalValues.erase(LocalValues.begin(), LocalValues.begin() + NVacant);
+  Offset += NVacant;
+  NVacant = 0;
+}
+
 StringTable::StringTable() : LNMap(LNPageAllocator) {
   GValueMap.reserve(kDefaultReserveSize);
 }
 
-void StringTable::setup(const ExiOptions& Opts) {
+void StringTable::setup(const ExiOptions& Opts,
+                        const SchemaTables* Schema) {
   if (DidSetup)
     return;
   DidSetup = true;
 
-  Option<const String&> ID = PullSchemaID(Opts.SchemaID);
-  const bool UsesSchema = ID.has_value();
-
   /// Populates the URI, Prefix, and LocalName partitions.
-  createInitialEntries(UsesSchema);
-  if (UsesSchema) {
-    // TODO: Reserve for schema.
-    // SchemaResolver[*ID]->getExtraEntryCount();
+  if (Schema) {
+    exi_invariant(PullSchemaID(Opts.SchemaID).has_value());
+    createSchemaEntries(*Schema);
+  } else {
+    Option<const String&> ID = PullSchemaID(Opts.SchemaID);
+    restoreInitialEntries(GetInitialEntries(ID.has_value()));
   }
 
   if (Bounded I = Opts.ValuePartitionCapacity; I.bounded()) {
     WrappingValues = true;
-    LOG_WARN("Bounded tables are not supported, "
-             "the value '{}' only affects the initial reserve.", *I);
-    // TODO: Do some kind of check here. We definitely don't want arbitrarily
-    // large allocations.
-    GValueMap.reserve(*I);
+    ValueCapacity = *I;
+    // Slots are created as they are used, so large capacities don't
+    // allocate up front.
+    GValueMap.reserve(std::min<u64>(*I, kDefaultReserveSize));
   } else
     GValueMap.reserve(kDefaultReserveSize);
 
+  if (Bounded I = Opts.ValueMaxLength; I.bounded())
+    ValueMaxLength = *I;
+
   if (Opts.DatatypeRepresentationMap) {
     // TODO: DatatypeRepresentationMap?
     exi_unreachable("datatype mapping is unsupported.");
   }
 }
 
+void StringTable::reset() {
+  if (!DidSetup)
+    return;
+
+  const usize NPartitions = *LNCount;
+  if EXI_UNLIKELY(NPartitions > kLNPageElts) {
+    // Pages can't be freed individually, so drop all of them.
+    LNMap.clear();
+    LNPageAllocator.Reset();
+  } else {
+    // Keep the first page, along with the capacity of each partition.
+    for (usize Ix = 0; Ix != NPartitions; ++Ix)
+      LNMap[Ix].clear();
+  }
+
+  LNAllocator.DestroyAll();
+  NameValueCache.getAllocator().Reset();
+  LNCache.clear();
+
+  URIMap.clear();
+  URICount = CompactIDCounter<1>();
+  PrefixMap.clear();
+  LNCount = CompactIDCounter<>();
+  GValueMap.clear();
+  GValueCount = CompactIDCounter<>();
+  GValueNext = 0;
+  ValueCapacity = max_v<u64>;
+  ValueMaxLength = max_v<u64>;
+  TransientValue = StrRef();
+  Saved.Changes.clear();
+  Saved.IsActive = false;
+
+  DidSetup = false;
+  WrappingValues = false;
+}
+
+usize StringTable::getMemoryUsage() const {
+  usize Total = NameValueCache.getAllocator().getTotalMemory()
+    + LNPageAllocator.getTotalMemory()
+    + LNAllocator.getTotalMemory();
+  Total += URIMap.capacity_in_bytes() + PrefixMap.capacity_in_bytes();
+  Total += GValueMap.capacity_in_bytes();
+  Total += GValueSlots.capacity_in_bytes() + GValueSlotBytes;
+  Total += TransientData.capacity();
+  // Every value is also in a LocalValue partition. Walking them would be
+  // too slow for periodic checks, so assume each is densely packed.
+  Total += *GValueCount * sizeof(StrRef);
+  return Total;
+}
+
 IDPair StringTable::addURI(StrRef URI, Option<StrRef> Pfx) {
   // const CompactID ID = *URICount;
   auto [Info, ID] = createURI(URI, Pfx);
@@ -112,28 +184,176 @@ IDPair StringTable::addPrefix(CompactID URI, StrRef Pfx) {
   exi_invariant(URI < URIMap.size());
   this->assertPartitionsInSync();
 
-  const CompactID ID = URIMap[URI].PrefixElts++;
+  // `PrefixElts` is one more than the number of prefixes, unless there are
+  // none. URIs created without a prefix start at zero.
+  const CompactID ID = PrefixMap[URI].size();
   InlineStr* PfxP = intern(Pfx);
+  if EXI_UNLIKELY(Saved.IsActive)
+    this->recordChange({.Kind = TableChange::kPrefix,
+      .PrefixElts = URIMap[URI].PrefixElts, .URI = URI});
   PrefixMap[URI].push_back(PfxP);
+  URIMap[URI].PrefixElts = ID + 2;
 
   return {PfxP->str(), ID};
 }
 
 IDPair StringTable::addLocalName(CompactID URI, StrRef Name) {
+  return this->pushLocalName(URI, internStr(Name));
+}
+
+IDPair StringTable::addLocalNameRef(CompactID URI, StrRef Name) {
+  return this->pushLocalName(URI, Name);
+}
+
+IDPair StringTable::pushLocalName(CompactID URI, StrRef Name) {
   exi_invariant(URI < URIMap.size());
   this->assertPartitionsInSync();
 
   const CompactID ID = URIMap[URI].LNElts++;
   LocalName* LN = createLocalName(Name);
   LNMap[URI].push_back(LN);
+  if EXI_UNLIKELY(Saved.IsActive)
+    this->recordChange({.Kind = TableChange::kLocalName, .URI = URI});
 
   return {LN->Name, ID};
 }
 
+void StringTable::checkpoint() {
+  Saved.Changes.clear();
+  Saved.NURIs = URIMap.size();
+  Saved.URICount = URICount;
+  Saved.LNCount = LNCount;
+  Saved.GValueCount = GValueCount;
+  Saved.GValueNext = GValueNext;
+  Saved.IsActive = true;
+  Saved.IsLost = false;
+}
+
+bool StringTable::rollback() {
+  if (!Saved.IsActive || Saved.IsLost)
+    return false;
+  this->assertPartitionsInSync();
+
+  // Undone in reverse, values may belong to LocalNames added since.
+  for (const TableChange& Change : reverse(Saved.Changes)) {
+    switch (Change.Kind) {
+    case TableChange::kPrefix:
+      PrefixMap[Change.URI].pop_back();
+      URIMap[Change.URI].PrefixElts = Change.PrefixElts;
+      break;
+    case TableChange::kLocalName:
+      LNMap[Change.URI].pop_back();
+      --URIMap[Change.URI].LNElts;
+      break;
+    case TableChange::kLocalValue:
+      Change.Values->LocalValues.pop_back();
+      break;
+    }
+  }
+  Saved.Changes.clear();
+
+  // The LocalName partitions of new URIs are empty now. `LNMap` keeps the
+  // elements of its last page when shrinking, which is fine.
+  for (usize URI = Saved.NURIs; URI != URIMap.size(); ++URI)
+    exi_invariant(LNMap[URI].empty());
+  URIMap.truncate(Saved.NURIs);
+  PrefixMap.truncate(Saved.NURIs);
+  LNMap.resize(Saved.NURIs);
+  URICount = Saved.URICount;
+  LNCount = Saved.LNCount;
+
+  GValueMap.truncate(*Saved.GValueCount);
+  GValueCount = Saved.GValueCount;
+  GValueNext = Saved.GValueNext;
+  // Cached partitions may belong to LocalNames which were removed.
+  LNCache.clear();
+  return true;
+}
+
 IDPair StringTable::addGlobalValue(StrRef Value) {
   const CompactID ID = *GValueCount;
   // Add to the global table, no other interaction needed.
-  return {createGlobalValue(Value)->str(), ID};
+  return {pushGlobalValue(internStr(Value)), ID};
+}
+
+IDTriple StringTable::addWrappingValue(SmallQName IDs, StrRef Value,
+                                       bool Copy) {
+  exi_invariant(IDs.isQName());
+  exi_invariant(ValueCapacity != 0, "value should not be added");
+
+  const CompactID GID = GValueNext;
+  if (++GValueNext == ValueCapacity)
+    GValueNext = 0;
+
+  if (GID < GValueMap.size()) {
+    // The partition is full, so the previous value is removed from its
+    // local partition. Other LocalIDs are unaffected.
+    ValueSlot& Old = GValueSlots[GID];
+    getLVPartition(Old.Name)->vacate(Old.LocalID);
+    Saved.IsLost |= Saved.IsActive;
+  } else {
+    exi_invariant(GID == GValueMap.size());
+    GValueMap.emplace_back();
+    ++GValueCount;
+    if (GID == GValueSlots.size())
+      GValueSlots.emplace_back();
+  }
+
+  ValueSlot& Slot = GValueSlots[GID];
+  if (Copy) {
+    // The storage of the slot is reused, so it stops growing once it has
+    // held the longest value.
+    const usize OldCapacity = Slot.Data.capacity();
+    Slot.Data.assign(Value.begin(), Value.end());
+    GValueSlotBytes += (Slot.Data.capacity() - OldCapacity);
+    Value = StrRef(Slot.Data.data(), Slot.Data.size());
+  }
+
+  LNPartition& Values = *getLVPartition(IDs);
+  const CompactID LnID = Values.size();
+  Values.LocalValues.push_back(Value);
+  if EXI_UNLIKELY(Saved.IsActive)
+    this->recordChange({.Kind = TableChange::kLocalValue, .Values = &Values});
+  Slot.Name = IDs;
+  Slot.LocalID = LnID;
+  GValueMap[GID] = Value;
+
+  return {.Value = Value, .GlobalID = GID, .LocalID = LnID};
+}
+
+StringTable::StringTable(InitialEntriesTag, bool UsesSchema) : StringTable() {
+  createInitialEntries(UsesSchema);
+  DidSetup = true;
+}
+
+const StringTable& StringTable::GetInitialEntries(bool UsesSchema) {
+  // Never modified after creation, so these may be shared between threads.
+  static const StringTable Schemaless(InitialEntriesTag{}, false);
+  static const StringTable Schema(InitialEntriesTag{}, true);
+  return UsesSchema ? Schema : Schemaless;
+}
+
+void StringTable::restoreInitialEntries(const StringTable& Init) {
+  Init.assertPartitionsInSync();
+  // The URI partition is trivially copyable, so this is just a copy.
+  URIMap.assign(Init.URIMap.begin(), Init.URIMap.end());
+  PrefixMap.assign(Init.PrefixMap.begin(), Init.PrefixMap.end());
+  URICount = Init.URICount;
+  LNCount = Init.LNCount;
+  LNMap.resize(*LNCount);
+
+  usize NNames = 0;
+  for (const URIInfo& Info : URIMap)
+    NNames += Info.LNElts;
+
+  // LocalNames hold their own values, so they can't be shared. Their
+  // strings can be, as `Init` is never destroyed.
+  LocalName* LNs = LNAllocator.Allocate(NNames);
+  for (usize URI = 0, E = *LNCount; URI != E; ++URI) {
+    LNMapType& NameMap = LNMap[URI];
+    for (const LocalName* Name : Init.LNMap[URI])
+      NameMap.push_back(new (LNs++) LocalName {.Name = Name->Name});
+  }
 }
 
 void StringTable::createInitialEntries(bool UsesSchema) {
@@ -156,6 +376,30 @@ void StringTable::createInitialEntries(bool UsesSchema) {
   }
 }
 
+void StringTable::createSchemaEntries(const SchemaTables& Schema) {
+  // D.1 & D.2 - The first partitions are those defined by the spec, only
+  // they have initial prefixes.
+  static constexpr StrRef InitialPrefixes[] {""_str, "xml"_str, "xsi"_str};
+  usize NNames = 0;
+  for (auto [Ix, Info] : exi::enumerate(Schema.URIs)) {
+    Option<StrRef> Pfx;
+    if (Ix < std::size(InitialPrefixes))
+      Pfx = InitialPrefixes[Ix];
+    createURI(Schema.getStr(Info.Name), Pfx);
+    NNames += Info.NNames;
+  }
+
+  // D.3 - The LocalNames of every partition, sorted. These are owned by the
+  // schema, so they don't need to be interned.
+  LocalName* LNs = LNAllocator.Allocate(NNames);
+  for (auto [ID, Info] : exi::enumerate(Schema.URIs)) {
+    LNMapType& NameMap = LNMap[ID];
+    for (SchemaStr Name : Schema.LocalNames.slice(Info.FirstName, Info.NNames))
+      NameMap.push_back(new (LNs++) LocalName {.Name = Schema.getStr(Name)});
+    URIMap[ID].LNElts = NameMap.size();
+  }
+}
+
 std::pair<URIInfo*, CompactID>
  StringTable::createURI(StrRef URI, Option<StrRef> Pfx) {
   this->assertPartitionsInSync();
@@ -188,9 +432,10 @@ void StringTable::appendLocalNames(CompactID ID, ArrayRef<StrRef> LocalNames) {
   exi_invariant(ID < *LNCount);
   LNMapType& NameMap = LNMap[ID];
   for (StrRef Local : LocalNames) {
-    auto* LN = createLocalName(Local);
+    auto* LN = createLocalName(internStr(Local));
     NameMap.push_back(LN);
   }
+  URIMap[ID].LNElts = NameMap.size();
 }
 
 } // namespace exi::decode
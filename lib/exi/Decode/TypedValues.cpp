@@ -0,0 +1,343 @@
+//===- exi/Decode/TypedValues.cpp -----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements decoding of schema-typed values.
+///
+/// Values other than strings are never added to the string tables, so they
+/// are printed in their canonical lexical form and returned as transient.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Decode/BodyDecoder.hpp>
+#include <core/Common/Unwrap.hpp>
+#include <core/Support/Format.hpp>
+#include <core/Support/Logging.hpp>
+#include <core/Support/MathExtras.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Grammar/SchemaGrammars.hpp>
+
+#define DEBUG_TYPE "TypedValues"
+
+using namespace exi;
+
+/// The exponent of a Float which is INF, -INF, or NaN.
+static constexpr i64 kSpecialExponent = -(i64(1) << 14);
+/// The offset of a TimeZone.
+static constexpr i64 kTimeZoneOffset = 896;
+
+namespace {
+
+/// Reads the primitive representations of section 7.1.
+template <class StrmT> struct PrimitiveReader {
+  StrmT* Strm;
+public:
+  ExiError readBool(bool& Out) { return Strm->readBit(Out); }
+
+  ExiError readUnsigned(u64& Out) { return Strm->readUInt(Out); }
+
+  ExiError readNBit(u64& Out, unsigned Bits) {
+    return Strm->readBits64(Out, Bits);
+  }
+
+  /// Reads a sign, followed by the magnitude. Negative values are offset
+  /// by one, as there is no negative zero.
+  ExiError readInteger(i64& Out) {
+    bool Negative = false;
+    u64 Magnitude = 0;
+    exi_try(readBool(Negative));
+    exi_try(readUnsigned(Magnitude));
+    if EXI_UNLIKELY(Magnitude > u64(max_v<i64>))
+      return ErrorCode::kInvalidEXIInput;
+    Out = Negative ? (-i64(Magnitude) - 1) : i64(Magnitude);
+    return ExiError::OK;
+  }
+};
+
+} // namespace `anonymous`
+
+/// Appends the digits of `Value` in reverse, as with fractional parts.
+static void AppendReversed(raw_ostream& OS, u64 Value) {
+  do {
+    OS << char('0' + (Value % 10));
+    Value /= 10;
+  } while (Value != 0);
+}
+
+static void AppendBase64(raw_ostream& OS, ArrayRef<u8> Bytes) {
+  static constexpr char Table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  usize Ix = 0;
+  for (const usize E = Bytes.size(); Ix + 3 <= E; Ix += 3) {
+    const u32 Word = (u32(Bytes[Ix]) << 16)
+      | (u32(Bytes[Ix + 1]) << 8) | Bytes[Ix + 2];
+    OS << Table[(Word >> 18) & 63] << Table[(Word >> 12) & 63]
+       << Table[(Word >> 6) & 63] << Table[Word & 63];
+  }
+
+  const usize Rest = Bytes.size() - Ix;
+  if (Rest == 0)
+    return;
+  u32 Word = u32(Bytes[Ix]) << 16;
+  if (Rest == 2)
+    Word |= u32(Bytes[Ix + 1]) << 8;
+  OS << Table[(Word >> 18) & 63] << Table[(Word >> 12) & 63];
+  OS << (Rest == 2 ? Table[(Word >> 6) & 63] : '=') << '=';
+}
+
+template <class StrmT>
+static ExiError AppendDateTime(PrimitiveReader<StrmT> R,
+                               SchemaValueKind Kind, raw_ostream& OS) {
+  using enum SchemaValueKind;
+  const bool HasYear = (Kind == DateTime || Kind == Date
+    || Kind == GYearMonth || Kind == GYear);
+  const bool HasMonthDay = (Kind != Time && Kind != GYear);
+  const bool HasTime = (Kind == DateTime || Kind == Time);
+
+  if (HasYear) {
+    i64 Year = 0;
+    exi_try(R.readInteger(Year));
+    Year += 2000;
+    if (Year < 0)
+      OS << format("-{:04}", -Year);
+    else
+      OS << format("{:04}", Year);
+  }
+
+  if (HasMonthDay) {
+    u64 MonthDay = 0;
+    exi_try(R.readNBit(MonthDay, 9));
+    const u64 Month = MonthDay / 32, Day = MonthDay % 32;
+    switch (Kind) {
+    case DateTime:
+    case Date:
+      OS << format("-{:02}-{:02}", Month, Day);
+      break;
+    case GYearMonth:
+      OS << format("-{:02}", Month);
+      break;
+    case GMonthDay:
+      OS << format("--{:02}-{:02}", Month, Day);
+      break;
+    case GMonth:
+      OS << format("--{:02}", Month);
+      break;
+    default:
+      exi_invariant(Kind == GDay);
+      OS << format("---{:02}", Day);
+      break;
+    }
+  }
+
+  if (HasTime) {
+    u64 Time = 0;
+    exi_try(R.readNBit(Time, 17));
+    if (Kind == DateTime)
+      OS << 'T';
+    OS << format("{:02}:{:02}:{:02}",
+      Time / (64 * 64), (Time / 64) % 64, Time % 64);
+
+    bool HasFraction = false;
+    exi_try(R.readBool(HasFraction));
+    if (HasFraction) {
+      u64 Fraction = 0;
+      exi_try(R.readUnsigned(Fraction));
+      OS << '.';
+      AppendReversed(OS, Fraction);
+    }
+  }
+
+  bool HasTimeZone = false;
+  exi_try(R.readBool(HasTimeZone));
+  if (HasTimeZone) {
+    u64 Raw = 0;
+    exi_try(R.readNBit(Raw, 11));
+    const i64 Offset = i64(Raw) - kTimeZoneOffset;
+    if (Offset == 0)
+      OS << 'Z';
+    else {
+      const i64 Abs = Offset < 0 ? -Offset : Offset;
+      OS << format("{}{:02}:{:02}", Offset < 0 ? '-' : '+', Abs / 64, Abs % 64);
+    }
+  }
+
+  return ExiError::OK;
+}
+
+template <class StrmT>
+ExiResult<EventUID> ExiDecoder::decodeTypedValue(StrmT* Strm, SmallQName Name,
+                                                 const SchemaTables& Schema,
+                                                 u32 Datatype) {
+  const SchemaDatatype& DT = Schema.Datatypes[Datatype];
+  if (DT.Kind == SchemaValueKind::String)
+    tail_return this->decodeValue(Strm, Name, Schema.getCharSet(DT));
+
+  SmallStr<64> Data;
+  exi_try_r(this->appendTypedValue(Strm, Name, Schema, DT, Data));
+  StrRef Value = Idents.setTransientValue(Data);
+  LOG_INFO(">> TV: \"{}\"", Value);
+  return EventUID::NewTransientValue();
+}
+
+template <class StrmT>
+ExiError ExiDecoder::appendTypedValue(StrmT* Strm, SmallQName Name,
+                                      const SchemaTables& Schema,
+                                      const SchemaDatatype& DT,
+                                      SmallVecImpl<char>& Out) {
+  using enum SchemaValueKind;
+  PrimitiveReader<StrmT> R {Strm};
+  raw_svector_ostream OS(Out);
+
+  switch (DT.Kind) {
+  case String: {
+    // Only list items get here, their strings are still in the tables.
+    const EventUID Value = $unwrap(
+      this->decodeValue(Strm, Name, Schema.getCharSet(DT)));
+    OS << Idents.getValue(Value);
+    return ExiError::OK;
+  }
+  case Boolean: {
+    u64 Bits = 0;
+    exi_try(R.readNBit(Bits, std::max<unsigned>(DT.Bits, 1)));
+    if (DT.Bits == 2) {
+      // Patterns may restrict the lexical space, so "0" and "1" are kept.
+      static constexpr StringLiteral Values[] {"false", "0", "true", "1"};
+      OS << Values[Bits & 3];
+    } else
+      OS << (Bits ? "true" : "false");
+    return ExiError::OK;
+  }
+  case Decimal: {
+    bool Negative = false;
+    u64 Integral = 0, Fraction = 0;
+    exi_try(R.readBool(Negative));
+    exi_try(R.readUnsigned(Integral));
+    exi_try(R.readUnsigned(Fraction));
+    if (Negative)
+      OS << '-';
+    OS << Integral << '.';
+    AppendReversed(OS, Fraction);
+    return ExiError::OK;
+  }
+  case Float: {
+    i64 Mantissa = 0, Exponent = 0;
+    exi_try(R.readInteger(Mantissa));
+    exi_try(R.readInteger(Exponent));
+    if (Exponent == kSpecialExponent) {
+      if (Mantissa == 1)
+        OS << "INF";
+      else if (Mantissa == -1)
+        OS << "-INF";
+      else
+        OS << "NaN";
+    } else
+      OS << Mantissa << 'E' << Exponent;
+    return ExiError::OK;
+  }
+  case Integer: {
+    i64 Value = 0;
+    exi_try(R.readInteger(Value));
+    OS << Value;
+    return ExiError::OK;
+  }
+  case Unsigned: {
+    u64 Value = 0;
+    exi_try(R.readUnsigned(Value));
+    OS << Value;
+    return ExiError::OK;
+  }
+  case NBitUnsigned: {
+    u64 Value = 0;
+    exi_try(R.readNBit(Value, DT.Bits));
+    OS << (DT.Min + i64(Value));
+    return ExiError::OK;
+  }
+  case Binary:
+  case HexBinary: {
+    u64 Size = 0;
+    exi_try(R.readUnsigned(Size));
+    // The size comes from the input, so check it before allocating.
+    if EXI_UNLIKELY(Size > max_v<u64> / 8 || !Strm->canRead(Size * 8)) {
+      LOG_ERROR("Binary of {} bytes exceeds the stream.", Size);
+      return ErrorCode::kInvalidEXIInput;
+    }
+    if (ExiError E = this->reserveMemory(Size))
+      return E;
+    SmallVec<u8, 64> Bytes;
+    // Incremental input can't be checked, so only grow as bytes are read.
+    Bytes.reserve(std::min(Size, StrmT::kMaxStringReserve));
+    for (u64 Ix = 0; Ix != Size; ++Ix) {
+      u64 Raw = 0;
+      exi_try(R.readNBit(Raw, 8));
+      Bytes.push_back(u8(Raw));
+    }
+
+    if (DT.Kind == Binary)
+      AppendBase64(OS, Bytes);
+    else {
+      for (u8 Byte : Bytes)
+        OS << format("{:02X}", Byte);
+    }
+    return ExiError::OK;
+  }
+  case DateTime:
+  case Time:
+  case Date:
+  case GYearMonth:
+  case GYear:
+  case GMonthDay:
+  case GDay:
+  case GMonth:
+    return AppendDateTime(R, DT.Kind, OS);
+  case List: {
+    u64 Count = 0;
+    exi_try(R.readUnsigned(Count));
+    const SchemaDatatype& Item = Schema.Datatypes[DT.First];
+    for (u64 Ix = 0; Ix != Count; ++Ix) {
+      if (Ix != 0)
+        OS << ' ';
+      exi_try(this->appendTypedValue(Strm, Name, Schema, Item, Out));
+    }
+    return ExiError::OK;
+  }
+  case Enumeration: {
+    u64 Ix = 0;
+    exi_try(R.readNBit(Ix, Log2_32_Ceil(DT.Count)));
+    if EXI_UNLIKELY(Ix >= DT.Count) {
+      LOG_ERROR("Enumeration value {} out of range.", Ix);
+      return ErrorCode::kInvalidEXIInput;
+    }
+    OS << Schema.getStr(Schema.getEnumValues(DT)[Ix]);
+    return ExiError::OK;
+  }
+  }
+
+  exi_unreachable("invalid value kind");
+}
+
+#define INSTANTIATE_DECODERS(STRM)                                            \
+  template ExiResult<EventUID> ExiDecoder::decodeTypedValue(                  \
+    STRM*, SmallQName, const SchemaTables&, u32);                             \
+  template ExiError ExiDecoder::appendTypedValue(                             \
+    STRM*, SmallQName, const SchemaTables&, const SchemaDatatype&,            \
+    SmallVecImpl<char>&);
+
+INSTANTIATE_DECODERS(BitReader)
+INSTANTIATE_DECODERS(ByteReader)
+
+#undef INSTANTIATE_DECODERS
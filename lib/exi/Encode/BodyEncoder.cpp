@@ -0,0 +1,827 @@
+//===- exi/Encode/BodyEncoder.cpp -----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements encoding of the EXI body to a stream.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Encode/BodyEncoder.hpp>
+#include <core/Common/DenseMap.hpp>
+#include <core/Common/STLExtras.hpp>
+#include <core/Common/SmallStr.hpp>
+#include <core/Support/Allocator.hpp>
+#include <core/Support/Casting.hpp>
+#include <core/Support/Logging.hpp>
+#include <exi/Basic/ErrorCodes.hpp>
+#include <exi/Basic/Runes.hpp>
+#include <exi/Basic/XMLNames.hpp>
+#include <exi/Decode/Serializer.hpp>
+#include <exi/Stream/ChannelReader.hpp>
+#include <exi/Stream/ChannelWriter.hpp>
+#include <rapidxml.hpp>
+#include <cstring>
+
+#define DEBUG_TYPE "BodyEncoder"
+
+using namespace exi;
+using namespace exi::encode;
+
+/// The channels of a block, used for compression and pre-compression.
+/// Structure is encoded as usual, while values are buffered in channels
+/// until the block is closed.
+struct ExiEncoder::ChannelState {
+  struct Channel {
+    SmallQName Name;
+    SmallVec<StrRef, 0> Values;
+  };
+
+  /// The structure channel, which `Writer` writes to.
+  SmallVec<char, 0> Structure;
+  /// The value channels of the block, the first `NChannels` are active.
+  /// They are kept between blocks to reuse their storage.
+  SmallVec<Channel, 4> Channels;
+  u32 NChannels = 0;
+  /// Maps names to their channel in the current block.
+  DenseMap<SmallQName, u32> Lookup;
+  /// Copies of the values in the block, unless strings are stable.
+  BumpPtrAllocator Strings;
+  /// The number of values in the block.
+  u64 NValues = 0;
+  /// The maximum number of values in a block.
+  u64 BlockSize = 1'000'000;
+
+  /// The encoded value channels of the block.
+  SmallVec<char, 0> ValueData;
+  /// The stream used when writing to a buffer.
+  Box<raw_ostream> BufferOut;
+  /// Where streams are written.
+  Box<ChannelWriter> Out;
+  /// The first error from closing a block, which may happen mid-event.
+  ExiError Error = ExiError::OK;
+
+  /// Returns the channel for `Name`, creating it if needed.
+  Channel& getChannel(SmallQName Name) {
+    auto [It, DidInsert] = Lookup.try_emplace(Name, NChannels);
+    if (!DidInsert)
+      return Channels[It->second];
+    if (NChannels == Channels.size())
+      Channels.emplace_back();
+    Channel& New = Channels[NChannels++];
+    New.Name = Name;
+    New.Values.clear();
+    return New;
+  }
+
+  /// Returns the channels of the block.
+  ArrayRef<Channel> channels() const {
+    return ArrayRef(Channels).take_front(NChannels);
+  }
+
+  /// Removes the values of the block, keeping allocations.
+  void clear() {
+    Structure.clear();
+    NChannels = 0;
+    Lookup.clear();
+    Strings.Reset();
+    NValues = 0;
+  }
+};
+
+ExiEncoder::ExiEncoder(Option<raw_ostream&> OS) : OS(OS) {}
+
+ExiEncoder::ExiEncoder(MaybeBox<ExiOptions> Opts,
+                       Option<raw_ostream&> OS) : ExiEncoder(OS) {
+  Header.Opts = std::move(Opts);
+}
+
+ExiEncoder::~ExiEncoder() {
+  // Grammars are allocated with `BP`, so the schema must be destroyed first.
+  Fragment.reset();
+  CurrentSchema.reset();
+  os().flush();
+}
+
+raw_ostream& ExiEncoder::os() const {
+  return OS.value_or(errs());
+}
+
+void ExiEncoder::diagnose(ExiError E) const {
+  if (E == ExiError::OK || !OS)
+    return;
+  os() << E << '\n';
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Initialization
+
+ExiError ExiEncoder::setOptions(MaybeBox<ExiOptions> Opts) {
+  if (!Writer.empty()) {
+    LOG_ERROR("Options must be set before the writer.");
+    return ErrorCode::kInvalidConfig;
+  }
+
+  Header.Opts = std::move(Opts);
+  LOG_EXTRA("Options set manually.");
+  return ExiError::OK;
+}
+
+static ExiError CheckWriterOptions(const ExiHeader& Header) {
+  if (!Header.Opts) {
+    LOG_ERROR("Cannot deduce stream type without options.");
+    return ErrorCode::kInvalidConfig;
+  }
+  if (Header.Opts->Alignment == AlignKind::None) {
+    LOG_ERROR("Alignment has not been set.");
+    return ErrorCode::kInvalidConfig;
+  }
+  return ExiError::OK;
+}
+
+template <typename T>
+static void SetWriterImpl(const ExiHeader& Header,
+                          OrdWriter& Writer, T& Out) {
+  if (Header.Opts->Alignment == AlignKind::BitPacked)
+    Writer.emplace<BitWriter>(Out);
+  else
+    Writer.emplace<ByteWriter>(Out);
+}
+
+ExiError ExiEncoder::setWriter(SmallVecImpl<char>& Buffer) {
+  exi_try(CheckWriterOptions(Header));
+  if (Header.Opts->Alignment == AlignKind::PreCompression) {
+    auto BufferOut = std::make_unique<raw_svector_ostream>(Buffer);
+    exi_try(this->setChannelWriter(*BufferOut));
+    Channels->BufferOut = std::move(BufferOut);
+    return ExiError::OK;
+  }
+
+  SetWriterImpl(Header, Writer, Buffer);
+  Channels.reset();
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::setWriter(raw_ostream& Strm, u64 FlushThreshold) {
+  exi_try(CheckWriterOptions(Header));
+  if (Header.Opts->Alignment == AlignKind::PreCompression)
+    return this->setChannelWriter(Strm);
+
+  SetWriterImpl(Header, Writer, Strm);
+  Writer->setFlushThreshold(FlushThreshold);
+  Channels.reset();
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::setChannelWriter(raw_ostream& OS) {
+  if (!Channels)
+    Channels = std::make_unique<ChannelState>();
+  ChannelState& State = *Channels;
+
+  // Channels are byte-aligned, and the structure is buffered per block.
+  Writer.emplace<ByteWriter>(State.Structure);
+  State.clear();
+  State.BlockSize = std::max<u64>(Header.Opts->BlockSize, 1);
+  State.Error = ExiError::OK;
+
+  if (Header.Opts->Compression)
+    State.Out = std::make_unique<DeflateWriter>(OS);
+  else
+    State.Out = std::make_unique<BlockWriter>(OS);
+  State.BufferOut.reset();
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::setBackgroundFlush(u32 NBuffers) {
+  if (Writer.empty() || !Writer->setBackgroundFlush(NBuffers)) {
+    LOG_ERROR("Background flushing requires a stream writer.");
+    return ErrorCode::kInvalidConfig;
+  }
+#if !EXI_USE_THREADS
+  LOG_WARN("Threads are disabled (EXI_USE_THREADS), "
+           "flushing on the calling thread.");
+#endif
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::setParallelCompression(unsigned Threads) {
+  if (!Channels || !Header.Opts->Compression) {
+    LOG_ERROR("Parallel compression requires a compressed writer.");
+    return ErrorCode::kInvalidConfig;
+  }
+
+#if EXI_USE_THREADS
+  ChannelState& State = *Channels;
+  exi_try(State.Out->flush());
+  raw_ostream& OS = State.Out->os();
+  State.Out = std::make_unique<ParallelDeflateWriter>(OS, Threads);
+#else
+  // Streams stay compressed on the calling thread.
+  LOG_WARN("Threads are disabled (EXI_USE_THREADS), "
+           "compressing on the calling thread.");
+#endif
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::init() {
+  if (Flags.DidInit)
+    return ExiError::OK;
+
+  if (!Header.Opts || Writer.empty()) {
+    LOG_ERROR("Options or Writer are not initialized.");
+    return ErrorCode::kInvalidConfig;
+  }
+
+  auto& Opts = *Header.Opts;
+  if (const auto& ID = Opts.SchemaID.expect("schema is required"); !ID)
+    CurrentSchema = BuiltinSchema::New(Opts, Flags.Fragment);
+  else {
+    LOG_ERROR("Schemas are unsupported when encoding.");
+    return ErrorCode::kUnimplemented;
+  }
+
+  if (!CurrentSchema) {
+    LOG_ERROR("Schema could not be allocated.");
+    return ErrorCode::kInvalidMemoryAlloc;
+  }
+
+  if (hasDbgLogLevel(INFO))
+    CurrentSchema->dump();
+  Idents.setup(Opts);
+
+  Preserve = Opts.Preserve;
+  Flags.DidInit = true;
+
+  LOG_EXTRA("Initialized!");
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::flush() {
+  if (Writer.empty())
+    return ExiError::OK;
+  if (Channels) {
+    exi_try(Channels->Error);
+    return Channels->Out->flush();
+  }
+  Writer->flush();
+  return ExiError::OK;
+}
+
+void ExiEncoder::flushStructure() {
+  ChannelState& State = *Channels;
+  Writer->flushToWord();
+  State.Out->writeRaw(StrRef(State.Structure.data(), State.Structure.size()));
+  State.Structure.clear();
+}
+
+ExiError ExiEncoder::closeBlock() {
+  ChannelState& State = *Channels;
+  if EXI_UNLIKELY(State.Error)
+    return State.Error;
+
+  Writer->flushToWord();
+  ArrayRef<ChannelState::Channel> Chans = State.channels();
+  const bool IsGrouped = State.NValues <= ChannelReader::kMaxGroupedValues;
+  auto IsSmall = [] (const ChannelState::Channel& C) {
+    return C.Values.size() <= ChannelReader::kMaxGroupedValues;
+  };
+
+  // Values are encoded in the order their streams are written, which is the
+  // order the decoder adds them to its tables. Small channels are combined
+  // into a single stream when the block is large.
+  SmallVec<usize, 8> Ends;
+  State.ValueData.clear();
+  {
+    ByteWriter Strm(State.ValueData);
+    auto Encode = [&, this] (const ChannelState::Channel& C) {
+      for (StrRef Value : C.Values)
+        this->writeValue(&Strm, C.Name, Value);
+      Strm.flushToWord();
+    };
+
+    if (IsGrouped) {
+      for (const auto& C : Chans)
+        Encode(C);
+      Ends.push_back(State.ValueData.size());
+    } else {
+      if (exi::any_of(Chans, IsSmall)) {
+        for (const auto& C : Chans) {
+          if (IsSmall(C))
+            Encode(C);
+        }
+        Ends.push_back(State.ValueData.size());
+      }
+      for (const auto& C : Chans) {
+        if (IsSmall(C))
+          continue;
+        Encode(C);
+        Ends.push_back(State.ValueData.size());
+      }
+    }
+  }
+
+  const StrRef Structure(State.Structure.data(), State.Structure.size());
+  const StrRef Values(State.ValueData.data(), State.ValueData.size());
+  ExiError E = ExiError::OK;
+  if (IsGrouped)
+    E = State.Out->writeStream({Structure, Values});
+  else {
+    E = State.Out->writeStream({Structure});
+    usize Begin = 0;
+    for (usize End : Ends) {
+      if (E)
+        break;
+      E = State.Out->writeStream({Values.slice(Begin, End)});
+      Begin = End;
+    }
+  }
+
+  LOG_EXTRA("Closed block with {} values", State.NValues);
+  State.clear();
+  State.Error = E;
+  return E;
+}
+
+Box<ExiEncoder> ExiEncoder::newFragment() {
+  auto Frag = std::make_unique<ExiEncoder>(*Header.Opts, OS);
+  // The fragment writes to the same buffer, starting from the current bits.
+  if (isa<BitWriter>(Writer))
+    Frag->Writer.emplace<BitWriter>(Writer->getProxy());
+  else
+    Frag->Writer.emplace<ByteWriter>(Writer->getProxy());
+  Frag->Flags.DidHeader = true;
+  Frag->Flags.Fragment = true;
+  Frag->setStableStrings(Idents.hasStableStrings());
+  return Frag;
+}
+
+ExiError ExiEncoder::closeFragment() {
+  exi_invariant(Fragment && FragmentDepth == 0);
+  exi_try(Fragment->CurrentSchema->encodeTerm(Fragment.get(), EventTerm::ED));
+  // The fragment isn't padded, so take over its remaining bits.
+  Writer->setProxy(Fragment->Writer->takeProxy());
+  Fragment.reset();
+  return ExiError::OK;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Events
+
+ExiError ExiEncoder::encodeSD() {
+  exi_try(this->prepareForEncoding());
+  return CurrentSchema->encodeTerm(this, EventTerm::SD);
+}
+
+ExiError ExiEncoder::encodeED() {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment) {
+    LOG_ERROR("ED inside a self-contained element.");
+    return ErrorCode::kInconsistentProcState;
+  }
+  exi_try(CurrentSchema->encodeTerm(this, EventTerm::ED));
+  if (Channels) {
+    // ED always closes the final block, even if it has no values.
+    exi_try(this->closeBlock());
+  }
+  return this->flush();
+}
+
+ExiError ExiEncoder::encodeSE(const QName& Name) {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment) {
+    ++FragmentDepth;
+    return Fragment->encodeSE(Name);
+  }
+  return CurrentSchema->encodeSE(this, Name);
+}
+
+ExiError ExiEncoder::encodeEE() {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment) {
+    exi_try(Fragment->encodeEE());
+    if (--FragmentDepth != 0)
+      return ExiError::OK;
+    // The buffer is shared until the fragment is closed.
+    exi_try(this->closeFragment());
+    Writer->flushIfFull();
+    return ExiError::OK;
+  }
+  exi_try(CurrentSchema->encodeEE(this));
+  // Elements are a cheap boundary to hand completed bytes to the stream.
+  Writer->flushIfFull();
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::encodeSC(const QName& Name) {
+  exi_try(this->prepareForEncoding());
+  if (Fragment)
+    return Fragment->encodeSC(Name);
+  if EXI_UNLIKELY(Channels) {
+    LOG_ERROR("Self-contained elements can't be used with compression.");
+    return ErrorCode::kInvalidConfig;
+  }
+
+  exi_try(CurrentSchema->encodeSC(this));
+  // The fragment starts on a byte boundary, and has its own string tables
+  // and grammars. It repeats the SE of the element.
+  if (auto* Bits = dyn_cast<BitWriter>(&Writer))
+    Bits->align();
+  Fragment = this->newFragment();
+  FragmentDepth = 1;
+  exi_try(Fragment->encodeSD());
+  return Fragment->encodeSE(Name);
+}
+
+ExiError ExiEncoder::encodeAT(const QName& Name, StrRef Value) {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment)
+    return Fragment->encodeAT(Name, Value);
+  return CurrentSchema->encodeAT(this, Name, Value);
+}
+
+ExiError ExiEncoder::encodeNS(StrRef URI, StrRef Prefix, bool LocalElementNS) {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment)
+    return Fragment->encodeNS(URI, Prefix, LocalElementNS);
+  if (!Preserve.Prefixes)
+    return ExiError::OK;
+  return CurrentSchema->encodeNS(this, URI, Prefix, LocalElementNS);
+}
+
+ExiError ExiEncoder::encodeCH(StrRef Value) {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment)
+    return Fragment->encodeCH(Value);
+  return CurrentSchema->encodeCH(this, Value);
+}
+
+ExiError ExiEncoder::encodeCM(StrRef Comment) {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment)
+    return Fragment->encodeCM(Comment);
+  if (!Preserve.Comments)
+    return ExiError::OK;
+  exi_try(CurrentSchema->encodeTerm(this, EventTerm::CM));
+  Writer->encodeString(Comment);
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::encodePI(StrRef Target, StrRef Text) {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment)
+    return Fragment->encodePI(Target, Text);
+  if (!Preserve.PIs)
+    return ExiError::OK;
+  exi_try(CurrentSchema->encodeTerm(this, EventTerm::PI));
+  Writer->encodeString(Target);
+  Writer->encodeString(Text);
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::encodeDT(StrRef Name, StrRef PublicID,
+                              StrRef SystemID, StrRef Text) {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment)
+    return Fragment->encodeDT(Name, PublicID, SystemID, Text);
+  if (!Preserve.DTDs)
+    return ExiError::OK;
+  exi_try(CurrentSchema->encodeTerm(this, EventTerm::DT));
+  Writer->encodeString(Name);
+  Writer->encodeString(PublicID);
+  Writer->encodeString(SystemID);
+  Writer->encodeString(Text);
+  return ExiError::OK;
+}
+
+ExiError ExiEncoder::encodeER(StrRef Name) {
+  exi_try(this->prepareForEncoding());
+  if EXI_UNLIKELY(Fragment)
+    return Fragment->encodeER(Name);
+  if (!Preserve.DTDs)
+    return ExiError::OK;
+  exi_try(CurrentSchema->encodeTerm(this, EventTerm::ER));
+  Writer->encodeString(Name);
+  return ExiError::OK;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Values
+
+template <class StrmT>
+SmallQName ExiEncoder::encodeQName(StrmT* Strm, const QName& Name) {
+  const u32 NameHash = StringTable::Hash(Name.Name);
+  if (Option<SmallQName> ID
+   = Idents.findCachedQName(Name.URI, Name.Name, NameHash)) {
+    // Cached, so both the URI and LocalName are hits.
+    Strm->writeBits64(ID->URI + 1, Idents.getURILog());
+    Strm->writeUInt(0);
+    Strm->writeBits64(ID->LocalID, Idents.getLocalNameLog(ID->URI));
+    LOG_INFO(">> QName(Hit) @{}:{}: \"{}\"", ID->URI, ID->LocalID, Name.Name);
+    encodePfxQ(Strm, ID->URI, Name.Prefix);
+    return *ID;
+  }
+
+  const CompactID URI = encodeURI(Strm, Name.URI);
+  const CompactID LNI = encodeName(Strm, URI, Name.Name, NameHash);
+  encodePfxQ(Strm, URI, Name.Prefix);
+  const auto ID = SmallQName::NewQName(URI, LNI);
+  Idents.cacheQName(ID, Name.Name, NameHash);
+  return ID;
+}
+
+template <class StrmT>
+void ExiEncoder::encodeNS(StrmT* Strm, StrRef URI, StrRef Pfx, bool IsLocal) {
+  const CompactID URIID = encodeURI(Strm, URI);
+  encodePfx(Strm, URIID, Pfx);
+  Strm->writeBit(IsLocal);
+}
+
+template <class StrmT>
+CompactID ExiEncoder::encodeURI(StrmT* Strm, StrRef URI) {
+  const u64 NBits = Idents.getURILog();
+  const u32 URIHash = StringTable::Hash(URI);
+  if (Option<CompactID> ID = Idents.findURI(URI, URIHash)) {
+    // Cache hit
+    LOG_INFO(">> URI(Hit) @{}: \"{}\"", *ID, URI);
+    Strm->writeBits64(*ID + 1, NBits);
+    return *ID;
+  }
+
+  // Cache miss
+  Strm->writeBits64(0, NBits);
+  Strm->encodeString(URI);
+  const CompactID ID = Idents.addURI(URI, URIHash);
+  LOG_INFO(">> URI(Miss) @{}: \"{}\"", ID, URI);
+  return ID;
+}
+
+template <class StrmT>
+CompactID ExiEncoder::encodeName(StrmT* Strm, CompactID URI,
+                                 StrRef Name, u32 NameHash) {
+  if (Option<CompactID> ID = Idents.findLocalName(URI, Name, NameHash)) {
+    // Cache hit
+    Strm->writeUInt(0);
+    Strm->writeBits64(*ID, Idents.getLocalNameLog(URI));
+    LOG_INFO(">> LN @{}: \"{}\"", *ID, Name);
+    return *ID;
+  }
+
+  // Cache miss
+  Strm->writeUInt(exi::countRunes(Name) + 1);
+  Strm->writeString(Name);
+  const CompactID ID = Idents.addLocalName(URI, Name, NameHash);
+  LOG_INFO(">> LN @{}: \"{}\"", ID, Name);
+  return ID;
+}
+
+template <class StrmT>
+void ExiEncoder::encodePfxQ(StrmT* Strm, CompactID URI, StrRef Pfx) {
+  if (!Preserve.Prefixes)
+    return;
+  if (!Idents.hasPrefix(URI))
+    return;
+
+  // Undeclared prefixes fall back to the first in the partition.
+  const CompactID PfxID = Idents.findPrefix(URI, Pfx).value_or(0);
+  if (const u64 NBits = Idents.getPrefixLogQ(URI))
+    Strm->writeBits64(PfxID, NBits);
+  LOG_INFO(">> PXQ @{}: \"{}\"", PfxID, Pfx);
+}
+
+template <class StrmT>
+void ExiEncoder::encodePfx(StrmT* Strm, CompactID URI, StrRef Pfx) {
+  exi_invariant(Preserve.Prefixes, "NS event occurred without prefixes.");
+  const u64 NBits = Idents.getPrefixLog(URI);
+  if (Option<CompactID> ID = Idents.findPrefix(URI, Pfx)) {
+    // Cache hit
+    Strm->writeBits64(*ID + 1, NBits);
+    LOG_INFO(">> PXNS @{}: \"{}\"", *ID, Pfx);
+    return;
+  }
+
+  // Cache miss
+  Strm->writeBits64(0, NBits);
+  Strm->encodeString(Pfx);
+  const CompactID ID = Idents.addPrefix(URI, Pfx);
+  LOG_INFO(">> PXNS @{}: \"{}\"", ID, Pfx);
+}
+
+template <class StrmT>
+void ExiEncoder::encodeValue(StrmT* Strm, SmallQName Name, StrRef Value) {
+  if EXI_UNLIKELY(Channels)
+    return this->deferValue(Name, Value);
+  this->writeValue(Strm, Name, Value);
+}
+
+void ExiEncoder::deferValue(SmallQName Name, StrRef Value) {
+  ChannelState& State = *Channels;
+  if (!Idents.hasStableStrings() && !Value.empty()) {
+    // The caller's string may not live until the block is closed.
+    char* Data = State.Strings.Allocate<char>(Value.size());
+    std::memcpy(Data, Value.data(), Value.size());
+    Value = StrRef(Data, Value.size());
+  }
+
+  State.getChannel(Name).Values.push_back(Value);
+  if (++State.NValues >= State.BlockSize) {
+    // Errors are reported on ED or `flush`.
+    (void) this->closeBlock();
+  }
+}
+
+template <class StrmT>
+void ExiEncoder::writeValue(StrmT* Strm, SmallQName Name, StrRef Value) {
+  exi_invariant(Name.isQName());
+  // Misses are added by the lookup, so each value takes a single probe.
+  if (const ValueInfo* Info = Idents.findOrAddValue(Name, Value)) {
+    if (Info->Name == Name) {
+      // LocalValue hit
+      Strm->writeUInt(0);
+      Strm->writeBits64(Info->LocalID, Idents.getLocalValueLog(Name));
+      LOG_INFO(">> LV @{}: \"{}\"", Info->LocalID, Value);
+    } else {
+      // GlobalValue hit
+      Strm->writeUInt(1);
+      Strm->writeBits64(Info->GlobalID, Idents.getGlobalValueLog());
+      LOG_INFO(">> GV @{}: \"{}\"", Info->GlobalID, Value);
+    }
+    return;
+  }
+
+  // Cache miss
+  Strm->writeUInt(exi::countRunes(Value) + 2);
+  Strm->writeString(Value);
+  LOG_INFO(">> V: \"{}\"", Value);
+}
+
+#define INSTANTIATE_ENCODERS(STRM)                                            \
+  template SmallQName ExiEncoder::encodeQName(STRM*, const QName&);          \
+  template void ExiEncoder::encodeNS(STRM*, StrRef, StrRef, bool);            \
+  template CompactID ExiEncoder::encodeURI(STRM*, StrRef);                    \
+  template CompactID ExiEncoder::encodeName(STRM*, CompactID, StrRef, u32);   \
+  template void ExiEncoder::encodePfxQ(STRM*, CompactID, StrRef);             \
+  template void ExiEncoder::encodePfx(STRM*, CompactID, StrRef);              \
+  template void ExiEncoder::encodeValue(STRM*, SmallQName, StrRef);           \
+  template void ExiEncoder::writeValue(STRM*, SmallQName, StrRef);
+
+INSTANTIATE_ENCODERS(BitWriter)
+INSTANTIATE_ENCODERS(ByteWriter)
+
+#undef INSTANTIATE_ENCODERS
+
+//////////////////////////////////////////////////////////////////////////
+// Documents
+
+namespace {
+
+/// Walks an `XMLDocument`, resolving namespaces and translating entities.
+class DocumentEncoder {
+  ExiEncoder& E;
+  /// The in-scope prefix bindings.
+  XMLNamespaceScope Scope;
+  /// Storage for translated strings.
+  SmallStr<128> Buffer;
+  /// Storage for translated namespace URIs, which must outlive their tag.
+  BumpPtrAllocator URIs;
+
+public:
+  DocumentEncoder(ExiEncoder& E) : E(E) {}
+  ExiError encode(const XMLDocument& Doc);
+
+private:
+  ExiError encodeNode(const XMLNode* Node);
+  ExiError encodeStart(const XMLNode* Node);
+  ExiError encodeEnd();
+
+  /// Translates the entities in `Str`, the result is valid until the next
+  /// call.
+  StrRef translate(StrRef Str) {
+    return exi::translateXMLEntities(Str, Buffer);
+  }
+
+  /// Translates the entities in `URI`, copying the result if needed.
+  StrRef translateURI(StrRef URI) {
+    const StrRef Out = this->translate(URI);
+    if EXI_LIKELY(Out.data() == URI.data())
+      return URI;
+    char* Data = URIs.Allocate<char>(Out.size());
+    std::memcpy(Data, Out.data(), Out.size());
+    return StrRef(Data, Out.size());
+  }
+};
+
+} // namespace `anonymous`
+
+ExiError DocumentEncoder::encode(const XMLDocument& Doc) {
+  exi_try(E.encodeSD());
+
+  const XMLNode* Node = Doc.first_node();
+  while (Node) {
+    exi_try(this->encodeNode(Node));
+    if (Node->type() == NodeKind::node_element && Node->first_node()) {
+      // Descend into the element.
+      Node = Node->first_node();
+      continue;
+    }
+
+    if (Node->type() == NodeKind::node_element)
+      exi_try(this->encodeEnd());
+    // Ascend until there is a sibling, closing elements along the way.
+    while (!Node->next_sibling()) {
+      Node = Node->parent();
+      if (!Node || Node->type() == NodeKind::node_document)
+        return E.encodeED();
+      exi_try(this->encodeEnd());
+    }
+    Node = Node->next_sibling();
+  }
+
+  return E.encodeED();
+}
+
+ExiError DocumentEncoder::encodeNode(const XMLNode* Node) {
+  switch (Node->type()) {
+  case NodeKind::node_element:
+    return this->encodeStart(Node);
+  case NodeKind::node_data: {
+    const StrRef Value = Node->value();
+    // Whitespace only data is dropped.
+    if (exi::isXMLWhitespace(Value))
+      return ExiError::OK;
+    return E.encodeCH(this->translate(Value));
+  }
+  case NodeKind::node_cdata:
+    return E.encodeCH(Node->value());
+  case NodeKind::node_comment:
+    return E.encodeCM(Node->value());
+  case NodeKind::node_pi:
+    return E.encodePI(Node->name(), Node->value());
+  case NodeKind::node_doctype: {
+    const XMLDoctype DT = exi::splitXMLDoctype(Node->value());
+    return E.encodeDT(DT.Name, DT.PublicID, DT.SystemID, DT.Text);
+  }
+  default:
+    // Declarations aren't part of the infoset.
+    return ExiError::OK;
+  }
+}
+
+ExiError DocumentEncoder::encodeStart(const XMLNode* Node) {
+  Scope.push();
+  for (const XMLAttribute* Attr = Node->first_attribute();
+       Attr; Attr = Attr->next_attribute()) {
+    if (Option<StrRef> Pfx = exi::getXMLNSPrefix(Attr->name()))
+      Scope.bind(*Pfx, this->translateURI(Attr->value()));
+  }
+
+  QName Name;
+  exi_try(Scope.resolve(Name, Node->name(), /*IsAttr=*/false));
+  exi_try(E.encodeSE(Name));
+
+  // Namespace declarations are always encoded before attributes.
+  bool FoundLocal = false;
+  for (auto [Pfx, URI] : Scope.declared()) {
+    const bool IsLocal = !FoundLocal
+      && (Pfx == Name.Prefix) && (URI == Name.URI);
+    FoundLocal |= IsLocal;
+    exi_try(E.encodeNS(URI, Pfx, IsLocal));
+  }
+
+  for (const XMLAttribute* Attr = Node->first_attribute();
+       Attr; Attr = Attr->next_attribute()) {
+    const StrRef Raw = Attr->name();
+    if (exi::getXMLNSPrefix(Raw))
+      continue;
+    QName AttrName;
+    exi_try(Scope.resolve(AttrName, Raw, /*IsAttr=*/true));
+    exi_try(E.encodeAT(AttrName, this->translate(Attr->value())));
+  }
+
+  return ExiError::OK;
+}
+
+ExiError DocumentEncoder::encodeEnd() {
+  exi_invariant(Scope.depth() > 0);
+  Scope.pop();
+  return E.encodeEE();
+}
+
+ExiError ExiEncoder::encodeBody(const XMLDocument& Doc) {
+  exi_try(this->prepareForEncoding());
+  DocumentEncoder Encoder(*this);
+  return Encoder.encode(Doc);
+}
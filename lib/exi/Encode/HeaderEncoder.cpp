@@ -27,7 +27,7 @@
 #include <core/Support/Logging.hpp>
 #include <exi/Basic/ExiHeader.hpp>
 #include <exi/Basic/NBitInt.hpp>
-//#include <exi/Decode/BodyEncoder.hpp>
+#include <exi/Encode/BodyEncoder.hpp>
 
 #define DEBUG_TYPE "HeaderEncoder"
 
@@ -169,10 +169,8 @@ static ExiError EncodeVersion(const ExiHeader& Header, BitWriter* Strm) {
   // This assume has been tested on GCC and Clang.
   // It WILL remove/unroll the loop, as seen here https://godbolt.org/z/h6hfcPPqh.
   exi_assume(Version < kCurrentExiVersion);
-  for (; Version >= VersionChunk; Version -= VersionChunk) {
+  for (; Version >= VersionChunk; Version -= VersionChunk)
     Strm->writeBits<4>(VersionChunk);
-    Version -= VersionChunk;
-  }
 
   Strm->writeBits<4>(Version);
   return ExiError::OK;
@@ -226,6 +224,31 @@ ExiError exi::encodeHeader(const ExiHeader& Header, OrdWriter& Strm) {
   BitWriter Bits(Bytes.getProxy());
 
   ExiError Out = encodeHeaderImpl(Header, Bits);
+  // The header is aligned, so this only writes whole bytes. Otherwise the
+  // store would be written again when `Bits` is destroyed.
+  Bits.flushToWord();
   Bytes.setProxy(Bits.getProxy());
   return Out;
 }
+
+ExiError ExiEncoder::encodeHeader(bool HasCookie) {
+  if (Flags.DidHeader) {
+    LOG_ERROR("Header has already been written.");
+    return ErrorCode::kInvalidConfig;
+  }
+
+  if (Writer.empty()) {
+    LOG_ERROR("Writer must be set before the header.");
+    return ErrorCode::kInvalidConfig;
+  }
+
+  Header.HasCookie = HasCookie;
+  Header.HasOptions = false;
+  exi_try(exi::encodeHeader(Header, Writer));
+  if (Channels)
+    // The header is never compressed.
+    this->flushStructure();
+
+  Flags.DidHeader = true;
+  return this->prepareForEncoding();
+}
@@ -0,0 +1,102 @@
+//===- exi/Encode/StreamEncoder.cpp ---------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements an encoder front end which accepts events as they
+/// occur, without building a document.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Encode/StreamEncoder.hpp>
+#include <core/Support/Logging.hpp>
+
+#define DEBUG_TYPE "StreamEncoder"
+
+using namespace exi;
+
+ExiError StreamEncoder::SD() {
+  if (!Encoder.flags().DidHeader)
+    exi_try(Encoder.encodeHeader(HasCookie));
+  Depth = 0;
+  return Encoder.encodeSD();
+}
+
+ExiError StreamEncoder::ED() {
+  if EXI_UNLIKELY(Depth != 0) {
+    LOG_ERROR("{} element(s) still open at ED.", Depth);
+    return ErrorCode::kInvalidEXIInput;
+  }
+
+  exi_try(Encoder.encodeED());
+  return ExiError::DONE;
+}
+
+ExiError StreamEncoder::SE(QName Name) {
+  exi_try(Encoder.encodeSE(Name));
+  LastSE = Name;
+  ++Depth;
+  return ExiError::OK;
+}
+
+ExiError StreamEncoder::EE(QName Name) {
+  if EXI_UNLIKELY(Depth == 0) {
+    LOG_ERROR("EE without a matching SE.");
+    return ErrorCode::kInvalidEXIInput;
+  }
+
+  exi_try(Encoder.encodeEE());
+  --Depth;
+  return ExiError::OK;
+}
+
+ExiError StreamEncoder::SC() {
+  if EXI_UNLIKELY(Depth == 0) {
+    LOG_ERROR("SC without a matching SE.");
+    return ErrorCode::kInvalidEXIInput;
+  }
+  return Encoder.encodeSC(LastSE);
+}
+
+ExiError StreamEncoder::AT(QName Name, StrRef Value) {
+  return Encoder.encodeAT(Name, Value);
+}
+
+ExiError StreamEncoder::NS(StrRef URI, StrRef Prefix, bool LocalElementNS) {
+  return Encoder.encodeNS(URI, Prefix, LocalElementNS);
+}
+
+ExiError StreamEncoder::CH(StrRef Value) {
+  return Encoder.encodeCH(Value);
+}
+
+ExiError StreamEncoder::CM(StrRef Comment) {
+  return Encoder.encodeCM(Comment);
+}
+
+ExiError StreamEncoder::PI(StrRef Target, StrRef Text) {
+  return Encoder.encodePI(Target, Text);
+}
+
+ExiError StreamEncoder::DT(StrRef Name, StrRef PublicID,
+                           StrRef SystemID, StrRef Text) {
+  return Encoder.encodeDT(Name, PublicID, SystemID, Text);
+}
+
+ExiError StreamEncoder::ER(StrRef Name) {
+  return Encoder.encodeER(Name);
+}
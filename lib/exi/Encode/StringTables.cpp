@@ -26,6 +26,7 @@
 #include <core/Support/ErrorHandle.hpp>
 #include <core/Support/Logging.hpp>
 #include <exi/Basic/ExiOptions.hpp>
+#include <exi/Basic/Runes.hpp>
 #include <algorithm>
 
 #define DEBUG_TYPE "StringTables"
@@ -67,18 +68,232 @@ static const Option<String&> PullSchemaID(const Option<MaybeBox<String>>& ID) {
 
 namespace exi::encode {
 
-StringTable::StringTable()
-    : NameCache(Alloc), URIMap(4, Alloc), PrefixMap(4, Alloc) {
-  //GValueMap.reserve(kDefaultReserveSize);
-}
+StringTable::StringTable() :
+ URIMap(kSchemaElts, Alloc), GValueMap(kDefaultReserveSize) {}
 
 void StringTable::setup(const ExiOptions& Opts) {
   if (DidSetup)
     return;
   DidSetup = true;
 
-  // TODO: Implement encoder setup...
-  exi_unreachable("implement setup");
+  Option<const String&> ID = PullSchemaID(Opts.SchemaID);
+  const bool UsesSchema = ID.has_value();
+
+  /// Populates the URI, Prefix, and LocalName partitions.
+  createInitialEntries(UsesSchema);
+
+  if (Bounded I = Opts.ValuePartitionCapacity; I.bounded()) {
+    WrappingValues = true;
+    ValueCapacity = *I;
+  }
+  if (Bounded I = Opts.ValueMaxLength; I.bounded())
+    ValueMaxLength = *I;
+
+  if (Opts.DatatypeRepresentationMap) {
+    // TODO: DatatypeRepresentationMap?
+    exi_unreachable("datatype mapping is unsupported.");
+  }
+}
+
+CompactID StringTable::addURI(StrRef URI, u32 URIHash, Option<StrRef> Pfx) {
+  const CompactID ID = *URICount++;
+  auto [It, DidInsert] = URIMap.try_emplace_with_hash(URI, URIHash, ID);
+  exi_invariant(DidInsert, "URI already exists!");
+
+  URIInfo* Info = new (URIAllocator.Allocate()) URIInfo(It->getKey(), Alloc);
+  URIs.push_back(Info);
+  if (Pfx) {
+    this->addPrefix(ID, *Pfx);
+    LOG_EXTRA("Created <xmlns:{}=\"{}\">", *Pfx, Info->Name);
+  }
+
+  return ID;
+}
+
+CompactID StringTable::addPrefix(CompactID URI, StrRef Pfx) {
+  auto& Prefixes = getInfo(URI).Prefixes;
+  const CompactID ID = Prefixes.size();
+  // Prefixes are rare, so they can live in the shared allocator.
+  Prefixes.push_back(Pfx.copy(Alloc));
+  return ID;
+}
+
+CompactID StringTable::addLocalName(CompactID URI, StrRef Name,
+                                     u32 NameHash) {
+  URIInfo& Info = getInfo(URI);
+  const CompactID ID = Info.LocalNames.size();
+  auto [It, DidInsert]
+    = Info.LocalNames.try_emplace_with_hash(Name, NameHash, ID);
+  exi_invariant(DidInsert, "LocalName already exists!");
+  Info.LocalValues.push_back(0);
+  return ID;
+}
+
+void StringTable::addValue(SmallQName Name, StrRef Value) {
+  exi_invariant(Name.isQName());
+  // Empty values are never added to the tables.
+  if EXI_UNLIKELY(Value.empty())
+    return;
+
+  if EXI_UNLIKELY(hasBoundedValues()) {
+    if (!isValueAdded(Value))
+      return;
+    if (WrappingValues) {
+      const u32 ValueHash = Hash(Value);
+      if (!findWrappingValue(Value, ValueHash))
+        this->addWrappingValue(Name, Value, ValueHash);
+      return;
+    }
+  }
+
+  URIInfo& Info = getInfo(Name.URI);
+  exi_invariant(Name.LocalID < Info.LocalValues.size());
+
+  const CompactID GID = *GValueCount;
+  auto [It, DidInsert] = GValueMap.try_emplace(Value);
+  if EXI_UNLIKELY(!DidInsert) {
+    // This can only happen when the value was produced as a miss, which
+    // means the caller did not check the table first.
+    LOG_WARN("Value '{}' already exists.", Value);
+    return;
+  }
+
+  ++GValueCount;
+  const CompactID LnID = Info.LocalValues[Name.LocalID]++;
+  It->second = ValueInfo {
+    .GlobalID = GID, .LocalID = LnID, .Name = Name
+  };
+}
+
+const ValueInfo* StringTable::findOrAddValue(SmallQName Name, StrRef Value) {
+  exi_invariant(Name.isQName());
+  // Empty values are never added to the tables.
+  if EXI_UNLIKELY(Value.empty())
+    return nullptr;
+
+  if EXI_UNLIKELY(hasBoundedValues()) {
+    // Values which are too long are never in the tables.
+    if (!isValueAdded(Value))
+      return nullptr;
+    if (WrappingValues) {
+      const u32 ValueHash = Hash(Value);
+      if (const ValueInfo* Info = findWrappingValue(Value, ValueHash))
+        return Info;
+      this->addWrappingValue(Name, Value, ValueHash);
+      return nullptr;
+    }
+  }
+
+  if (StableStrings) {
+    auto [It, DidInsert] = ValueAddrs.try_emplace(Value.data());
+    if (!DidInsert)
+      return It->second;
+    auto [Info, DidAdd] = probeValue(Name, Value);
+    It->second = Info;
+    return DidAdd ? nullptr : Info;
+  }
+
+  auto [Info, DidAdd] = probeValue(Name, Value);
+  return DidAdd ? nullptr : Info;
+}
+
+std::pair<const ValueInfo*, bool>
+ StringTable::probeValue(SmallQName Name, StrRef Value) {
+  // Hits are the common case, so the insertion probe doubles as the lookup.
+  auto [It, DidInsert] = GValueMap.try_emplace(Value);
+  if (!DidInsert)
+    return {&It->second, false};
+
+  URIInfo& Info = getInfo(Name.URI);
+  exi_invariant(Name.LocalID < Info.LocalValues.size());
+
+  const CompactID GID = *GValueCount++;
+  const CompactID LnID = Info.LocalValues[Name.LocalID]++;
+  It->second = ValueInfo {
+    .GlobalID = GID, .LocalID = LnID, .Name = Name
+  };
+  return {&It->second, true};
+}
+
+bool StringTable::isValueAdded(StrRef Value) const {
+  if (ValueCapacity == 0)
+    return false;
+  // Lengths are in characters, which are never more than the bytes.
+  if EXI_LIKELY(Value.size() <= ValueMaxLength)
+    return true;
+  return exi::countRunes(Value) <= ValueMaxLength;
+}
+
+void StringTable::addWrappingValue(SmallQName Name, StrRef Value,
+                                   u32 ValueHash) {
+  exi_invariant(WrappingValues && ValueCapacity != 0);
+  URIInfo& Info = getInfo(Name.URI);
+  exi_invariant(Name.LocalID < Info.LocalValues.size());
+
+  const CompactID GID = GValueNext;
+  if (++GValueNext == ValueCapacity)
+    GValueNext = 0;
+
+  if (GID < *GValueCount) {
+    // The partition is full, so the previous value is removed. LocalIDs
+    // are never reused, so only the global entry must be dropped.
+    ValueSlot& Old = GValueSlots[GID];
+    const StrRef OldValue(Old.Data.data(), Old.Data.size());
+    GValueLookup.erase(CachedHashStrRef(OldValue, Hash(OldValue)));
+  } else {
+    exi_invariant(GID == *GValueCount);
+    ++GValueCount;
+    if (GID == GValueSlots.size())
+      GValueSlots.emplace_back();
+  }
+
+  // The storage of the slot is reused, so it stops growing once it has
+  // held the longest value.
+  ValueSlot& Slot = GValueSlots[GID];
+  Slot.Data.assign(Value.begin(), Value.end());
+  Slot.Info = ValueInfo {
+    .GlobalID = GID,
+    .LocalID = Info.LocalValues[Name.LocalID]++,
+    .Name = Name
+  };
+
+  const StrRef Stored(Slot.Data.data(), Slot.Data.size());
+  GValueLookup.try_emplace(CachedHashStrRef(Stored, ValueHash), GID);
+}
+
+void StringTable::cacheQName(SmallQName ID, StrRef Name, u32 NameHash) {
+  exi_invariant(ID.isQName());
+  const URIInfo& Info = getInfo(ID.URI);
+  // Use the strings owned by the tables, the inputs may be transient.
+  auto It = Info.LocalNames.find(Name, NameHash);
+  exi_invariant(It != Info.LocalNames.end(), "LocalName does not exist!");
+  QNameCache[NameHash % kQNameCacheSize] = QNameCacheEntry {
+    .URI = Info.Name, .Name = It->getKey(), .ID = ID
+  };
+}
+
+void StringTable::createInitialEntries(bool UsesSchema) {
+  // D.1 & D.2 - Initial Entries in Uri & Prefix Partition
+  auto Empty = addURI(""_str, ""_str);
+  auto Xml = addURI(XML_URI, "xml"_str);
+  auto Xsi = addURI(XSI_URI, "xsi"_str);
+  (void) Empty;
+
+  // D.3 - Initial Entries in LocalName Partitions
+  appendLocalNames(Xml, XML_InitialValues);
+  appendLocalNames(Xsi, XSI_InitialValues);
+
+  if (UsesSchema) {
+    // TODO: When a schema is provided, prepopulate with the LocalName of each
+    // attribute, element and type explicitly declared in the schema.
+    auto Xsd = addURI(XSD_URI);
+    appendLocalNames(Xsd, XSD_InitialValues);
+  }
+}
+
+void StringTable::appendLocalNames(CompactID ID, ArrayRef<StrRef> LocalNames) {
+  for (StrRef Local : LocalNames)
+    this->addLocalName(ID, Local);
 }
 
 } // namespace exi::encode
@@ -0,0 +1,103 @@
+//===- exi/Encode/Transcoder.cpp ------------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements a transcoder, which re-encodes EXI with new options.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Encode/Transcoder.hpp>
+#include <core/Support/Logging.hpp>
+#include <exi/Decode/BodyDecoderImpl.hpp>
+#include <exi/Encode/BodyEncoder.hpp>
+#include <exi/Encode/StreamEncoder.hpp>
+
+#define DEBUG_TYPE "Transcoder"
+
+using namespace exi;
+
+namespace {
+/// Forwards decoded events to a `StreamEncoder`. This is dispatched
+/// statically, so the decoder calls the encoder directly.
+struct TranscodeSink {
+  StreamEncoder& S;
+
+  ExiError SD() { return S.SD(); }
+  ExiError ED() { return S.ED(); }
+  ExiError SE(QName Name) { return S.SE(Name); }
+  ExiError EE(QName Name) { return S.EE(Name); }
+  /// The events of SC fragments are forwarded by the decoder, so they are
+  /// encoded as part of the enclosing element.
+  ExiError SC() { return ExiError::OK; }
+  ExiError AT(QName Name, StrRef Value) { return S.AT(Name, Value); }
+  ExiError NS(StrRef URI, StrRef Prefix, bool LocalElementNS) {
+    return S.NS(URI, Prefix, LocalElementNS);
+  }
+  ExiError CH(StrRef Value) { return S.CH(Value); }
+  ExiError CM(StrRef Comment) { return S.CM(Comment); }
+  ExiError PI(StrRef Target, StrRef Text) { return S.PI(Target, Text); }
+  ExiError DT(StrRef Name, StrRef PublicID, StrRef SystemID, StrRef Text) {
+    return S.DT(Name, PublicID, SystemID, Text);
+  }
+  ExiError ER(StrRef Name) { return S.ER(Name); }
+
+  /// The encoder keys its tables by address, so every string must stay alive
+  /// until the stream ends. This also keeps the tables of SC fragments.
+  bool needsPersistence() const { return true; }
+};
+} // namespace `anonymous`
+
+ExiTranscoder::ExiTranscoder(MaybeBox<ExiOptions> InOpts,
+                             Option<raw_ostream&> OS) :
+ Decoder(std::move(InOpts), OS) {
+  // Borrowed strings point into the input, which outlives the stream.
+  Decoder.setBorrowInput();
+}
+
+ExiError ExiTranscoder::transcode(MemoryBufferRef In,
+                                  MaybeBox<ExiOptions> OutOpts,
+                                  SmallVecImpl<char>& Out, bool HasCookie) {
+  ExiEncoder Encoder(std::move(OutOpts), Decoder.os());
+  exi_try(Encoder.setWriter(Out));
+  return this->transcodeTo(In, Encoder, HasCookie);
+}
+
+ExiError ExiTranscoder::transcode(MemoryBufferRef In,
+                                  MaybeBox<ExiOptions> OutOpts,
+                                  raw_ostream& Out, bool HasCookie) {
+  ExiEncoder Encoder(std::move(OutOpts), Decoder.os());
+  exi_try(Encoder.setWriter(Out));
+  return this->transcodeTo(In, Encoder, HasCookie);
+}
+
+ExiError ExiTranscoder::transcodeTo(MemoryBufferRef In, ExiEncoder& Encoder,
+                                    bool HasCookie) {
+  if (NeedsReset)
+    Decoder.reset();
+  NeedsReset = true;
+
+  LOG_INFO("Transcoding: \"{}\"", In.getBufferIdentifier());
+  exi_try(Decoder.decodeHeader(In));
+
+  // Bounded tables reuse the storage of values, so equal addresses may
+  // hold different strings over time.
+  Encoder.setStableStrings(!Decoder.idents().hasBoundedValues());
+  StreamEncoder S(Encoder, HasCookie);
+  TranscodeSink Sink {S};
+  return Decoder.decodeBody(Sink);
+}
@@ -0,0 +1,241 @@
+//===- exi/Grammar/BuiltinInfo.hpp ----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the event code layout of the builtin grammars, which is
+/// shared by the encoder and decoder.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/Array.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Support/ErrorHandle.hpp>
+#include <core/Support/IntCast.hpp>
+#include <core/Support/Logging.hpp>
+#include <core/Support/MathExtras.hpp>
+#include <exi/Basic/EventCodes.hpp>
+#include <exi/Basic/ExiOptions.hpp>
+
+#define DEBUG_TYPE "BuiltinSchema"
+
+namespace exi {
+
+/// A small log2 table for deducing bit counts. The maximum value a builtin
+/// schema can have is 7, with `StartTagContent.{CM, PI}` with `SC` enabled.
+alignas(16) inline constexpr u8 SmallLog2[10] {0, 0, 1, 2, 2, 3, 3, 3, 3, 4};
+
+/// The number of builtin grammars with event codes, `DocContent` to
+/// `Fragment`. `Document` is always empty.
+inline constexpr usize kBuiltinGrammarCount = 5;
+
+/// Small EventCode for use in `BIInfo`.
+struct SEventCode {
+  Array<u8, 3> Data = {};  // [x.y.z]
+  Array<u8, 3> Bits = {};  // [[x].[y].[z]]
+  i8 Length = 0;           // Number of pieces.
+};
+
+struct BIInfo {
+  u8 Offset = 0;
+  SEventCode Code = {};
+};
+
+/// Builds the event codes for the builtin grammars. Terms are laid out in
+/// the order of their event codes, starting at `BIInfo::Offset`.
+class BuiltinBuilder {
+  using Builder = BuiltinBuilder;
+public:
+  SmallVec<EventTerm, 8> Terms;
+  SmallVec<BIInfo, kBuiltinGrammarCount> Info;
+
+private:
+  ExiOptions::PreserveOpts Preserve;
+  bool SelfContained;
+
+  class EventCodeRTTI {
+    SEventCode* C;
+  public:
+    EventCodeRTTI(SEventCode* EC) : C(EC) {}
+    ~EventCodeRTTI() { Builder::CalculateLog(C); }
+    SEventCode& operator*() { return *C; }
+    SEventCode* operator->() { return C; }
+  };
+
+  static void CalculateLog(SEventCode* EC) {
+    exi_invariant(EC);
+    exi_assert(EC->Length <= 3 && EC->Length >= 0);
+
+    auto& Length = EC->Length;
+    if (Length == 0)
+      return;
+    
+    auto& Data = EC->Data;
+    // If we have `[x.y.0]`, make it `[x.y].0`.
+    if (Length == 3 && !Data[2]) {
+      Length -= 1;
+    }
+
+    // If we have `[x.0.z]`, make it `[x.z].0`.
+    if (Length >= 2 && !Data[1]) {
+      Data[1] = Data[2];
+      Data[2] = 0;
+      Length -= 1;
+    }
+
+    // We can't remove the first level event code, as it's possible grammars
+    // will extend the base values. This would lead to inaccuracies.
+
+    // Calculate log for all elements.
+    for (int Ix = 0; Ix < 3; ++Ix)
+      EC->Bits[Ix] = SmallLog2[Data[Ix]];
+  }
+
+  EventCodeRTTI createBIInfo() {
+    const u8 Offset = IntCast<u8>(Terms.size());
+    Info.push_back({
+      .Offset = Offset,
+      .Code { .Length = 1 }
+    });
+    return &Info.back().Code;
+  }
+
+public:
+  BuiltinBuilder(const ExiOptions& Opts) :
+   Preserve(Opts.Preserve),
+   SelfContained(Opts.SelfContained) {
+  }
+
+  static void Inc(SEventCode& C, i8 I = 1) {
+    if EXI_LIKELY(C.Length)
+      C.Data[C.Length - 1] += I;
+    else
+      LOG_WARN("'Inc' ran on empty EventCode.");
+  }
+  static void Next(SEventCode& C) {
+    if EXI_LIKELY(C.Length < 3)
+      ++C.Length;
+    else
+      LOG_WARN("'Next' ran on full EventCode.");
+  }
+  static void IncNext(SEventCode& C, i8 I = 1) {
+    Builder::Inc(C, I);
+    Builder::Next(C);
+  }
+
+  void init() {
+    /*DocContent:*/ {
+      LOG_EXTRA("DocContent:");
+      auto C = createBIInfo();
+      Terms.push_back(EventTerm::SE);
+      Builder::Inc(*C);
+
+      if (Preserve.DTDs) {
+        Terms.push_back(EventTerm::DT);
+        Builder::IncNext(*C);
+        Builder::Inc(*C);
+      }
+
+      this->addCMPI(*C);
+    }
+
+    /*DocEnd:*/ {
+      LOG_EXTRA("DocEnd:");
+      auto C = createBIInfo();
+      Terms.push_back(EventTerm::ED);
+      Builder::Inc(*C);
+      this->addCMPI(*C);
+    }
+
+    /*StartTagContent:*/ {
+      LOG_EXTRA("StartTagContent:");
+      auto C = createBIInfo();
+      Terms.push_back(EventTerm::EE);
+      Terms.push_back(EventTerm::AT);
+      Builder::Next(*C);
+      Builder::Inc(*C, 2);
+
+      if (Preserve.Prefixes) {
+        Terms.push_back(EventTerm::NS);
+        Builder::Inc(*C);
+      }
+
+      if (SelfContained) {
+        Terms.push_back(EventTerm::SC);
+        Builder::Inc(*C);
+      }
+
+      this->addCCItems(*C);
+    }
+
+    /*ElementContent:*/ {
+      LOG_EXTRA("ElementContent:");
+      auto C = createBIInfo();
+      Terms.push_back(EventTerm::EE);
+      Builder::Inc(*C, 2);
+      this->addCCItems(*C);
+    }
+
+    /*Fragment:*/ {
+      LOG_EXTRA("Fragment:");
+      auto C = createBIInfo();
+      Terms.push_back(EventTerm::SE);
+      Terms.push_back(EventTerm::ED);
+      Builder::Inc(*C, 2);
+      this->addCMPI(*C);
+    }
+  }
+
+private:
+  /// Adds CM/PI to the end of a grammar, if possible.
+  void addCMPI(SEventCode& C) {
+    if (!Preserve.Comments && !Preserve.PIs)
+      return;
+    Builder::IncNext(C);
+    if (Preserve.Comments) {
+      Terms.push_back(EventTerm::CM);
+      Builder::Inc(C);
+    }
+    if (Preserve.PIs) {
+      Terms.push_back(EventTerm::PI);
+      Builder::Inc(C);
+    }
+  }
+
+  /// Adds ChildContentItems.
+  void addCCItems(SEventCode& C) {
+    exi_assert(C.Length <= 2);
+    C.Length = 2;
+
+    Terms.push_back(EventTerm::SE);
+    Terms.push_back(EventTerm::CH);
+    Builder::Inc(C, 2);
+
+    if (Preserve.DTDs) {
+      Terms.push_back(EventTerm::ER);
+      Builder::Inc(C);
+    }
+
+    this->addCMPI(C);
+  }
+};
+
+} // namespace exi
+
+#undef DEBUG_TYPE
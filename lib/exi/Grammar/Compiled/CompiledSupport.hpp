@@ -0,0 +1,28 @@
+//===- exi/Grammar/Compiled/CompiledSupport.hpp ---------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file provides what sources generated by exi-schemac need from the
+/// decoder. `exi_add_schema` only adds this directory to the include path,
+/// so generated code can't reach any other private headers.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include "../Decode/InformedSchema.hpp"
@@ -23,19 +23,20 @@
 
 // #include <exi/Grammar/Schema.hpp>
 #include <exi/Grammar/DecoderSchema.hpp>
-#include <core/Common/DenseMap.hpp>
 #include <core/Common/EnumArray.hpp>
 #include <core/Common/MMatch.hpp>
 #include <core/Common/SmallVec.hpp>
 #include <core/Common/STLExtras.hpp>
 #include <core/Support/Format.hpp>
 #include <core/Support/Logging.hpp>
+#include <core/Support/MathExtras.hpp>
 #include <core/Support/TrailingArray.hpp>
 #include <exi/Basic/ExiOptions.hpp>
 #include <exi/Grammar/Grammar.hpp>
 #include <exi/Stream/OrderedReader.hpp>
 #include <fmt/ranges.h>
 #include "SchemaGet.hpp"
+#include "../BuiltinInfo.hpp"
 
 using namespace exi;
 using namespace exi::decode;
@@ -98,6 +99,12 @@ using namespace exi::decode;
 ///   SC Fragment             0.3
 ///   ChildContentItems      (0.4)  
 /// 
+/// Fragment:
+///   SE (*) Fragment         0
+///   ED                      1
+///   CM Fragment             2.0
+///   PI Fragment             2.1
+/// 
 /// ElementContent:
 ///   EE                      0
 ///   ChildContentItems      (1.0)  
@@ -112,10 +119,6 @@ using namespace exi::decode;
 
 namespace INTERNAL_NS {
 
-/// A small log2 table for deducing bit counts. The maximum value a builtin
-/// schema can have is 7, with `StartTagContent.{CM, PI}` with `SC` enabled.
-alignas(16) static constexpr u8 SmallLog2[10] {0, 0, 1, 2, 2, 3, 3, 3, 3, 4};
-
 static constexpr StringLiteral BIGrammarNames[] {
   "Document",
   "DocContent",
@@ -125,16 +128,11 @@ static constexpr StringLiteral BIGrammarNames[] {
   "Fragment"
 };
 
-/// Small EventCode for use in `BIInfo`.
-struct SEventCode {
-  Array<u8, 3> Data = {};  // [x.y.z]
-  Array<u8, 3> Bits = {};  // [[x].[y].[z]]
-  i8 Length = 0;           // Number of pieces.
-};
-
-struct BIInfo {
-  u8 Offset = 0;
-  SEventCode Code = {};
+/// Offsets of the Fragment terms, which are not accessed with `decodeTerm`.
+enum FragmentTerms {
+  kFragmentSE   = 0,
+  kFragmentED   = 1,
+  kFragmentCMPI = 2,
 };
 
 // TODO: Update other functions to use template.
@@ -145,7 +143,7 @@ class INTERNAL_LINKAGE DynBuiltinSchema final
     : public BuiltinSchema,
       public TrailingArray<DynBuiltinSchema<StrmT>, EventTerm> {
   using enum BuiltinSchema::Grammar;
-  class Builder;
+  using Builder = BuiltinBuilder;
 
   using BaseT = TrailingArray<DynBuiltinSchema, EventTerm>;
   using InfoT = EnumeratedArray<BIInfo, Grammar, Last, DocContent>;
@@ -161,15 +159,92 @@ class INTERNAL_LINKAGE DynBuiltinSchema final
   /// The grammar stack.
   /// TODO: Profile...
   Vec<GrammarT> GStack;
-  /// The generated grammars.
-  DenseMap<SmallQName, BuiltinGrammar*> Grammars;
+  /// The generated grammars, indexed by URI and then LocalID. Both are
+  /// dense IDs from the string table, so lookups don't need to hash.
+  SmallVec<SmallVec<BuiltinGrammar*, 0>, 4> Grammars;
+  /// The generated grammars, in order of creation.
+  SmallVec<BuiltinGrammar*, 0> GrammarList;
+  /// The number of productions learned by the generated grammars.
+  usize NLearned = 0;
+  /// The SE(qname) productions learned by the Fragment grammar, the most
+  /// recent has event code 0.
+  SmallVec<SmallQName, 1> FragmentNames;
+  /// The grammar used after the root element, DocEnd or Fragment.
+  BuiltinSchema::Grammar RootEnd = DocEnd;
+
+  /// The state before the current event, see `checkpoint`.
+  struct {
+    BuiltinSchema::Grammar Current = Document;
+    /// An event only changes the top two entries of the stack, or pushes
+    /// or pops once.
+    usize Depth = 0;
+    GrammarT Top, Parent;
+    /// The productions of `Top`, which are only learned by one event.
+    usize NStartTag = 0, NElement = 0;
+    usize NGrammars = 0;
+    usize NLearned = 0;
+    usize NFragmentNames = 0;
+  } Saved;
 
   DynBuiltinSchema(const SmallVecImpl<EventTerm>& Terms) : 
    BaseT(Terms.size(), Terms.begin(), Terms.end()) {
   }
 
 public:
-  static Box<DynBuiltinSchema> New(const ExiOptions& Opts);
+  static Box<DynBuiltinSchema> New(const ExiOptions& Opts, bool IsFragment);
+  ~DynBuiltinSchema() override { this->destroyGrammars(); }
+
+  void reset(bool IsFragment) override {
+    this->destroyGrammars();
+    // Keep the capacity of each URI, names are usually similar.
+    for (auto& LNs : Grammars)
+      LNs.clear();
+    GrammarList.clear();
+    NLearned = 0;
+    GStack.clear();
+    FragmentNames.clear();
+    Event = EventUID::NewNull();
+    Current = Document;
+    RootEnd = IsFragment ? Fragment : DocEnd;
+  }
+
+  void checkpoint() override {
+    Saved.Current = Current;
+    Saved.Depth = GStack.size();
+    if (!GStack.empty()) {
+      Saved.Top = GStack.back();
+      Saved.NStartTag = Saved.Top->size(/*IsStart=*/true);
+      Saved.NElement = Saved.Top->size(/*IsStart=*/false);
+    }
+    if (GStack.size() > 1)
+      Saved.Parent = GStack.end()[-2];
+    Saved.NGrammars = GrammarList.size();
+    Saved.NLearned = NLearned;
+    Saved.NFragmentNames = FragmentNames.size();
+  }
+
+  bool rollback() override {
+    // Grammars created since are no longer reachable.
+    for (BuiltinGrammar* G : drop_begin(GrammarList, Saved.NGrammars)) {
+      const SmallQName Name = G->getName();
+      Grammars[Name.URI][Name.LocalID] = nullptr;
+      G->~BuiltinGrammar();
+    }
+    GrammarList.truncate(Saved.NGrammars);
+
+    GStack.resize(Saved.Depth);
+    if (Saved.Depth != 0) {
+      GStack.back() = Saved.Top;
+      Saved.Top->truncate(Saved.NStartTag, /*IsStart=*/true);
+      Saved.Top->truncate(Saved.NElement, /*IsStart=*/false);
+    }
+    if (Saved.Depth > 1)
+      GStack.end()[-2] = Saved.Parent;
+    Current = Saved.Current;
+    NLearned = Saved.NLearned;
+    FragmentNames.truncate(Saved.NFragmentNames);
+    return true;
+  }
 
   ////////////////////////////////////////////////////////////////////////
   // Decoding
@@ -178,6 +253,20 @@ public:
     tail_return this->getTermImpl(D);
   }
 
+  usize getMemoryUsage() const override {
+    // Grammars are allocated by the decoder, but their productions aren't.
+    // These are counted from the number learned, rather than walking every
+    // grammar.
+    usize Total = Grammars.capacity_in_bytes()
+      + GrammarList.capacity_in_bytes()
+      + (GStack.capacity() * sizeof(GrammarT))
+      + FragmentNames.capacity_in_bytes()
+      + (NLearned * sizeof(EventUID));
+    for (const auto& LNs : Grammars)
+      Total += LNs.capacity_in_bytes();
+    return Total;
+  }
+
 private:
   MatchT createDecodedTerm(unsigned At) {
     const unsigned Offset = Info[Current].Offset;
@@ -186,7 +275,16 @@ private:
     return MatchT(Term);
   }
 
-  GNU_ATTR(hot) MatchT decodeTerm(StrmT* Strm, int Start, unsigned At = 0) {
+  /// Diagnoses `E`, and leaves a null event.
+  GNU_ATTR(cold) MatchT failTerm(ExiDecoder* D, ExiError E) {
+    D->diagnose(E);
+    this->Event = EventUID::NewNull();
+    return MatchT(this->Event.getTerm());
+  }
+
+  /// Decodes the event code from the part at `Start`. If it can't be read,
+  /// or is out of range, the event will be null.
+  GNU_ATTR(hot) MatchT decodeTerm(ExiDecoder* D, int Start, unsigned At = 0) {
     SEventCode Code = Info[Current].Code;
     if (Code.Length && Start == 0) {
       /// The only level allowed to have zero elements is the first.
@@ -194,36 +292,37 @@ private:
         Start = 1;
     } else if (Start == 1 && Code.Data[0]) {
       const u64 CData = Code.Data[0] - 1;
+      if EXI_UNLIKELY(At > CData)
+        return this->failTerm(D, ErrorCode::kInvalidEXIInput);
       if (At != CData)
         return this->createDecodedTerm(At);
     }
 
+    auto* Strm = Get::Reader<StrmT>(D);
     for (int Ix = Start, E = Code.Length; Ix < E; ++Ix) {
       const u64 Bits = Code.Bits[Ix];
-      const u64 Data = *Strm->readBits64(Bits);
-      At += Data;
+      const auto Data = Strm->readBits64(Bits);
+      if EXI_UNLIKELY(Data.is_err())
+        return this->failTerm(D, Data.error());
+      At += *Data;
 
-      LOG_EXTRA("Code[{}]: @{}:{}", Ix, Bits, Data);
+      LOG_EXTRA("Code[{}]: @{}:{}", Ix, Bits, *Data);
       exi_invariant(Code.Data[Ix] != 0,
         "EventCode node not pruned!");
 
       const u64 CData = Code.Data[Ix] - 1;
-      exi_invariant(Data <= CData);
-      if (Data != CData)
+      if EXI_UNLIKELY(*Data > CData)
+        return this->failTerm(D, ErrorCode::kInvalidEXIInput);
+      if (*Data != CData)
         break;
     }
 
     return this->createDecodedTerm(At);
   }
 
-  MatchT decodeTerm(StrmT* Strm) {
-    return this->decodeTerm(Strm, /*Start=*/0, /*At=*/0);
-  }
-
   ALWAYS_INLINE MatchT decodeTerm(ExiDecoder* D) {
-    auto* Strm = Get::Reader<StrmT>(D);
-    return this->decodeTerm(Strm);
-  }  
+    return this->decodeTerm(D, /*Start=*/0, /*At=*/0);
+  }
 
   inline GrammarTerm getGrammarTerm(ExiDecoder* D) {
     exi_invariant(!GStack.empty());
@@ -238,12 +337,13 @@ private:
     if (Ret.is_ok()) {
       LOG_EXTRA("Grammar hit");
       this->Event = *Ret;
+      if EXI_UNLIKELY(!Ret->hasTerm())
+        D->diagnose(Get::Reader(D)->getEndError());
       return *Ret;
     }
     
     // LOG_EXTRA("Grammar miss: {}", Ret.error());
-    auto* Strm = Get::Reader<StrmT>(D);
-    const MatchT M = this->decodeTerm(Strm, 1, Ret.error());
+    this->decodeTerm(D, 1, Ret.error());
     return this->Event;
   }
 
@@ -259,8 +359,6 @@ private:
       tail_return this->handleStartTag(D);
     case ElementContent:
       tail_return this->handleElement(D);
-    case Fragment:
-      exi_unreachable("SC elements are currently unsupported");
     default:
       tail_return this->getDocTerm(D);
     }
@@ -275,6 +373,8 @@ private:
       tail_return this->handleDocContent(D);
     case DocEnd:
       tail_return this->handleDocEnd(D);
+    case Fragment:
+      tail_return this->handleFragment(D);
     default:
       exi_unreachable("invalid state?");
     }
@@ -295,7 +395,7 @@ private:
 
   CC_INLINE GNU_ATTR(cold) EventUID handleDocument(ExiDecoder*) {
     // Document is always empty, and therefore never reads.
-    this->pushGrammar(DocContent);
+    this->pushGrammar(RootEnd == Fragment ? Fragment : DocContent);
     this->logEvent(EventTerm::SD);
     return NewTerm(EventTerm::SD);
   }
@@ -303,11 +403,13 @@ private:
   CC EventUID handleDocContent(ExiDecoder* D) {
     using enum EventTerm;
     const auto M = this->decodeTerm(D);
+    if EXI_UNLIKELY(!this->Event.hasTerm())
+      return this->Event;
     this->logEvent(M.Data);
 
     if (M.is(SE)) {
       // This should only be called once, at the start of processing.
-      exi_assert(GStack.empty() && Grammars.empty());
+      exi_assert(GStack.empty() && GrammarList.empty());
       tail_return this->handleSE</*IsRoot=*/true>(D);
     } else if (M.is(DT, CM, PI))
       return NewTerm(M.Data);
@@ -318,6 +420,8 @@ private:
   CC EventUID handleDocEnd(ExiDecoder* D) {
     using enum EventTerm;
     const auto M = this->decodeTerm(D);
+    if EXI_UNLIKELY(!this->Event.hasTerm())
+      return this->Event;
     this->logEvent(M.Data);
 
     if (M.is(ED)) {
@@ -329,10 +433,74 @@ private:
     exi_unreachable("invalid DocEnd");
   }
 
+  /// Fragments are decoded in the same way as elements, but the learned
+  /// SE(qname) productions are kept separately. The element grammars are
+  /// shared with the rest of the fragment.
+  CC GNU_ATTR(cold) EventUID handleFragment(ExiDecoder* D) {
+    using enum EventTerm;
+    exi_invariant(GStack.empty(), "invalid nesting");
+    auto* Strm = Get::Reader<StrmT>(D);
+    const auto [Offset, Code] = Info[Fragment];
+
+    // [SE(qname)..., SE(*), ED, CM/PI?]
+    const u64 Learned = FragmentNames.size();
+    const u64 Count = Learned + Code.Data[0];
+    const auto Read = Strm->readBits64(Log2_64_Ceil(Count));
+    if EXI_UNLIKELY(Read.is_err()) {
+      this->failTerm(D, Read.error());
+      return this->Event;
+    }
+
+    const u64 At = *Read;
+    if EXI_UNLIKELY(At >= Count) {
+      this->failTerm(D, ErrorCode::kInvalidEXIInput);
+      return this->Event;
+    }
+
+    if (At < Learned) {
+      this->Event = EventUID::NewTerm(SEQName);
+      this->Event.Name = FragmentNames[Learned - At - 1];
+      this->logEvent(SEQName);
+      if EXI_UNLIKELY(!this->decodeCachedPrefix(D))
+        return EventUID::NewNull();
+      tail_return this->handleSEQName</*KnownCached=*/true>(D);
+    }
+
+    switch (At - Learned) {
+    case kFragmentSE: {
+      this->logEvent(SE);
+      const EventUID Out = this->handleSE</*IsRoot=*/true>(D);
+      if EXI_LIKELY(Out.hasQName())
+        FragmentNames.push_back(Out.Name);
+      return Out;
+    }
+    case kFragmentED:
+      this->logEvent(ED);
+      return NewTerm(ED);
+    default: {
+      exi_invariant(At - Learned == kFragmentCMPI);
+      const auto Sub = Strm->readBits64(Code.Bits[1]);
+      if EXI_UNLIKELY(Sub.is_err()) {
+        this->failTerm(D, Sub.error());
+        return this->Event;
+      }
+      if EXI_UNLIKELY(*Sub >= Code.Data[1]) {
+        this->failTerm(D, ErrorCode::kInvalidEXIInput);
+        return this->Event;
+      }
+      const auto Term = BaseT::at(Offset + kFragmentCMPI + *Sub);
+      this->logEvent(Term);
+      return NewTerm(Term);
+    }
+    }
+  }
+
   /// Handles StartTag unique elements.
   CC GNU_ATTR(hot) EventUID handleStartTag(ExiDecoder* D) {
     using enum EventTerm;
     this->decodeTermGrammar(D);
+    if EXI_UNLIKELY(!this->Event.hasTerm())
+      return this->Event;
     const EventTerm Term = this->Event.getTerm();
     this->logEvent(Term);
 
@@ -346,11 +514,15 @@ private:
       tail_return this->handleAT(D);
     case ATQName:
       // GStack.back()->dump(D);
+      if EXI_UNLIKELY(!this->decodeCachedPrefix(D))
+        return EventUID::NewNull();
       tail_return this->handleATQName(D);
     case NS:
       return NewTerm(Term);
     case SC:
-      this->pushGrammar(Fragment);
+      // The content of the element is decoded as a separate fragment, which
+      // includes its EE. Continue as if the element has ended.
+      this->handleEE</*IsStart=*/true>(D);
       return NewTerm(EventTerm::SC);
     default:
       tail_return this->handleSharedContent<true>(D);
@@ -361,6 +533,8 @@ private:
   CC GNU_ATTR(hot) EventUID handleElement(ExiDecoder* D) {
     using enum EventTerm;
     this->decodeTermGrammar(D);
+    if EXI_UNLIKELY(!this->Event.hasTerm())
+      return this->Event;
     this->logCurrentEvent();
     tail_return this->handleSharedContent<false>(D);
   }
@@ -376,6 +550,8 @@ private:
       tail_return this->handleEE(D);
     case SEQName:
       // SE(qname) events are cached.
+      if EXI_UNLIKELY(!this->decodeCachedPrefix(D))
+        return EventUID::NewNull();
       tail_return this->handleSEQName(D);
     case CHExtern:
       tail_return this->handleCH<true>(D);
@@ -402,6 +578,7 @@ private:
     case CM:
     case PI:
       this->pushGrammar(ElementContent);
+      GStack.back().setInt(false);
       return NewTerm(Term);
     default:
       exi_unreachable(UnreachableMsg);
@@ -413,7 +590,7 @@ private:
 
   template <bool IsRoot = false>
   CC EventUID handleSE(ExiDecoder* D) {
-    const auto Event = Get::DecodeQName(D);
+    const auto Event = Get::DecodeQName<StrmT>(D);
     if EXI_UNLIKELY(Event.is_err()) {
       D->diagnose(Event.error());
       return EventUID::NewNull();
@@ -423,6 +600,19 @@ private:
     tail_return this->handleSEQName</*KnownCached=*/IsRoot>(D);
   }
 
+  /// Learned SE(qname) and AT(qname) productions still encode their prefix
+  /// when prefixes are preserved.
+  CC_INLINE bool decodeCachedPrefix(ExiDecoder* D) {
+    exi_invariant(Event.hasQName());
+    const auto Pfx = Get::DecodePfxQ<StrmT>(D, Event.getURI());
+    if EXI_UNLIKELY(Pfx.is_err()) {
+      D->diagnose(Pfx.error());
+      return false;
+    }
+    Event.Prefix = (*Pfx).value_or(kInvalidPrefix);
+    return true;
+  }
+
   template <bool KnownCached = true>
   CC EventUID handleSEQName(ExiDecoder* D) {
     using enum EventTerm;
@@ -451,7 +641,7 @@ private:
       this->pushGrammar(ElementContent);
       GStack.back().setInt(false);
     } else
-      this->pushGrammar(DocEnd);
+      this->pushGrammar(RootEnd);
     
     return Event;
   }
@@ -462,13 +652,14 @@ private:
       this->addQNameToEvent();
       // Cache event for current grammar.
       GStack.back()->addTerm(Event, /*IsStart=*/true);
+      ++NLearned;
     }
     tail_return this->handleEE</*IsStart=*/true>(D);
   }
 
   template <bool Cached = false>
   CC EventUID handleAT(ExiDecoder* D) {
-    const auto Event = Get::DecodeQName(D);
+    const auto Event = Get::DecodeQName<StrmT>(D);
     if EXI_UNLIKELY(Event.is_err()) {
       D->diagnose(Event.error());
       return EventUID::NewNull();
@@ -493,7 +684,7 @@ private:
   CC EventUID handleCH(ExiDecoder* D) {
     exi_invariant(!GStack.empty());
     const SmallQName Name = GStack.back()->getName();
-    const auto Event = Get::DecodeValue(D, Name);
+    const auto Event = Get::DecodeValue<StrmT>(D, Name);
 
     if EXI_UNLIKELY(Event.is_err()) {
       D->diagnose(Event.error());
@@ -534,6 +725,7 @@ private:
     exi_invariant(!GStack.empty());
     Event.setTerm(Term);
     GStack.back()->addTerm(Event, isStart());
+    ++NLearned;
   }
 
   /// Uses the current grammar's QName as the event's.
@@ -545,23 +737,45 @@ private:
   /// Returns `[Grammar, Cached]`.
   std::pair<BuiltinGrammar*, bool>
    loadGrammar(ExiDecoder* D, SmallQName Name) {
-    if (auto* G = Grammars.lookup(Name))
+    if (auto* G = this->lookupGrammar(Name))
       return {G, true};
     // Cache miss
     auto* G = this->makeGrammar(D, Name);
     return {G, false};
   }
 
+  EXI_INLINE BuiltinGrammar* lookupGrammar(SmallQName Name) const {
+    exi_invariant(Name.isQName());
+    if EXI_UNLIKELY(Name.URI >= Grammars.size())
+      return nullptr;
+    const auto& LNs = Grammars[Name.URI];
+    if EXI_UNLIKELY(Name.LocalID >= LNs.size())
+      return nullptr;
+    return LNs[Name.LocalID];
+  }
+
   BuiltinGrammar* makeGrammar(ExiDecoder* D, SmallQName Name) {
     auto& BP = Get::BP(D);
     auto* G = new (BP) BuiltinGrammar(Name);
-    auto [It, DidEmplace] = Grammars.try_emplace(Name, G);
-    exi_invariant(DidEmplace, "grammar already added");
+
+    // IDs are assigned in order, so the tables only grow by a few slots.
+    if (Name.URI >= Grammars.size())
+      Grammars.resize(Name.URI + 1);
+    auto& LNs = Grammars[Name.URI];
+    if (Name.LocalID >= LNs.size())
+      LNs.resize(Name.LocalID + 1, nullptr);
+    exi_invariant(!LNs[Name.LocalID], "grammar already added");
+
+    LNs[Name.LocalID] = G;
+    GrammarList.push_back(G);
     return G;
   }
 
-  EXI_INLINE BuiltinGrammar* getGrammar(SmallQName Name) const {
-    return Grammars.at(Name);
+  /// Grammars are allocated with the decoder, which never destroys them.
+  /// Their productions may live on the heap, so destroy them here.
+  void destroyGrammars() {
+    for (BuiltinGrammar* G : GrammarList)
+      G->~BuiltinGrammar();
   }
 
   ////////////////////////////////////////////////////////////////////////
@@ -591,183 +805,11 @@ private:
 #endif
 };
 
-template <class StrmT>
-class DynBuiltinSchema<StrmT>::Builder {
-  using SuperT = DynBuiltinSchema<StrmT>;
-public:
-  SmallVec<EventTerm, 8> Terms;
-  SmallVec<BIInfo, SuperT::InfoT::size()> Info;
-
-private:
-  ExiOptions::PreserveOpts Preserve;
-  bool SelfContained;
-
-  class EventCodeRTTI {
-    SEventCode* C;
-  public:
-    EventCodeRTTI(SEventCode* EC) : C(EC) {}
-    ~EventCodeRTTI() { Builder::CalculateLog(C); }
-    SEventCode& operator*() { return *C; }
-    SEventCode* operator->() { return C; }
-  };
-
-  static void CalculateLog(SEventCode* EC);
-
-  EventCodeRTTI createBIInfo() {
-    const u8 Offset = IntCast<u8>(Terms.size());
-    Info.push_back({
-      .Offset = Offset,
-      .Code { .Length = 1 }
-    });
-    return &Info.back().Code;
-  }
-
-public:
-  Builder(const ExiOptions& Opts) :
-   Preserve(Opts.Preserve),
-   SelfContained(Opts.SelfContained) {
-  }
-
-  static void Inc(SEventCode& C, i8 I = 1) {
-    if EXI_LIKELY(C.Length)
-      C.Data[C.Length - 1] += I;
-    else
-      LOG_WARN("'Inc' ran on empty EventCode.");
-  }
-  static void Next(SEventCode& C) {
-    if EXI_LIKELY(C.Length < 3)
-      ++C.Length;
-    else
-      LOG_WARN("'Next' ran on full EventCode.");
-  }
-  static void IncNext(SEventCode& C, i8 I = 1) {
-    Builder::Inc(C, I);
-    Builder::Next(C);
-  }
-
-  void init() {
-    /*DocContent:*/ {
-      LOG_EXTRA("DocContent:");
-      auto C = createBIInfo();
-      Terms.push_back(EventTerm::SE);
-      Builder::Inc(*C);
-
-      if (Preserve.DTDs) {
-        Terms.push_back(EventTerm::DT);
-        Builder::IncNext(*C);
-        Builder::Inc(*C);
-      }
-
-      this->addCMPI(*C);
-    }
-
-    /*DocEnd:*/ {
-      LOG_EXTRA("DocEnd:");
-      auto C = createBIInfo();
-      Terms.push_back(EventTerm::ED);
-      Builder::Inc(*C);
-      this->addCMPI(*C);
-    }
-
-    /*StartTagContent:*/ {
-      LOG_EXTRA("StartTagContent:");
-      auto C = createBIInfo();
-      Terms.push_back(EventTerm::EE);
-      Terms.push_back(EventTerm::AT);
-      Builder::Next(*C);
-      Builder::Inc(*C, 2);
-
-      if (Preserve.Prefixes) {
-        Terms.push_back(EventTerm::NS);
-        Builder::Inc(*C);
-      }
-
-      if (SelfContained) {
-        Terms.push_back(EventTerm::SC);
-        Builder::Inc(*C);
-      }
-
-      this->addCCItems(*C);
-    }
-
-    /*ElementContent:*/ {
-      LOG_EXTRA("ElementContent:");
-      auto C = createBIInfo();
-      Terms.push_back(EventTerm::EE);
-      Builder::Inc(*C, 2);
-      this->addCCItems(*C);
-    }
-  }
-
-private:
-  /// Adds CM/PI to the end of a grammar, if possible.
-  void addCMPI(SEventCode& C) {
-    if (!Preserve.Comments && !Preserve.PIs)
-      return;
-    Builder::IncNext(C);
-    if (Preserve.Comments) {
-      Terms.push_back(EventTerm::CM);
-      Builder::Inc(C);
-    }
-    if (Preserve.PIs) {
-      Terms.push_back(EventTerm::PI);
-      Builder::Inc(C);
-    }
-  }
-
-  /// Adds ChildContentItems.
-  void addCCItems(SEventCode& C) {
-    exi_assert(C.Length <= 2);
-    C.Length = 2;
-
-    Terms.push_back(EventTerm::SE);
-    Terms.push_back(EventTerm::CH);
-    Builder::Inc(C, 2);
-
-    if (Preserve.DTDs) {
-      Terms.push_back(EventTerm::ER);
-      Builder::Inc(C);
-    }
-
-    this->addCMPI(C);
-  }
-};
-
 } // namespace INTERNAL_NS
 
-template <class StrmT>
-void DynBuiltinSchema<StrmT>::Builder::CalculateLog(SEventCode* EC) {
-  exi_invariant(EC);
-  exi_assert(EC->Length <= 3 && EC->Length >= 0);
-
-  auto& Length = EC->Length;
-  if (Length == 0)
-    return;
-  
-  auto& Data = EC->Data;
-  // If we have `[x.y.0]`, make it `[x.y].0`.
-  if (Length == 3 && !Data[2]) {
-    Length -= 1;
-  }
-
-  // If we have `[x.0.z]`, make it `[x.z].0`.
-  if (Length >= 2 && !Data[1]) {
-    Data[1] = Data[2];
-    Data[2] = 0;
-    Length -= 1;
-  }
-
-  // We can't remove the first level event code, as it's possible grammars will
-  // extend the base values. This would lead to inaccuracies.
-
-  // Calculate log for all elements.
-  for (int Ix = 0; Ix < 3; ++Ix)
-    EC->Bits[Ix] = SmallLog2[Data[Ix]];
-}
-
 template <class StrmT>
 Box<DynBuiltinSchema<StrmT>>
-    DynBuiltinSchema<StrmT>::New(const ExiOptions& Opts) {
+    DynBuiltinSchema<StrmT>::New(const ExiOptions& Opts, bool IsFragment) {
   Builder B(Opts);
   B.init();
 
@@ -780,6 +822,7 @@ Box<DynBuiltinSchema<StrmT>>
     // Copy all our generated info.
     BuiltinInfo = B.Info[Ix];
   
+  Schema->reset(IsFragment);
   return Box<DynBuiltinSchema>(Schema);
 }
 
@@ -791,6 +834,8 @@ void DynBuiltinSchema<StrmT>::dump() const {
   PrintGrammar(Grammar::DocEnd);
   PrintGrammar(Grammar::StartTagContent);
   PrintGrammar(Grammar::ElementContent);
+  if (RootEnd == Grammar::Fragment)
+    PrintGrammar(Grammar::Fragment);
   outs().flush();
 }
 
@@ -898,13 +943,13 @@ void DynBuiltinSchema<StrmT>::logEvent(EventTerm Term) {
 }
 #endif // EXI_LOGGING
 
-Box<BuiltinSchema> BuiltinSchema::New(const ExiOptions& Opts) {
+Box<BuiltinSchema> BuiltinSchema::New(const ExiOptions& Opts,
+                                       bool IsFragment) {
   const AlignKind A = Opts.Alignment;
   if (A == AlignKind::BitPacked)
-    return DynBuiltinSchema<BitReader>::New(Opts);
-  else if (A == AlignKind::BytePacked)
-    return DynBuiltinSchema<ByteReader>::New(Opts);
-  exi_unreachable("Channel readers are currently unsupported!");
+    return DynBuiltinSchema<BitReader>::New(Opts, IsFragment);
+  // Channels are byte-aligned, with or without compression.
+  return DynBuiltinSchema<ByteReader>::New(Opts, IsFragment);
 }
 
 //===----------------------------------------------------------------===//
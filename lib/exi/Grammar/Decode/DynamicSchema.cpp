@@ -0,0 +1,92 @@
+//===- exi/Grammar/Decode/DynamicSchema.cpp -------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines schema-informed decoding with grammars built at
+/// runtime, from the tables in `SchemaGrammars`.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Grammar/DecoderSchema.hpp>
+#include "InformedSchema.hpp"
+
+using namespace exi;
+using namespace exi::decode;
+
+#define DEBUG_TYPE "DynamicSchema"
+
+#ifdef __clang__
+/// Keep debug information clean when using clang.
+# define INTERNAL_LINKAGE [[clang::internal_linkage]]
+# define INTERNAL_NS exi::decode
+#else
+# define INTERNAL_LINKAGE
+# define INTERNAL_NS
+#endif
+
+//===----------------------------------------------------------------===//
+// Schema-informed Grammar
+//===----------------------------------------------------------------===//
+
+namespace INTERNAL_NS {
+
+template <class StrmT>
+class INTERNAL_LINKAGE DynInformedSchema final
+    : public InformedSchema<DynInformedSchema<StrmT>, StrmT, DynamicSchema> {
+  using BaseT = InformedSchema<DynInformedSchema<StrmT>, StrmT, DynamicSchema>;
+  friend BaseT;
+  using typename BaseT::Frame;
+
+  SchemaGrammarsRef Grammars;
+
+public:
+  DynInformedSchema(const ExiOptions& Opts, SchemaGrammarsRef InGrammars) :
+   BaseT(Opts, InGrammars->tables()), Grammars(std::move(InGrammars)) {}
+
+private:
+  /// Decodes an event of a declared element, with the productions of its
+  /// state looked up in the tables.
+  EventUID decodeState(ExiDecoder* D, Frame& F) {
+    const SchemaState& S = this->T.States[F.State];
+    const bool HasSecond = !this->Strict || this->hasStrictSecond(F, S);
+
+    const auto Code = BaseT::ReadCode(D, S.NProds + HasSecond);
+    if EXI_UNLIKELY(Code.is_err())
+      return BaseT::Fail(D, Code.error());
+    if (*Code < S.NProds)
+      return this->decodeDeclared(D, F, this->T.Prods[S.FirstProd + *Code]);
+    return this->decodeUndeclared(D, F, S);
+  }
+};
+
+} // namespace INTERNAL_NS
+
+Box<DynamicSchema> DynamicSchema::New(const ExiOptions& Opts,
+                                      SchemaGrammarsRef Grammars,
+                                      bool IsFragment) {
+  exi_invariant(Grammars, "grammars must be loaded");
+  Box<DynamicSchema> Out;
+  if (Opts.Alignment == AlignKind::BitPacked)
+    Out = std::make_unique<DynInformedSchema<BitReader>>(
+      Opts, std::move(Grammars));
+  else
+    Out = std::make_unique<DynInformedSchema<ByteReader>>(
+      Opts, std::move(Grammars));
+  Out->reset(IsFragment);
+  return Out;
+}
@@ -0,0 +1,869 @@
+//===- exi/Grammar/Decode/InformedSchema.hpp ------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the shared parts of schema-informed decoding. Schemas
+/// only differ in how the productions of a state are found, which is done by
+/// `Derived::decodeState`. `DynamicSchema` looks them up in the tables, and
+/// schemas generated by `exi-schemac` switch on the state.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <exi/Grammar/DecoderSchema.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Common/STLExtras.hpp>
+#include <core/Common/Vec.hpp>
+#include <core/Support/Format.hpp>
+#include <core/Support/Logging.hpp>
+#include <core/Support/MathExtras.hpp>
+#include <exi/Basic/ExiOptions.hpp>
+#include <exi/Grammar/Grammar.hpp>
+#include <exi/Stream/OrderedReader.hpp>
+#include "SchemaGet.hpp"
+#include "../BuiltinInfo.hpp"
+
+#define DEBUG_TYPE "InformedSchema"
+
+namespace exi::decode {
+
+/// The declared productions of each state have the first part of their
+/// event codes. When `Strict` is false, the undeclared productions follow
+/// in the second part, in the order below. Each is only present where noted.
+///
+///   EE                      If the state has no EE.
+///   AT(xsi:type)            Start states.
+///   AT(xsi:nil)             Start states.
+///   AT(*)                   Attribute states.
+///   AT(*) [untyped]         Attribute states, with a third part for each
+///                           attribute use, then AT(*).
+///   NS                      Start states, if prefixes are preserved.
+///   SC                      Start states, if self-contained.
+///   SE(*)
+///   CH [untyped]
+///   ER                      If DTDs are preserved.
+///   CM/PI                   If either is preserved.
+///
+/// When `Strict` is true, only AT(xsi:type) and AT(xsi:nil) may be in the
+/// second part, if the type has named sub-types or the element is nillable.
+/// Undeclared elements without a global declaration use the builtin element
+/// grammars, as they would without a schema.
+
+/// The undeclared productions of a state.
+enum class Undeclared : u8 {
+  EE,
+  XsiType,
+  XsiNil,
+  AT,
+  ATUntyped,
+  NS,
+  SC,
+  SE,
+  CH,
+  ER,
+  CMPI,
+};
+
+/// The predefined IDs of `xsi:nil` and `xsi:type`.
+inline constexpr SmallQName kXsiNil = SmallQName::NewQName(2, 0);
+inline constexpr SmallQName kXsiType = SmallQName::NewQName(2, 1);
+
+/// Decodes with schema-informed grammars. `Derived` must define
+/// `EventUID decodeState(ExiDecoder*, Frame&)`, which decodes an event of
+/// the declared element on top of the stack.
+template <class Derived, class StrmT, class BaseT>
+class InformedSchema : public BaseT {
+protected:
+  using Get = typename BaseT::Get;
+
+  enum class Mode : u8 {
+    Document,
+    DocContent,
+    DocEnd,
+    Fragment,
+    Element,
+  };
+
+  /// An element being decoded. Declared elements use the schema grammars,
+  /// others use a builtin grammar.
+  struct Frame {
+    /// The current state, when `G` is null.
+    u32 State = 0;
+    /// If the element is nillable, which decides the strict productions.
+    bool Nillable = false;
+    /// If `G` is in StartTagContent.
+    bool IsStart = true;
+    /// The builtin grammar of an undeclared element.
+    BuiltinGrammar* G = nullptr;
+    SmallQName Name;
+  };
+
+  const SchemaTables& T;
+  /// The builtin event codes, for undeclared elements.
+  BuiltinBuilder Builtin;
+
+  bool Strict : 1;
+  bool Prefixes : 1;
+  bool DTDs : 1;
+  bool Comments : 1;
+  bool PIs : 1;
+  bool SelfContained : 1;
+
+  Mode Current = Mode::Document;
+  /// The mode used after the root element, DocEnd or Fragment.
+  Mode RootEnd = Mode::DocEnd;
+  Vec<Frame> Frames;
+  /// The builtin grammars, indexed by URI and then LocalID.
+  SmallVec<SmallVec<BuiltinGrammar*, 0>, 4> BuiltinGrammars;
+  /// The builtin grammars, in order of creation.
+  SmallVec<BuiltinGrammar*, 0> GrammarList;
+  /// The number of productions learned by the builtin grammars.
+  usize NLearned = 0;
+
+  /// The state before the current event, see `checkpoint`.
+  struct {
+    Mode Current = Mode::Document;
+    /// An event only changes the top frame, or pushes or pops once.
+    usize Depth = 0;
+    Frame Top;
+    /// The productions of `Top.G`, which are only learned by one event.
+    usize NStartTag = 0, NElement = 0;
+    usize NGrammars = 0;
+    usize NLearned = 0;
+  } Saved;
+
+public:
+  InformedSchema(const ExiOptions& Opts, const SchemaTables& Tables) :
+   T(Tables), Builtin(Opts),
+   Strict(Opts.Strict), Prefixes(Opts.Preserve.Prefixes),
+   DTDs(Opts.Preserve.DTDs), Comments(Opts.Preserve.Comments),
+   PIs(Opts.Preserve.PIs), SelfContained(Opts.SelfContained) {
+    Builtin.init();
+  }
+
+  ~InformedSchema() override { this->destroyGrammars(); }
+
+  void reset(bool IsFragment) override {
+    this->destroyGrammars();
+    for (auto& LNs : BuiltinGrammars)
+      LNs.clear();
+    GrammarList.clear();
+    NLearned = 0;
+    Frames.clear();
+    Current = Mode::Document;
+    RootEnd = IsFragment ? Mode::Fragment : Mode::DocEnd;
+  }
+
+  void checkpoint() override {
+    Saved.Current = Current;
+    Saved.Depth = Frames.size();
+    if (!Frames.empty()) {
+      Saved.Top = Frames.back();
+      if (BuiltinGrammar* G = Saved.Top.G) {
+        Saved.NStartTag = G->size(/*IsStart=*/true);
+        Saved.NElement = G->size(/*IsStart=*/false);
+      }
+    }
+    Saved.NGrammars = GrammarList.size();
+    Saved.NLearned = NLearned;
+  }
+
+  bool rollback() override {
+    // Grammars created since are no longer reachable.
+    for (BuiltinGrammar* G : drop_begin(GrammarList, Saved.NGrammars)) {
+      const SmallQName Name = G->getName();
+      BuiltinGrammars[Name.URI][Name.LocalID] = nullptr;
+      G->~BuiltinGrammar();
+    }
+    GrammarList.truncate(Saved.NGrammars);
+
+    Frames.resize(Saved.Depth);
+    if (Saved.Depth != 0) {
+      Frames.back() = Saved.Top;
+      if (BuiltinGrammar* G = Saved.Top.G) {
+        G->truncate(Saved.NStartTag, /*IsStart=*/true);
+        G->truncate(Saved.NElement, /*IsStart=*/false);
+      }
+    }
+    Current = Saved.Current;
+    NLearned = Saved.NLearned;
+    return true;
+  }
+
+  EventUID decode(ExiDecoder* D) override {
+    switch (Current) {
+    case Mode::Element:
+      if (Frames.back().G)
+        return this->decodeBuiltin(D);
+      return static_cast<Derived*>(this)->decodeState(D, Frames.back());
+    case Mode::Document:
+      Current = (RootEnd == Mode::Fragment) ? Mode::Fragment
+                                            : Mode::DocContent;
+      return EventUID::NewTerm(EventTerm::SD);
+    case Mode::DocContent:
+      return this->decodeDocContent(D);
+    case Mode::DocEnd:
+      return this->decodeDocEnd(D);
+    case Mode::Fragment:
+      return this->decodeFragment(D);
+    }
+    exi_unreachable("invalid mode");
+  }
+
+  usize getMemoryUsage() const override {
+    usize Total = (Frames.capacity() * sizeof(Frame))
+      + BuiltinGrammars.capacity_in_bytes()
+      + GrammarList.capacity_in_bytes()
+      + (NLearned * sizeof(EventUID));
+    for (const auto& LNs : BuiltinGrammars)
+      Total += LNs.capacity_in_bytes();
+    return Total;
+  }
+
+  void dump() const override { T.dump(); }
+
+protected:
+  ////////////////////////////////////////////////////////////////////////
+  // Utilities
+
+  /// Reads an n-bit event code part, for `Count` productions.
+  static ExiResult<u64> ReadCode(ExiDecoder* D, u64 Count) {
+    return Get::template Reader<StrmT>(D)->readBits64(Log2_64_Ceil(Count));
+  }
+
+  /// Reads the first part of an event code, for a state with `NProds`
+  /// declared productions. The widths are constant for generated schemas.
+  template <u32 NProds>
+  ALWAYS_INLINE static ExiResult<u64> ReadStateCode(ExiDecoder* D,
+                                                    bool HasSecond) {
+    constexpr unsigned Bits = NProds ? Log2_32_Ceil(NProds) : 0;
+    constexpr unsigned BitsWithSecond = Log2_32_Ceil(NProds + 1);
+    auto* Strm = Get::template Reader<StrmT>(D);
+    if constexpr (Bits == BitsWithSecond)
+      return Strm->readBits64(Bits);
+    return Strm->readBits64(HasSecond ? BitsWithSecond : Bits);
+  }
+
+  /// Diagnoses `E`, and returns a null event.
+  static EventUID Fail(ExiDecoder* D, ExiError E) {
+    D->diagnose(E);
+    return EventUID::NewNull();
+  }
+
+  static EventUID NewEvent(EventTerm Term, SmallQName Name) {
+    EventUID Event = EventUID::NewQName(Name);
+    Event.setTerm(Term);
+    return Event;
+  }
+
+  /// Decodes the prefix of a QName, if prefixes are preserved.
+  static ExiError DecodePrefix(ExiDecoder* D, EventUID& Event) {
+    const auto Pfx = Get::template DecodePfxQ<StrmT>(D, Event.getURI());
+    if EXI_UNLIKELY(Pfx.is_err())
+      return Pfx.error();
+    Event.Prefix = (*Pfx).value_or(kInvalidPrefix);
+    return ExiError::OK;
+  }
+
+  /// Sets the value of `Event` from a decoded value.
+  static void SetValue(EventUID& Event, EventUID Value) {
+    Event.ValueID = Value.ValueID;
+    Event.IsLocal = Value.IsLocal;
+  }
+
+  /// Decodes CM or PI, for the last part of an event code.
+  EventUID decodeCMPI(ExiDecoder* D) {
+    using enum EventTerm;
+    if (Comments && PIs) {
+      const auto Sub = ReadCode(D, 2);
+      if EXI_UNLIKELY(Sub.is_err())
+        return Fail(D, Sub.error());
+      return EventUID::NewTerm(*Sub ? PI : CM);
+    }
+    return EventUID::NewTerm(Comments ? CM : PI);
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Document
+
+  EventUID decodeDocContent(ExiDecoder* D) {
+    using enum EventTerm;
+    const u64 NElts = T.DocElements.size();
+    const bool HasSecond = DTDs || Comments || PIs;
+    const auto Code = ReadCode(D, NElts + 1 + HasSecond);
+    if EXI_UNLIKELY(Code.is_err())
+      return Fail(D, Code.error());
+
+    if (*Code < NElts) {
+      const u32 Elt = T.DocElements[*Code];
+      return this->startDeclared(D, Elt);
+    } else if (*Code == NElts)
+      return this->startUndeclared(D);
+
+    if (DTDs) {
+      const auto Sub = ReadCode(D, 1 + (Comments || PIs));
+      if EXI_UNLIKELY(Sub.is_err())
+        return Fail(D, Sub.error());
+      if (*Sub == 0)
+        return EventUID::NewTerm(DT);
+    }
+    return this->decodeCMPI(D);
+  }
+
+  EventUID decodeDocEnd(ExiDecoder* D) {
+    const auto Code = ReadCode(D, 1 + (Comments || PIs));
+    if EXI_UNLIKELY(Code.is_err())
+      return Fail(D, Code.error());
+    if (*Code == 0)
+      return EventUID::NewTerm(EventTerm::ED);
+    return this->decodeCMPI(D);
+  }
+
+  EventUID decodeFragment(ExiDecoder* D) {
+    const u64 NElts = T.FragmentElements.size();
+    const auto Code = ReadCode(D, NElts + 2 + (Comments || PIs));
+    if EXI_UNLIKELY(Code.is_err())
+      return Fail(D, Code.error());
+
+    if (*Code < NElts)
+      return this->startDeclared(D, T.FragmentElements[*Code]);
+    else if (*Code == NElts)
+      return this->startUndeclared(D);
+    else if (*Code == NElts + 1)
+      return EventUID::NewTerm(EventTerm::ED);
+    return this->decodeCMPI(D);
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Elements
+
+  /// Starts the declared element `Elt`, after its SE(qname).
+  EventUID startDeclared(ExiDecoder* D, u32 Elt) {
+    const SchemaElement& E = T.Elements[Elt];
+    EventUID Event = NewEvent(EventTerm::SEQName, E.Name.get());
+    if (ExiError Err = DecodePrefix(D, Event))
+      return Fail(D, Err);
+    this->pushElement(E, Event.Name);
+    return Event;
+  }
+
+  /// Starts an element from a decoded SE(*).
+  EventUID startUndeclared(ExiDecoder* D) {
+    const auto Event = Get::template DecodeQName<StrmT>(D);
+    if EXI_UNLIKELY(Event.is_err())
+      return Fail(D, Event.error());
+    return this->startElement(D, *Event);
+  }
+
+  /// Starts the element with the name of `Event`, which uses its global
+  /// declaration if it has one.
+  EventUID startElement(ExiDecoder* D, EventUID Event) {
+    Event.setTerm(EventTerm::SE);
+    if (Option<u32> Elt = T.findElement(Event.Name))
+      this->pushElement(T.Elements[*Elt], Event.Name);
+    else
+      Frames.push_back({.G = this->loadGrammar(D, Event.Name),
+                        .Name = Event.Name});
+    Current = Mode::Element;
+    return Event;
+  }
+
+  void pushElement(const SchemaElement& E, SmallQName Name) {
+    Frames.push_back({
+      .State = T.Types[E.Type].Grammar,
+      .Nillable = E.isNillable(),
+      .Name = Name
+    });
+    Current = Mode::Element;
+  }
+
+  EventUID endElement() {
+    exi_invariant(!Frames.empty(), "invalid nesting");
+    const EventUID Event = NewEvent(EventTerm::EE, Frames.back().Name);
+    Frames.pop_back();
+    if (Frames.empty())
+      Current = RootEnd;
+    return Event;
+  }
+
+  bool hasStrictSecond(const Frame& F, const SchemaState& S) const {
+    if (!S.isStart() || S.isEmpty())
+      return false;
+    return F.Nillable || T.Types[S.Type].hasSubTypes();
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Declared Productions
+
+  /// Decodes the declared production `P`, from the tables.
+  EventUID decodeDeclared(ExiDecoder* D, Frame& F, const SchemaProd& P) {
+    using enum EventTerm;
+    const EventTerm Term = P.getTerm();
+    LOG_EXTRA("Declared {}", get_event_name(Term));
+
+    switch (Term) {
+    case EE:
+      return this->endElement();
+    case SEQName:
+      return this->declaredSE(D, F, P.Next, P.Target);
+    case SEUri:
+    case SE:
+      return this->declaredWildcardSE(D, F, P.Next, Term, P.Name.URI);
+    case ATQName:
+      return this->declaredAT(D, F, P.Next, P.Name.get(), P.Target);
+    case ATUri:
+    case AT:
+      return this->declaredWildcardAT(D, F, P.Next, Term, P.Name.URI);
+    case CH:
+      return this->declaredCH(D, F, P.Next, P.Target);
+    default:
+      exi_unreachable("invalid declared production");
+    }
+  }
+
+  /// SE(qname) of the element `Elt`.
+  EventUID declaredSE(ExiDecoder* D, Frame& F, u32 Next, u32 Elt) {
+    F.State = Next;
+    return this->startDeclared(D, Elt);
+  }
+
+  /// SE(uri:*) or SE(*).
+  EventUID declaredWildcardSE(ExiDecoder* D, Frame& F, u32 Next,
+                              EventTerm Term, u32 URI) {
+    F.State = Next;
+    const auto Event = this->decodeWildcardName(D, Term, URI);
+    if EXI_UNLIKELY(Event.is_err())
+      return Fail(D, Event.error());
+    return this->startElement(D, *Event);
+  }
+
+  /// AT(qname), with values of the type `Datatype`.
+  EventUID declaredAT(ExiDecoder* D, Frame& F, u32 Next,
+                      SmallQName Name, u32 Datatype) {
+    F.State = Next;
+    EventUID Event = NewEvent(EventTerm::ATQName, Name);
+    if (ExiError E = DecodePrefix(D, Event))
+      return Fail(D, E);
+    return this->decodeTypedAT(D, Event, Datatype);
+  }
+
+  /// AT(uri:*) or AT(*).
+  EventUID declaredWildcardAT(ExiDecoder* D, Frame& F, u32 Next,
+                              EventTerm Term, u32 URI) {
+    F.State = Next;
+    const auto Event = this->decodeWildcardName(D, Term, URI);
+    if EXI_UNLIKELY(Event.is_err())
+      return Fail(D, Event.error());
+    return this->decodeGlobalAT(D, *Event);
+  }
+
+  /// CH, with values of the type `Datatype`.
+  EventUID declaredCH(ExiDecoder* D, Frame& F, u32 Next, u32 Datatype) {
+    F.State = Next;
+    return this->decodeTypedCH(D, F.Name, Datatype);
+  }
+
+  /// Decodes the name of a wildcard, where SE(uri:*) and AT(uri:*) only
+  /// encode the LocalName.
+  ExiResult<EventUID> decodeWildcardName(ExiDecoder* D, EventTerm Term,
+                                         CompactID URI) {
+    if (Term == EventTerm::SE || Term == EventTerm::AT)
+      return Get::template DecodeQName<StrmT>(D);
+
+    const auto LocalID = Get::template DecodeName<StrmT>(D, URI);
+    if EXI_UNLIKELY(LocalID.is_err())
+      return Err(LocalID.error());
+    EventUID Event = EventUID::NewQName(SmallQName::NewQName(URI, *LocalID));
+    if (ExiError E = DecodePrefix(D, Event))
+      return Err(E);
+    return Ok(Event);
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Undeclared Productions
+
+  /// Collects the undeclared productions of a state, in event code order.
+  void getUndeclared(const Frame& F, const SchemaState& S,
+                     SmallVecImpl<Undeclared>& Out) const {
+    using enum Undeclared;
+    if (Strict) {
+      if (T.Types[S.Type].hasSubTypes())
+        Out.push_back(XsiType);
+      if (F.Nillable)
+        Out.push_back(XsiNil);
+      return;
+    }
+
+    if (!S.hasEE())
+      Out.push_back(EE);
+    if (S.isStart())
+      Out.append({XsiType, XsiNil});
+    if (S.isAttributes())
+      Out.append({AT, ATUntyped});
+    if (S.isStart() && Prefixes)
+      Out.push_back(NS);
+    if (S.isStart() && SelfContained)
+      Out.push_back(SC);
+    Out.append({SE, CH});
+    if (DTDs)
+      Out.push_back(ER);
+    if (Comments || PIs)
+      Out.push_back(CMPI);
+  }
+
+  EXI_COLD EventUID decodeUndeclared(ExiDecoder* D, Frame& F,
+                                     const SchemaState& S) {
+    SmallVec<Undeclared, 12> Prods;
+    this->getUndeclared(F, S, Prods);
+    const auto Code = ReadCode(D, Prods.size());
+    if EXI_UNLIKELY(Code.is_err())
+      return Fail(D, Code.error());
+    if EXI_UNLIKELY(*Code >= Prods.size())
+      return Fail(D, ErrorCode::kInvalidEXIInput);
+
+    switch (Prods[*Code]) {
+    case Undeclared::EE:
+      return this->endElement();
+    case Undeclared::XsiType:
+      return this->decodeXsiType(D, F);
+    case Undeclared::XsiNil:
+      return this->decodeXsiNil(D, F, S);
+    case Undeclared::AT: {
+      const auto Event = Get::template DecodeQName<StrmT>(D);
+      if EXI_UNLIKELY(Event.is_err())
+        return Fail(D, Event.error());
+      return this->decodeGlobalAT(D, *Event);
+    }
+    case Undeclared::ATUntyped:
+      return this->decodeUntypedAT(D, S);
+    case Undeclared::NS:
+      return EventUID::NewTerm(EventTerm::NS);
+    case Undeclared::SC:
+      LOG_ERROR("Self-contained elements are unsupported with schemas.");
+      return Fail(D, ErrorCode::kUnimplemented);
+    case Undeclared::SE: {
+      F.State = S.Content2;
+      return this->startUndeclared(D);
+    }
+    case Undeclared::CH: {
+      F.State = S.Content2;
+      return this->decodeUntypedCH(D, F.Name);
+    }
+    case Undeclared::ER:
+      F.State = S.Content2;
+      return EventUID::NewTerm(EventTerm::ER);
+    case Undeclared::CMPI:
+      F.State = S.Content2;
+      return this->decodeCMPI(D);
+    }
+    exi_unreachable("invalid undeclared production");
+  }
+
+  /// Decodes AT(qname) [untyped] for an attribute use, or AT(*) [untyped].
+  EventUID decodeUntypedAT(ExiDecoder* D, const SchemaState& S) {
+    const auto Uses = T.getAttrUses(T.Types[S.Type]);
+    const auto Code = ReadCode(D, Uses.size() + 1);
+    if EXI_UNLIKELY(Code.is_err())
+      return Fail(D, Code.error());
+
+    if (*Code < Uses.size()) {
+      EventUID Event = NewEvent(EventTerm::ATQName, Uses[*Code].get());
+      if (ExiError E = DecodePrefix(D, Event))
+        return Fail(D, E);
+      return Event;
+    }
+
+    auto Event = Get::template DecodeQName<StrmT>(D);
+    if EXI_UNLIKELY(Event.is_err())
+      return Fail(D, Event.error());
+    Event->setTerm(EventTerm::AT);
+    return *Event;
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // xsi:type and xsi:nil
+
+  EventUID decodeXsiType(ExiDecoder* D, Frame& F) {
+    EventUID Event = NewEvent(EventTerm::ATQName, kXsiType);
+    if (ExiError E = DecodePrefix(D, Event))
+      return Fail(D, E);
+
+    const auto Type = Get::template DecodeQName<StrmT>(D);
+    if EXI_UNLIKELY(Type.is_err())
+      return Fail(D, Type.error());
+    const Option<u32> TypeIx = T.findType(Type->Name);
+    if EXI_UNLIKELY(!TypeIx) {
+      LOG_ERROR("Unknown type in xsi:type.");
+      return Fail(D, ErrorCode::kInvalidEXIInput);
+    }
+
+    // The element continues with the grammar of the new type.
+    F.State = T.Types[*TypeIx].Grammar;
+    F.G = nullptr;
+    this->setQNameValue(D, *Type);
+    SetValue(Event, EventUID::NewTransientValue());
+    return Event;
+  }
+
+  EventUID decodeXsiNil(ExiDecoder* D, Frame& F, const SchemaState& S) {
+    EventUID Event = NewEvent(EventTerm::ATQName, kXsiNil);
+    if (ExiError E = DecodePrefix(D, Event))
+      return Fail(D, E);
+
+    bool IsNil = false;
+    if (ExiError E = Get::template Reader<StrmT>(D)->readBit(IsNil))
+      return Fail(D, E);
+    if (IsNil)
+      F.State = T.Types[S.Type].EmptyGrammar;
+
+    Get::Idents(D).setTransientValue(IsNil ? "true"_str : "false"_str);
+    SetValue(Event, EventUID::NewTransientValue());
+    return Event;
+  }
+
+  /// Prints a QName value as the transient value.
+  void setQNameValue(ExiDecoder* D, EventUID QName) {
+    auto& Idents = Get::Idents(D);
+    auto [URI, Local] = Idents.getQName(QName.Name);
+    if (!QName.hasPrefix()) {
+      Idents.setTransientValue(Local);
+      return;
+    }
+
+    SmallStr<64> Data;
+    wrap_stream(Data) << Idents.getPrefix(QName.getURI(), QName.getPrefix())
+                      << ':' << Local;
+    Idents.setTransientValue(Data);
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Values
+
+  EventUID decodeTypedAT(ExiDecoder* D, EventUID Event, u32 Datatype) {
+    const auto Value = Get::template DecodeTypedValue<StrmT>(
+      D, Event.Name, T, Datatype);
+    if EXI_UNLIKELY(Value.is_err())
+      return Fail(D, Value.error());
+    SetValue(Event, *Value);
+    return Event;
+  }
+
+  /// Decodes an attribute value with the type of its global declaration.
+  /// Values of other attributes are decoded as strings by the decoder.
+  EventUID decodeGlobalAT(ExiDecoder* D, EventUID Event) {
+    Event.setTerm(EventTerm::AT);
+    if (Option<u32> Attr = T.findAttribute(Event.Name))
+      return this->decodeTypedAT(D, Event, T.Attributes[*Attr].Datatype);
+    return Event;
+  }
+
+  EventUID decodeTypedCH(ExiDecoder* D, SmallQName Name, u32 Datatype) {
+    const auto Value = Get::template DecodeTypedValue<StrmT>(
+      D, Name, T, Datatype);
+    if EXI_UNLIKELY(Value.is_err())
+      return Fail(D, Value.error());
+    EventUID Event = *Value;
+    Event.Name = Name;
+    Event.setTerm(EventTerm::CH);
+    return Event;
+  }
+
+  EventUID decodeUntypedCH(ExiDecoder* D, SmallQName Name) {
+    const auto Value = Get::template DecodeValue<StrmT>(D, Name);
+    if EXI_UNLIKELY(Value.is_err())
+      return Fail(D, Value.error());
+    EventUID Event = *Value;
+    Event.Name = Name;
+    Event.setTerm(EventTerm::CH);
+    return Event;
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Builtin Elements
+
+  /// Decodes an event of an undeclared element, as `DynBuiltinSchema`
+  /// does. `xsi:type` switches the element to a schema grammar.
+  EXI_COLD EventUID decodeBuiltin(ExiDecoder* D) {
+    using enum EventTerm;
+    Frame& F = Frames.back();
+    BuiltinGrammar* G = F.G;
+    const bool IsStart = F.IsStart;
+
+    EventUID Event;
+    bool Learned = true;
+    if (auto Ret = G->getTerm<StrmT>(Get::Reader(D), IsStart); Ret.is_ok()) {
+      Event = *Ret;
+      if EXI_UNLIKELY(!Event.hasTerm())
+        return Fail(D, Get::Reader(D)->getEndError());
+    } else {
+      const auto Term = this->decodeBuiltinTerm(D, IsStart, Ret.error());
+      if EXI_UNLIKELY(Term.is_err())
+        return Fail(D, Term.error());
+      Event = EventUID::NewTerm(*Term);
+      Learned = false;
+    }
+
+    switch (Event.getTerm()) {
+    case EE:
+      if (IsStart && !Learned) {
+        G->addTerm(NewEvent(EE, F.Name), /*IsStart=*/true);
+        ++NLearned;
+      }
+      return this->endElement();
+    case SEQName:
+    case SE: {
+      if (Learned) {
+        if (ExiError E = DecodePrefix(D, Event))
+          return Fail(D, E);
+      } else {
+        auto Decoded = Get::template DecodeQName<StrmT>(D);
+        if EXI_UNLIKELY(Decoded.is_err())
+          return Fail(D, Decoded.error());
+        Event = *Decoded;
+        G->addTerm(NewEvent(SEQName, Event.Name), IsStart);
+        ++NLearned;
+      }
+      F.IsStart = false;
+      return this->startElement(D, Event);
+    }
+    case ATQName:
+    case AT: {
+      if (Learned) {
+        if (ExiError E = DecodePrefix(D, Event))
+          return Fail(D, E);
+      } else {
+        auto Decoded = Get::template DecodeQName<StrmT>(D);
+        if EXI_UNLIKELY(Decoded.is_err())
+          return Fail(D, Decoded.error());
+        Event = *Decoded;
+        G->addTerm(NewEvent(ATQName, Event.Name), IsStart);
+        ++NLearned;
+      }
+      if (Event.Name == kXsiType)
+        return this->decodeBuiltinXsiType(D, Event);
+      return this->decodeGlobalAT(D, Event);
+    }
+    case CHExtern:
+    case CH:
+      if (!Learned) {
+        G->addTerm(EventUID::NewTerm(CHExtern), IsStart);
+        ++NLearned;
+      }
+      F.IsStart = false;
+      return this->decodeUntypedCH(D, F.Name);
+    case NS:
+      return EventUID::NewTerm(NS);
+    case SC:
+      LOG_ERROR("Self-contained elements are unsupported with schemas.");
+      return Fail(D, ErrorCode::kUnimplemented);
+    default:
+      // ER, CM, and PI.
+      F.IsStart = false;
+      return Event;
+    }
+  }
+
+  /// Switches an undeclared element to the grammar of its `xsi:type`.
+  EventUID decodeBuiltinXsiType(ExiDecoder* D, EventUID Event) {
+    const auto Type = Get::template DecodeQName<StrmT>(D);
+    if EXI_UNLIKELY(Type.is_err())
+      return Fail(D, Type.error());
+    const Option<u32> TypeIx = T.findType(Type->Name);
+    if EXI_UNLIKELY(!TypeIx) {
+      LOG_ERROR("Unknown type in xsi:type.");
+      return Fail(D, ErrorCode::kInvalidEXIInput);
+    }
+
+    Frame& F = Frames.back();
+    F.State = T.Types[*TypeIx].Grammar;
+    F.G = nullptr;
+    this->setQNameValue(D, *Type);
+    Event.setTerm(EventTerm::AT);
+    SetValue(Event, EventUID::NewTransientValue());
+    return Event;
+  }
+
+  /// Decodes the builtin terms of an element grammar, after the first part
+  /// escaped to them at `At`.
+  ExiResult<EventTerm> decodeBuiltinTerm(ExiDecoder* D, bool IsStart,
+                                         u64 At) {
+    // StartTagContent and ElementContent, see `BuiltinBuilder::init`.
+    const BIInfo& Info = Builtin.Info[IsStart ? 2 : 3];
+    const SEventCode& Code = Info.Code;
+    auto* Strm = Get::template Reader<StrmT>(D);
+
+    if (!Code.Data[0] || At == u64(Code.Data[0] - 1)) {
+      for (int Ix = 1, E = Code.Length; Ix < E; ++Ix) {
+        u64 Data = 0;
+        exi_try_r(Strm->readBits64(Data, Code.Bits[Ix]));
+        At += Data;
+        const u64 CData = Code.Data[Ix] - 1;
+        if EXI_UNLIKELY(Data > CData)
+          return Err(ErrorCode::kInvalidEXIInput);
+        if (Data != CData)
+          break;
+      }
+    }
+
+    const usize Ix = Info.Offset + At;
+    if EXI_UNLIKELY(Ix >= Builtin.Terms.size())
+      return Err(ErrorCode::kInvalidEXIInput);
+    return Builtin.Terms[Ix];
+  }
+
+  BuiltinGrammar* loadGrammar(ExiDecoder* D, SmallQName Name) {
+    exi_invariant(Name.isQName());
+    if (Name.URI >= BuiltinGrammars.size())
+      BuiltinGrammars.resize(Name.URI + 1);
+    auto& LNs = BuiltinGrammars[Name.URI];
+    if (Name.LocalID >= LNs.size())
+      LNs.resize(Name.LocalID + 1, nullptr);
+    if (BuiltinGrammar* G = LNs[Name.LocalID])
+      return G;
+
+    auto* G = new (Get::BP(D)) BuiltinGrammar(Name);
+    LNs[Name.LocalID] = G;
+    GrammarList.push_back(G);
+    return G;
+  }
+
+  /// Grammars are allocated with the decoder, which never destroys them.
+  void destroyGrammars() {
+    for (BuiltinGrammar* G : GrammarList)
+      G->~BuiltinGrammar();
+  }
+};
+
+/// Creates a schema generated by `exi-schemac`, with a reader matching the
+/// alignment of `Opts`.
+template <template <class> class SchemaT>
+Box<CompiledSchema> NewCompiledSchema(const ExiOptions& Opts,
+                                      bool IsFragment) {
+  Box<CompiledSchema> Out;
+  if (Opts.Alignment == AlignKind::BitPacked)
+    Out = std::make_unique<SchemaT<BitReader>>(Opts);
+  else
+    Out = std::make_unique<SchemaT<ByteReader>>(Opts);
+  Out->reset(IsFragment);
+  return Out;
+}
+
+} // namespace exi::decode
+
+#undef DEBUG_TYPE
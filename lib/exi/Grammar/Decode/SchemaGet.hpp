@@ -38,10 +38,30 @@ public:
   static StrmT* Reader(ExiDecoder* D) { return &cast<StrmT>(D->Reader); }
   static OrdReader& Reader(ExiDecoder* D) { return D->Reader; }
 
-  static auto DecodeQName(ExiDecoder* D) { return D->decodeQName(); }
-  static auto DecodeNS(ExiDecoder* D) { return D->decodeNS(); }
+  template <class StrmT>
+  static auto DecodeQName(ExiDecoder* D) {
+    return D->decodeQName(Reader<StrmT>(D));
+  }
+  template <class StrmT>
+  static auto DecodePfxQ(ExiDecoder* D, CompactID URI) {
+    return D->decodePfxQ(Reader<StrmT>(D), URI);
+  }
+  template <class StrmT>
+  static auto DecodeNS(ExiDecoder* D) {
+    return D->decodeNS(Reader<StrmT>(D));
+  }
+  template <class StrmT>
+  static auto DecodeName(ExiDecoder* D, CompactID URI) {
+    return D->decodeName(Reader<StrmT>(D), URI);
+  }
+  template <class StrmT>
   static auto DecodeValue(ExiDecoder* D, SmallQName Name) {
-    return D->decodeValue(Name);
+    return D->decodeValue(Reader<StrmT>(D), Name);
+  }
+  template <class StrmT>
+  static auto DecodeTypedValue(ExiDecoder* D, SmallQName Name,
+                               const SchemaTables& Schema, u32 Datatype) {
+    return D->decodeTypedValue(Reader<StrmT>(D), Name, Schema, Datatype);
   }
 };
 
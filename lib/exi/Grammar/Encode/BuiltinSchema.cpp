@@ -0,0 +1,472 @@
+//===- exi/Grammar/Encode/BuiltinSchema.cpp -------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the builtin schema used for encoding.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Grammar/EncoderSchema.hpp>
+#include <core/Common/DenseMap.hpp>
+#include <core/Common/EnumArray.hpp>
+#include <core/Common/PointerIntPair.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Support/Logging.hpp>
+#include <exi/Basic/ExiOptions.hpp>
+#include <exi/Decode/Serializer.hpp>
+#include <exi/Grammar/Grammar.hpp>
+#include <exi/Stream/OrderedWriter.hpp>
+#include "SchemaGet.hpp"
+#include "../BuiltinInfo.hpp"
+
+using namespace exi;
+using namespace exi::encode;
+
+#define DEBUG_TYPE "BuiltinSchema"
+
+#ifdef __clang__
+/// Keep debug information clean when using clang.
+# define INTERNAL_LINKAGE [[clang::internal_linkage]]
+# define INTERNAL_NS exi::encode
+#else
+# define INTERNAL_LINKAGE
+# define INTERNAL_NS
+#endif
+
+//===----------------------------------------------------------------===//
+// Built-in Grammar
+//===----------------------------------------------------------------===//
+
+/// The event codes are laid out identically to the decoder, see
+/// `Decode/BuiltinSchema.cpp`. Rather than walking the event code tree for
+/// each event, the code of every term is calculated when the schema is
+/// created. Learned productions are found with `BuiltinGrammar::findTerm`.
+
+namespace INTERNAL_NS {
+
+template <class StrmT>
+class INTERNAL_LINKAGE DynBuiltinSchema final : public BuiltinSchema {
+  using enum BuiltinSchema::Grammar;
+
+  /// The event codes of the terms in a grammar. Terms which don't appear in
+  /// the grammar have a length of 0.
+  using CodesT = EnumeratedArray<EventCode, EventTerm>;
+  using InfoT = EnumeratedArray<CodesT, Grammar, Last, DocContent>;
+  using GrammarT = PointerIntPair<BuiltinGrammar*, 1, bool>;
+
+  /// Contains the precalculated event codes.
+  InfoT Info;
+  /// The pseudo grammar stack.
+  BuiltinSchema::Grammar Current = Document;
+  /// The grammar stack.
+  SmallVec<GrammarT, 16> GStack;
+  /// The generated grammars.
+  DenseMap<SmallQName, BuiltinGrammar*> Grammars;
+  /// The learned SE(qname) productions of `Fragment`, most recent last.
+  SmallVec<SmallQName, 1> FragmentNames;
+  /// The number of builtin productions in the first part of `Fragment`.
+  u32 FragmentCount = 0;
+  /// The grammar after the root element ends.
+  BuiltinSchema::Grammar RootEnd = DocEnd;
+
+  DynBuiltinSchema() = default;
+
+public:
+  static Box<DynBuiltinSchema> New(const ExiOptions& Opts, bool IsFragment);
+  ~DynBuiltinSchema() override { this->destroyGrammars(); }
+
+  void reset() override {
+    this->destroyGrammars();
+    Grammars.clear();
+    GStack.clear();
+    FragmentNames.clear();
+    Current = Document;
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Encoding
+
+  ExiError encodeSE(ExiEncoder* E, const QName& Name) override {
+    using enum EventTerm;
+    switch (Current) {
+    case DocContent:
+      // The root element never learns productions.
+      exi_try(this->writeCode(E, SE));
+      this->pushElement(E, Get::EncodeQName<StrmT>(E, Name));
+      Current = StartTagContent;
+      return ExiError::OK;
+    case Fragment:
+      return this->encodeFragmentSE(E, Name);
+    case StartTagContent:
+    case ElementContent:
+      break;
+    default:
+      return this->invalidEvent(SE);
+    }
+
+    const bool IsStart = isStart();
+    BuiltinGrammar* G = GStack.back().getPointer();
+    auto& Idents = Get::Idents(E);
+
+    SmallQName ID;
+    if (auto Cached = this->findCachedQName(Idents, Name, SEQName)) {
+      ID = *Cached;
+      this->writeLearned(E, G, IsStart, SEQName, ID);
+      Get::EncodePfxQ<StrmT>(E, ID.URI, Name.Prefix);
+    } else {
+      exi_try(this->writeCode(E, SE));
+      ID = Get::EncodeQName<StrmT>(E, Name);
+      this->addTerm(G, IsStart, SEQName, ID);
+    }
+
+    this->pushElement(E, ID);
+    Current = StartTagContent;
+    return ExiError::OK;
+  }
+
+  ExiError encodeEE(ExiEncoder* E) override {
+    using enum EventTerm;
+    if EXI_UNLIKELY(GStack.empty())
+      return this->invalidEvent(EE);
+
+    BuiltinGrammar* G = GStack.back().getPointer();
+    if (Current == StartTagContent) {
+      if (!this->writeLearned(E, G, /*IsStart=*/true, EE)) {
+        exi_try(this->writeCode(E, EE));
+        this->addTerm(G, /*IsStart=*/true, EE, G->getName());
+      }
+    } else {
+      exi_invariant(Current == ElementContent);
+      // EE is never learned in ElementContent, as it always has one part.
+      exi_try(this->writeCode(E, EE));
+    }
+
+    this->popElement();
+    return ExiError::OK;
+  }
+
+  ExiError encodeAT(ExiEncoder* E, const QName& Name, StrRef Value) override {
+    using enum EventTerm;
+    if EXI_UNLIKELY(Current != StartTagContent)
+      return this->invalidEvent(AT);
+
+    BuiltinGrammar* G = GStack.back().getPointer();
+    auto& Idents = Get::Idents(E);
+
+    SmallQName ID;
+    if (auto Cached = this->findCachedQName(Idents, Name, ATQName)) {
+      ID = *Cached;
+      this->writeLearned(E, G, /*IsStart=*/true, ATQName, ID);
+      Get::EncodePfxQ<StrmT>(E, ID.URI, Name.Prefix);
+    } else {
+      exi_try(this->writeCode(E, AT));
+      ID = Get::EncodeQName<StrmT>(E, Name);
+      this->addTerm(G, /*IsStart=*/true, ATQName, ID);
+    }
+
+    // TODO: xsi:type
+    Get::EncodeValue<StrmT>(E, ID, Value);
+    return ExiError::OK;
+  }
+
+  ExiError encodeNS(ExiEncoder* E, StrRef URI, StrRef Pfx,
+                    bool IsLocal) override {
+    if EXI_UNLIKELY(Current != StartTagContent)
+      return this->invalidEvent(EventTerm::NS);
+    exi_try(this->writeCode(E, EventTerm::NS));
+    Get::EncodeNS<StrmT>(E, URI, Pfx, IsLocal);
+    return ExiError::OK;
+  }
+
+  ExiError encodeCH(ExiEncoder* E, StrRef Value) override {
+    using enum EventTerm;
+    if EXI_UNLIKELY(GStack.empty())
+      return this->invalidEvent(CH);
+
+    const bool IsStart = isStart();
+    BuiltinGrammar* G = GStack.back().getPointer();
+    if (!this->writeLearned(E, G, IsStart, CHExtern)) {
+      exi_try(this->writeCode(E, CH));
+      this->addTerm(G, IsStart, CHExtern, SmallQName::NewAny());
+    }
+
+    Get::EncodeValue<StrmT>(E, G->getName(), Value);
+    Current = ElementContent;
+    GStack.back().setInt(false);
+    return ExiError::OK;
+  }
+
+  ExiError encodeSC(ExiEncoder* E) override {
+    if EXI_UNLIKELY(Current != StartTagContent)
+      return this->invalidEvent(EventTerm::SC);
+    exi_try(this->writeCode(E, EventTerm::SC));
+    // The fragment includes the EE of the element, and SC is never learned.
+    this->popElement();
+    return ExiError::OK;
+  }
+
+  ExiError encodeTerm(ExiEncoder* E, EventTerm Term) override {
+    using enum EventTerm;
+    if (Term == SD) {
+      if EXI_UNLIKELY(Current != Document)
+        return this->invalidEvent(SD);
+      // Document only has a single production, so nothing is written.
+      Current = (RootEnd == Fragment) ? Fragment : DocContent;
+      return ExiError::OK;
+    } else if EXI_UNLIKELY(Current == Document)
+      return this->invalidEvent(Term);
+
+    exi_try(this->writeCode(E, Term));
+    if (Term == ED)
+      Current = Document;
+    else if (!GStack.empty()) {
+      // CM, PI and ER move StartTagContent to ElementContent.
+      Current = ElementContent;
+      GStack.back().setInt(false);
+    }
+    return ExiError::OK;
+  }
+
+  void dump() const override;
+
+private:
+  ALWAYS_INLINE bool isStart() const {
+    return (Current == StartTagContent);
+  }
+
+  EXI_COLD ExiError invalidEvent(EventTerm Term) const {
+    LOG_ERROR("{} is invalid in the current grammar.",
+      get_event_name(Term));
+    return ErrorCode::kInconsistentProcState;
+  }
+
+  /// Encodes a Start Element in `Fragment`. Learned productions come first,
+  /// with the most recent at 0.
+  ExiError encodeFragmentSE(ExiEncoder* E, const QName& Name) {
+    const auto& Idents = Get::Idents(E);
+    const u64 Learned = FragmentNames.size();
+    SmallQName ID;
+    if (auto Pos = this->findFragmentName(Idents, Name)) {
+      ID = FragmentNames[*Pos];
+      auto* Strm = Get::Writer<StrmT>(E);
+      Strm->writeBits64(Learned - *Pos - 1, this->getFragmentLog());
+      Get::EncodePfxQ<StrmT>(E, ID.URI, Name.Prefix);
+    } else {
+      exi_try(this->writeCode(E, EventTerm::SE));
+      ID = Get::EncodeQName<StrmT>(E, Name);
+      FragmentNames.push_back(ID);
+    }
+
+    this->pushElement(E, ID);
+    Current = StartTagContent;
+    return ExiError::OK;
+  }
+
+  /// Returns the position of `Name` in `FragmentNames`, if learned.
+  Option<usize> findFragmentName(const StringTable& Idents,
+                                 const QName& Name) const {
+    const Option<SmallQName> ID = Idents.findQName(Name.URI, Name.Name);
+    if (!ID)
+      return std::nullopt;
+    for (usize Ix = 0, E = FragmentNames.size(); Ix != E; ++Ix) {
+      if (FragmentNames[Ix] == *ID)
+        return Ix;
+    }
+    return std::nullopt;
+  }
+
+  /// Returns the width of the first part of `Fragment`.
+  u32 getFragmentLog() const {
+    return Log2_64_Ceil(FragmentNames.size() + FragmentCount);
+  }
+
+  /// Returns the IDs of `Name` if it has a learned production in the
+  /// current grammar.
+  Option<SmallQName> findCachedQName(const StringTable& Idents,
+                                     const QName& Name, EventTerm Term) {
+    const Option<SmallQName> ID = Idents.findQName(Name.URI, Name.Name);
+    if (!ID)
+      return std::nullopt;
+    BuiltinGrammar* G = GStack.back().getPointer();
+    if (!G->findTerm(Term, *ID, isStart()))
+      return std::nullopt;
+    return ID;
+  }
+
+  /// Writes the event code of a learned production.
+  /// @return `false` if the production has not been learned.
+  bool writeLearned(ExiEncoder* E, BuiltinGrammar* G, bool IsStart,
+                    EventTerm Term, SmallQName Name = SmallQName::NewAny()) {
+    const Option<u64> Code = G->findTerm(Term, Name, IsStart);
+    if (!Code)
+      return false;
+    auto* Strm = Get::Writer<StrmT>(E);
+    Strm->writeBits64(*Code, G->getLog(IsStart));
+    return true;
+  }
+
+  /// Writes the event code of a builtin term in the current grammar.
+  ExiError writeCode(ExiEncoder* E, EventTerm Term) {
+    const EventCode& Code = Info[Current][Term];
+    if EXI_UNLIKELY(Code.Length == 0)
+      return this->invalidEvent(Term);
+
+    auto* Strm = Get::Writer<StrmT>(E);
+    int Ix = 0;
+    if (Current == StartTagContent || Current == ElementContent) {
+      // The first part is shifted by the learned productions.
+      const bool IsStart = isStart();
+      BuiltinGrammar* G = GStack.back().getPointer();
+      Strm->writeBits64(G->size(IsStart) + Code.Data[0], G->getLog(IsStart));
+      Ix = 1;
+    } else if (Current == Fragment) {
+      // So is the first part of `Fragment`, by its SE(qname) productions.
+      Strm->writeBits64(FragmentNames.size() + Code.Data[0],
+                        this->getFragmentLog());
+      Ix = 1;
+    }
+
+    for (; Ix < Code.Length; ++Ix)
+      Strm->writeBits64(Code.Data[Ix], Code.Bits[Ix]);
+    return ExiError::OK;
+  }
+
+  void addTerm(BuiltinGrammar* G, bool IsStart,
+               EventTerm Term, SmallQName Name) {
+    EventUID Event = EventUID::NewNull();
+    Event.setTerm(Term);
+    Event.Name = Name;
+    G->addTerm(Event, IsStart);
+  }
+
+  void pushElement(ExiEncoder* E, SmallQName Name) {
+    BuiltinGrammar*& G = Grammars[Name];
+    if (!G)
+      G = new (Get::BP(E)) BuiltinGrammar(Name);
+    GStack.emplace_back(G, /*IsStart=*/true);
+  }
+
+  void popElement() {
+    GStack.pop_back();
+    if EXI_LIKELY(!GStack.empty()) {
+      Current = ElementContent;
+      GStack.back().setInt(false);
+    } else
+      Current = RootEnd;
+  }
+
+  /// Grammars are allocated with the encoder, which never destroys them.
+  /// Their productions may live on the heap, so destroy them here.
+  void destroyGrammars() {
+    for (auto& Entry : Grammars)
+      Entry.second->~BuiltinGrammar();
+  }
+
+  /// Calculates the event code of the term at `Ix` in a grammar.
+  static EventCode MakeCode(const SEventCode& C, unsigned Ix);
+};
+
+} // namespace INTERNAL_NS
+
+template <class StrmT>
+EventCode DynBuiltinSchema<StrmT>::MakeCode(const SEventCode& C, unsigned Ix) {
+  EventCode Out;
+  unsigned Acc = 0;
+  for (int Level = 0; Level < C.Length; ++Level) {
+    Out.Bits[Level] = C.Bits[Level];
+    Out.Length = Level + 1;
+    // Only the first level may be empty, it is never written.
+    if (C.Data[Level] == 0)
+      continue;
+
+    // The last value of each level continues to the next.
+    const unsigned CData = C.Data[Level] - 1;
+    if (Ix - Acc < CData || Level + 1 == C.Length) {
+      Out.Data[Level] = Ix - Acc;
+      break;
+    }
+
+    Out.Data[Level] = CData;
+    Acc += CData;
+  }
+  return Out;
+}
+
+template <class StrmT>
+Box<DynBuiltinSchema<StrmT>>
+    DynBuiltinSchema<StrmT>::New(const ExiOptions& Opts, bool IsFragment) {
+  BuiltinBuilder B(Opts);
+  B.init();
+
+  Box<DynBuiltinSchema> Schema(new DynBuiltinSchema);
+  exi_assert(B.Info.size() == Schema->Info.size());
+
+  for (auto [Ix, Codes] : exi::enumerate(Schema->Info)) {
+    const BIInfo& Info = B.Info[Ix];
+    const usize End = (Ix + 1 < B.Info.size())
+      ? B.Info[Ix + 1].Offset : B.Terms.size();
+    for (usize Off = Info.Offset; Off < End; ++Off) {
+      const EventTerm Term = B.Terms[Off];
+      Codes[Term] = MakeCode(Info.Code, Off - Info.Offset);
+    }
+  }
+
+  // Fragment is the last grammar.
+  Schema->FragmentCount = B.Info.back().Code.Data[0];
+  Schema->RootEnd = IsFragment ? Fragment : DocEnd;
+  Schema->reset();
+  return Schema;
+}
+
+template <class StrmT>
+void DynBuiltinSchema<StrmT>::dump() const {
+  for (auto [Ix, Codes] : exi::enumerate(Info)) {
+    outs() << "Grammar[" << (Ix + 1) << "]:\n";
+    for (auto [Term, Code] : exi::enumerate(Codes)) {
+      if (Code.Length == 0)
+        continue;
+      outs() << "  " << get_event_name(EventTerm(Term)) << "  ";
+      for (int Level = 0; Level < Code.Length; ++Level) {
+        if (Level != 0)
+          outs() << '.';
+        outs() << Code.Data[Level];
+      }
+      outs() << '\n';
+    }
+  }
+  outs().flush();
+}
+
+Box<BuiltinSchema> BuiltinSchema::New(const ExiOptions& Opts,
+                                       bool IsFragment) {
+  const AlignKind A = Opts.Alignment;
+  if (A == AlignKind::BitPacked)
+    return DynBuiltinSchema<BitWriter>::New(Opts, IsFragment);
+  // Channels are byte-aligned, with or without compression.
+  return DynBuiltinSchema<ByteWriter>::New(Opts, IsFragment);
+}
+
+//===----------------------------------------------------------------===//
+// Miscellaneous
+//===----------------------------------------------------------------===//
+
+void Schema::anchor() {}
+void BuiltinSchema::anchor() {}
+
+const char Schema::ID = 0;
+const char BuiltinSchema::ID = 0;
@@ -0,0 +1,59 @@
+//===- exi/Grammar/Encode/SchemaGet.hpp -----------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the Schema::Get class, which exposes processor internals.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Support/Casting.hpp>
+#include <exi/Grammar/Schema.hpp>
+#include <exi/Encode/BodyEncoder.hpp>
+
+namespace exi::encode {
+
+class Schema::Get {
+public:
+  static BumpPtrAllocator& BP(ExiEncoder* E) { return E->BP; }
+  static encode::StringTable& Idents(ExiEncoder* E) { return E->Idents; }
+
+  template <class StrmT>
+  static StrmT* Writer(ExiEncoder* E) { return &cast<StrmT>(E->Writer); }
+  static OrdWriter& Writer(ExiEncoder* E) { return E->Writer; }
+
+  template <class StrmT>
+  static auto EncodeQName(ExiEncoder* E, const QName& Name) {
+    return E->encodeQName(Writer<StrmT>(E), Name);
+  }
+  template <class StrmT>
+  static auto EncodePfxQ(ExiEncoder* E, CompactID URI, StrRef Pfx) {
+    return E->encodePfxQ(Writer<StrmT>(E), URI, Pfx);
+  }
+  template <class StrmT>
+  static auto EncodeNS(ExiEncoder* E, StrRef URI, StrRef Pfx, bool IsLocal) {
+    return E->encodeNS(Writer<StrmT>(E), URI, Pfx, IsLocal);
+  }
+  template <class StrmT>
+  static auto EncodeValue(ExiEncoder* E, SmallQName Name, StrRef Value) {
+    return E->encodeValue(Writer<StrmT>(E), Name, Value);
+  }
+};
+
+} // namespace exi::encode
@@ -70,6 +70,22 @@ void BuiltinGrammar::setLog(bool IsStart) {
   }
 }
 
+Option<u64> BuiltinGrammar::findTerm(EventTerm Term, SmallQName Name,
+                                     bool IsStart) const {
+  const bool HasName = (Term == EventTerm::SEQName)
+                    || (Term == EventTerm::ATQName);
+  auto& Elts = this->getElts(IsStart);
+  // Search from the most recent production, which has the lowest code.
+  for (usize Code = 0, Size = Elts.size(); Code != Size; ++Code) {
+    const EventUID& Elt = Elts[Size - 1 - Code];
+    if (Elt.getTerm() != Term)
+      continue;
+    if (!HasName || Elt.Name == Name)
+      return Code;
+  }
+  return std::nullopt;
+}
+
 void BuiltinGrammar::dump(ExiDecoder* D) const {
   outs() << "StartTag:\n";
   for (auto [Ix, Val] : exi::enumerate(exi::reverse(this->StartTag))) {
@@ -0,0 +1,1163 @@
+//===- exi/Grammar/SchemaBuilder.cpp --------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements building schema-informed grammars from a loaded
+/// `xsd::Model`.
+///
+/// Each type is converted into an NFA following the proto-grammars of
+/// Section 8.5.4.1, which is then made deterministic by subset construction.
+/// Only the declared productions are stored. The undeclared productions of
+/// Section 8.5.4.4 depend on the options of a stream, so they are computed
+/// while decoding.
+///
+//===----------------------------------------------------------------===//
+
+#include "XSDModel.hpp"
+#include <core/Common/STLExtras.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Support/Logging.hpp>
+#include <core/Support/MathExtras.hpp>
+#include <exi/Basic/Runes.hpp>
+#include <algorithm>
+#include <map>
+
+using namespace exi;
+using namespace exi::xsd;
+
+#define DEBUG_TYPE "SchemaBuilder"
+
+/// Bounded repetitions are unrolled, so very large grammars are rejected.
+static constexpr usize kMaxNFANodes = 1u << 20;
+/// The maximum nesting of group references.
+static constexpr usize kMaxGroupDepth = 64;
+/// Restricted character sets are only used with at most this many
+/// characters, see Section 7.1.10.1.
+static constexpr usize kMaxCharSet = 255;
+/// Integers with ranges this small use the n-bit representation.
+static constexpr u64 kMaxNBitRange = 4096;
+
+//===----------------------------------------------------------------===//
+// Patterns
+//===----------------------------------------------------------------===//
+
+/// Computes the set of characters a regular expression may match, or
+/// nothing if the set is too large to be restricted.
+static bool AddPatternChars(StrRef Pattern, SmallVecImpl<u32>& Out) {
+  SmallVec<u32, 32> Runes;
+  for (Rune C : RuneDecoder(Pattern))
+    Runes.push_back(C);
+
+  auto AddRange = [&Out] (u32 Lo, u32 Hi) {
+    if (Hi < Lo || (Hi - Lo) >= kMaxCharSet)
+      return false;
+    for (u32 C = Lo; C <= Hi; ++C)
+      Out.push_back(C);
+    return Out.size() <= kMaxCharSet * 4;
+  };
+
+  const usize E = Runes.size();
+  /// Reads an escape after the backslash at `Ix`. Returns false for
+  /// multi-character escapes, which are unrestricted.
+  auto ReadEscape = [&] (usize& Ix, Option<u32>& Char) -> bool {
+    if (++Ix >= E)
+      return false;
+    switch (Runes[Ix]) {
+    case 'n': Char = '\n'; return true;
+    case 'r': Char = '\r'; return true;
+    case 't': Char = '\t'; return true;
+    case 's':
+      Char = std::nullopt;
+      Out.append({0x9, 0xA, 0xD, 0x20});
+      return true;
+    case 'S': case 'i': case 'I': case 'c': case 'C':
+    case 'd': case 'D': case 'w': case 'W': case 'p': case 'P':
+      return false;
+    default:
+      Char = Runes[Ix];
+      return true;
+    }
+  };
+
+  for (usize Ix = 0; Ix < E; ++Ix) {
+    const u32 C = Runes[Ix];
+    switch (C) {
+    case '.':
+      return false;
+    case '(': case ')': case '|': case '?': case '*': case '+':
+      continue;
+    case '{':
+      // Skip quantifiers.
+      while (Ix < E && Runes[Ix] != '}')
+        ++Ix;
+      continue;
+    case '\\': {
+      Option<u32> Char;
+      if (!ReadEscape(Ix, Char))
+        return false;
+      if (Char)
+        Out.push_back(*Char);
+      continue;
+    }
+    case '[':
+      break;
+    default:
+      Out.push_back(C);
+      continue;
+    }
+
+    // Character class.
+    if (++Ix < E && Runes[Ix] == '^')
+      return false;
+    for (; Ix < E && Runes[Ix] != ']'; ++Ix) {
+      Option<u32> Lo;
+      if (Runes[Ix] == '\\') {
+        if (!ReadEscape(Ix, Lo))
+          return false;
+      } else if (Runes[Ix] == '-' && Ix + 1 < E && Runes[Ix + 1] == '[')
+        // Subtractions are unrestricted.
+        return false;
+      else
+        Lo = Runes[Ix];
+
+      if (!Lo)
+        continue;
+      if (Ix + 2 < E && Runes[Ix + 1] == '-' && Runes[Ix + 2] != ']'
+          && Runes[Ix + 2] != '[') {
+        Ix += 2;
+        Option<u32> Hi = Runes[Ix];
+        if (Runes[Ix] == '\\' && (!ReadEscape(Ix, Hi) || !Hi))
+          return false;
+        if (!AddRange(*Lo, *Hi))
+          return false;
+      } else
+        Out.push_back(*Lo);
+    }
+  }
+
+  return true;
+}
+
+//===----------------------------------------------------------------===//
+// Builder
+//===----------------------------------------------------------------===//
+
+namespace {
+
+/// An attribute use of an effective type.
+struct EffAttr {
+  XName Name;
+  u32 Datatype = 0;
+  bool Required = false;
+};
+
+/// A complex type with its derivation applied.
+struct EffType {
+  /// Sorted by event code order.
+  Vec<EffAttr> Attrs;
+  Option<Wildcard> AnyAttr;
+  Option<Particle> Content;
+  bool Mixed = false;
+  /// The datatype of simple content.
+  Option<u32> SimpleDT;
+};
+
+/// A transition of the NFA.
+struct NEdge {
+  EventTerm Term;
+  XName Name;
+  /// The element of `SEQName`, or the datatype of `ATQName` and `CH`.
+  u32 Target = 0;
+  /// The schema order of `SEQName` and `SEUri`.
+  u32 Order = 0;
+  u32 To = 0;
+};
+
+struct NNode {
+  SmallVec<NEdge, 2> Edges;
+  SmallVec<u32, 2> Eps;
+  bool Final = false;
+};
+
+/// A production before event codes are assigned.
+struct ProtoProd {
+  NEdge Edge;
+  Vec<u32> To;
+};
+
+class GrammarBuilder {
+  const Model& M;
+  SchemaTableData D;
+
+  /// The URI partitions, in order.
+  Vec<StrRef> URIs;
+  std::map<StrRef, u32> URIIndex;
+  /// The sorted LocalNames of each URI.
+  Vec<Vec<StrRef>> Names;
+
+  /// The datatype of each type, or `kNone` if not yet created.
+  Vec<u32> TypeDatatypes;
+  Vec<Option<EffType>> EffTypes;
+  Vec<bool> InProgress;
+  /// The direct substitution group members of each global element.
+  Vec<SmallVec<u32, 2>> SubstMembers;
+
+  // NFA state
+
+  Vec<NNode> Nodes;
+  u32 NextOrder = 0;
+  u32 AnyTypeIx = 0;
+public:
+  explicit GrammarBuilder(const Model& M) : M(M) {}
+  Expected<SchemaGrammarsRef> build();
+
+private:
+  void buildStrings();
+  SchemaQName getQName(const XName& Name) const;
+  u32 getURI(StrRef URI) const { return URIIndex.at(URI); }
+
+  /// Gets the next type in the derivation of simple values.
+  u32 getSimpleBase(u32 Ix) const;
+  u32 getDatatype(u32 TypeIx);
+  u32 createDatatype(u32 TypeIx);
+  Expected<const EffType*> getEffType(u32 TypeIx);
+  Error addAttrUses(ArrayRef<AttrUse> Uses, ArrayRef<XName> Groups,
+                    Vec<EffAttr>& Attrs, Option<Wildcard>& AnyAttr,
+                    usize Depth = 0);
+
+  Error buildTypes();
+  Error buildGrammar(u32 TypeIx, const EffType& E, bool IsEmpty, u32& Start);
+  void buildElements();
+
+  // NFA
+
+  u32 addNode() {
+    Nodes.emplace_back();
+    return u32(Nodes.size() - 1);
+  }
+  void addEdge(u32 From, NEdge Edge) {
+    Nodes[From].Edges.push_back(std::move(Edge));
+  }
+  void addEps(u32 From, u32 To) {
+    if (From != To)
+      Nodes[From].Eps.push_back(To);
+  }
+  Expected<u32> addParticle(const Particle& P, u32 From, usize Depth);
+  Expected<u32> addTerm(const Particle& P, u32 From, usize Depth);
+  void addSubstitutions(u32 Global, SmallVecImpl<u32>& Out);
+  void closure(Vec<u32>& Set) const;
+};
+
+} // namespace `anonymous`
+
+//////////////////////////////////////////////////////////////////////////
+// Strings
+
+void GrammarBuilder::buildStrings() {
+  // D.1 - Initial Entries in Uri Partition
+  URIs = {""_str, XML_URI, XSI_URI, XSD_URI};
+  Names.resize(4);
+  Names[1] = {"base", "id", "lang", "space"};
+  Names[2] = {"nil", "type"};
+
+  auto AddName = [this] (const XName& Name) {
+    auto [It, Inserted] = URIIndex.try_emplace(Name.URI, URIs.size());
+    if (Inserted) {
+      URIs.push_back(Name.URI);
+      Names.emplace_back();
+    }
+    if (!Name.Local.empty())
+      Names[It->second].push_back(Name.Local);
+  };
+
+  for (auto [Ix, URI] : exi::enumerate(ArrayRef(URIs)))
+    URIIndex[URI] = Ix;
+  // D.3 - Initial Entries in LocalName Partitions
+  for (const TypeDef& T : M.Types) {
+    if (!T.Name.empty())
+      AddName(T.Name);
+  }
+  for (const ElementDecl& E : M.Elements)
+    AddName(E.Name);
+  for (const AttrDecl& A : M.Attrs)
+    AddName(A.Name);
+  for (StrRef URI : M.WildcardURIs)
+    AddName({URI, ""_str});
+
+  // URIs besides the initial entries are sorted.
+  Vec<StrRef> Sorted(URIs.begin() + 4, URIs.end());
+  std::sort(Sorted.begin(), Sorted.end());
+  Vec<Vec<StrRef>> OldNames = std::move(Names);
+  Names.assign(URIs.size(), {});
+  for (u32 Ix = 0; Ix < 4; ++Ix)
+    Names[Ix] = std::move(OldNames[Ix]);
+  for (auto [Ix, URI] : exi::enumerate(Sorted)) {
+    const u32 Old = URIIndex[URI];
+    URIs[Ix + 4] = URI;
+    Names[Ix + 4] = std::move(OldNames[Old]);
+  }
+  for (auto [Ix, URI] : exi::enumerate(ArrayRef(URIs)))
+    URIIndex[URI] = Ix;
+
+  for (auto [URI, Partition] : exi::zip(URIs, Names)) {
+    std::sort(Partition.begin(), Partition.end());
+    Partition.erase(std::unique(Partition.begin(), Partition.end()),
+                    Partition.end());
+
+    SchemaURI Info;
+    Info.Name = D.addStr(URI);
+    Info.FirstName = D.LocalNames.size();
+    Info.NNames = Partition.size();
+    for (StrRef Local : Partition)
+      D.LocalNames.push_back(D.addStr(Local));
+    D.URIs.push_back(Info);
+  }
+}
+
+SchemaQName GrammarBuilder::getQName(const XName& Name) const {
+  const u32 URI = getURI(Name.URI);
+  ArrayRef<StrRef> Partition = Names[URI];
+  auto It = std::lower_bound(Partition.begin(), Partition.end(), Name.Local);
+  exi_invariant(It != Partition.end() && *It == Name.Local);
+  return {URI, u32(It - Partition.begin())};
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Datatypes
+
+u32 GrammarBuilder::getSimpleBase(u32 Ix) const {
+  const TypeDef& T = M.Types[Ix];
+  if (!T.Complex)
+    return T.Base;
+  if (!T.SimpleContent)
+    return kNone;
+  if (!T.Extension && T.SimpleType != kNone)
+    return T.SimpleType;
+  return T.Base;
+}
+
+u32 GrammarBuilder::getDatatype(u32 TypeIx) {
+  if (TypeIx == kNone)
+    return 0;
+  u32& DT = TypeDatatypes[TypeIx];
+  if (DT == kNone) {
+    // Set early to break cycles.
+    DT = 0;
+    const u32 Out = createDatatype(TypeIx);
+    TypeDatatypes[TypeIx] = Out;
+    return Out;
+  }
+  return DT;
+}
+
+u32 GrammarBuilder::createDatatype(u32 TypeIx) {
+  Option<Variety> Var;
+  Option<Primitive> Prim;
+  u32 Item = kNone;
+  ArrayRef<StrRef> Enums, Patterns;
+  Option<i64> Min, Max;
+
+  // Walk the derivation, keeping the nearest facets.
+  u32 Cur = TypeIx;
+  for (usize Depth = 0; Cur != kNone && Depth <= M.Types.size(); ++Depth) {
+    const TypeDef& T = M.Types[Cur];
+    if (!Var) {
+      if (T.Var != Variety::Atomic) {
+        Var = T.Var;
+        Item = T.Item;
+      } else if (T.Prim) {
+        Var = Variety::Atomic;
+        Prim = T.Prim;
+      }
+    }
+    if (Enums.empty())
+      Enums = T.Enums;
+    if (Patterns.empty())
+      Patterns = T.Patterns;
+    if (T.Min)
+      Min = Min ? std::max(*Min, *T.Min) : *T.Min;
+    if (T.Max)
+      Max = Max ? std::min(*Max, *T.Max) : *T.Max;
+    Cur = getSimpleBase(Cur);
+  }
+
+  SchemaDatatype DT;
+  if (Var == Variety::List) {
+    DT.Kind = SchemaValueKind::List;
+    DT.First = getDatatype(Item);
+    D.Datatypes.push_back(DT);
+    return u32(D.Datatypes.size() - 1);
+  } else if (Var != Variety::Atomic || !Prim) {
+    // Unions are represented as strings.
+    return 0;
+  }
+
+  if (!Enums.empty() && *Prim != Primitive::QName) {
+    DT.Kind = SchemaValueKind::Enumeration;
+    DT.First = D.EnumValues.size();
+    DT.Count = Enums.size();
+    DT.Bits = Log2_32_Ceil(DT.Count);
+    for (StrRef Value : Enums) {
+      if (*Prim != Primitive::String)
+        Value = Value.trim();
+      D.EnumValues.push_back(D.addStr(Value));
+    }
+    D.Datatypes.push_back(DT);
+    return u32(D.Datatypes.size() - 1);
+  }
+
+  using enum Primitive;
+  switch (*Prim) {
+  case String: {
+    SmallVec<u32, 32> Chars;
+    for (StrRef Pattern : Patterns) {
+      if (!AddPatternChars(Pattern, Chars)) {
+        Chars.clear();
+        break;
+      }
+    }
+    std::sort(Chars.begin(), Chars.end());
+    Chars.erase(std::unique(Chars.begin(), Chars.end()), Chars.end());
+    if (Chars.empty() || Chars.size() > kMaxCharSet)
+      return 0;
+    DT.Kind = SchemaValueKind::String;
+    DT.First = D.CharSets.size();
+    DT.Count = Chars.size();
+    D.CharSets.insert(D.CharSets.end(), Chars.begin(), Chars.end());
+    break;
+  }
+  case QName:
+    return 0;
+  case Boolean:
+    DT.Kind = SchemaValueKind::Boolean;
+    DT.Bits = Patterns.empty() ? 1 : 2;
+    break;
+  case Decimal:
+    DT.Kind = SchemaValueKind::Decimal;
+    break;
+  case Float:
+    DT.Kind = SchemaValueKind::Float;
+    break;
+  case Integer:
+    if (Min && Max && *Max >= *Min
+        && u64(*Max) - u64(*Min) < kMaxNBitRange) {
+      DT.Kind = SchemaValueKind::NBitUnsigned;
+      DT.Bits = Log2_64_Ceil(u64(*Max) - u64(*Min) + 1);
+      DT.Min = *Min;
+    } else if (Min && *Min >= 0)
+      DT.Kind = SchemaValueKind::Unsigned;
+    else
+      DT.Kind = SchemaValueKind::Integer;
+    break;
+  case Binary:
+    DT.Kind = SchemaValueKind::Binary;
+    break;
+  case HexBinary:
+    DT.Kind = SchemaValueKind::HexBinary;
+    break;
+  case DateTime:
+    DT.Kind = SchemaValueKind::DateTime;
+    break;
+  case Time:
+    DT.Kind = SchemaValueKind::Time;
+    break;
+  case Date:
+    DT.Kind = SchemaValueKind::Date;
+    break;
+  case GYearMonth:
+    DT.Kind = SchemaValueKind::GYearMonth;
+    break;
+  case GYear:
+    DT.Kind = SchemaValueKind::GYear;
+    break;
+  case GMonthDay:
+    DT.Kind = SchemaValueKind::GMonthDay;
+    break;
+  case GDay:
+    DT.Kind = SchemaValueKind::GDay;
+    break;
+  case GMonth:
+    DT.Kind = SchemaValueKind::GMonth;
+    break;
+  }
+
+  D.Datatypes.push_back(DT);
+  return u32(D.Datatypes.size() - 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Effective Types
+
+Error GrammarBuilder::addAttrUses(ArrayRef<AttrUse> Uses,
+                                  ArrayRef<XName> Groups,
+                                  Vec<EffAttr>& Attrs,
+                                  Option<Wildcard>& AnyAttr,
+                                  usize Depth) {
+  if (Depth > kMaxGroupDepth)
+    return createStringError("attribute groups nested too deeply");
+
+  for (const AttrUse& Use : Uses) {
+    u32 Ix = Use.Attr;
+    if (Ix == kNone) {
+      Option<u32> Global = Model::Find(M.AttrNames, Use.Ref);
+      if (!Global) {
+        LOG_WARN("Undeclared attribute '{{{}}}{}', ignoring",
+                 Use.Ref.URI, Use.Ref.Local);
+        continue;
+      }
+      Ix = *Global;
+    }
+
+    const AttrDecl& A = M.Attrs[Ix];
+    auto It = exi::find_if(Attrs,
+      [&A] (const EffAttr& Other) { return Other.Name == A.Name; });
+    if (Use.Prohibited) {
+      if (It != Attrs.end())
+        Attrs.erase(It);
+      continue;
+    }
+
+    const EffAttr Eff {A.Name, getDatatype(A.Type), Use.Required};
+    if (It != Attrs.end())
+      *It = Eff;
+    else
+      Attrs.push_back(Eff);
+  }
+
+  for (const XName& Name : Groups) {
+    Option<u32> Ix = Model::Find(M.AttrGroupNames, Name);
+    if (!Ix) {
+      LOG_WARN("Undeclared attribute group '{{{}}}{}', ignoring",
+               Name.URI, Name.Local);
+      continue;
+    }
+    const AttrGroupDef& G = M.AttrGroups[*Ix];
+    if (Error E = addAttrUses(G.Attrs, G.AttrGroups, Attrs, AnyAttr,
+                              Depth + 1))
+      return E;
+    if (G.AnyAttr) {
+      if (AnyAttr)
+        AnyAttr->merge(*G.AnyAttr);
+      else
+        AnyAttr = G.AnyAttr;
+    }
+  }
+
+  return Error::success();
+}
+
+Expected<const EffType*> GrammarBuilder::getEffType(u32 TypeIx) {
+  if (EffTypes[TypeIx])
+    return &*EffTypes[TypeIx];
+  if (InProgress[TypeIx])
+    return createStringError("circular derivation of type #{}", TypeIx);
+  InProgress[TypeIx] = true;
+
+  const TypeDef& T = M.Types[TypeIx];
+  EffType E;
+
+  if (!T.Complex) {
+    E.SimpleDT = getDatatype(TypeIx);
+  } else if (T.Builtin) {
+    // anyType
+    E.AnyAttr = T.AnyAttr;
+    E.Content = T.Content;
+    E.Mixed = true;
+  } else {
+    const EffType* Base = nullptr;
+    if (T.Base != kNone && M.Types[T.Base].Complex) {
+      auto BaseOrErr = getEffType(T.Base);
+      if (!BaseOrErr)
+        return BaseOrErr.takeError();
+      Base = *BaseOrErr;
+    }
+
+    if (Base) {
+      E.Attrs = Base->Attrs;
+      if (T.Extension)
+        E.AnyAttr = Base->AnyAttr;
+    }
+
+    if (T.SimpleContent) {
+      E.SimpleDT = getDatatype(TypeIx);
+    } else if (T.Extension && Base) {
+      E.Mixed = T.Mixed || Base->Mixed;
+      if (!Base->Content)
+        E.Content = T.Content;
+      else if (!T.Content)
+        E.Content = Base->Content;
+      else {
+        Particle Seq;
+        Seq.Kind = ParticleKind::Sequence;
+        Seq.Children.push_back(*Base->Content);
+        Seq.Children.push_back(*T.Content);
+        E.Content = std::move(Seq);
+      }
+    } else {
+      E.Mixed = T.Mixed;
+      E.Content = T.Content;
+    }
+
+    Option<Wildcard> OwnAny = T.AnyAttr;
+    if (Error Err = addAttrUses(T.Attrs, T.AttrGroups, E.Attrs, OwnAny))
+      return std::move(Err);
+    if (OwnAny) {
+      if (E.AnyAttr)
+        E.AnyAttr->merge(*OwnAny);
+      else
+        E.AnyAttr = std::move(OwnAny);
+    }
+  }
+
+  // Section 8.5.4.1.3.1 - Attribute uses are sorted by qname.
+  std::stable_sort(E.Attrs.begin(), E.Attrs.end(),
+    [] (const EffAttr& L, const EffAttr& R) { return L.Name < R.Name; });
+
+  InProgress[TypeIx] = false;
+  EffTypes[TypeIx] = std::move(E);
+  return &*EffTypes[TypeIx];
+}
+
+//////////////////////////////////////////////////////////////////////////
+// NFA
+
+void GrammarBuilder::addSubstitutions(u32 Global, SmallVecImpl<u32>& Out) {
+  if (exi::is_contained(Out, Global))
+    return;
+  Out.push_back(Global);
+  for (u32 Member : SubstMembers[Global])
+    addSubstitutions(Member, Out);
+}
+
+Expected<u32> GrammarBuilder::addTerm(const Particle& P, u32 From,
+                                      usize Depth) {
+  if (Nodes.size() > kMaxNFANodes)
+    return createStringError("content model is too large");
+
+  switch (P.Kind) {
+  case ParticleKind::Element: {
+    const u32 To = addNode();
+    addEdge(From, {EventTerm::SEQName, M.Elements[P.Element].Name,
+                   P.Element, NextOrder++, To});
+    return To;
+  }
+  case ParticleKind::ElementRef: {
+    Option<u32> Global = Model::Find(M.ElementNames, P.Ref);
+    if (!Global) {
+      LOG_WARN("Undeclared element '{{{}}}{}', ignoring",
+               P.Ref.URI, P.Ref.Local);
+      return From;
+    }
+    // Section 8.5.4.1.6 - The head and members of a substitution group
+    // share a position, and are sorted by qname.
+    SmallVec<u32, 4> Members;
+    addSubstitutions(*Global, Members);
+    const u32 To = addNode();
+    const u32 Order = NextOrder++;
+    for (u32 Ix : Members) {
+      const ElementDecl& E = M.Elements[Ix];
+      if (!E.Abstract)
+        addEdge(From, {EventTerm::SEQName, E.Name, Ix, Order, To});
+    }
+    return To;
+  }
+  case ParticleKind::Wildcard: {
+    const u32 To = addNode();
+    const u32 Order = NextOrder++;
+    if (P.WC.Any)
+      addEdge(From, {EventTerm::SE, XName(), 0, Order, To});
+    else {
+      for (StrRef URI : P.WC.URIs)
+        addEdge(From, {EventTerm::SEUri, XName{URI, ""}, 0, Order, To});
+    }
+    return To;
+  }
+  case ParticleKind::Sequence: {
+    u32 Cur = From;
+    for (const Particle& Child : P.Children) {
+      auto Next = addParticle(Child, Cur, Depth);
+      if (!Next)
+        return Next.takeError();
+      Cur = *Next;
+    }
+    return Cur;
+  }
+  case ParticleKind::Choice: {
+    if (P.Children.empty())
+      return From;
+    const u32 To = addNode();
+    for (const Particle& Child : P.Children) {
+      auto End = addParticle(Child, From, Depth);
+      if (!End)
+        return End.takeError();
+      addEps(*End, To);
+    }
+    return To;
+  }
+  case ParticleKind::All: {
+    // Approximated as a repeated choice, as in Section 8.5.4.1.8.3.
+    const u32 Loop = addNode();
+    addEps(From, Loop);
+    for (const Particle& Child : P.Children) {
+      auto End = addParticle(Child, Loop, Depth);
+      if (!End)
+        return End.takeError();
+      addEps(*End, Loop);
+    }
+    return Loop;
+  }
+  case ParticleKind::GroupRef: {
+    if (Depth >= kMaxGroupDepth)
+      return createStringError("group '{}' nested too deeply", P.Ref.Local);
+    Option<u32> Ix = Model::Find(M.GroupNames, P.Ref);
+    if (!Ix) {
+      LOG_WARN("Undeclared group '{{{}}}{}', ignoring",
+               P.Ref.URI, P.Ref.Local);
+      return From;
+    }
+    return addParticle(M.Groups[*Ix].Content, From, Depth + 1);
+  }
+  }
+  exi_unreachable("invalid particle kind");
+}
+
+Expected<u32> GrammarBuilder::addParticle(const Particle& P, u32 From,
+                                          usize Depth) {
+  if (P.Max == 0)
+    return From;
+
+  u32 Cur = From;
+  for (u64 Ix = 0; Ix < P.Min; ++Ix) {
+    auto Next = addTerm(P, Cur, Depth);
+    if (!Next)
+      return Next.takeError();
+    Cur = *Next;
+  }
+
+  if (P.Max == kUnbounded) {
+    auto End = addTerm(P, Cur, Depth);
+    if (!End)
+      return End.takeError();
+    addEps(*End, Cur);
+    return Cur;
+  }
+
+  if (P.Max == P.Min)
+    return Cur;
+
+  const u32 Join = addNode();
+  for (u64 Ix = P.Min; Ix < P.Max; ++Ix) {
+    addEps(Cur, Join);
+    auto Next = addTerm(P, Cur, Depth);
+    if (!Next)
+      return Next.takeError();
+    Cur = *Next;
+  }
+  addEps(Cur, Join);
+  return Join;
+}
+
+void GrammarBuilder::closure(Vec<u32>& Set) const {
+  for (usize Ix = 0; Ix < Set.size(); ++Ix) {
+    for (u32 To : Nodes[Set[Ix]].Eps) {
+      if (!exi::is_contained(Set, To))
+        Set.push_back(To);
+    }
+  }
+  std::sort(Set.begin(), Set.end());
+}
+
+/// The position of a term in the event code order of Section 8.5.4.3.
+static int GetTermRank(EventTerm Term) {
+  using enum EventTerm;
+  switch (Term) {
+  case ATQName: return 0;
+  case ATUri:   return 1;
+  case AT:      return 2;
+  case SEQName: return 3;
+  case SEUri:   return 4;
+  case SE:      return 5;
+  case EE:      return 6;
+  case CH:      return 7;
+  default:
+    exi_unreachable("invalid schema production");
+  }
+}
+
+static bool IsAttrTerm(EventTerm Term) {
+  using enum EventTerm;
+  return Term == AT || Term == ATUri || Term == ATQName;
+}
+
+Error GrammarBuilder::buildGrammar(u32 TypeIx, const EffType& E,
+                                   bool IsEmpty, u32& Start) {
+  Nodes.clear();
+  NextOrder = 0;
+
+  // Attributes, Section 8.5.4.1.4.
+  SmallVec<u32, 8> AttrNodes;
+  u32 Cur = addNode();
+  AttrNodes.push_back(Cur);
+  for (const EffAttr& A : E.Attrs) {
+    const u32 Next = addNode();
+    addEdge(Cur, {EventTerm::ATQName, A.Name, A.Datatype, 0, Next});
+    if (!A.Required)
+      addEps(Cur, Next);
+    AttrNodes.push_back(Cur = Next);
+  }
+  if (E.AnyAttr) {
+    for (u32 Node : AttrNodes) {
+      if (E.AnyAttr->Any)
+        addEdge(Node, {EventTerm::AT, XName(), 0, 0, Node});
+      else {
+        for (StrRef URI : E.AnyAttr->URIs)
+          addEdge(Node, {EventTerm::ATUri, XName{URI, ""}, 0, 0, Node});
+      }
+    }
+  }
+  const u32 AttrEnd = Cur;
+  const u32 FirstContent = Nodes.size();
+
+  // Content, Sections 8.5.4.1.3.2 and 8.5.4.1.5.
+  if (IsEmpty || (!E.Content && !E.Mixed && !E.SimpleDT)) {
+    Nodes[AttrEnd].Final = true;
+  } else if (E.SimpleDT) {
+    const u32 Content = addNode();
+    const u32 End = addNode();
+    addEps(AttrEnd, Content);
+    addEdge(Content, {EventTerm::CH, XName(), *E.SimpleDT, 0, End});
+    Nodes[End].Final = true;
+  } else {
+    const u32 Content = addNode();
+    addEps(AttrEnd, Content);
+    u32 End = Content;
+    if (E.Content) {
+      auto EndOrErr = addParticle(*E.Content, Content, 0);
+      if (!EndOrErr)
+        return EndOrErr.takeError();
+      End = *EndOrErr;
+    }
+    Nodes[End].Final = true;
+    if (E.Mixed) {
+      for (u32 Node = FirstContent, NE = Nodes.size(); Node != NE; ++Node)
+        addEdge(Node, {EventTerm::CH, XName(), 0, 0, Node});
+    }
+  }
+
+  // Subset construction.
+  using StateKey = std::pair<Vec<u32>, bool>;
+  std::map<StateKey, u32> StateIDs;
+  Vec<std::pair<StateKey, u32>> Worklist;
+
+  auto GetState = [&, this] (Vec<u32> Set, bool IsAttr) -> u32 {
+    closure(Set);
+    StateKey Key {std::move(Set), IsAttr};
+    auto [It, Inserted] = StateIDs.try_emplace(Key, D.States.size());
+    if (Inserted) {
+      SchemaState S;
+      S.Type = TypeIx;
+      S.Flags = (IsAttr ? SchemaState::kAttributes : 0)
+              | (IsEmpty ? SchemaState::kEmpty : 0);
+      D.States.push_back(S);
+      Worklist.emplace_back(std::move(Key), It->second);
+    }
+    return It->second;
+  };
+
+  Start = GetState({AttrNodes.front()}, true);
+  D.States[Start].Flags |= SchemaState::kStart;
+  // Section 8.5.4.4.1 - Undeclared content leaves the attributes.
+  const u32 Content2 = GetState({AttrEnd}, false);
+
+  while (!Worklist.empty()) {
+    auto [Key, ID] = std::move(Worklist.back());
+    Worklist.pop_back();
+    const auto& [Set, IsAttr] = Key;
+
+    // Group transitions with the same event.
+    Vec<ProtoProd> Protos;
+    bool IsFinal = false;
+    for (u32 Node : Set) {
+      IsFinal |= Nodes[Node].Final;
+      for (const NEdge& Edge : Nodes[Node].Edges) {
+        if (!IsAttr && IsAttrTerm(Edge.Term))
+          continue;
+        auto It = exi::find_if(Protos, [&Edge] (const ProtoProd& P) {
+          if (P.Edge.Term != Edge.Term)
+            return false;
+          switch (Edge.Term) {
+          case EventTerm::SEQName:
+          case EventTerm::ATQName:
+            return P.Edge.Name == Edge.Name;
+          case EventTerm::SEUri:
+          case EventTerm::ATUri:
+            return P.Edge.Name.URI == Edge.Name.URI;
+          default:
+            return true;
+          }
+        });
+        if (It == Protos.end())
+          Protos.push_back({Edge, {Edge.To}});
+        else {
+          It->Edge.Order = std::min(It->Edge.Order, Edge.Order);
+          if (!exi::is_contained(It->To, Edge.To))
+            It->To.push_back(Edge.To);
+        }
+      }
+    }
+    if (IsFinal)
+      Protos.push_back({NEdge{EventTerm::EE}, {}});
+
+    std::stable_sort(Protos.begin(), Protos.end(),
+     [] (const ProtoProd& LHS, const ProtoProd& RHS) {
+      const NEdge& L = LHS.Edge;
+      const NEdge& R = RHS.Edge;
+      if (L.Term != R.Term)
+        return GetTermRank(L.Term) < GetTermRank(R.Term);
+      switch (L.Term) {
+      case EventTerm::ATQName:
+        return L.Name < R.Name;
+      case EventTerm::ATUri:
+        return L.Name.URI < R.Name.URI;
+      case EventTerm::SEQName:
+        if (L.Order != R.Order)
+          return L.Order < R.Order;
+        return L.Name < R.Name;
+      case EventTerm::SEUri:
+        if (L.Order != R.Order)
+          return L.Order < R.Order;
+        return L.Name.URI < R.Name.URI;
+      default:
+        return false;
+      }
+    });
+
+    // Targets are resolved first, as they may add states.
+    Vec<u32> Targets;
+    for (ProtoProd& P : Protos) {
+      if (P.Edge.Term == EventTerm::EE)
+        Targets.push_back(0);
+      else
+        Targets.push_back(
+          GetState(std::move(P.To), IsAttrTerm(P.Edge.Term) && IsAttr));
+    }
+
+    SchemaState& S = D.States[ID];
+    S.FirstProd = D.Prods.size();
+    S.NProds = Protos.size();
+    S.Content2 = IsAttr ? Content2 : ID;
+    if (IsFinal)
+      S.Flags |= SchemaState::kHasEE;
+
+    for (auto [P, Next] : exi::zip(Protos, Targets)) {
+      SchemaProd Prod;
+      Prod.Term = u8(P.Edge.Term);
+      Prod.Next = Next;
+      switch (P.Edge.Term) {
+      case EventTerm::SEQName:
+      case EventTerm::ATQName:
+        Prod.Name = getQName(P.Edge.Name);
+        Prod.Target = P.Edge.Target;
+        break;
+      case EventTerm::SEUri:
+      case EventTerm::ATUri:
+        Prod.Name = {getURI(P.Edge.Name.URI), 0};
+        break;
+      case EventTerm::CH:
+        Prod.Target = P.Edge.Target;
+        break;
+      default:
+        break;
+      }
+      D.Prods.push_back(Prod);
+    }
+  }
+
+  return Error::success();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Tables
+
+Error GrammarBuilder::buildTypes() {
+  const usize NTypes = M.Types.size();
+  D.Types.resize(NTypes);
+
+  for (u32 Ix = 0; Ix < NTypes; ++Ix) {
+    const TypeDef& T = M.Types[Ix];
+    SchemaType& Out = D.Types[Ix];
+    if (!T.Name.empty()) {
+      Out.Name = getQName(T.Name);
+      Out.Flags |= SchemaType::kNamed;
+    }
+    if (!T.Complex)
+      Out.Flags |= SchemaType::kSimple;
+  }
+
+  // Mark every ancestor of a named type.
+  for (u32 Ix = 0; Ix < NTypes; ++Ix) {
+    if (M.Types[Ix].Name.empty())
+      continue;
+    u32 Cur = M.Types[Ix].Base;
+    for (usize Depth = 0; Cur != kNone && Depth < NTypes; ++Depth) {
+      D.Types[Cur].Flags |= SchemaType::kHasSubTypes;
+      Cur = M.Types[Cur].Base;
+    }
+  }
+
+  // Unions always allow `xsi:type`, see Section 8.5.4.4.2.
+  for (u32 Ix = 0; Ix < NTypes; ++Ix) {
+    u32 Cur = Ix;
+    for (usize Depth = 0; Cur != kNone && Depth < NTypes; ++Depth) {
+      const TypeDef& T = M.Types[Cur];
+      if (T.Var == Variety::Union)
+        D.Types[Ix].Flags |= SchemaType::kHasSubTypes;
+      if (T.Var != Variety::Atomic || T.Prim)
+        break;
+      Cur = getSimpleBase(Cur);
+    }
+  }
+
+  for (u32 Ix = 0; Ix < NTypes; ++Ix) {
+    auto E = getEffType(Ix);
+    if (!E)
+      return E.takeError();
+
+    SchemaType& Out = D.Types[Ix];
+    Out.FirstAttrUse = D.AttrUses.size();
+    Out.NAttrUses = (*E)->Attrs.size();
+    for (const EffAttr& A : (*E)->Attrs)
+      D.AttrUses.push_back(getQName(A.Name));
+
+    u32 Grammar = 0, Empty = 0;
+    if (Error Err = buildGrammar(Ix, **E, false, Grammar))
+      return Err;
+
+    const bool HasContent
+      = (*E)->Content || (*E)->Mixed || (*E)->SimpleDT;
+    if (!HasContent)
+      Empty = Grammar;
+    else if (Error Err = buildGrammar(Ix, **E, true, Empty))
+      return Err;
+
+    D.Types[Ix].Grammar = Grammar;
+    D.Types[Ix].EmptyGrammar = Empty;
+  }
+
+  return Error::success();
+}
+
+void GrammarBuilder::buildElements() {
+  for (const ElementDecl& E : M.Elements) {
+    SchemaElement Out;
+    Out.Name = getQName(E.Name);
+    Out.Type = E.Type;
+    if (E.Nillable)
+      Out.Flags |= SchemaElement::kNillable;
+    if (E.Global)
+      Out.Flags |= SchemaElement::kGlobal;
+    D.Elements.push_back(Out);
+  }
+
+  for (auto [Name, Ix] : M.AttrNames) {
+    const AttrDecl& A = M.Attrs[Ix];
+    D.Attributes.push_back({getQName(Name), getDatatype(A.Type)});
+  }
+  std::sort(D.Attributes.begin(), D.Attributes.end(),
+    [] (const SchemaAttribute& L, const SchemaAttribute& R) {
+      return L.Name < R.Name;
+    });
+
+  // Section 8.5.1 - `ElementNames` is ordered by local-name, then uri.
+  for (auto [Name, Ix] : M.ElementNames)
+    D.DocElements.push_back(Ix);
+
+  // Section 8.5.2 - Elements with the same qname but different types use
+  // the ur-type.
+  std::map<XName, u32> Fragment;
+  for (auto [Ix, E] : exi::enumerate(M.Elements)) {
+    auto [It, Inserted] = Fragment.try_emplace(E.Name, Ix);
+    if (Inserted)
+      continue;
+    const SchemaElement& Prev = D.Elements[It->second];
+    if (Prev.Type == E.Type && Prev.isNillable() == E.Nillable)
+      continue;
+    SchemaElement Any;
+    Any.Name = getQName(E.Name);
+    Any.Type = AnyTypeIx;
+    Any.Flags = SchemaElement::kNillable;
+    It->second = D.Elements.size();
+    D.Elements.push_back(Any);
+  }
+  for (auto [Name, Ix] : Fragment)
+    D.FragmentElements.push_back(Ix);
+
+  auto ByName = [] (auto& Items) {
+    return [&Items] (u32 L, u32 R) { return Items[L].Name < Items[R].Name; };
+  };
+
+  D.GlobalElements = D.DocElements;
+  std::sort(D.GlobalElements.begin(), D.GlobalElements.end(),
+            ByName(D.Elements));
+
+  for (auto [Name, Ix] : M.TypeNames)
+    D.NamedTypes.push_back(Ix);
+  std::sort(D.NamedTypes.begin(), D.NamedTypes.end(), ByName(D.Types));
+}
+
+Expected<SchemaGrammarsRef> GrammarBuilder::build() {
+  AnyTypeIx = *Model::Find(M.TypeNames, {XSD_URI, "anyType"});
+  D.AnyType = AnyTypeIx;
+  buildStrings();
+
+  // Datatype 0 is used for untyped values.
+  D.Datatypes.push_back(SchemaDatatype());
+  TypeDatatypes.assign(M.Types.size(), kNone);
+  EffTypes.resize(M.Types.size());
+  InProgress.assign(M.Types.size(), false);
+
+  SubstMembers.resize(M.Elements.size());
+  for (auto [Ix, E] : exi::enumerate(M.Elements)) {
+    if (E.SubstGroup.empty())
+      continue;
+    if (Option<u32> Head = Model::Find(M.ElementNames, E.SubstGroup))
+      SubstMembers[*Head].push_back(Ix);
+  }
+  for (auto& Members : SubstMembers) {
+    std::sort(Members.begin(), Members.end(), [this] (u32 L, u32 R) {
+      return M.Elements[L].Name < M.Elements[R].Name;
+    });
+  }
+
+  if (Error E = buildTypes())
+    return std::move(E);
+  buildElements();
+
+  LOG_INFO("Built {} states for {} types, {} elements",
+           D.States.size(), D.Types.size(), D.Elements.size());
+  return make_refcounted<SchemaGrammars>(std::move(D));
+}
+
+//===----------------------------------------------------------------===//
+// Interface
+//===----------------------------------------------------------------===//
+
+Expected<SchemaGrammarsRef> xsd::buildGrammars(const Model& M) {
+  GrammarBuilder Builder(M);
+  return Builder.build();
+}
@@ -0,0 +1,290 @@
+//===- exi/Grammar/SchemaCache.cpp ----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements grammar caches.
+///
+/// A cache starts with a `CacheHeader`, followed by each section aligned to
+/// `kSectionAlign`. Everything is stored in the native layout, so a cache
+/// written on another platform is rejected rather than converted. The header
+/// holds the MD5 of everything after it, so a truncated or damaged cache is
+/// rejected before its tables are used.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Grammar/SchemaCache.hpp>
+#include <core/Common/SmallStr.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Common/Twine.hpp>
+#include <core/Common/bit.hpp>
+#include <core/Support/Endian.hpp>
+#include <core/Support/Logging.hpp>
+#include <core/Support/MathExtras.hpp>
+#include <core/Support/MemoryBuffer.hpp>
+#include <core/Support/raw_ostream.hpp>
+#include <cstring>
+#include <type_traits>
+
+using namespace exi;
+
+#define DEBUG_TYPE "SchemaCache"
+
+namespace {
+
+/// The sections of a cache, in the order they are stored.
+enum CacheSection : u32 {
+  kSources,
+  kChars,
+  kURIs,
+  kLocalNames,
+  kDatatypes,
+  kEnumValues,
+  kCharSets,
+  kTypes,
+  kAttrUses,
+  kElements,
+  kAttributes,
+  kStates,
+  kProds,
+  kDocElements,
+  kFragmentElements,
+  kGlobalElements,
+  kNamedTypes,
+  kNumSections
+};
+
+/// The location of a section, with `Size` in elements.
+struct CacheRange {
+  u64 Offset = 0;
+  u64 Size = 0;
+};
+
+struct CacheHeader {
+  char Magic[8];
+  u32 Version = 0;
+  /// Identifies the byte order and struct sizes of the writer.
+  u32 Layout = 0;
+  /// The hash of the sources.
+  u8 Hash[16];
+  /// The hash of everything after the header.
+  u8 PayloadHash[16];
+  u32 AnyType = 0;
+  u32 Reserved = 0;
+  CacheRange Sections[kNumSections];
+};
+
+} // namespace `anonymous`
+
+static constexpr char kMagic[8] {'E', 'X', 'I', 'G', 'R', 'A', 'M', 'S'};
+/// The alignment of each section, enough for every table.
+static constexpr u64 kSectionAlign = 8;
+
+template <typename...TT>
+static constexpr u32 GetLayout() {
+  u32 Out = (endianness::native == endianness::little) ? 1 : 2;
+  ((Out = Out * 31 + u32(sizeof(TT))), ...);
+  return Out;
+}
+
+static constexpr u32 kLayout = GetLayout<
+  CacheHeader, SchemaStr, SchemaURI, SchemaQName, SchemaDatatype, SchemaType,
+  SchemaElement, SchemaAttribute, SchemaState, SchemaProd>();
+
+/// Calls `Fn` with each section of `T` after `kSources`.
+template <class TablesT, class F>
+static void ForEachTable(TablesT& T, F&& Fn) {
+  Fn(kChars, T.Chars);
+  Fn(kURIs, T.URIs);
+  Fn(kLocalNames, T.LocalNames);
+  Fn(kDatatypes, T.Datatypes);
+  Fn(kEnumValues, T.EnumValues);
+  Fn(kCharSets, T.CharSets);
+  Fn(kTypes, T.Types);
+  Fn(kAttrUses, T.AttrUses);
+  Fn(kElements, T.Elements);
+  Fn(kAttributes, T.Attributes);
+  Fn(kStates, T.States);
+  Fn(kProds, T.Prods);
+  Fn(kDocElements, T.DocElements);
+  Fn(kFragmentElements, T.FragmentElements);
+  Fn(kGlobalElements, T.GlobalElements);
+  Fn(kNamedTypes, T.NamedTypes);
+}
+
+template <typename T>
+static usize GetByteSize(ArrayRef<T> Table) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  static_assert(alignof(T) <= kSectionAlign);
+  return Table.size() * sizeof(T);
+}
+
+/// Passes everything after the header to `Out`, in the order it is stored.
+/// Returns the size of the cache.
+template <class F>
+static u64 ForEachPayload(const SchemaTables& T, ArrayRef<char> SourceData,
+                          F&& Out) {
+  static constexpr char kPadding[kSectionAlign] {};
+  u64 Pos = sizeof(CacheHeader);
+  auto Write = [&Out, &Pos] (CacheSection, auto Table) {
+    const u64 Aligned = alignTo(Pos, kSectionAlign);
+    Out(StrRef(kPadding, Aligned - Pos));
+    Out(StrRef(reinterpret_cast<const char*>(Table.data()),
+               GetByteSize(Table)));
+    Pos = Aligned + GetByteSize(Table);
+  };
+  Write(kSources, SourceData);
+  ForEachTable(T, Write);
+  return Pos;
+}
+
+void exi::hashSchemaSource(MD5& Hash, StrRef Data) {
+  // Sizes are included, so contents can't shift between sources.
+  u8 Size[8];
+  support::endian::write64le(Size, Data.size());
+  Hash.update(ArrayRef<u8>(Size));
+  Hash.update(Data);
+}
+
+Expected<MD5::MD5Result> exi::hashSchemaSources(ArrayRef<String> Sources) {
+  MD5 Hash;
+  for (const String& Source : Sources) {
+    auto BufOrErr = MemoryBuffer::getFile(Source, /*IsText=*/false,
+      /*RequiresNullTerminator=*/false);
+    if (!BufOrErr)
+      return createFileError(Source, BufOrErr.getError());
+
+    exi::hashSchemaSource(Hash, (*BufOrErr)->getBuffer());
+  }
+  return Hash.final();
+}
+
+void exi::writeSchemaCache(raw_ostream& OS, const SchemaTables& T,
+                           ArrayRef<String> Sources,
+                           const MD5::MD5Result& Hash) {
+  SmallStr<256> SourceData;
+  for (const String& Source : Sources) {
+    SourceData.append(Source.begin(), Source.end());
+    SourceData.push_back('\0');
+  }
+
+  CacheHeader H {};
+  std::memcpy(H.Magic, kMagic, sizeof(kMagic));
+  H.Version = kSchemaCacheVersion;
+  H.Layout = kLayout;
+  std::memcpy(H.Hash, Hash.data(), sizeof(H.Hash));
+  H.AnyType = T.AnyType;
+
+  u64 Offset = sizeof(CacheHeader);
+  auto Place = [&H, &Offset] (CacheSection Section, auto Table) {
+    Offset = alignTo(Offset, kSectionAlign);
+    H.Sections[Section] = {Offset, Table.size()};
+    Offset += GetByteSize(Table);
+  };
+  Place(kSources, ArrayRef<char>(SourceData));
+  ForEachTable(T, Place);
+
+  // The header comes first, so the payload is hashed before it is written.
+  MD5 Payload;
+  ForEachPayload(T, SourceData, [&Payload] (StrRef Data) {
+    Payload.update(Data);
+  });
+  std::memcpy(H.PayloadHash, Payload.final().data(), sizeof(H.PayloadHash));
+
+  OS.write(reinterpret_cast<const char*>(&H), sizeof(H));
+  const u64 Pos = ForEachPayload(T, SourceData, [&OS] (StrRef Data) {
+    OS.write(Data.data(), Data.size());
+  });
+
+  LOG_INFO("Wrote grammar cache: {} bytes", Pos);
+}
+
+SchemaGrammarsRef exi::loadSchemaCache(const Twine& Path) {
+  // Large caches are mapped, and smaller ones read into aligned memory.
+  auto BufOrErr = MemoryBuffer::getFile(Path, /*IsText=*/false,
+    /*RequiresNullTerminator=*/false, /*IsVolatile=*/false,
+    Align(kSectionAlign));
+  if (!BufOrErr) {
+    LOG_INFO("No grammar cache at '{}'.", Path.str());
+    return nullptr;
+  }
+
+  Box<MemoryBuffer>& Buf = *BufOrErr;
+  const StrRef Data = Buf->getBuffer();
+  CacheHeader H;
+  if (Data.size() < sizeof(H)) {
+    LOG_WARN("'{}' is not a grammar cache.", Path.str());
+    return nullptr;
+  }
+
+  std::memcpy(&H, Data.data(), sizeof(H));
+  if (std::memcmp(H.Magic, kMagic, sizeof(kMagic)) != 0
+      || H.Version != kSchemaCacheVersion || H.Layout != kLayout) {
+    LOG_WARN("'{}' is not a grammar cache for this version.", Path.str());
+    return nullptr;
+  }
+
+  MD5 Payload;
+  Payload.update(Data.drop_front(sizeof(H)));
+  if (std::memcmp(Payload.final().data(), H.PayloadHash,
+                  sizeof(H.PayloadHash)) != 0) {
+    LOG_WARN("Grammar cache '{}' is corrupt.", Path.str());
+    return nullptr;
+  }
+
+  bool Valid = true;
+  auto GetSection = [&] <typename T> (CacheSection Section, ArrayRef<T>& Out) {
+    const CacheRange R = H.Sections[Section];
+    if (R.Offset % kSectionAlign != 0 || R.Offset > Data.size()
+        || R.Size > (Data.size() - R.Offset) / sizeof(T)) {
+      Valid = false;
+      return;
+    }
+    Out = ArrayRef<T>(
+      reinterpret_cast<const T*>(Data.data() + R.Offset), R.Size);
+  };
+
+  ArrayRef<char> SourceData;
+  SchemaTables T {};
+  GetSection(kSources, SourceData);
+  ForEachTable(T, GetSection);
+  T.AnyType = H.AnyType;
+  if (!Valid || (!SourceData.empty() && SourceData.back() != '\0')) {
+    LOG_WARN("Grammar cache '{}' is corrupt.", Path.str());
+    return nullptr;
+  }
+
+  SmallVec<String, 4> Sources;
+  for (StrRef Rest(SourceData.data(), SourceData.size()); !Rest.empty();) {
+    auto [Source, Tail] = Rest.split('\0');
+    Sources.emplace_back(Source);
+    Rest = Tail;
+  }
+
+  auto HashOrErr = hashSchemaSources(Sources);
+  if (!HashOrErr) {
+    consumeError(HashOrErr.takeError());
+    LOG_INFO("Sources of grammar cache '{}' are missing.", Path.str());
+    return nullptr;
+  }
+  if (std::memcmp(HashOrErr->data(), H.Hash, sizeof(H.Hash)) != 0) {
+    LOG_INFO("Grammar cache '{}' is stale.", Path.str());
+    return nullptr;
+  }
+
+  return make_refcounted<SchemaGrammars>(std::move(Buf), T);
+}
@@ -0,0 +1,227 @@
+//===- exi/Grammar/SchemaGrammars.cpp -------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the tables of schema-informed grammars.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Grammar/SchemaGrammars.hpp>
+#include <core/Common/STLExtras.hpp>
+#include <core/Support/Format.hpp>
+#include <core/Support/MathExtras.hpp>
+#include <core/Support/MemoryBuffer.hpp>
+#include <core/Support/raw_ostream.hpp>
+#include <algorithm>
+
+using namespace exi;
+
+#define DEBUG_TYPE "SchemaGrammars"
+
+//===----------------------------------------------------------------===//
+// SchemaTables
+//===----------------------------------------------------------------===//
+
+/// Finds `Name` in a list of indices sorted by the names of `Items`.
+template <typename T>
+static Option<u32> FindByName(ArrayRef<u32> Sorted, ArrayRef<T> Items,
+                              SmallQName Name) {
+  const SchemaQName Key {u32(Name.URI), u32(Name.LocalID)};
+  auto It = std::lower_bound(Sorted.begin(), Sorted.end(), Key,
+    [Items] (u32 Ix, SchemaQName Key) { return Items[Ix].Name < Key; });
+  if (It == Sorted.end() || Items[*It].Name != Key)
+    return std::nullopt;
+  return *It;
+}
+
+Option<u32> SchemaTables::findElement(SmallQName Name) const {
+  return FindByName(GlobalElements, Elements, Name);
+}
+
+Option<u32> SchemaTables::findAttribute(SmallQName Name) const {
+  const SchemaQName Key {u32(Name.URI), u32(Name.LocalID)};
+  auto It = std::lower_bound(Attributes.begin(), Attributes.end(), Key,
+    [] (const SchemaAttribute& A, SchemaQName Key) { return A.Name < Key; });
+  if (It == Attributes.end() || It->Name != Key)
+    return std::nullopt;
+  return u32(It - Attributes.begin());
+}
+
+Option<u32> SchemaTables::findType(SmallQName Name) const {
+  return FindByName(NamedTypes, Types, Name);
+}
+
+Option<u32> SchemaTables::findLocalName(u32 URI, StrRef Local) const {
+  if (URI >= URIs.size())
+    return std::nullopt;
+  const SchemaURI& Info = URIs[URI];
+  ArrayRef<SchemaStr> Names = LocalNames.slice(Info.FirstName, Info.NNames);
+  auto It = std::lower_bound(Names.begin(), Names.end(), Local,
+    [this] (SchemaStr S, StrRef Local) { return getStr(S) < Local; });
+  if (It == Names.end() || getStr(*It) != Local)
+    return std::nullopt;
+  return u32(It - Names.begin());
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Printing
+
+static StrRef GetKindName(SchemaValueKind Kind) {
+  static constexpr StringLiteral Names[] {
+    "String", "Boolean", "Decimal", "Float", "Integer", "Unsigned",
+    "NBitUnsigned", "Binary", "HexBinary", "DateTime", "Time", "Date",
+    "GYearMonth", "GYear", "GMonthDay", "GDay", "GMonth", "List",
+    "Enumeration"
+  };
+  static_assert(std::size(Names) == usize(SchemaValueKind::Last) + 1);
+  return Names[usize(Kind)];
+}
+
+void SchemaTables::dump(raw_ostream& OS) const {
+  auto PrintName = [&, this] (SchemaQName Name) {
+    const StrRef URI = getURI(Name.URI);
+    if (URI.empty())
+      OS << getLocalName(Name);
+    else
+      OS << format("{{{}}}{}", URI, getLocalName(Name));
+  };
+
+  auto PrintProd = [&, this] (const SchemaProd& P) {
+    using enum EventTerm;
+    OS << get_event_name(P.getTerm());
+    switch (P.getTerm()) {
+    case SEQName:
+    case ATQName:
+      OS << '(';
+      PrintName(P.Name);
+      OS << ')';
+      break;
+    case SEUri:
+    case ATUri:
+      OS << format("({}:*)", getURI(P.Name.URI));
+      break;
+    case SE:
+    case AT:
+      OS << "(*)";
+      break;
+    default:
+      break;
+    }
+    if (P.getTerm() == CH || P.getTerm() == ATQName)
+      OS << format(" [{}]", GetKindName(Datatypes[P.Target].Kind));
+  };
+
+  for (auto [Ix, Type] : exi::enumerate(Types)) {
+    if (Type.Flags & SchemaType::kNamed) {
+      OS << "Type ";
+      PrintName(Type.Name);
+    } else
+      OS << format("Type #{}", Ix);
+    OS << format(" <{}, {}>:\n", Type.Grammar, Type.EmptyGrammar);
+  }
+  OS << '\n';
+
+  for (auto [Ix, State] : exi::enumerate(States)) {
+    OS << format("State {} [{}] <{}{}{}>:\n", Ix, State.NProds,
+      State.isStart() ? "start " : "",
+      State.isAttributes() ? "attributes" : "content",
+      State.isEmpty() ? ", empty" : "");
+    const unsigned Bits = Log2_32_Ceil(State.NProds);
+    for (auto [Code, P] : exi::enumerate(getProds(State))) {
+      OS << format("  {: <4} @{}  ", Code, Bits);
+      PrintProd(P);
+      if (P.getTerm() != EventTerm::EE)
+        OS << format(" -> {}", P.Next);
+      OS << '\n';
+    }
+  }
+  OS.flush();
+}
+
+void SchemaTables::dump() const {
+  this->dump(outs());
+}
+
+//===----------------------------------------------------------------===//
+// SchemaTableData
+//===----------------------------------------------------------------===//
+
+SchemaStr SchemaTableData::addStr(StrRef Str) {
+  const SchemaStr Out {u32(Chars.size()), u32(Str.size())};
+  Chars.insert(Chars.end(), Str.begin(), Str.end());
+  return Out;
+}
+
+SchemaTables SchemaTableData::view() const {
+  return SchemaTables {
+    .Chars = Chars,
+    .URIs = URIs,
+    .LocalNames = LocalNames,
+    .Datatypes = Datatypes,
+    .EnumValues = EnumValues,
+    .CharSets = CharSets,
+    .Types = Types,
+    .AttrUses = AttrUses,
+    .Elements = Elements,
+    .Attributes = Attributes,
+    .States = States,
+    .Prods = Prods,
+    .DocElements = DocElements,
+    .FragmentElements = FragmentElements,
+    .GlobalElements = GlobalElements,
+    .NamedTypes = NamedTypes,
+    .AnyType = AnyType
+  };
+}
+
+usize SchemaTableData::getMemoryUsage() const {
+  auto Bytes = [] (const auto& V) -> usize {
+    using ValueT = typename std::decay_t<decltype(V)>::value_type;
+    return V.capacity() * sizeof(ValueT);
+  };
+  return Bytes(Chars) + Bytes(URIs) + Bytes(LocalNames)
+    + Bytes(Datatypes) + Bytes(EnumValues) + Bytes(CharSets)
+    + Bytes(Types) + Bytes(AttrUses) + Bytes(Elements)
+    + Bytes(Attributes) + Bytes(States) + Bytes(Prods)
+    + Bytes(DocElements) + Bytes(FragmentElements)
+    + Bytes(GlobalElements) + Bytes(NamedTypes);
+}
+
+//===----------------------------------------------------------------===//
+// SchemaGrammars
+//===----------------------------------------------------------------===//
+
+SchemaGrammars::SchemaGrammars(SchemaTableData&& InData) :
+ Data(std::move(InData)), Tables(Data.view()) {
+}
+
+SchemaGrammars::SchemaGrammars(Box<MemoryBuffer> InMapped,
+                               const SchemaTables& InTables) :
+ Mapped(std::move(InMapped)), Tables(InTables) {
+  exi_invariant(Mapped, "mapped tables require a buffer");
+}
+
+SchemaGrammars::~SchemaGrammars() = default;
+
+usize SchemaGrammars::getMemoryUsage() const {
+  if (Mapped)
+    return Mapped->getBufferSize();
+  return Data.getMemoryUsage();
+}
+
+SchemaResolver::~SchemaResolver() = default;
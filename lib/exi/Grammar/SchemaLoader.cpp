@@ -0,0 +1,1106 @@
+//===- exi/Grammar/SchemaLoader.cpp ---------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements loading XSD schemas into an `xsd::Model`.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Grammar/SchemaLoader.hpp>
+#include <core/Common/SmallStr.hpp>
+#include <core/Common/StringExtras.hpp>
+#include <core/Common/StringSet.hpp>
+#include <core/Common/Twine.hpp>
+#include <core/Support/Logging.hpp>
+#include <core/Support/MD5.hpp>
+#include <core/Support/MemoryBufferRef.hpp>
+#include <core/Support/Path.hpp>
+#include <core/Support/raw_ostream.hpp>
+#include <exi/Basic/XML.hpp>
+#include <exi/Basic/XMLContainer.hpp>
+#include <exi/Basic/XMLNames.hpp>
+#include <exi/Grammar/SchemaCache.hpp>
+#include "XSDModel.hpp"
+
+using namespace exi;
+using namespace exi::xsd;
+
+#define DEBUG_TYPE "SchemaLoader"
+
+//===----------------------------------------------------------------===//
+// Builtin Types
+//===----------------------------------------------------------------===//
+
+namespace {
+
+struct BuiltinInfo {
+  StrRef Name;
+  /// The base type, or empty for `anyType`.
+  StrRef Base;
+  Primitive Prim = Primitive::String;
+  /// The item type of list types.
+  StrRef Item = ""_str;
+  Option<i64> Min = std::nullopt;
+  Option<i64> Max = std::nullopt;
+};
+
+using enum Primitive;
+
+/// The builtin datatypes, which are defined before any schema is loaded.
+/// Every base is defined before the types derived from it.
+static const BuiltinInfo BuiltinTypes[] {
+  {"anySimpleType",       "anyType"},
+  {"string",              "anySimpleType"},
+  {"boolean",             "anySimpleType", Boolean},
+  {"decimal",             "anySimpleType", Decimal},
+  {"float",               "anySimpleType", Float},
+  {"double",              "anySimpleType", Float},
+  {"duration",            "anySimpleType"},
+  {"dateTime",            "anySimpleType", DateTime},
+  {"time",                "anySimpleType", Time},
+  {"date",                "anySimpleType", Date},
+  {"gYearMonth",          "anySimpleType", GYearMonth},
+  {"gYear",               "anySimpleType", GYear},
+  {"gMonthDay",           "anySimpleType", GMonthDay},
+  {"gDay",                "anySimpleType", GDay},
+  {"gMonth",              "anySimpleType", GMonth},
+  {"hexBinary",           "anySimpleType", HexBinary},
+  {"base64Binary",        "anySimpleType", Binary},
+  {"anyURI",              "anySimpleType"},
+  {"QName",               "anySimpleType", QName},
+  {"NOTATION",            "anySimpleType", QName},
+
+  {"normalizedString",    "string"},
+  {"token",               "normalizedString"},
+  {"language",            "token"},
+  {"Name",                "token"},
+  {"NMTOKEN",             "token"},
+  {"NCName",              "Name"},
+  {"ID",                  "NCName"},
+  {"IDREF",               "NCName"},
+  {"ENTITY",              "NCName"},
+  {"NMTOKENS",            "anySimpleType", String, "NMTOKEN"},
+  {"IDREFS",              "anySimpleType", String, "IDREF"},
+  {"ENTITIES",            "anySimpleType", String, "ENTITY"},
+
+  {"integer",             "decimal", Integer},
+  {"nonPositiveInteger",  "integer", Integer, "", std::nullopt, 0},
+  {"negativeInteger",     "nonPositiveInteger", Integer, "", std::nullopt, -1},
+  {"long",                "integer", Integer, "", min_v<i64>, max_v<i64>},
+  {"int",                 "long",    Integer, "", min_v<i32>, max_v<i32>},
+  {"short",               "int",     Integer, "", min_v<i16>, max_v<i16>},
+  {"byte",                "short",   Integer, "", min_v<i8>,  max_v<i8>},
+  {"nonNegativeInteger",  "integer", Integer, "", 0},
+  {"unsignedLong",        "nonNegativeInteger", Integer, "", 0},
+  {"unsignedInt",         "unsignedLong",  Integer, "", 0, max_v<u32>},
+  {"unsignedShort",       "unsignedInt",   Integer, "", 0, max_v<u16>},
+  {"unsignedByte",        "unsignedShort", Integer, "", 0, max_v<u8>},
+  {"positiveInteger",     "nonNegativeInteger", Integer, "", 1},
+};
+
+} // namespace `anonymous`
+
+/// Defines `anyType` and the builtin datatypes.
+static void AddBuiltinTypes(Model& M) {
+  auto Add = [&M] (TypeDef&& T) {
+    const u32 Ix = M.Types.size();
+    M.TypeNames[T.Name] = Ix;
+    M.Types.push_back(std::move(T));
+  };
+
+  /*anyType*/ {
+    TypeDef T;
+    T.Name = {XSD_URI, "anyType"};
+    T.Complex = true;
+    T.Builtin = true;
+    T.Mixed = true;
+    Particle Any;
+    Any.Kind = ParticleKind::Wildcard;
+    Any.Min = 0;
+    Any.Max = kUnbounded;
+    Any.WC.Any = true;
+    T.Content = std::move(Any);
+    T.AnyAttr.emplace().Any = true;
+    Add(std::move(T));
+  }
+
+  for (const BuiltinInfo& Info : BuiltinTypes) {
+    TypeDef T;
+    T.Name = {XSD_URI, Info.Name};
+    T.Builtin = true;
+    T.BaseName = {XSD_URI, Info.Base};
+    T.Base = *Model::Find(M.TypeNames, T.BaseName);
+    if (!Info.Item.empty()) {
+      T.Var = Variety::List;
+      T.ItemName = {XSD_URI, Info.Item};
+      T.Item = *Model::Find(M.TypeNames, T.ItemName);
+    } else
+      T.Prim = Info.Prim;
+    T.Min = Info.Min;
+    T.Max = Info.Max;
+    Add(std::move(T));
+  }
+}
+
+//===----------------------------------------------------------------===//
+// Loader
+//===----------------------------------------------------------------===//
+
+void Wildcard::merge(const Wildcard& Other) {
+  if (Any || Other.Any) {
+    Any = true;
+    URIs.clear();
+    return;
+  }
+  for (StrRef URI : Other.URIs) {
+    if (!exi::is_contained(URIs, URI))
+      URIs.push_back(URI);
+  }
+}
+
+namespace {
+
+/// The context of a schema document.
+struct DocContext {
+  /// The path of the document, used to resolve included schemas.
+  StrRef Path;
+  /// The namespace of its components, possibly from a chameleon include.
+  StrRef TargetNS;
+  bool QualifiedElements = false;
+  bool QualifiedAttributes = false;
+  /// If unprefixed references resolve to `TargetNS`, from a chameleon
+  /// include of a document with no namespace.
+  bool Chameleon = false;
+};
+
+class XSDLoader {
+  XMLManager& Mgr;
+  Model& M;
+  /// The documents which have been loaded.
+  StringSet<> Loaded;
+  /// The loaded documents, in load order.
+  XSDSources* Sources = nullptr;
+public:
+  XSDLoader(XMLManager& Mgr, Model& M, XSDSources* Sources = nullptr) :
+   Mgr(Mgr), M(M), Sources(Sources) {}
+
+  /// Loads a schema document.
+  /// @param IncluderNS The namespace of the including document, if any.
+  Error loadFile(StrRef Path, Option<StrRef> IncluderNS);
+  /// Resolves the references between components once every document is
+  /// loaded.
+  Error resolve();
+
+private:
+  Error loadSchema(const XMLNode* Root, DocContext& C);
+  Error loadReference(const XMLNode* N, const DocContext& C, bool IsInclude);
+  Error loadTopLevel(const XMLNode* N, const DocContext& C, bool Redefine);
+
+  Expected<u32> parseElement(const XMLNode* N, const DocContext& C,
+                             bool Global);
+  Expected<u32> parseAttribute(const XMLNode* N, const DocContext& C,
+                               bool Global);
+  Expected<u32> parseComplexType(const XMLNode* N, const DocContext& C,
+                                 XName Name);
+  Expected<u32> parseSimpleType(const XMLNode* N, const DocContext& C,
+                                XName Name);
+  Expected<Particle> parseParticle(const XMLNode* N, const DocContext& C);
+  Expected<Particle> parseModelGroup(const XMLNode* N, const DocContext& C);
+
+  /// Parses the facets and base of a `restriction`.
+  Error parseRestriction(const XMLNode* N, const DocContext& C, TypeDef& T);
+  /// Parses the attribute uses, attribute group references and attribute
+  /// wildcard of `Parent`.
+  Error parseAttrUses(const XMLNode* Parent, const DocContext& C,
+                      Vec<AttrUse>& Attrs, Vec<XName>& Groups,
+                      Option<Wildcard>& AnyAttr);
+  Error parseOccurs(const XMLNode* N, Particle& P);
+  Wildcard parseWildcard(const XMLNode* N, const DocContext& C);
+
+  //////////////////////////////////////////////////////////////////////
+  // Names
+
+  /// Gets the value of the unprefixed attribute `Name`.
+  Option<StrRef> getAttr(const XMLNode* N, StrRef Name);
+  /// Resolves `Raw` as a QName in the scope of `N`.
+  Expected<XName> resolveQName(const XMLNode* N, const DocContext& C,
+                               StrRef Raw);
+  /// Resolves a QName in the attribute `Attr`, if it exists.
+  Expected<Option<XName>> getQNameAttr(const XMLNode* N, const DocContext& C,
+                                       StrRef Attr);
+  /// Gets the declared name of a component.
+  Expected<XName> getName(const XMLNode* N, StrRef NS);
+
+  Error resolveType(XName Name, u32& Out, StrRef Kind, bool Simple = false);
+  Error registerGlobal(Model::NameMap& Map, const XName& Name, u32 Ix,
+                       StrRef Kind);
+};
+
+} // namespace `anonymous`
+
+/// Gets the local name of an element in the XSD namespace, or an empty string.
+static StrRef GetXSDName(const XMLNode* N) {
+  if (N->type() != NodeKind::node_element)
+    return ""_str;
+  return exi::splitXMLName(N->name()).second;
+}
+
+/// Iterates over the element children of `N`, skipping annotations.
+static auto XSDChildren(const XMLNode* N) {
+  struct Iterator {
+    const XMLNode* Cur;
+    static const XMLNode* Skip(const XMLNode* N) {
+      while (N && (N->type() != NodeKind::node_element
+          || GetXSDName(N) == "annotation"))
+        N = N->next_sibling();
+      return N;
+    }
+    const XMLNode* operator*() const { return Cur; }
+    Iterator& operator++() {
+      Cur = Skip(Cur->next_sibling());
+      return *this;
+    }
+    bool operator!=(const Iterator& RHS) const { return Cur != RHS.Cur; }
+  };
+  return exi::make_range(
+    Iterator{Iterator::Skip(N->first_node())},
+    Iterator{nullptr});
+}
+
+/// Checks if a location refers to a remote document.
+static bool IsRemote(StrRef Location) {
+  return Location.contains("://");
+}
+
+Option<StrRef> XSDLoader::getAttr(const XMLNode* N, StrRef Name) {
+  for (const XMLAttribute* A = N->first_attribute(); A;
+       A = A->next_attribute()) {
+    if (A->name() != Name)
+      continue;
+    SmallStr<64> Buf;
+    const StrRef Value = exi::translateXMLEntities(A->value(), Buf);
+    if (Value.data() == Buf.data())
+      return M.Strings.save(Value);
+    return Value;
+  }
+  return std::nullopt;
+}
+
+Expected<XName> XSDLoader::resolveQName(const XMLNode* N,
+                                        const DocContext& C, StrRef Raw) {
+  auto [Pfx, Local] = exi::splitXMLName(Raw.trim());
+  if (Pfx == kXMLPrefix)
+    return XName {kXMLNamespaceURI, Local};
+
+  for (const XMLNode* Cur = N; Cur && Cur->type() == NodeKind::node_element;
+       Cur = Cur->parent()) {
+    for (const XMLAttribute* A = Cur->first_attribute(); A;
+         A = A->next_attribute()) {
+      Option<StrRef> Decl = exi::getXMLNSPrefix(A->name());
+      if (!Decl || *Decl != Pfx)
+        continue;
+      StrRef URI = A->value();
+      if (URI.empty() && C.Chameleon)
+        URI = C.TargetNS;
+      return XName {URI, Local};
+    }
+  }
+
+  if (!Pfx.empty())
+    return createStringError("{}: unknown prefix in '{}'", C.Path, Raw);
+  return XName {C.Chameleon ? C.TargetNS : ""_str, Local};
+}
+
+Expected<Option<XName>> XSDLoader::getQNameAttr(const XMLNode* N,
+                                                const DocContext& C,
+                                                StrRef Attr) {
+  Option<StrRef> Raw = getAttr(N, Attr);
+  if (!Raw)
+    return Option<XName>();
+  auto Name = resolveQName(N, C, *Raw);
+  if (!Name)
+    return Name.takeError();
+  return Option<XName>(*Name);
+}
+
+Expected<XName> XSDLoader::getName(const XMLNode* N, StrRef NS) {
+  Option<StrRef> Name = getAttr(N, "name");
+  if (!Name)
+    return createStringError("<{}> requires a name", N->name());
+  return XName {NS, Name->trim()};
+}
+
+Error XSDLoader::registerGlobal(Model::NameMap& Map, const XName& Name,
+                                u32 Ix, StrRef Kind) {
+  auto [It, Inserted] = Map.try_emplace(Name, Ix);
+  if (!Inserted)
+    return createStringError("duplicate {} '{{{}}}{}'",
+                             Kind, Name.URI, Name.Local);
+  return Error::success();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Documents
+
+Error XSDLoader::loadFile(StrRef Path, Option<StrRef> IncluderNS) {
+  if (!Loaded.insert(Path).second)
+    // Already loaded, or currently being loaded.
+    return Error::success();
+
+  auto Ref = Mgr.getXMLRef(Path);
+  if (!Ref)
+    return Ref.takeError();
+  XMLContainerRef Container = *Ref;
+  if (Sources) {
+    Sources->Paths.emplace_back(Path);
+    // Hashed before parsing, which may modify the buffer in place.
+    if (Container.isParsed() && !Container.isImmutable())
+      Sources->IsComplete = false;
+    else
+      exi::hashSchemaSource(Sources->Hash,
+                            Container.getBufferRef().getBuffer());
+  }
+  if (Container.getKind() != XMLKind::XsdXmlSchema)
+    LOG_WARN("'{}' is not an XSD file, loading as a schema", Path);
+
+  auto Doc = Container.parse();
+  if (!Doc)
+    return Doc.takeError();
+
+  const XMLNode* Root = Doc->first_node();
+  while (Root && Root->type() != NodeKind::node_element)
+    Root = Root->next_sibling();
+  if (!Root || GetXSDName(Root) != "schema")
+    return createStringError("'{}' is not a schema", Path);
+
+  DocContext C;
+  // The path is kept by `Loaded` for the rest of loading.
+  C.Path = Loaded.find(Path)->getKey();
+  C.TargetNS = getAttr(Root, "targetNamespace").value_or(""_str);
+  if (IncluderNS) {
+    if (C.TargetNS.empty() && !IncluderNS->empty()) {
+      // Chameleon include, components take the namespace of the includer.
+      C.TargetNS = *IncluderNS;
+      C.Chameleon = true;
+    } else if (C.TargetNS != *IncluderNS) {
+      return createStringError("'{}' included with a different namespace",
+                               Path);
+    }
+  }
+
+  C.QualifiedElements
+    = getAttr(Root, "elementFormDefault") == Option<StrRef>("qualified"_str);
+  C.QualifiedAttributes
+    = getAttr(Root, "attributeFormDefault") == Option<StrRef>("qualified"_str);
+  return this->loadSchema(Root, C);
+}
+
+Error XSDLoader::loadSchema(const XMLNode* Root, DocContext& C) {
+  if (!C.TargetNS.empty() && !exi::is_contained(M.WildcardURIs, C.TargetNS))
+    // Every namespace with components is added to the string tables.
+    M.WildcardURIs.push_back(C.TargetNS);
+
+  for (const XMLNode* N : XSDChildren(Root)) {
+    const StrRef Kind = GetXSDName(N);
+    if (Kind == "include") {
+      if (Error E = loadReference(N, C, /*IsInclude=*/true))
+        return E;
+    } else if (Kind == "import") {
+      if (Error E = loadReference(N, C, /*IsInclude=*/false))
+        return E;
+    } else if (Kind == "redefine") {
+      if (Error E = loadReference(N, C, /*IsInclude=*/true))
+        return E;
+      for (const XMLNode* Child : XSDChildren(N)) {
+        if (Error E = loadTopLevel(Child, C, /*Redefine=*/true))
+          return E;
+      }
+    } else if (Error E = loadTopLevel(N, C, /*Redefine=*/false))
+      return E;
+  }
+
+  return Error::success();
+}
+
+Error XSDLoader::loadReference(const XMLNode* N, const DocContext& C,
+                               bool IsInclude) {
+  Option<StrRef> Location = getAttr(N, "schemaLocation");
+  if (!Location) {
+    // Imports may only name the namespace, its components are undeclared.
+    LOG_INFO("Skipping {} without a location", N->name());
+    return Error::success();
+  }
+
+  if (IsRemote(*Location)) {
+    LOG_WARN("Skipping remote schema '{}', "
+             "its components will be undeclared", *Location);
+    return Error::success();
+  }
+
+  SmallStr<128> Path;
+  if (sys::path::is_absolute(*Location))
+    Path.assign(Location->begin(), Location->end());
+  else {
+    sys::path::append(Path, sys::path::parent_path(C.Path), *Location);
+    sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+  }
+
+  Option<StrRef> IncluderNS;
+  if (IsInclude)
+    IncluderNS = C.TargetNS;
+  return this->loadFile(Path.str(), IncluderNS);
+}
+
+Error XSDLoader::loadTopLevel(const XMLNode* N, const DocContext& C,
+                              bool Redefine) {
+  const StrRef Kind = GetXSDName(N);
+  if (Kind == "element") {
+    if (auto Ix = parseElement(N, C, /*Global=*/true); !Ix)
+      return Ix.takeError();
+  } else if (Kind == "attribute") {
+    if (auto Ix = parseAttribute(N, C, /*Global=*/true); !Ix)
+      return Ix.takeError();
+  } else if (Kind == "complexType" || Kind == "simpleType") {
+    auto Name = getName(N, C.TargetNS);
+    if (!Name)
+      return Name.takeError();
+    if (Redefine) {
+      // The redefined type derives from the original, which is hidden.
+      if (auto It = M.TypeNames.find(*Name); It != M.TypeNames.end())
+        M.TypeNames.erase(It);
+    }
+    auto Ix = (Kind == "complexType")
+      ? parseComplexType(N, C, *Name)
+      : parseSimpleType(N, C, *Name);
+    if (!Ix)
+      return Ix.takeError();
+    return registerGlobal(M.TypeNames, *Name, *Ix, "type");
+  } else if (Kind == "group") {
+    auto Name = getName(N, C.TargetNS);
+    if (!Name)
+      return Name.takeError();
+    GroupDef G;
+    G.Name = *Name;
+    for (const XMLNode* Child : XSDChildren(N)) {
+      auto P = parseModelGroup(Child, C);
+      if (!P)
+        return P.takeError();
+      G.Content = std::move(*P);
+    }
+    if (Redefine)
+      M.GroupNames.erase(G.Name);
+    const u32 Ix = M.Groups.size();
+    M.Groups.push_back(std::move(G));
+    return registerGlobal(M.GroupNames, *Name, Ix, "group");
+  } else if (Kind == "attributeGroup") {
+    auto Name = getName(N, C.TargetNS);
+    if (!Name)
+      return Name.takeError();
+    AttrGroupDef G;
+    G.Name = *Name;
+    if (Error E = parseAttrUses(N, C, G.Attrs, G.AttrGroups, G.AnyAttr))
+      return E;
+    if (Redefine)
+      M.AttrGroupNames.erase(G.Name);
+    const u32 Ix = M.AttrGroups.size();
+    M.AttrGroups.push_back(std::move(G));
+    return registerGlobal(M.AttrGroupNames, *Name, Ix, "attribute group");
+  } else if (Kind != "notation") {
+    LOG_WARN("Ignoring unknown schema component <{}>", N->name());
+  }
+
+  return Error::success();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Declarations
+
+Expected<u32> XSDLoader::parseElement(const XMLNode* N, const DocContext& C,
+                                      bool Global) {
+  ElementDecl E;
+  E.Global = Global;
+
+  bool Qualified = Global || C.QualifiedElements;
+  if (Option<StrRef> Form = getAttr(N, "form"))
+    Qualified = Global || (*Form == "qualified");
+  auto Name = getName(N, Qualified ? C.TargetNS : ""_str);
+  if (!Name)
+    return Name.takeError();
+  E.Name = *Name;
+
+  E.Nillable = getAttr(N, "nillable") == Option<StrRef>("true"_str);
+  E.Abstract = getAttr(N, "abstract") == Option<StrRef>("true"_str);
+
+  if (auto Group = getQNameAttr(N, C, "substitutionGroup"); !Group)
+    return Group.takeError();
+  else if (*Group)
+    E.SubstGroup = **Group;
+
+  if (auto Type = getQNameAttr(N, C, "type"); !Type)
+    return Type.takeError();
+  else if (*Type)
+    E.TypeName = **Type;
+
+  for (const XMLNode* Child : XSDChildren(N)) {
+    const StrRef Kind = GetXSDName(Child);
+    if (Kind != "complexType" && Kind != "simpleType")
+      // Identity constraints don't affect grammars.
+      continue;
+    Expected<u32> Type = (Kind == "complexType")
+      ? parseComplexType(Child, C, XName())
+      : parseSimpleType(Child, C, XName());
+    if (!Type)
+      return Type.takeError();
+    E.Type = *Type;
+  }
+
+  const u32 Ix = M.Elements.size();
+  M.Elements.push_back(std::move(E));
+  if (Global) {
+    if (Error Err = registerGlobal(M.ElementNames, *Name, Ix, "element"))
+      return std::move(Err);
+  }
+  return Ix;
+}
+
+Expected<u32> XSDLoader::parseAttribute(const XMLNode* N,
+                                        const DocContext& C, bool Global) {
+  AttrDecl A;
+  A.Global = Global;
+
+  bool Qualified = Global || C.QualifiedAttributes;
+  if (Option<StrRef> Form = getAttr(N, "form"))
+    Qualified = Global || (*Form == "qualified");
+  auto Name = getName(N, Qualified ? C.TargetNS : ""_str);
+  if (!Name)
+    return Name.takeError();
+  A.Name = *Name;
+
+  if (auto Type = getQNameAttr(N, C, "type"); !Type)
+    return Type.takeError();
+  else if (*Type)
+    A.TypeName = **Type;
+
+  for (const XMLNode* Child : XSDChildren(N)) {
+    if (GetXSDName(Child) != "simpleType")
+      continue;
+    auto Type = parseSimpleType(Child, C, XName());
+    if (!Type)
+      return Type.takeError();
+    A.Type = *Type;
+  }
+
+  const u32 Ix = M.Attrs.size();
+  M.Attrs.push_back(std::move(A));
+  if (Global) {
+    if (Error E = registerGlobal(M.AttrNames, *Name, Ix, "attribute"))
+      return std::move(E);
+  }
+  return Ix;
+}
+
+Error XSDLoader::parseAttrUses(const XMLNode* Parent, const DocContext& C,
+                               Vec<AttrUse>& Attrs, Vec<XName>& Groups,
+                               Option<Wildcard>& AnyAttr) {
+  for (const XMLNode* N : XSDChildren(Parent)) {
+    const StrRef Kind = GetXSDName(N);
+    if (Kind == "attribute") {
+      AttrUse Use;
+      const Option<StrRef> Usage = getAttr(N, "use");
+      Use.Required = (Usage == Option<StrRef>("required"_str));
+      Use.Prohibited = (Usage == Option<StrRef>("prohibited"_str));
+
+      auto Ref = getQNameAttr(N, C, "ref");
+      if (!Ref)
+        return Ref.takeError();
+      if (*Ref)
+        Use.Ref = **Ref;
+      else {
+        auto Ix = parseAttribute(N, C, /*Global=*/false);
+        if (!Ix)
+          return Ix.takeError();
+        Use.Attr = *Ix;
+      }
+      Attrs.push_back(std::move(Use));
+    } else if (Kind == "attributeGroup") {
+      auto Ref = getQNameAttr(N, C, "ref");
+      if (!Ref)
+        return Ref.takeError();
+      if (*Ref)
+        Groups.push_back(**Ref);
+    } else if (Kind == "anyAttribute") {
+      Wildcard WC = parseWildcard(N, C);
+      if (AnyAttr)
+        AnyAttr->merge(WC);
+      else
+        AnyAttr = std::move(WC);
+    }
+  }
+  return Error::success();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+
+Expected<u32> XSDLoader::parseComplexType(const XMLNode* N,
+                                          const DocContext& C, XName Name) {
+  TypeDef T;
+  T.Name = Name;
+  T.Complex = true;
+  T.Mixed = getAttr(N, "mixed") == Option<StrRef>("true"_str);
+
+  // The attributes are either on the type, or on its derivation.
+  const XMLNode* AttrParent = N;
+
+  for (const XMLNode* Child : XSDChildren(N)) {
+    const StrRef Kind = GetXSDName(Child);
+    if (Kind == "simpleContent" || Kind == "complexContent") {
+      const bool IsSimple = (Kind == "simpleContent");
+      if (!IsSimple && getAttr(Child, "mixed") == Option<StrRef>("true"_str))
+        T.Mixed = true;
+
+      const XMLNode* Deriv = nullptr;
+      for (const XMLNode* D : XSDChildren(Child))
+        Deriv = D;
+      if (!Deriv)
+        return createStringError("{}: <{}> requires a derivation",
+                                 C.Path, Child->name());
+
+      T.Extension = (GetXSDName(Deriv) == "extension");
+      auto Base = getQNameAttr(Deriv, C, "base");
+      if (!Base)
+        return Base.takeError();
+      if (*Base)
+        T.BaseName = **Base;
+      AttrParent = Deriv;
+
+      if (IsSimple) {
+        T.SimpleContent = true;
+        if (!T.Extension) {
+          // Restrictions of simple content define an anonymous simple type.
+          TypeDef Simple;
+          if (Error E = parseRestriction(Deriv, C, Simple))
+            return std::move(E);
+          T.SimpleType = M.Types.size();
+          M.Types.push_back(std::move(Simple));
+        }
+        continue;
+      }
+
+      for (const XMLNode* D : XSDChildren(Deriv)) {
+        const StrRef DKind = GetXSDName(D);
+        if (DKind == "sequence" || DKind == "choice"
+            || DKind == "all" || DKind == "group") {
+          auto P = parseModelGroup(D, C);
+          if (!P)
+            return P.takeError();
+          T.Content = std::move(*P);
+        }
+      }
+    } else if (Kind == "sequence" || Kind == "choice"
+               || Kind == "all" || Kind == "group") {
+      auto P = parseModelGroup(Child, C);
+      if (!P)
+        return P.takeError();
+      T.Content = std::move(*P);
+    }
+  }
+
+  if (T.BaseName.empty())
+    // Types without a derivation restrict `anyType`.
+    T.BaseName = {XSD_URI, "anyType"};
+
+  if (Error E = parseAttrUses(AttrParent, C, T.Attrs, T.AttrGroups,
+                              T.AnyAttr))
+    return std::move(E);
+
+  const u32 Ix = M.Types.size();
+  M.Types.push_back(std::move(T));
+  return Ix;
+}
+
+Expected<u32> XSDLoader::parseSimpleType(const XMLNode* N,
+                                         const DocContext& C, XName Name) {
+  TypeDef T;
+  T.Name = Name;
+
+  for (const XMLNode* Child : XSDChildren(N)) {
+    const StrRef Kind = GetXSDName(Child);
+    if (Kind == "restriction") {
+      if (Error E = parseRestriction(Child, C, T))
+        return std::move(E);
+    } else if (Kind == "list") {
+      T.Var = Variety::List;
+      T.BaseName = {XSD_URI, "anySimpleType"};
+      auto Item = getQNameAttr(Child, C, "itemType");
+      if (!Item)
+        return Item.takeError();
+      if (*Item)
+        T.ItemName = **Item;
+      for (const XMLNode* I : XSDChildren(Child)) {
+        auto Ix = parseSimpleType(I, C, XName());
+        if (!Ix)
+          return Ix.takeError();
+        T.Item = *Ix;
+      }
+    } else if (Kind == "union") {
+      T.Var = Variety::Union;
+      T.BaseName = {XSD_URI, "anySimpleType"};
+      if (Option<StrRef> Members = getAttr(Child, "memberTypes")) {
+        SmallVec<StrRef, 4> Names;
+        Members->split(Names, ' ', -1, /*KeepEmpty=*/false);
+        for (StrRef Raw : Names) {
+          auto Member = resolveQName(Child, C, Raw);
+          if (!Member)
+            return Member.takeError();
+          T.MemberNames.push_back(*Member);
+        }
+      }
+    }
+  }
+
+  const u32 Ix = M.Types.size();
+  M.Types.push_back(std::move(T));
+  return Ix;
+}
+
+Error XSDLoader::parseRestriction(const XMLNode* N, const DocContext& C,
+                                  TypeDef& T) {
+  auto Base = getQNameAttr(N, C, "base");
+  if (!Base)
+    return Base.takeError();
+  if (*Base)
+    T.BaseName = **Base;
+
+  for (const XMLNode* F : XSDChildren(N)) {
+    const StrRef Kind = GetXSDName(F);
+    if (Kind == "simpleType") {
+      auto Ix = parseSimpleType(F, C, XName());
+      if (!Ix)
+        return Ix.takeError();
+      T.Base = *Ix;
+      continue;
+    }
+
+    Option<StrRef> Value = getAttr(F, "value");
+    if (!Value)
+      continue;
+
+    if (Kind == "enumeration") {
+      T.Enums.push_back(*Value);
+    } else if (Kind == "pattern") {
+      T.Patterns.push_back(*Value);
+    } else if (Kind.starts_with("min") || Kind.starts_with("max")) {
+      // Only integer bounds are used, others are ignored.
+      i64 Bound = 0;
+      if (Value->trim().getAsInteger(10, Bound))
+        continue;
+      if (Kind == "minInclusive")
+        T.Min = Bound;
+      else if (Kind == "minExclusive" && Bound != max_v<i64>)
+        T.Min = Bound + 1;
+      else if (Kind == "maxInclusive")
+        T.Max = Bound;
+      else if (Kind == "maxExclusive" && Bound != min_v<i64>)
+        T.Max = Bound - 1;
+    }
+  }
+
+  return Error::success();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Particles
+
+Error XSDLoader::parseOccurs(const XMLNode* N, Particle& P) {
+  if (Option<StrRef> Min = getAttr(N, "minOccurs")) {
+    if (Min->trim().getAsInteger(10, P.Min))
+      return createStringError("invalid minOccurs '{}'", *Min);
+  }
+  if (Option<StrRef> Max = getAttr(N, "maxOccurs")) {
+    if (Max->trim() == "unbounded")
+      P.Max = kUnbounded;
+    else if (Max->trim().getAsInteger(10, P.Max))
+      return createStringError("invalid maxOccurs '{}'", *Max);
+  }
+  if (P.Max < P.Min)
+    return createStringError("<{}> has maxOccurs less than minOccurs",
+                             N->name());
+  return Error::success();
+}
+
+Wildcard XSDLoader::parseWildcard(const XMLNode* N, const DocContext& C) {
+  Wildcard WC;
+  const StrRef NS = getAttr(N, "namespace").value_or("##any"_str);
+  SmallVec<StrRef, 4> Names;
+  NS.split(Names, ' ', -1, /*KeepEmpty=*/false);
+
+  for (StrRef Name : Names) {
+    if (Name == "##any" || Name == "##other") {
+      // Negated wildcards are represented as SE(*) and AT(*).
+      WC.Any = true;
+      WC.URIs.clear();
+      break;
+    }
+
+    StrRef URI = Name;
+    if (Name == "##targetNamespace")
+      URI = C.TargetNS;
+    else if (Name == "##local")
+      URI = ""_str;
+    if (!exi::is_contained(WC.URIs, URI))
+      WC.URIs.push_back(URI);
+    if (!exi::is_contained(M.WildcardURIs, URI))
+      M.WildcardURIs.push_back(URI);
+  }
+
+  return WC;
+}
+
+Expected<Particle> XSDLoader::parseParticle(const XMLNode* N,
+                                            const DocContext& C) {
+  const StrRef Kind = GetXSDName(N);
+  if (Kind == "element") {
+    Particle P;
+    if (Error E = parseOccurs(N, P))
+      return std::move(E);
+    auto Ref = getQNameAttr(N, C, "ref");
+    if (!Ref)
+      return Ref.takeError();
+    if (*Ref) {
+      P.Kind = ParticleKind::ElementRef;
+      P.Ref = **Ref;
+      return P;
+    }
+    auto Ix = parseElement(N, C, /*Global=*/false);
+    if (!Ix)
+      return Ix.takeError();
+    P.Kind = ParticleKind::Element;
+    P.Element = *Ix;
+    return P;
+  } else if (Kind == "any") {
+    Particle P;
+    if (Error E = parseOccurs(N, P))
+      return std::move(E);
+    P.Kind = ParticleKind::Wildcard;
+    P.WC = parseWildcard(N, C);
+    return P;
+  }
+
+  return parseModelGroup(N, C);
+}
+
+Expected<Particle> XSDLoader::parseModelGroup(const XMLNode* N,
+                                              const DocContext& C) {
+  const StrRef Kind = GetXSDName(N);
+  Particle P;
+  if (Error E = parseOccurs(N, P))
+    return std::move(E);
+
+  if (Kind == "group") {
+    auto Ref = getQNameAttr(N, C, "ref");
+    if (!Ref)
+      return Ref.takeError();
+    if (!*Ref)
+      return createStringError("{}: local <group> requires a ref", C.Path);
+    P.Kind = ParticleKind::GroupRef;
+    P.Ref = **Ref;
+    return P;
+  }
+
+  if (Kind == "sequence")
+    P.Kind = ParticleKind::Sequence;
+  else if (Kind == "choice")
+    P.Kind = ParticleKind::Choice;
+  else if (Kind == "all")
+    P.Kind = ParticleKind::All;
+  else
+    return createStringError("{}: unexpected <{}> in a content model",
+                             C.Path, N->name());
+
+  for (const XMLNode* Child : XSDChildren(N)) {
+    auto Sub = parseParticle(Child, C);
+    if (!Sub)
+      return Sub.takeError();
+    P.Children.push_back(std::move(*Sub));
+  }
+  return P;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Resolution
+
+Error XSDLoader::resolveType(XName Name, u32& Out, StrRef Kind,
+                             bool Simple) {
+  if (Name.empty() || Out != kNone)
+    return Error::success();
+  if (Option<u32> Ix = Model::Find(M.TypeNames, Name)) {
+    Out = *Ix;
+    return Error::success();
+  }
+
+  // Types from remote schemas are undeclared, so fall back to the ur-types.
+  LOG_WARN("Undeclared type '{{{}}}{}' used by {}, using {}",
+           Name.URI, Name.Local, Kind,
+           Simple ? "anySimpleType" : "anyType");
+  const XName Ur {XSD_URI, Simple ? "anySimpleType"_str : "anyType"_str};
+  Out = *Model::Find(M.TypeNames, Ur);
+  return Error::success();
+}
+
+Error XSDLoader::resolve() {
+  for (TypeDef& T : M.Types) {
+    if (T.Builtin)
+      continue;
+    const bool Simple = !T.Complex || T.SimpleContent;
+    if (Error E = resolveType(T.BaseName, T.Base, "a derivation", Simple))
+      return E;
+    if (Error E = resolveType(T.ItemName, T.Item, "a list", true))
+      return E;
+  }
+
+  for (AttrDecl& A : M.Attrs) {
+    if (A.TypeName.empty() && A.Type == kNone)
+      A.TypeName = {XSD_URI, "anySimpleType"};
+    if (Error E = resolveType(A.TypeName, A.Type, "an attribute", true))
+      return E;
+  }
+
+  for (ElementDecl& E : M.Elements) {
+    if (Error Err = resolveType(E.TypeName, E.Type, "an element"))
+      return Err;
+  }
+
+  // Elements without a type use the type of their substitution group head.
+  const u32 AnyType = *Model::Find(M.TypeNames, {XSD_URI, "anyType"});
+  for (ElementDecl& E : M.Elements) {
+    const ElementDecl* Cur = &E;
+    for (usize Depth = 0; Cur->Type == kNone && Depth < M.Elements.size();
+         ++Depth) {
+      Option<u32> Head = Model::Find(M.ElementNames, Cur->SubstGroup);
+      if (!Head)
+        break;
+      Cur = &M.Elements[*Head];
+    }
+    E.Type = (Cur->Type != kNone) ? Cur->Type : AnyType;
+  }
+
+  return Error::success();
+}
+
+//===----------------------------------------------------------------===//
+// Interface
+//===----------------------------------------------------------------===//
+
+Expected<SchemaGrammarsRef> exi::loadXSDGrammars(XMLManager& Mgr,
+                                                 const Twine& Path,
+                                                 XSDSources* Sources) {
+  Model M;
+  AddBuiltinTypes(M);
+
+  XSDLoader Loader(Mgr, M, Sources);
+  SmallStr<128> Buf;
+  if (Error E = Loader.loadFile(Path.toStrRef(Buf), std::nullopt))
+    return std::move(E);
+  if (Error E = Loader.resolve())
+    return std::move(E);
+
+  return xsd::buildGrammars(M);
+}
+
+XSDSchemaResolver::XSDSchemaResolver(XMLManagerRef Mgr, StrRef BaseDir) :
+ Mgr(std::move(Mgr)), BaseDir(BaseDir) {
+}
+
+XSDSchemaResolver::~XSDSchemaResolver() = default;
+
+void XSDSchemaResolver::setCacheDir(StrRef Dir) {
+  std::lock_guard Guard(Lock);
+  CacheDir = Dir;
+}
+
+void XSDSchemaResolver::getCachePath(StrRef Path,
+                                     SmallVecImpl<char>& Out) const {
+  // Keyed by path, the cache itself checks the contents.
+  MD5::MD5Result Hash = MD5::hash(arrayRefFromStringRef(Path));
+  SmallStr<32> Name = Hash.digest();
+  Name += ".exig";
+  sys::path::append(Out, CacheDir, Name);
+}
+
+Expected<SchemaGrammarsRef> XSDSchemaResolver::resolve(StrRef SchemaID) {
+  std::lock_guard Guard(Lock);
+  if (auto It = Cache.find(SchemaID); It != Cache.end())
+    return It->second;
+
+  if (SchemaID.empty()) {
+    // An empty schemaId only uses the builtin types.
+    Model M;
+    AddBuiltinTypes(M);
+    auto Grammars = xsd::buildGrammars(M);
+    if (!Grammars)
+      return Grammars.takeError();
+    Cache[SchemaID] = *Grammars;
+    return std::move(*Grammars);
+  }
+
+  SmallStr<128> Path;
+  if (BaseDir.empty() || sys::path::is_absolute(SchemaID))
+    Path.assign(SchemaID.begin(), SchemaID.end());
+  else
+    sys::path::append(Path, BaseDir, SchemaID);
+
+  if (CacheDir.empty()) {
+    auto Grammars = exi::loadXSDGrammars(*Mgr, Path);
+    if (!Grammars)
+      return Grammars.takeError();
+    Cache[SchemaID] = *Grammars;
+    return std::move(*Grammars);
+  }
+
+  SmallStr<128> CachePath;
+  this->getCachePath(Path, CachePath);
+  if (SchemaGrammarsRef Mapped = exi::loadSchemaCache(CachePath)) {
+    LOG_INFO("Mapped grammars of '{}' from '{}'", SchemaID, CachePath);
+    Cache[SchemaID] = Mapped;
+    return Mapped;
+  }
+
+  XSDSources Sources;
+  auto Grammars = exi::loadXSDGrammars(*Mgr, Path, &Sources);
+  if (!Grammars)
+    return Grammars.takeError();
+  Cache[SchemaID] = *Grammars;
+
+  if (!Sources.IsComplete) {
+    LOG_INFO("Sources of '{}' were already parsed, not caching.", SchemaID);
+    return std::move(*Grammars);
+  }
+
+  // Failing to write the cache only costs the next process a rebuild.
+  const MD5::MD5Result Hash = Sources.Hash.final();
+  Error E = exi::writeToOutput(CachePath, [&] (raw_ostream& OS) {
+    exi::writeSchemaCache(OS, (*Grammars)->tables(), Sources.Paths, Hash);
+    return Error::success();
+  });
+  if (E) {
+    LOG_WARN("Unable to write grammar cache '{}'", CachePath);
+    consumeError(std::move(E));
+  }
+  return std::move(*Grammars);
+}
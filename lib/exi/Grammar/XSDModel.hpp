@@ -0,0 +1,240 @@
+//===- exi/Grammar/XSDModel.hpp -------------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the components of a loaded XSD schema, which are
+/// compiled into grammars by `SchemaBuilder.cpp`.
+///
+/// Only what affects the grammars is kept. Names are resolved to components
+/// once every document has been loaded, and strings are owned by the
+/// `XMLManager` or the model itself.
+///
+//===----------------------------------------------------------------===//
+
+#pragma once
+
+#include <core/Common/Option.hpp>
+#include <core/Common/SmallVec.hpp>
+#include <core/Common/StrRef.hpp>
+#include <core/Common/Vec.hpp>
+#include <core/Support/Error.hpp>
+#include <core/Support/Limits.hpp>
+#include <core/Support/StringSaver.hpp>
+#include <exi/Grammar/SchemaGrammars.hpp>
+#include <map>
+
+namespace exi::xsd {
+
+inline constexpr StrRef XML_URI("http://www.w3.org/XML/1998/namespace");
+inline constexpr StrRef XSI_URI("http://www.w3.org/2001/XMLSchema-instance");
+inline constexpr StrRef XSD_URI("http://www.w3.org/2001/XMLSchema");
+
+/// The `maxOccurs` of an unbounded particle.
+inline constexpr u64 kUnbounded = max_v<u64>;
+/// An unresolved component.
+inline constexpr u32 kNone = max_v<u32>;
+
+/// An expanded name.
+struct XName {
+  StrRef URI;
+  StrRef Local;
+public:
+  bool empty() const { return Local.empty(); }
+  bool operator==(const XName&) const = default;
+  /// Names are ordered by local-name, then URI, as they are for event codes.
+  bool operator<(const XName& RHS) const {
+    if (Local != RHS.Local)
+      return Local < RHS.Local;
+    return URI < RHS.URI;
+  }
+};
+
+/// The namespace constraint of a wildcard.
+struct Wildcard {
+  /// If any namespace is allowed, from `##any` or `##other`.
+  bool Any = false;
+  /// The allowed namespaces otherwise, where `##local` is empty.
+  SmallVec<StrRef, 2> URIs;
+public:
+  /// Combines the constraints of two wildcards, used for extensions.
+  void merge(const Wildcard& Other);
+};
+
+/// The primitive a simple type is derived from, which decides how its
+/// values are represented.
+enum class Primitive : u8 {
+  String,
+  Boolean,
+  Decimal,
+  Integer,
+  Float,
+  Binary,
+  HexBinary,
+  DateTime,
+  Time,
+  Date,
+  GYearMonth,
+  GYear,
+  GMonthDay,
+  GDay,
+  GMonth,
+  /// Represented as strings, but never as enumerations.
+  QName,
+};
+
+enum class ParticleKind : u8 {
+  Element,
+  ElementRef,
+  Wildcard,
+  Sequence,
+  Choice,
+  All,
+  GroupRef,
+};
+
+/// A particle of a content model.
+struct Particle {
+  ParticleKind Kind = ParticleKind::Sequence;
+  u64 Min = 1;
+  u64 Max = 1;
+  /// The local element declaration of `Element`.
+  u32 Element = kNone;
+  /// The name referenced by `ElementRef` and `GroupRef`.
+  XName Ref;
+  /// The constraint of `Wildcard`.
+  Wildcard WC;
+  /// The particles of a model group.
+  Vec<Particle> Children;
+};
+
+/// An attribute use, or a reference to a global attribute.
+struct AttrUse {
+  /// The local attribute declaration, or `kNone` for references.
+  u32 Attr = kNone;
+  /// The global attribute referenced.
+  XName Ref;
+  bool Required = false;
+  bool Prohibited = false;
+};
+
+enum class Variety : u8 { Atomic, List, Union };
+
+/// A simple or complex type definition.
+struct TypeDef {
+  /// The name, or empty for anonymous types.
+  XName Name;
+  bool Complex = false;
+  bool Builtin = false;
+  bool Mixed = false;
+  /// If the type extends its base, rather than restricting it.
+  bool Extension = false;
+  /// The base type.
+  XName BaseName;
+  u32 Base = kNone;
+
+  // Simple types, and complex types with simple content.
+
+  Variety Var = Variety::Atomic;
+  /// The item type of a list.
+  XName ItemName;
+  u32 Item = kNone;
+  /// The member types of a union.
+  Vec<XName> MemberNames;
+  /// The primitive of an atomic type, resolved from the base.
+  Option<Primitive> Prim;
+  Vec<StrRef> Enums;
+  Vec<StrRef> Patterns;
+  /// The inclusive bounds of an integer type.
+  Option<i64> Min, Max;
+
+  // Complex types.
+
+  /// If the content is simple, with `SimpleType` as its type.
+  bool SimpleContent = false;
+  u32 SimpleType = kNone;
+  /// The content model, if the content is not empty.
+  Option<Particle> Content;
+  Vec<AttrUse> Attrs;
+  Vec<XName> AttrGroups;
+  Option<Wildcard> AnyAttr;
+};
+
+struct ElementDecl {
+  XName Name;
+  /// The named type, or `Type` if it is anonymous.
+  XName TypeName;
+  u32 Type = kNone;
+  XName SubstGroup;
+  bool Global = false;
+  bool Nillable = false;
+  bool Abstract = false;
+};
+
+struct AttrDecl {
+  XName Name;
+  /// The named type, or `Type` if it is anonymous.
+  XName TypeName;
+  u32 Type = kNone;
+  bool Global = false;
+};
+
+struct GroupDef {
+  XName Name;
+  Particle Content;
+};
+
+struct AttrGroupDef {
+  XName Name;
+  Vec<AttrUse> Attrs;
+  Vec<XName> AttrGroups;
+  Option<Wildcard> AnyAttr;
+};
+
+/// The components of every document in a schema.
+struct Model {
+  using NameMap = std::map<XName, u32>;
+
+  OwningStringSaver Strings;
+  Vec<TypeDef> Types;
+  Vec<ElementDecl> Elements;
+  Vec<AttrDecl> Attrs;
+  Vec<GroupDef> Groups;
+  Vec<AttrGroupDef> AttrGroups;
+
+  NameMap TypeNames;
+  NameMap ElementNames;
+  NameMap AttrNames;
+  NameMap GroupNames;
+  NameMap AttrGroupNames;
+  /// The namespaces allowed by wildcards, which are added to the tables.
+  SmallVec<StrRef, 4> WildcardURIs;
+public:
+  /// Finds a global component by name.
+  static Option<u32> Find(const NameMap& Map, const XName& Name) {
+    auto It = Map.find(Name);
+    if (It == Map.end())
+      return std::nullopt;
+    return It->second;
+  }
+};
+
+/// Builds the grammars and string tables of a loaded schema.
+/// Defined in `SchemaBuilder.cpp`.
+Expected<SchemaGrammarsRef> buildGrammars(const Model& M);
+
+} // namespace exi::xsd
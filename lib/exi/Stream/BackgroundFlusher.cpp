@@ -0,0 +1,105 @@
+//===- exi/Stream/BackgroundFlusher.cpp -----------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements a ring of buffers which are written on another thread.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Stream/BackgroundFlusher.hpp>
+#include <core/Support/ErrorHandle.hpp>
+
+using namespace exi;
+
+#if EXI_USE_THREADS
+
+BackgroundFlusher::BackgroundFlusher(raw_ostream& OS, u32 NBuffers) :
+ OS(OS), Buffers(std::max(NBuffers, kMinBuffers)) {
+  // Everything the thread uses must exist before it starts.
+  Worker = std::thread([this] { this->run(); });
+}
+
+BackgroundFlusher::~BackgroundFlusher() {
+  {
+    std::scoped_lock L(Lock);
+    IsStopping = true;
+  }
+  Signal.notify_all();
+  Worker.join();
+}
+
+SmallVecImpl<char>& BackgroundFlusher::submit() {
+  std::unique_lock L(Lock);
+  ++Submitted;
+  Signal.notify_all();
+
+  // The next buffer is free once everything submitted before it was
+  // written. With two buffers, this waits for the previous one.
+  const u64 NBuffers = Buffers.size();
+  Signal.wait(L, [&] { return Submitted - Written < NBuffers; });
+  return Buffers[Submitted % NBuffers];
+}
+
+void BackgroundFlusher::drain() {
+  std::unique_lock L(Lock);
+  Signal.wait(L, [this] { return Written == Submitted; });
+}
+
+void BackgroundFlusher::run() {
+  std::unique_lock L(Lock);
+  while (true) {
+    Signal.wait(L, [this] { return Written < Submitted || IsStopping; });
+    if (Written == Submitted) {
+      exi_assert(IsStopping);
+      return;
+    }
+
+    // Submitted buffers are not touched by the writer until they are
+    // returned from `submit`, so they can be written without the lock.
+    buffer_t& Buf = Buffers[Written % Buffers.size()];
+    L.unlock();
+    OS.write(Buf.data(), Buf.size());
+    Buf.clear();
+    L.lock();
+
+    ++Written;
+    Signal.notify_all();
+  }
+}
+
+#else // !EXI_USE_THREADS
+
+BackgroundFlusher::BackgroundFlusher(raw_ostream& OS, u32 NBuffers) :
+ OS(OS), Buffers(std::max(NBuffers, kMinBuffers)) {
+}
+
+// Everything submitted has already been written.
+BackgroundFlusher::~BackgroundFlusher() = default;
+
+SmallVecImpl<char>& BackgroundFlusher::submit() {
+  buffer_t& Buf = this->current();
+  OS.write(Buf.data(), Buf.size());
+  Buf.clear();
+  ++Submitted;
+  ++Written;
+  return this->current();
+}
+
+void BackgroundFlusher::drain() {}
+
+#endif // EXI_USE_THREADS
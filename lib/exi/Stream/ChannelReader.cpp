@@ -0,0 +1,210 @@
+//===- exi/Stream/ChannelReader.cpp ---------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements the readers for streams split into channels.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Stream/ChannelReader.hpp>
+#include <core/Support/Logging.hpp>
+#include <Config/Config.inc>
+#if EXI_USE_ZLIB
+# include <zlib.h>
+#endif
+
+#define DEBUG_TYPE "ChannelReader"
+
+using namespace exi;
+
+#if EXI_USE_ZLIB
+
+Inflater::Inflater() : Z(new z_stream{}) {
+  // Negative window bits select raw DEFLATE, without a zlib header.
+  if (inflateInit2(Z, -MAX_WBITS) != Z_OK) {
+    delete Z;
+    Z = nullptr;
+  }
+}
+
+Inflater::~Inflater() {
+  if (Z) {
+    inflateEnd(Z);
+    delete Z;
+  }
+}
+
+ExiResult<usize> Inflater::inflate(ArrayRef<u8> Input,
+                                   SmallVecImpl<u8>& Out, usize Limit) {
+  if EXI_UNLIKELY(!Z) {
+    LOG_ERROR("Inflater could not be initialized.");
+    return Err(ErrorCode::kInvalidMemoryAlloc);
+  }
+
+  Out.clear();
+  inflateReset(Z);
+  Z->next_in = const_cast<u8*>(Input.data());
+  Z->avail_in = static_cast<uInt>(std::min<usize>(Input.size(), max_v<uInt>));
+
+  // Output stops one byte past the limit, which is enough to detect it.
+  Limit = std::min(Limit, max_v<usize> - 1);
+  while (true) {
+    // Streams are usually several times larger once inflated.
+    const usize Size = Out.size();
+    const usize Chunk = std::min<usize>(
+      std::max<usize>(Size, 16 * 1024), (Limit - Size) + 1);
+    Out.resize_for_overwrite(Size + Chunk);
+
+    Z->next_out = Out.data() + Size;
+    Z->avail_out = static_cast<uInt>(Chunk);
+    const int Ret = ::inflate(Z, Z_NO_FLUSH);
+    Out.truncate(Size + Chunk - Z->avail_out);
+
+    if EXI_UNLIKELY(Out.size() > Limit) {
+      LOG_ERROR("Inflated stream exceeds the limit of {} bytes.", Limit);
+      return Err(ErrorCode::kInvalidMemoryAlloc);
+    }
+
+    if (Ret == Z_STREAM_END)
+      break;
+    if (Ret == Z_OK && Z->avail_out == 0)
+      continue;
+    if (Ret == Z_OK || Ret == Z_BUF_ERROR) {
+      LOG_ERROR("Compressed stream was truncated.");
+      return Err(ErrorCode::kBufferEndReached);
+    }
+
+    LOG_ERROR("Invalid compressed stream: {}", Z->msg ? Z->msg : "?");
+    return Err(ErrorCode::kInvalidEXIInput);
+  }
+
+  LOG_EXTRA("Inflated {} bytes", Out.size());
+  return usize(Z->total_in);
+}
+
+#else // !EXI_USE_ZLIB
+
+Inflater::Inflater() {}
+Inflater::~Inflater() = default;
+
+ExiResult<usize> Inflater::inflate(ArrayRef<u8> Input,
+                                   SmallVecImpl<u8>& Out, usize Limit) {
+  LOG_ERROR("Compression requires zlib (EXI_USE_ZLIB).");
+  return Err(ErrorCode::kUnimplemented);
+}
+
+#endif // EXI_USE_ZLIB
+
+//===----------------------------------------------------------------===//
+// DeflateReader
+//===----------------------------------------------------------------===//
+
+ExiResult<ArrayRef<u8>> DeflateReader::beginStream() {
+  Result R = Z.inflate(Input, Buffer, StreamLimit);
+  if EXI_UNLIKELY(R.is_err())
+    return Err(R.error());
+  Input = Input.drop_front(*R);
+  return ArrayRef<u8>(Buffer);
+}
+
+#if EXI_USE_THREADS
+
+//===----------------------------------------------------------------===//
+// ParallelDeflateReader
+//===----------------------------------------------------------------===//
+
+ParallelDeflateReader::ParallelDeflateReader(ArrayRef<u8> Input,
+                                             u32 NSlots,
+                                             usize StreamLimit) :
+ ChannelReader(Input, StreamLimit), Slots(std::max(NSlots, kMinSlots)) {
+  // Everything the thread uses must exist before it starts.
+  Worker = std::thread([this] { this->run(); });
+}
+
+ParallelDeflateReader::~ParallelDeflateReader() {
+  {
+    std::scoped_lock L(Lock);
+    IsStopping = true;
+  }
+  Signal.notify_all();
+  Worker.join();
+}
+
+ExiResult<ArrayRef<u8>> ParallelDeflateReader::beginStream() {
+  std::unique_lock L(Lock);
+  if (Taken > 0) {
+    // The previous stream is no longer used, so its slot may be refilled.
+    Signal.notify_all();
+  }
+
+  Signal.wait(L, [this] { return Taken < Inflated || IsDone; });
+  if EXI_UNLIKELY(Taken == Inflated) {
+    LOG_ERROR("No streams remain in the input.");
+    return Err(ErrorCode::kBufferEndReached);
+  }
+
+  // Inflated slots are not touched by the thread until they are released.
+  Slot& S = Slots[Taken++ % Slots.size()];
+  if EXI_UNLIKELY(S.Error)
+    return Err(S.Error);
+  return ArrayRef<u8>(S.Data);
+}
+
+usize ParallelDeflateReader::getMemoryUsage() const {
+  std::scoped_lock L(Lock);
+  usize Total = 0;
+  for (const Slot& S : Slots)
+    Total += S.Capacity;
+  return Total;
+}
+
+void ParallelDeflateReader::run() {
+  Inflater Z;
+  std::unique_lock L(Lock);
+  while (!Input.empty()) {
+    // The slot of the current stream is kept until it is released.
+    const u64 NSlots = Slots.size();
+    Signal.wait(L, [&] {
+      const u64 Held = (Taken > 0) ? Taken - 1 : 0;
+      return Inflated - Held < NSlots || IsStopping;
+    });
+    if (IsStopping)
+      return;
+
+    Slot& S = Slots[Inflated % NSlots];
+    L.unlock();
+    S.Error = ExiError::OK;
+    Result R = Z.inflate(Input, S.Data, StreamLimit);
+    if (R.is_ok())
+      Input = Input.drop_front(*R);
+    else
+      S.Error = R.error();
+    L.lock();
+
+    S.Capacity = S.Data.capacity_in_bytes();
+    ++Inflated;
+    Signal.notify_all();
+    if (S.Error)
+      break;
+  }
+
+  IsDone = true;
+  Signal.notify_all();
+}
+
+#endif // EXI_USE_THREADS
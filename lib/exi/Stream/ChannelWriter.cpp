@@ -0,0 +1,229 @@
+//===- exi/Stream/ChannelWriter.cpp ---------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements the writers for streams split into channels.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Stream/ChannelWriter.hpp>
+#include <core/Support/ErrorHandle.hpp>
+#include <core/Support/Logging.hpp>
+#include <Config/Config.inc>
+#if EXI_USE_ZLIB
+# include <zlib.h>
+#endif
+
+#define DEBUG_TYPE "ChannelWriter"
+
+using namespace exi;
+
+#if EXI_USE_ZLIB
+
+Deflater::Deflater(int Level) : Z(new z_stream{}) {
+  // Negative window bits select raw DEFLATE, without a zlib header.
+  if (deflateInit2(Z, Level, Z_DEFLATED, -MAX_WBITS,
+                   /*memLevel=*/8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    delete Z;
+    Z = nullptr;
+  }
+}
+
+Deflater::~Deflater() {
+  if (Z) {
+    deflateEnd(Z);
+    delete Z;
+  }
+}
+
+ExiError Deflater::deflate(ArrayRef<StrRef> Parts, SmallVecImpl<char>& Out) {
+  if EXI_UNLIKELY(!Z) {
+    LOG_ERROR("Deflater could not be initialized.");
+    return ErrorCode::kInvalidMemoryAlloc;
+  }
+
+  deflateReset(Z);
+  const usize NParts = Parts.size();
+  for (usize Ix = 0; Ix <= NParts; ++Ix) {
+    // An extra empty part finishes the stream.
+    const StrRef Part = (Ix < NParts) ? Parts[Ix] : StrRef();
+    const int Flush = (Ix < NParts) ? Z_NO_FLUSH : Z_FINISH;
+    Z->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(Part.data()));
+    Z->avail_in = static_cast<uInt>(Part.size());
+
+    while (true) {
+      const usize Size = Out.size();
+      const usize Chunk = std::max<usize>(deflateBound(Z, Z->avail_in),
+                                          4 * 1024);
+      Out.resize_for_overwrite(Size + Chunk);
+
+      Z->next_out = reinterpret_cast<Bytef*>(Out.data() + Size);
+      Z->avail_out = static_cast<uInt>(Chunk);
+      const int Ret = ::deflate(Z, Flush);
+      Out.truncate(Size + Chunk - Z->avail_out);
+
+      if (Ret == Z_STREAM_ERROR) {
+        LOG_ERROR("Could not compress stream: {}", Z->msg ? Z->msg : "?");
+        return ErrorCode::kUnexpectedError;
+      }
+      if (Flush == Z_FINISH ? (Ret == Z_STREAM_END) : (Z->avail_out != 0))
+        break;
+    }
+  }
+
+  return ExiError::OK;
+}
+
+#else // !EXI_USE_ZLIB
+
+Deflater::Deflater(int Level) {}
+Deflater::~Deflater() = default;
+
+ExiError Deflater::deflate(ArrayRef<StrRef> Parts, SmallVecImpl<char>& Out) {
+  LOG_ERROR("Compression requires zlib (EXI_USE_ZLIB).");
+  return ErrorCode::kUnimplemented;
+}
+
+#endif // EXI_USE_ZLIB
+
+//===----------------------------------------------------------------===//
+// DeflateWriter
+//===----------------------------------------------------------------===//
+
+ExiError DeflateWriter::writeStream(ArrayRef<StrRef> Parts) {
+  Buffer.clear();
+  exi_try(Z.deflate(Parts, Buffer));
+  OS.write(Buffer.data(), Buffer.size());
+  LOG_EXTRA("Deflated {} bytes", Buffer.size());
+  return ExiError::OK;
+}
+
+#if EXI_USE_THREADS
+
+//===----------------------------------------------------------------===//
+// ParallelDeflateWriter
+//===----------------------------------------------------------------===//
+
+ParallelDeflateWriter::ParallelDeflateWriter(raw_ostream& OS,
+                                             unsigned Threads, int Level) :
+ ChannelWriter(OS) {
+  if (Threads == 0)
+    Threads = std::max(std::thread::hardware_concurrency(), 1u);
+  // Two jobs per worker, so workers stay busy while results are written.
+  Jobs.resize(usize(Threads) * 2);
+
+  // Everything the workers use must exist before they start.
+  Workers.reserve(Threads);
+  for (unsigned Ix = 0; Ix < Threads; ++Ix)
+    Workers.emplace_back([this, Level] { this->run(Level); });
+}
+
+ParallelDeflateWriter::~ParallelDeflateWriter() {
+  // Errors are reported by `flush`.
+  (void) this->flush();
+  {
+    std::scoped_lock L(Lock);
+    IsStopping = true;
+  }
+  Signal.notify_all();
+  for (std::thread& Worker : Workers)
+    Worker.join();
+}
+
+void ParallelDeflateWriter::writeRaw(StrRef Data) {
+  (void) this->flush();
+  OS << Data;
+}
+
+ExiError ParallelDeflateWriter::writeStream(ArrayRef<StrRef> Parts) {
+  std::unique_lock L(Lock);
+  this->writeFinished(L, /*Wait=*/true);
+  if EXI_UNLIKELY(Error)
+    return Error;
+
+  // Queued jobs are not touched by workers until `Submitted` is bumped.
+  Job& J = Jobs[Submitted % Jobs.size()];
+  L.unlock();
+  J.Input.clear();
+  for (StrRef Part : Parts)
+    J.Input.append(Part.begin(), Part.end());
+  J.Output.clear();
+  J.Error = ExiError::OK;
+  J.IsDone = false;
+  L.lock();
+
+  ++Submitted;
+  Signal.notify_all();
+  return ExiError::OK;
+}
+
+ExiError ParallelDeflateWriter::flush() {
+  std::unique_lock L(Lock);
+  while (Written < Submitted) {
+    Signal.wait(L, [this] { return Jobs[Written % Jobs.size()].IsDone; });
+    this->writeFinished(L, /*Wait=*/false);
+  }
+  return Error;
+}
+
+void ParallelDeflateWriter::writeFinished(std::unique_lock<std::mutex>& L,
+                                          bool Wait) {
+  const u64 NJobs = Jobs.size();
+  if (Wait && Submitted - Written == NJobs) {
+    // Every job is in flight, wait for the oldest.
+    Signal.wait(L, [&] { return Jobs[Written % NJobs].IsDone; });
+  }
+
+  while (Written < Submitted) {
+    Job& J = Jobs[Written % NJobs];
+    if (!J.IsDone)
+      break;
+    // Finished jobs are only touched by the writer.
+    L.unlock();
+    if (!J.Error && !Error)
+      OS.write(J.Output.data(), J.Output.size());
+    L.lock();
+
+    if (J.Error && !Error)
+      Error = J.Error;
+    ++Written;
+  }
+}
+
+void ParallelDeflateWriter::run(int Level) {
+  Deflater Z(Level);
+  std::unique_lock L(Lock);
+  while (true) {
+    Signal.wait(L, [this] { return Started < Submitted || IsStopping; });
+    if (Started == Submitted) {
+      exi_assert(IsStopping);
+      return;
+    }
+
+    Job& J = Jobs[Started++ % Jobs.size()];
+    L.unlock();
+    const StrRef Input(J.Input.data(), J.Input.size());
+    J.Error = Z.deflate({Input}, J.Output);
+    L.lock();
+
+    J.IsDone = true;
+    Signal.notify_all();
+  }
+}
+
+#endif // EXI_USE_THREADS
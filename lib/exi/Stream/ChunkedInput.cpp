@@ -0,0 +1,67 @@
+//===- exi/Stream/ChunkedInput.cpp ----------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements input which is provided to readers in chunks.
+///
+//===----------------------------------------------------------------===//
+
+#include <exi/Stream/ChunkedInput.hpp>
+#include <core/Support/ErrorHandle.hpp>
+#include <algorithm>
+
+using namespace exi;
+
+void ChunkedInput::feed(ArrayRef<u8> Chunk) {
+  exi_invariant(!IsFinished, "fed data after the end of input");
+  // Drop consumed data, this keeps the buffer from growing with the
+  // size of the document. Marked data is kept for replays.
+  const u64 Keep = Mark.value_or(position());
+  const usize Drop = usize(std::min<u64>(Start, Keep - Offset));
+  if (Drop != 0) {
+    Buffer.erase(Buffer.begin(), Buffer.begin() + Drop);
+    Start -= Drop;
+    Offset += Drop;
+  }
+  Buffer.append(Chunk.begin(), Chunk.end());
+}
+
+bool ChunkedInput::request(usize Bytes) {
+  while (size() < Bytes && !IsFinished) {
+    const usize OldSize = Buffer.size();
+    this->underflow();
+    if (Buffer.size() == OldSize && !IsFinished)
+      return false;
+  }
+  return true;
+}
+
+ArrayRef<u8> ChunkedInput::refill(usize Consumed) {
+  exi_invariant(Consumed <= size(), "consumed past the end of the window");
+  Start += Consumed;
+  // Try to provide a full word, as reads may span the whole store.
+  (void) this->request(sizeof(u64));
+  return this->data();
+}
+
+void ChunkedInput::growLookahead(u64 Pos) {
+  exi_invariant(Pos >= Offset && Pos <= Offset + Buffer.size());
+  const u64 Buffered = Offset + Buffer.size() - Pos;
+  // Doubling keeps the number of replays logarithmic in the event size.
+  Lookahead = usize(std::max<u64>(Lookahead, Buffered) * 2);
+}
@@ -27,7 +27,7 @@
 
 #include <exi/Stream/Writer.hpp>
 #include <exi/Stream/OrderedWriter.hpp>
-// #include <exi/Stream/ChannelWriter.hpp>
+#include <exi/Stream/ChannelWriter.hpp>
 
 namespace exi {
 
@@ -46,6 +46,16 @@ void ByteWriter::anchor() {}
 void ChannelReader::anchor() {}
 void BlockReader::anchor() {}
 void DeflateReader::anchor() {}
+#if EXI_USE_THREADS
+void ParallelDeflateReader::anchor() {}
+#endif
+#endif
+
+void ChannelWriter::anchor() {}
+void BlockWriter::anchor() {}
+void DeflateWriter::anchor() {}
+#if EXI_USE_THREADS
+void ParallelDeflateWriter::anchor() {}
 #endif
 
 } // namespace exi
@@ -0,0 +1,421 @@
+//===- tools/SchemaCompiler.cpp -------------------------------------===//
+//
+// Copyright (C) 2025 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+///
+/// \file
+/// This file implements `exi-schemac`, which compiles an XSD schema to C++.
+///
+///   exi-schemac <schema.xsd> -name <Name> [-id <schemaId>] [-o <dir>]
+///
+/// Two files are written, `<Name>.hpp` declaring `exi::schemas::<Name>`, and
+/// `<Name>.cpp` defining it. The tables of the grammars become constants,
+/// and the productions of each state are decoded by a case of a switch, so
+/// no grammars are built at runtime. See `exi_add_schema` for building them.
+///
+//===----------------------------------------------------------------===//
+
+#include <core/Common/FunctionRef.hpp>
+#include <core/Common/SmallStr.hpp>
+#include <core/Common/StrRef.hpp>
+#include <core/Common/Twine.hpp>
+#include <core/Support/ErrorHandle.hpp>
+#include <core/Support/Path.hpp>
+#include <core/Support/raw_ostream.hpp>
+#include <exi/Basic/EventCodes.hpp>
+#include <exi/Basic/XMLManager.hpp>
+#include <exi/Grammar/SchemaGrammars.hpp>
+#include <exi/Grammar/SchemaLoader.hpp>
+
+using namespace exi;
+
+namespace {
+
+struct CompilerArgs {
+  StrRef Schema;
+  StrRef Name;
+  StrRef ID;
+  StrRef OutDir = ".";
+};
+
+/// Writes the C++ for the tables `T`.
+class SchemaEmitter {
+  const SchemaTables& T;
+  const CompilerArgs& Args;
+public:
+  SchemaEmitter(const SchemaTables& T, const CompilerArgs& Args) :
+   T(T), Args(Args) {}
+
+  void emitHeader(raw_ostream& OS) const;
+  void emitSource(raw_ostream& OS) const;
+
+private:
+  void emitBanner(raw_ostream& OS, StrRef Ext) const;
+  void emitTables(raw_ostream& OS) const;
+  void emitStates(raw_ostream& OS) const;
+  void emitState(raw_ostream& OS, u32 Ix) const;
+  void emitProd(raw_ostream& OS, const SchemaProd& P) const;
+  /// Writes the expression deciding if a state has a second part.
+  void emitHasSecond(raw_ostream& OS, const SchemaState& S) const;
+
+  /// Writes `Items` as a constant array, if there are any.
+  template <typename T, typename F>
+  static void EmitArray(raw_ostream& OS, StrRef Type, StrRef Name,
+                        ArrayRef<T> Items, F&& EmitItem) {
+    if (Items.empty())
+      return;
+    OS << "constexpr " << Type << ' ' << Name << "[] {\n";
+    for (const T& Item : Items) {
+      OS << "  ";
+      EmitItem(Item);
+      OS << ",\n";
+    }
+    OS << "};\n\n";
+  }
+
+  static void EmitRef(raw_ostream& OS, StrRef Field, StrRef Name, usize N) {
+    OS << "  ." << Field << " = ";
+    if (N == 0)
+      OS << "{},\n";
+    else
+      OS << Name << ",\n";
+  }
+};
+
+} // namespace `anonymous`
+
+static StrRef GetKindName(SchemaValueKind Kind) {
+  static constexpr StrRef Names[] {
+    "String", "Boolean", "Decimal", "Float", "Integer", "Unsigned",
+    "NBitUnsigned", "Binary", "HexBinary", "DateTime", "Time", "Date",
+    "GYearMonth", "GYear", "GMonthDay", "GDay", "GMonth", "List",
+    "Enumeration"
+  };
+  static_assert(std::size(Names) == usize(SchemaValueKind::Last) + 1);
+  return Names[usize(Kind)];
+}
+
+static StrRef GetTermName(EventTerm Term) {
+  using enum EventTerm;
+  switch (Term) {
+  case SEQName: return "SEQName";
+  case SEUri:   return "SEUri";
+  case SE:      return "SE";
+  case ATQName: return "ATQName";
+  case ATUri:   return "ATUri";
+  case AT:      return "AT";
+  case EE:      return "EE";
+  case CH:      return "CH";
+  default:
+    exi_unreachable("invalid declared production");
+  }
+}
+
+static raw_ostream& operator<<(raw_ostream& OS, SchemaStr S) {
+  return OS << '{' << S.Offset << ", " << S.Size << '}';
+}
+
+static raw_ostream& operator<<(raw_ostream& OS, SchemaQName Name) {
+  return OS << '{' << Name.URI << ", " << Name.LocalID << '}';
+}
+
+void SchemaEmitter::emitBanner(raw_ostream& OS, StrRef Ext) const {
+  OS << "//===- " << Args.Name << '.' << Ext
+     << " - Generated by exi-schemac ---===//\n"
+     << "//\n"
+     << "// Compiled from \"" << Args.Schema << "\", do not edit.\n"
+     << "//\n"
+     << "//===----------------------------------------------------------===//\n"
+     << '\n';
+}
+
+void SchemaEmitter::emitHeader(raw_ostream& OS) const {
+  this->emitBanner(OS, "hpp");
+  OS << "#pragma once\n\n"
+     << "#include <exi/Grammar/DecoderSchema.hpp>\n\n"
+     << "namespace exi::schemas {\n\n"
+     << "/// The compiled schema for \"";
+  OS.write_escaped(Args.ID);
+  OS << "\".\n"
+     << "extern const decode::CompiledSchemaInfo " << Args.Name << ";\n\n"
+     << "} // namespace exi::schemas\n";
+}
+
+void SchemaEmitter::emitSource(raw_ostream& OS) const {
+  this->emitBanner(OS, "cpp");
+  OS << "#include \"" << Args.Name << ".hpp\"\n"
+     << "#include <CompiledSupport.hpp>\n\n"
+     << "using namespace exi;\n"
+     << "using namespace exi::decode;\n\n"
+     << "namespace {\n\n";
+  this->emitTables(OS);
+  this->emitStates(OS);
+  OS << "} // namespace `anonymous`\n\n"
+     << "const CompiledSchemaInfo exi::schemas::" << Args.Name << " {\n"
+     << "  .SchemaID = \"";
+  OS.write_escaped(Args.ID);
+  OS << "\",\n"
+     << "  .Tables = &kTables,\n"
+     << "  .New = &NewCompiledSchema<" << Args.Name << "Schema>,\n"
+     << "};\n";
+}
+
+void SchemaEmitter::emitTables(raw_ostream& OS) const {
+  // Split into lines, so the source stays readable.
+  constexpr usize kLineSize = 64;
+  OS << "constexpr char kChars[] =";
+  if (T.Chars.empty())
+    OS << " \"\"";
+  for (usize Ix = 0, E = T.Chars.size(); Ix < E; Ix += kLineSize) {
+    const StrRef Line(T.Chars.data() + Ix, std::min(kLineSize, E - Ix));
+    OS << "\n  \"";
+    OS.write_escaped(Line);
+    OS << '"';
+  }
+  OS << ";\n\n";
+
+  EmitArray(OS, "SchemaURI", "kURIs", T.URIs,
+    [&OS] (const SchemaURI& U) {
+      OS << '{' << U.Name << ", " << U.FirstName << ", " << U.NNames << '}';
+    });
+  EmitArray(OS, "SchemaStr", "kLocalNames", T.LocalNames,
+    [&OS] (SchemaStr S) { OS << S; });
+  EmitArray(OS, "SchemaDatatype", "kDatatypes", T.Datatypes,
+    [&OS] (const SchemaDatatype& DT) {
+      OS << "{SchemaValueKind::" << GetKindName(DT.Kind) << ", "
+         << unsigned(DT.Bits) << ", 0, " << DT.First << ", " << DT.Count
+         << ", " << DT.Min << '}';
+    });
+  EmitArray(OS, "SchemaStr", "kEnumValues", T.EnumValues,
+    [&OS] (SchemaStr S) { OS << S; });
+  EmitArray(OS, "u32", "kCharSets", T.CharSets,
+    [&OS] (u32 C) { OS << C; });
+  EmitArray(OS, "SchemaType", "kTypes", T.Types,
+    [&OS] (const SchemaType& Ty) {
+      OS << '{' << Ty.Name << ", " << Ty.Grammar << ", " << Ty.EmptyGrammar
+         << ", " << Ty.FirstAttrUse << ", " << Ty.NAttrUses << ", "
+         << unsigned(Ty.Flags) << '}';
+    });
+  EmitArray(OS, "SchemaQName", "kAttrUses", T.AttrUses,
+    [&OS] (SchemaQName Name) { OS << Name; });
+  EmitArray(OS, "SchemaElement", "kElements", T.Elements,
+    [&OS] (const SchemaElement& E) {
+      OS << '{' << E.Name << ", " << E.Type << ", "
+         << unsigned(E.Flags) << '}';
+    });
+  EmitArray(OS, "SchemaAttribute", "kAttributes", T.Attributes,
+    [&OS] (const SchemaAttribute& A) {
+      OS << '{' << A.Name << ", " << A.Datatype << '}';
+    });
+  EmitArray(OS, "SchemaState", "kStates", T.States,
+    [&OS] (const SchemaState& S) {
+      OS << '{' << S.FirstProd << ", " << S.NProds << ", " << S.Content2
+         << ", " << S.Type << ", " << unsigned(S.Flags) << '}';
+    });
+  EmitArray(OS, "SchemaProd", "kProds", T.Prods,
+    [&OS] (const SchemaProd& P) {
+      OS << "{u8(EventTerm::" << GetTermName(P.getTerm()) << "), {}, "
+         << P.Name << ", " << P.Target << ", " << P.Next << '}';
+    });
+  auto EmitIndex = [&OS] (u32 Ix) { OS << Ix; };
+  EmitArray(OS, "u32", "kDocElements", T.DocElements, EmitIndex);
+  EmitArray(OS, "u32", "kFragmentElements", T.FragmentElements, EmitIndex);
+  EmitArray(OS, "u32", "kGlobalElements", T.GlobalElements, EmitIndex);
+  EmitArray(OS, "u32", "kNamedTypes", T.NamedTypes, EmitIndex);
+
+  OS << "constexpr SchemaTables kTables {\n"
+     << "  .Chars = ArrayRef<char>(kChars, sizeof(kChars) - 1),\n";
+  EmitRef(OS, "URIs", "kURIs", T.URIs.size());
+  EmitRef(OS, "LocalNames", "kLocalNames", T.LocalNames.size());
+  EmitRef(OS, "Datatypes", "kDatatypes", T.Datatypes.size());
+  EmitRef(OS, "EnumValues", "kEnumValues", T.EnumValues.size());
+  EmitRef(OS, "CharSets", "kCharSets", T.CharSets.size());
+  EmitRef(OS, "Types", "kTypes", T.Types.size());
+  EmitRef(OS, "AttrUses", "kAttrUses", T.AttrUses.size());
+  EmitRef(OS, "Elements", "kElements", T.Elements.size());
+  EmitRef(OS, "Attributes", "kAttributes", T.Attributes.size());
+  EmitRef(OS, "States", "kStates", T.States.size());
+  EmitRef(OS, "Prods", "kProds", T.Prods.size());
+  EmitRef(OS, "DocElements", "kDocElements", T.DocElements.size());
+  EmitRef(OS, "FragmentElements", "kFragmentElements",
+          T.FragmentElements.size());
+  EmitRef(OS, "GlobalElements", "kGlobalElements", T.GlobalElements.size());
+  EmitRef(OS, "NamedTypes", "kNamedTypes", T.NamedTypes.size());
+  OS << "  .AnyType = " << T.AnyType << ",\n"
+     << "};\n\n";
+}
+
+void SchemaEmitter::emitStates(raw_ostream& OS) const {
+  const StrRef Name = Args.Name;
+  OS << "template <class StrmT>\n"
+     << "class " << Name << "Schema final\n"
+     << "    : public InformedSchema<" << Name << "Schema<StrmT>, StrmT,\n"
+     << "                            CompiledSchema> {\n"
+     << "  using BaseT = InformedSchema<" << Name << "Schema<StrmT>, StrmT,\n"
+     << "                               CompiledSchema>;\n"
+     << "  friend BaseT;\n"
+     << "  using typename BaseT::Frame;\n"
+     << "public:\n"
+     << "  explicit " << Name << "Schema(const ExiOptions& Opts) :\n"
+     << "   BaseT(Opts, kTables) {}\n\n"
+     << "private:\n"
+     << "  EventUID decodeState(ExiDecoder* D, Frame& F) {\n"
+     << "    switch (F.State) {\n";
+  for (u32 Ix = 0, E = T.States.size(); Ix != E; ++Ix)
+    this->emitState(OS, Ix);
+  OS << "    default:\n"
+     << "      exi_unreachable(\"invalid state\");\n"
+     << "    }\n"
+     << "  }\n"
+     << "};\n\n";
+}
+
+void SchemaEmitter::emitState(raw_ostream& OS, u32 Ix) const {
+  const SchemaState& S = T.States[Ix];
+  OS << "    case " << Ix << ": {\n"
+     << "      const auto Code = BaseT::template ReadStateCode<"
+     << S.NProds << ">(D, ";
+  this->emitHasSecond(OS, S);
+  OS << ");\n"
+     << "      if EXI_UNLIKELY(Code.is_err())\n"
+     << "        return BaseT::Fail(D, Code.error());\n"
+     << "      switch (*Code) {\n";
+  for (u32 Code = 0; Code != S.NProds; ++Code) {
+    OS << "      case " << Code << ": ";
+    this->emitProd(OS, T.Prods[S.FirstProd + Code]);
+  }
+  OS << "      default: return this->decodeUndeclared(D, F, kStates["
+     << Ix << "]);\n"
+     << "      }\n"
+     << "    }\n";
+}
+
+void SchemaEmitter::emitProd(raw_ostream& OS, const SchemaProd& P) const {
+  using enum EventTerm;
+  const EventTerm Term = P.getTerm();
+  switch (Term) {
+  case EE:
+    OS << "return this->endElement();\n";
+    return;
+  case SEQName:
+    OS << "return this->declaredSE(D, F, " << P.Next << ", "
+       << P.Target << ");\n";
+    return;
+  case SEUri:
+  case SE:
+    OS << "return this->declaredWildcardSE(D, F, " << P.Next
+       << ", EventTerm::" << GetTermName(Term) << ", " << P.Name.URI
+       << ");\n";
+    return;
+  case ATQName:
+    OS << "return this->declaredAT(D, F, " << P.Next
+       << ", SmallQName::NewQName(" << P.Name.URI << ", " << P.Name.LocalID
+       << "), " << P.Target << ");\n";
+    return;
+  case ATUri:
+  case AT:
+    OS << "return this->declaredWildcardAT(D, F, " << P.Next
+       << ", EventTerm::" << GetTermName(Term) << ", " << P.Name.URI
+       << ");\n";
+    return;
+  case CH:
+    OS << "return this->declaredCH(D, F, " << P.Next << ", "
+       << P.Target << ");\n";
+    return;
+  default:
+    exi_unreachable("invalid declared production");
+  }
+}
+
+void SchemaEmitter::emitHasSecond(raw_ostream& OS,
+                                  const SchemaState& S) const {
+  // Mirrors `InformedSchema::hasStrictSecond`, with what is known here.
+  if (!S.isStart() || S.isEmpty())
+    OS << "!this->Strict";
+  else if (T.Types[S.Type].hasSubTypes())
+    OS << "true";
+  else
+    OS << "!this->Strict || F.Nillable";
+}
+
+//===----------------------------------------------------------------===//
+// Driver
+//===----------------------------------------------------------------===//
+
+static int PrintUsage() {
+  errs() << "usage: exi-schemac <schema.xsd> -name <Name> "
+            "[-id <schemaId>] [-o <dir>]\n";
+  return 1;
+}
+
+static bool WriteFile(const CompilerArgs& Args, StrRef Ext,
+                      function_ref<void(raw_ostream&)> Emit) {
+  SmallStr<128> Path(Args.OutDir);
+  sys::path::append(Path, Twine(Args.Name) + "." + Ext);
+
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC);
+  if (EC) {
+    errs() << "exi-schemac: could not open '" << Path << "': "
+           << EC.message() << '\n';
+    return false;
+  }
+  Emit(OS);
+  return true;
+}
+
+int main(int Argc, char* Argv[]) {
+  CompilerArgs Args;
+  for (int Ix = 1; Ix < Argc; ++Ix) {
+    const StrRef Arg = Argv[Ix];
+    if (!Arg.starts_with("-")) {
+      Args.Schema = Arg;
+      continue;
+    }
+    if (Ix + 1 == Argc)
+      return PrintUsage();
+    const StrRef Value = Argv[++Ix];
+    if (Arg == "-name")
+      Args.Name = Value;
+    else if (Arg == "-id")
+      Args.ID = Value;
+    else if (Arg == "-o")
+      Args.OutDir = Value;
+    else
+      return PrintUsage();
+  }
+
+  if (Args.Schema.empty() || Args.Name.empty())
+    return PrintUsage();
+  if (Args.ID.empty())
+    Args.ID = Args.Schema;
+
+  XMLManagerRef Mgr = make_refcounted<XMLManager>();
+  auto GrammarsOrErr = loadXSDGrammars(*Mgr, Args.Schema);
+  if (Error Err = GrammarsOrErr.takeError()) {
+    logAllUnhandledErrors(std::move(Err), errs(), "exi-schemac: ");
+    return 1;
+  }
+
+  const SchemaEmitter Emitter((*GrammarsOrErr)->tables(), Args);
+  if (!WriteFile(Args, "hpp",
+      [&] (raw_ostream& OS) { Emitter.emitHeader(OS); }))
+    return 1;
+  if (!WriteFile(Args, "cpp",
+      [&] (raw_ostream& OS) { Emitter.emitSource(OS); }))
+    return 1;
+  return 0;
+}
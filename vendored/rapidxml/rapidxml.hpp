@@ -1134,7 +1134,7 @@ public:
   //! \param attribute Attribute to append.
   void append_attribute(AttrType* attribute) {
     assert(attribute && !attribute->parent());
-    if EXI_UNLIKELY(attribute && !attribute->parent())
+    if EXI_UNLIKELY(!attribute || attribute->parent())
       return;
     if (first_attribute()) {
       attribute->m_prev_attribute = m_last_attribute;